@@ -17,6 +17,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "../eme/implementation.h"
 #include "../macros.h"
@@ -57,7 +58,8 @@ class SHAKA_EXPORT Decoder {
    * Attempts to decode the given frame into some number of full frames.
    *
    * This is given frames in DTS order, starting with a keyframe.  The caller
-   * will call ResetDecoder if there is a seek before passing new frames.  This
+   * will call ResetDecoder if the new frames don't follow the previous ones
+   * (e.g. after a seek outside the decoded frames).  This
    * may be given frames from different sub-streams, but changes will always
    * start with a keyframe.
    *
@@ -75,6 +77,27 @@ class SHAKA_EXPORT Decoder {
       std::vector<std::shared_ptr<DecodedFrame>>* frames,
       std::string* extra_info) = 0;
 
+  /**
+   * Attempts to decode a run of consecutive frames.  This calls Decode for each
+   * frame in order, stopping at the first frame that doesn't return Success.
+   * This isn't virtual so adding it didn't change the layout of this class.
+   *
+   * @param input The frames to decode, in DTS order.
+   * @param eme The EME implementation used to decrypt frames, or nullptr if not
+   *   using EME.
+   * @param frames [OUT] Where to insert newly created frames.
+   * @param decoded_count [OUT] Will contain the number of input frames that
+   *   were decoded.  If this doesn't return Success, the frame at this index
+   *   is the one that failed.
+   * @param extra_info [OUT] If this returns FatalError, this argument will be
+   *   set to a description of what error happened.
+   * @return The status of the decode operation.
+   */
+  MediaStatus DecodeFrames(
+      const std::vector<std::shared_ptr<EncodedFrame>>& input,
+      const eme::Implementation* eme,
+      std::vector<std::shared_ptr<DecodedFrame>>* frames,
+      size_t* decoded_count, std::string* extra_info);
 
   /**
    * Creates a new instance of the built-in decoder.  This returns nullptr if
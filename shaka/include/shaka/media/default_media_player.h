@@ -16,6 +16,7 @@
 #define SHAKA_EMBEDDED_MEDIA_DEFAULT_MEDIA_PLAYER_H_
 
 #include <memory>
+#include <vector>
 
 #include "../macros.h"
 #include "decoder.h"
@@ -25,6 +26,149 @@
 namespace shaka {
 namespace media {
 
+/**
+ * Defines how a player's media work is prioritized against other players.  All
+ * the DefaultMediaPlayer instances share the same media threads; when there is
+ * more work than threads, the work for a higher-priority player is done first.
+ *
+ * @ingroup media
+ */
+enum class MediaPriority : uint8_t {
+  /** Only use spare time, e.g. for thumbnails or a hidden player. */
+  Background,
+
+  /** The default priority. */
+  Normal,
+
+  /** Run before other players, e.g. for the main view in a multi-view app. */
+  Foreground,
+};
+
+/**
+ * Defines the scheduling priority of a thread compared to other threads in the
+ * system.
+ *
+ * @ingroup media
+ */
+enum class ThreadPriority : uint8_t {
+  Low,
+  Normal,
+  /** Raising the priority may need extra permissions on some platforms. */
+  High,
+};
+
+/**
+ * Defines how media threads are used.  This is shared by every player in the
+ * process.
+ *
+ * @ingroup media
+ */
+struct SHAKA_EXPORT MediaThreadingPolicy {
+  SHAKA_DECLARE_STRUCT_SPECIAL_METHODS(MediaThreadingPolicy);
+
+  /**
+   * The total number of threads the codecs can use, shared between all the
+   * video decoders in the process; or 0 to use the number of CPU cores.  Each
+   * decoder uses an equal share of this, but at least one, when it is created.
+   * Defaults to 0.
+   */
+  size_t codec_thread_budget;
+
+  /**
+   * Whether a codec can decode multiple frames in parallel.  This gives the
+   * best throughput, but adds a frame of latency for each thread.  Defaults to
+   * true.
+   */
+  bool frame_threading;
+
+  /**
+   * Whether a codec can decode the slices of one frame in parallel.  Defaults
+   * to true.
+   */
+  bool slice_threading;
+
+  /**
+   * The number of frames of each encrypted stream to decrypt in parallel ahead
+   * of the decoder; or 0 to decrypt each frame as it is decoded.  This is per
+   * stream, so a player with encrypted audio and video uses twice this many
+   * jobs; the jobs run on the shared media threads.  This takes decryption out
+   * of the decode loop, but uses memory for a clear copy of the next couple
+   * seconds of frames, up to the DecodeBufferLimits byte limit.  Defaults to
+   * 0.
+   */
+  size_t decrypt_jobs_per_stream;
+
+  /**
+   * The CPU cores that the media and audio threads can run on, or empty to
+   * use any core.  This is only supported on Linux.  Defaults to empty.
+   */
+  std::vector<size_t> cpu_affinity;
+
+  /**
+   * The priority of the threads that decode and demux media.  Defaults to
+   * Normal.
+   */
+  ThreadPriority media_thread_priority;
+
+  /** The priority of the threads that play audio.  Defaults to Normal. */
+  ThreadPriority audio_thread_priority;
+};
+
+/**
+ * Defines how far ahead of the playhead frames are decoded.  The player keeps
+ * at least |min_seconds| decoded; if decoding is slow compared to the frame
+ * rate, or if playback runs out of decoded frames, it decodes further ahead, up
+ * to |max_seconds|.  The decoded frames never use more than |max_bytes|.
+ *
+ * @ingroup media
+ */
+struct SHAKA_EXPORT DecodeBufferLimits {
+  SHAKA_DECLARE_STRUCT_SPECIAL_METHODS(DecodeBufferLimits);
+  DecodeBufferLimits(double min_seconds, double max_seconds, size_t max_bytes);
+
+  /**
+   * The minimum number of seconds of content to decode ahead.  Defaults to 1.
+   */
+  double min_seconds;
+
+  /**
+   * The maximum number of seconds of content to decode ahead.  Defaults to 4.
+   */
+  double max_seconds;
+
+  /**
+   * The maximum number of bytes of decoded frames to keep for each stream, or
+   * 0 for no limit.  This can reduce the buffer below |min_seconds|.  Defaults
+   * to 256 MB.
+   */
+  size_t max_bytes;
+};
+
+/**
+ * Describes the current statistics about decoding a stream.  These can be used
+ * to tune the DecodeBufferLimits for a device.
+ *
+ * @ingroup media
+ */
+struct SHAKA_EXPORT DecodingStats {
+  SHAKA_DECLARE_STRUCT_SPECIAL_METHODS(DecodingStats);
+
+  /**
+   * The number of times playback ran out of decoded frames while there were
+   * frames available to decode.
+   */
+  uint32_t underruns;
+
+  /** The number of seconds of content currently being decoded ahead. */
+  double decode_ahead;
+
+  /** The average number of seconds it takes to decode one frame. */
+  double frame_decode_time;
+
+  /** The average size of a decoded frame, in bytes. */
+  size_t frame_size;
+};
+
 /**
  * Defines the default MediaPlayer implementation.  This handles the current
  * time tracking and defines interfaces to swap out decryption (through EME
@@ -59,6 +203,49 @@ class SHAKA_EXPORT DefaultMediaPlayer final : public ProxyMediaPlayer {
    */
   void SetDecoders(Decoder* video_decoder, Decoder* audio_decoder);
 
+  /**
+   * Sets the priority of this player's decoding compared to other players.
+   * This can be changed at any time.  The default is MediaPriority::Normal.
+   */
+  void SetPriority(MediaPriority priority);
+
+  /**
+   * Sets how far ahead of the playhead frames are decoded, for both audio and
+   * video.  This can be changed at any time.  The default is 1 to 4 seconds
+   * and 256 MB.
+   */
+  void SetDecodeBufferLimits(const DecodeBufferLimits& limits);
+
+  /** @return The current statistics about decoding the video stream. */
+  DecodingStats VideoDecodingStats() const;
+
+  /** @return The current statistics about decoding the audio stream. */
+  DecodingStats AudioDecodingStats() const;
+
+  /**
+   * Sets the number of threads that are shared by every player to decode and
+   * demux media.  This must be called before the first player is created.  By
+   * default, this uses one thread per CPU core, up to 8.
+   *
+   * @param thread_count The number of threads to use; must be at least 1.
+   * @return True on success, false if a player was already created.
+   */
+  static bool SetMediaThreadCount(size_t thread_count);
+
+  /**
+   * Sets how the media threads are used.  The affinity and priorities only
+   * apply to threads created after this, so this should be called before
+   * creating any players or renderers.  The codec settings apply to decoders
+   * as they are configured, and decrypting applies to players created after
+   * this.  By default, this uses frame and slice threading, the codec threads
+   * are split between the decoders, frames are decrypted as they are decoded,
+   * and the threads use the normal priority on any core.
+   */
+  static void SetMediaThreadingPolicy(const MediaThreadingPolicy& policy);
+
+  /** @return The current policy for how the media threads are used. */
+  static MediaThreadingPolicy GetMediaThreadingPolicy();
+
   /**
    * Gets the iOS CALayer that is used to draw native src= content.  The
    * returned value has been retained and should use CFBridgingRelease to
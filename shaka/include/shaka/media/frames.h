@@ -15,6 +15,7 @@
 #ifndef SHAKA_EMBEDDED_MEDIA_FRAMES_H_
 #define SHAKA_EMBEDDED_MEDIA_FRAMES_H_
 
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -88,6 +89,14 @@ enum class PixelFormat : uint8_t {
    */
   VideoToolbox,
 
+  /**
+   * A frame held in GPU memory by a hardware accelerator other than
+   * VideoToolbox (e.g. VAAPI or VDPAU).  @a data[0] will contain the
+   * accelerator's surface handle.  The pixels can't be read directly; use
+   * DecodedFrame::MapHardwareFrame to access them.
+   */
+  HardwareFrame,
+
   /**
    * Apps can define custom pixel formats and use any values above 128.  This
    * library doesn't care about the PixelFormat outside of the Decoder and the
@@ -327,6 +336,27 @@ class SHAKA_EXPORT DecodedFrame : public BaseFrame {
 
   size_t EstimateSize() const override;
 
+  /**
+   * For HardwareFrame frames, gives the CPU access to the pixels of the
+   * frame.  If the driver supports it, this maps the surface in place so the
+   * pixels are only copied once, by the caller; otherwise this downloads the
+   * frame to system memory.  The surface stays mapped while the returned frame
+   * is alive.
+   *
+   * @return A software frame holding the same picture, or nullptr on error or
+   *   if this isn't a hardware frame.
+   */
+  std::shared_ptr<DecodedFrame> MapHardwareFrame() const;
+
+ protected:
+  /**
+   * Sets the function that MapHardwareFrame calls.  Subclasses that hold
+   * HardwareFrame frames use this instead of overriding a virtual method, so
+   * this class keeps the same layout for existing subclasses.
+   */
+  void SetHardwareFrameMapper(
+      std::function<std::shared_ptr<DecodedFrame>()> mapper);
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
@@ -15,6 +15,9 @@
 #ifndef SHAKA_EMBEDDED_MEDIA_STREAMS_H_
 #define SHAKA_EMBEDDED_MEDIA_STREAMS_H_
 
+#include <stdint.h>
+
+#include <limits>
 #include <memory>
 #include <type_traits>
 #include <vector>
@@ -32,6 +35,8 @@ enum class FrameLocation : uint8_t {
   Near,
   /** Locates the frame that starts after the given time. */
   After,
+  /** Locates the first keyframe that starts after the given time. */
+  KeyFrameAfter,
 };
 
 
@@ -68,6 +73,20 @@ static_assert(std::is_pod<BufferedRange>::value, "BufferedRange should be POD");
  */
 class SHAKA_EXPORT StreamBase {
  public:
+  /**
+   * Defines an interface for listening for stream events.  These callbacks
+   * are invoked on the thread that changed the stream after the stream's lock
+   * has been released, so they can call back into the stream.  They should
+   * return quickly and must not add or remove clients.
+   */
+  class SHAKA_EXPORT Client {
+   public:
+    SHAKA_DECLARE_INTERFACE_METHODS(Client);
+
+    /** Called after a new frame has been added to the stream. */
+    virtual void OnFrameAdded() = 0;
+  };
+
   /**
    * The gap, in seconds, between frames that will still be considered part of
    * the same buffered range.  If two frames are further than this apart, then
@@ -106,7 +125,42 @@ class SHAKA_EXPORT StreamBase {
   std::vector<BufferedRange> GetBufferedRanges() const;
 
   /**
-   * Estimates the size of the stream by adding up all the stored frames.
+   * Returns the same ranges as GetBufferedRanges, but as a shared immutable
+   * object.  This is cached and only rebuilt when the ranges change, so this
+   * doesn't allocate or scan the stream when called repeatedly.
+   *
+   * @param version [OUT] Optional, will contain the version of the returned
+   *   ranges; see GetBufferedRangesVersion.
+   * @return The time ranges of the buffered regions.
+   */
+  std::shared_ptr<const std::vector<BufferedRange>> GetBufferedRangesSnapshot(
+      uint64_t* version = nullptr) const;
+
+  /**
+   * Returns a number that changes every time the buffered ranges change.
+   * Versions are unique across all streams, so this can be used to cheaply
+   * check if a previous result is still valid.  This never returns 0.
+   *
+   * @return The current version of the buffered ranges.
+   */
+  uint64_t GetBufferedRangesVersion() const;
+
+  /**
+   * Adds a new client listener.  The given object will be called when events
+   * happen.  Calling this with an already-registered client will have no
+   * effect.  This is const since it doesn't change the frames in the stream.
+   */
+  void AddClient(Client* client) const;
+
+  /**
+   * Removes a client listener.  Once this returns, the given client will no
+   * longer be called.
+   */
+  void RemoveClient(Client* client) const;
+
+  /**
+   * Estimates the size of the stream by adding up all the stored frames.  This
+   * is tracked as frames are added and removed, so this is cheap to call.
    * @return The estimated size of the stream, in bytes.
    */
   size_t EstimateSize() const;
@@ -126,6 +180,19 @@ class SHAKA_EXPORT StreamBase {
    */
   void Remove(double start, double end);
 
+  /**
+   * Removes whole GOPs from the start of the stream, oldest first, until the
+   * estimated size is at most |max_size|.  This only removes GOPs that end
+   * before |time|, so the GOP containing |time| and everything after it are
+   * kept even if the stream is still too large.
+   *
+   * @param time The time (in seconds) to keep frames after, usually the
+   *   current playhead time.
+   * @param max_size The size (in bytes) to shrink the stream to.
+   * @return The estimated size of the stream afterwards, in bytes.
+   */
+  size_t EvictBefore(double time, size_t max_size);
+
   /** Removes all frames in the stream. */
   void Clear();
 
@@ -150,6 +217,31 @@ class SHAKA_EXPORT StreamBase {
   std::shared_ptr<BaseFrame> GetFrameInternal(double time,
                                               FrameLocation kind) const;
 
+  /** Holds the position of a Stream::Cursor. */
+  struct CursorPosition {
+    /** The time of the last frame read; the next frame read is after this. */
+    double time;
+    // Where the last frame read was stored.  This is only a hint; if the stream
+    // changed so this no longer points to that frame, we search by |time|.
+    size_t range;
+    size_t index;
+  };
+
+  /**
+   * Gets the frames that follow the given position, in order, until
+   * |max_count| frames have been read or the next frame starts after
+   * |end_time|.  This will continue into later buffered ranges.  This updates
+   * |position| to point to the last frame read.
+   *
+   * @param position [IN/OUT] The position to read from.
+   * @param max_count The maximum number of frames to read.
+   * @param end_time The inclusive time to stop reading at.
+   * @param frames [OUT] Where to append the frames.
+   */
+  void GetFramesAfterInternal(
+      CursorPosition* position, size_t max_count, double end_time,
+      std::vector<std::shared_ptr<BaseFrame>>* frames) const;
+
   /**
    * Adds a new frame to the stream.  This won't check for compatible streams
    * or for keyframe requirements; it is assumed the caller will only append
@@ -163,9 +255,6 @@ class SHAKA_EXPORT StreamBase {
   void AddFrameInternal(std::shared_ptr<BaseFrame> frame);
 
  private:
-  void DebugPrintLocked(bool all_frames) const;
-  void AssertRangesSorted() const;
-
   class Impl;
   std::unique_ptr<Impl> impl_;
 };
@@ -195,6 +284,55 @@ class SHAKA_EXPORT Stream : public StreamBase {
     auto ret = GetFrameInternal(time, kind);
     return std::shared_ptr<T>(ret, static_cast<T*>(ret.get()));
   }
+
+  /**
+   * Reads consecutive frames from a stream.  This remembers where the last
+   * frame read is stored, so reading the frames that follow doesn't need to
+   * search the stream.  The stream can still be changed while this is used;
+   * if the last frame moved, this will search for it by time.
+   *
+   * This type isn't thread-safe, but the stream can be changed on other
+   * threads while this is used.
+   */
+  class Cursor {
+   public:
+    Cursor() : Cursor(nullptr) {}
+    explicit Cursor(const Stream* stream)
+        : stream_(stream),
+          position_{-std::numeric_limits<double>::infinity(), 0, 0} {}
+
+    /** @return The time of the last frame read. */
+    double time() const {
+      return position_.time;
+    }
+
+    /** Moves the cursor so the next frame read is the first after |time|. */
+    void Seek(double time) {
+      position_.time = time;
+    }
+
+    /**
+     * Reads up to |max_count| frames after the cursor, stopping before any
+     * frame that starts after |end_time|.  This moves the cursor past the
+     * frames read.
+     *
+     * @return The number of frames read.
+     */
+    size_t Read(size_t max_count, double end_time,
+                std::vector<std::shared_ptr<T>>* frames) {
+      temp_.clear();
+      stream_->GetFramesAfterInternal(&position_, max_count, end_time, &temp_);
+      for (auto& frame : temp_)
+        frames->emplace_back(frame, static_cast<T*>(frame.get()));
+      return temp_.size();
+    }
+
+   private:
+    const Stream* stream_;
+    CursorPosition position_;
+    // Reused between reads to avoid allocating.
+    std::vector<std::shared_ptr<BaseFrame>> temp_;
+  };
 };
 
 
@@ -15,30 +15,203 @@
 #include "src/core/network_thread.h"
 
 #include <curl/curl.h>
-#include <sys/select.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef OS_LINUX
+#  include <sys/epoll.h>
+#else
+#  include <poll.h>
+#endif
 
 #include <algorithm>
 #include <cerrno>
+#include <limits>
 
 #include "src/js/xml_http_request.h"
+#include "src/util/clock.h"
 #include "src/util/utils.h"
 
 namespace shaka {
 
 namespace {
 
-constexpr const long kSmallDelayMs = 100;  // NOLINT
-constexpr const long kMaxDelayMs = 500;    // NOLINT
+constexpr const uint64_t kNoTimer = std::numeric_limits<uint64_t>::max();
 
 }  // namespace
 
+/**
+ * Waits for events on the sockets CURL is using.  This also holds a pipe that
+ * other threads can use to wake up a pending Wait() call.
+ *
+ * On Linux this uses epoll, so the cost of waiting depends on the number of
+ * ready sockets, not the number being watched.  Other platforms use poll().
+ */
+class NetworkThread::SocketPoller {
+ public:
+  struct Event {
+    int fd;
+    int curl_events;  // A combination of CURL_CSELECT_* flags.
+  };
+
+  SocketPoller() {
+    int fds[2];
+    PCHECK(pipe(fds) == 0) << "Unable to create wake pipe";
+    for (int fd : fds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    wake_read_fd_ = fds[0];
+    wake_write_fd_ = fds[1];
+
+#ifdef OS_LINUX
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    PCHECK(epoll_fd_ >= 0) << "Unable to create epoll instance";
+#endif
+    Watch(wake_read_fd_, CURL_POLL_IN);
+  }
+
+  ~SocketPoller() {
+#ifdef OS_LINUX
+    close(epoll_fd_);
+#endif
+    close(wake_read_fd_);
+    close(wake_write_fd_);
+  }
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(SocketPoller);
+
+  /**
+   * Starts watching the given socket, or changes the events to watch for.
+   * @param what A CURL_POLL_* value for which events to watch.
+   */
+  void Watch(int fd, int what) {
+#ifdef OS_LINUX
+    epoll_event event = {};
+    event.data.fd = fd;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+      event.events |= EPOLLIN;
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+      event.events |= EPOLLOUT;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) != 0) {
+      if (errno != ENOENT ||
+          epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        PLOG(ERROR) << "Error watching network socket";
+      }
+    }
+#else
+    short events = 0;  // NOLINT
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+      events |= POLLIN;
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+      events |= POLLOUT;
+    std::unique_lock<Mutex> lock(mutex_);
+    fds_[fd] = events;
+#endif
+  }
+
+  /** Stops watching the given socket. */
+  void Remove(int fd) {
+#ifdef OS_LINUX
+    // CURL may have already closed the socket, which removes it from epoll.
+    epoll_event event = {};
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, &event);
+#else
+    std::unique_lock<Mutex> lock(mutex_);
+    fds_.erase(fd);
+#endif
+  }
+
+  /** Wakes up a pending call to Wait(). */
+  void Wake() {
+    const char byte = 0;
+    // If the pipe is full, the waiting thread will wake up anyway.
+    if (write(wake_write_fd_, &byte, 1) < 0 && errno != EAGAIN)
+      PLOG(ERROR) << "Error waking network thread";
+  }
+
+  /**
+   * Waits until some sockets are ready or until we are woken up.
+   * @param timeout_ms The maximum time to wait, or -1 to wait forever.
+   * @param events [OUT] Will be filled with the sockets that are ready.
+   */
+  void Wait(int timeout_ms, std::vector<Event>* events) {
+#ifdef OS_LINUX
+    constexpr const int kMaxEvents = 64;
+    epoll_event ready[kMaxEvents];
+    const int count = epoll_wait(epoll_fd_, ready, kMaxEvents, timeout_ms);
+    if (count < 0 && errno != EINTR)
+      PLOG(ERROR) << "Error waiting for network handles";
+    for (int i = 0; i < count; i++) {
+      int flags = 0;
+      if (ready[i].events & EPOLLIN)
+        flags |= CURL_CSELECT_IN;
+      if (ready[i].events & EPOLLOUT)
+        flags |= CURL_CSELECT_OUT;
+      if (ready[i].events & (EPOLLERR | EPOLLHUP))
+        flags |= CURL_CSELECT_ERR;
+      AddEvent(ready[i].data.fd, flags, events);
+    }
+#else
+    std::vector<pollfd> fds;
+    {
+      std::unique_lock<Mutex> lock(mutex_);
+      fds.reserve(fds_.size());
+      for (auto& pair : fds_)
+        fds.push_back({pair.first, pair.second, 0});
+    }
+    if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR)
+      PLOG(ERROR) << "Error waiting for network handles";
+    for (auto& fd : fds) {
+      // If another thread aborts the request, it will close the file
+      // descriptor, giving POLLNVAL here, so just ignore it.
+      int flags = 0;
+      if (fd.revents & POLLIN)
+        flags |= CURL_CSELECT_IN;
+      if (fd.revents & POLLOUT)
+        flags |= CURL_CSELECT_OUT;
+      if (fd.revents & (POLLERR | POLLHUP))
+        flags |= CURL_CSELECT_ERR;
+      if (flags)
+        AddEvent(fd.fd, flags, events);
+    }
+#endif
+  }
+
+ private:
+  void AddEvent(int fd, int flags, std::vector<Event>* events) {
+    if (fd == wake_read_fd_) {
+      char buffer[64];
+      while (read(wake_read_fd_, buffer, sizeof(buffer)) > 0) {
+      }
+    } else {
+      events->push_back({fd, flags});
+    }
+  }
+
+#ifdef OS_LINUX
+  int epoll_fd_;
+#else
+  Mutex mutex_{"SocketPoller"};
+  std::unordered_map<int, short> fds_;  // NOLINT
+#endif
+  int wake_read_fd_;
+  int wake_write_fd_;
+};
+
 NetworkThread::NetworkThread()
     : mutex_("NetworkThread"),
-      cond_("Networking new request"),
+      poller_(new SocketPoller),
       multi_handle_(curl_multi_init()),
+      timer_deadline_ms_(kNoTimer),
       shutdown_(false),
       thread_("Networking", std::bind(&NetworkThread::ThreadMain, this)) {
   CHECK(multi_handle_);
+
+  std::unique_lock<Mutex> lock(mutex_);
+  curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETFUNCTION, &OnSocketUpdate);
+  curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, &OnTimerUpdate);
+  curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this);
 }
 
 NetworkThread::~NetworkThread() {
@@ -49,102 +222,125 @@ NetworkThread::~NetworkThread() {
 
 void NetworkThread::Stop() {
   shutdown_.store(true, std::memory_order_release);
-  cond_.SignalAllIfNotSet();
+  poller_->Wake();
   thread_.join();
 }
 
 bool NetworkThread::ContainsRequest(RefPtr<js::XMLHttpRequest> request) const {
   std::unique_lock<Mutex> lock(mutex_);
-  return util::contains(requests_, request);
+  return requests_.count(request.get()) > 0;
 }
 
 void NetworkThread::AddRequest(RefPtr<js::XMLHttpRequest> request) {
   std::unique_lock<Mutex> lock(mutex_);
   DCHECK(!shutdown_.load(std::memory_order_acquire));
-  DCHECK(!util::contains(requests_, request));
-  requests_.push_back(request);
+  DCHECK_EQ(requests_.count(request.get()), 0u);
+  // This is cleared when the request is reset, so set it for each request.
+  curl_easy_setopt(request->curl_, CURLOPT_PRIVATE, request.get());
+  requests_.emplace(request.get(), request);
+  // This will set a timer so CURL can start the request.
   CHECK_EQ(curl_multi_add_handle(multi_handle_, request->curl_), CURLM_OK);
-  cond_.SignalAllIfNotSet();
+  poller_->Wake();
 }
 
 void NetworkThread::AbortRequest(RefPtr<js::XMLHttpRequest> request) {
   std::unique_lock<Mutex> lock(mutex_);
-  for (auto it = requests_.begin(); it != requests_.end(); it++) {
-    if (*it == request) {
-      CHECK_EQ(curl_multi_remove_handle(multi_handle_, request->curl_),
-               CURLM_OK);
-      requests_.erase(it);
-      break;
-    }
+  auto it = requests_.find(request.get());
+  if (it != requests_.end()) {
+    CHECK_EQ(curl_multi_remove_handle(multi_handle_, request->curl_),
+             CURLM_OK);
+    requests_.erase(it);
+    poller_->Wake();
   }
 }
 
 void NetworkThread::ThreadMain() {
+  std::vector<SocketPoller::Event> events;
   while (!shutdown_.load(std::memory_order_acquire)) {
-    fd_set fdread;
-    fd_set fdwrite;
-    fd_set fdexc;
-    long timeout_ms = -1;  // NOLINT
-    int maxfd = -1;
-    bool no_handles;
+    int timeout_ms = -1;
     {
       std::unique_lock<Mutex> lock(mutex_);
       // This will still return success if there are no requests or if there is
-      // an error in one request.
-      int handles = 0;
-      CHECK_EQ(curl_multi_perform(multi_handle_, &handles), CURLM_OK);
-      no_handles = handles == 0;
-
-      // Get any pending messages and complete any requests that are done.
-      int msg_count;
-      while (CURLMsg* msg = curl_multi_info_read(multi_handle_, &msg_count)) {
-        if (msg->msg == CURLMSG_DONE) {
-          for (auto it = requests_.begin(); it != requests_.end(); it++) {
-            if ((*it)->curl_ == msg->easy_handle) {
-              (*it)->OnRequestComplete(msg->data.result);  // NOLINT
-              requests_.erase(it);
-              break;
-            }
-          }
-          CHECK_EQ(curl_multi_remove_handle(multi_handle_, msg->easy_handle),
-                   CURLM_OK);
-        } else {
-          // There are currently no other message types.
-          LOG(DFATAL) << "Unknown message type: " << msg->msg;
-        }
+      // an error in one request.  The socket may have been removed while we
+      // were waiting, in which case CURL ignores it.
+      int running;
+      for (auto& event : events) {
+        curl_multi_socket_action(multi_handle_, event.fd, event.curl_events,
+                                 &running);
       }
-
-      if (curl_multi_fdset(multi_handle_, &fdread, &fdwrite, &fdexc, &maxfd) !=
-          CURLM_OK) {
-        LOG(ERROR) << "Error getting file descriptors from CURL";
+      if (timer_deadline_ms_ <= util::Clock::Instance.GetMonotonicTime()) {
+        timer_deadline_ms_ = kNoTimer;
+        curl_multi_socket_action(multi_handle_, CURL_SOCKET_TIMEOUT, 0,
+                                 &running);
       }
-      if (curl_multi_timeout(multi_handle_, &timeout_ms) != CURLM_OK) {
-        LOG(ERROR) << "Error getting timeout from CURL";
+
+      HandleMessages();
+
+      if (timer_deadline_ms_ != kNoTimer) {
+        const uint64_t now = util::Clock::Instance.GetMonotonicTime();
+        timeout_ms = timer_deadline_ms_ <= now
+                         ? 0
+                         : static_cast<int>(std::min<uint64_t>(
+                               timer_deadline_ms_ - now,
+                               std::numeric_limits<int>::max()));
       }
-      if (timeout_ms < 0)
-        // If we failed to query CURL, use a default.
-        timeout_ms = kSmallDelayMs;
-      else
-        timeout_ms = std::min(timeout_ms, kMaxDelayMs);
     }
 
     // Wait until we have something to do.
-    if (no_handles) {
-      std::unique_lock<Mutex> lock(mutex_);
-      cond_.ResetAndWaitWhileUnlocked(lock);
-    } else {
-      timeval timeout = {.tv_sec = timeout_ms / 1000,
-                         .tv_usec = (timeout_ms % 1000) * 1000};
-      if (select(maxfd + 1, &fdread, &fdwrite, &fdexc, &timeout) < 0) {
-        if (errno == EBADF) {
-          // If another thread aborts the request, it will close the file
-          // descriptor, causing an error here, so just ignore it.
-        } else {
-          PLOG(ERROR) << "Error waiting for network handles";
-        }
+    events.clear();
+    poller_->Wait(timeout_ms, &events);
+  }
+}
+
+void NetworkThread::HandleMessages() {
+  // Get any pending messages and complete any requests that are done.
+  int msg_count;
+  while (CURLMsg* msg = curl_multi_info_read(multi_handle_, &msg_count)) {
+    if (msg->msg == CURLMSG_DONE) {
+      // |msg| is invalid once the handle is removed.
+      CURL* easy = msg->easy_handle;
+      const CURLcode result = msg->data.result;
+
+      char* request = nullptr;
+      curl_easy_getinfo(easy, CURLINFO_PRIVATE, &request);
+      auto it = requests_.find(reinterpret_cast<js::XMLHttpRequest*>(request));
+      if (it != requests_.end()) {
+        it->second->OnRequestComplete(result);
+        requests_.erase(it);
       }
+      CHECK_EQ(curl_multi_remove_handle(multi_handle_, easy), CURLM_OK);
+    } else {
+      // There are currently no other message types.
+      LOG(DFATAL) << "Unknown message type: " << msg->msg;
     }
   }
 }
 
+// static
+int NetworkThread::OnSocketUpdate(CURL* /* easy */, int fd, int what,
+                                  void* user, void* /* socket_data */) {
+  auto* self = static_cast<NetworkThread*>(user);
+  if (what == CURL_POLL_REMOVE)
+    self->poller_->Remove(fd);
+  else
+    self->poller_->Watch(fd, what);
+  return 0;
+}
+
+// static
+int NetworkThread::OnTimerUpdate(CURLM* /* multi */,
+                                 long timeout_ms,  // NOLINT
+                                 void* user) {
+  // This is called with |mutex_| held, either from the background thread or
+  // when adding/removing requests.
+  auto* self = static_cast<NetworkThread*>(user);
+  if (timeout_ms < 0) {
+    self->timer_deadline_ms_ = kNoTimer;
+  } else {
+    self->timer_deadline_ms_ =
+        util::Clock::Instance.GetMonotonicTime() + timeout_ms;
+  }
+  return 0;
+}
+
 }  // namespace shaka
@@ -16,13 +16,15 @@
 #define SHAKA_EMBEDDED_CORE_NETWORK_THREAD_H_
 
 #include <atomic>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "src/core/ref_ptr.h"
 #include "src/debug/mutex.h"
 #include "src/debug/thread.h"
-#include "src/debug/thread_event.h"
 
+typedef void CURL;
 typedef void CURLM;
 
 namespace shaka {
@@ -37,6 +39,10 @@ class XMLHttpRequest;
  * request happens, the background thread will make calls into the XHR object.
  * The XHR object MUST handle any synchronization required for cross-thread
  * access.
+ *
+ * This uses the CURL multi-socket API, so CURL tells us which sockets to watch
+ * and we only tell CURL about the sockets that are ready.  Other threads wake
+ * the background thread using a pipe when requests are added or removed.
  */
 class NetworkThread {
  public:
@@ -65,12 +71,28 @@ class NetworkThread {
   void AbortRequest(RefPtr<js::XMLHttpRequest> request);
 
  private:
+  class SocketPoller;
+
   void ThreadMain();
 
+  /** Handles any completed requests.  |mutex_| must be held. */
+  void HandleMessages();
+
+  /** Called by CURL when it wants to change which events to watch for. */
+  static int OnSocketUpdate(CURL* easy, int fd, int what, void* user,
+                            void* socket_data);
+  /** Called by CURL when it wants to change its timeout. */
+  static int OnTimerUpdate(CURLM* multi, long timeout_ms,  // NOLINT
+                           void* user);
+
   mutable Mutex mutex_;
-  ThreadEvent<void> cond_;
-  std::vector<RefPtr<js::XMLHttpRequest>> requests_;
+  std::unordered_map<js::XMLHttpRequest*, RefPtr<js::XMLHttpRequest>>
+      requests_;
+  std::unique_ptr<SocketPoller> poller_;
   CURLM* multi_handle_;
+  // When CURL wants us to call it back, in milliseconds based on
+  // util::Clock::GetMonotonicTime; or the max value if there is no timer.
+  uint64_t timer_deadline_ms_;
   std::atomic<bool> shutdown_;
 
   Thread thread_;
@@ -16,6 +16,7 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <chrono>
 #include <limits>
 
@@ -39,9 +40,20 @@ PendingTaskBase::~PendingTaskBase() {}
 
 }  // namespace impl
 
+namespace {
+
+/** The minimum number of canceled timers before we compact the heap. */
+constexpr const size_t kMinCanceledTimersToCompact = 32;
+
+}  // namespace
+
 TaskRunner::TaskRunner(std::function<void(RunLoop)> wrapper,
                        const util::Clock* clock, bool is_worker)
-    : mutex_(is_worker ? "TaskRunner worker" : "TaskRunner main"),
+    : canceled_timers_(0),
+      pending_timers_(0),
+      running_task_(nullptr),
+      has_new_task_(false),
+      mutex_(is_worker ? "TaskRunner worker" : "TaskRunner main"),
       clock_(clock),
       waiting_("TaskRunner wait until finished"),
       running_(true),
@@ -58,8 +70,10 @@ TaskRunner::~TaskRunner() {
 
 bool TaskRunner::HasPendingWork() const {
   std::unique_lock<Mutex> lock(mutex_);
-  for (auto& task : tasks_) {
-    if (!task->loop)
+  if (pending_timers_ > 0 || (running_task_ && !running_task_->loop))
+    return true;
+  for (auto& queue : tasks_) {
+    if (!queue.empty())
       return true;
   }
   return false;
@@ -77,6 +91,7 @@ void TaskRunner::Stop() {
       running_ = false;
       join = true;
       waiting_.SignalAllIfNotSet();
+      signal_.notify_all();
     }
   }
   if (join) {
@@ -93,10 +108,22 @@ void TaskRunner::WaitUntilFinished() {
 
 void TaskRunner::CancelTimer(int id) {
   std::unique_lock<Mutex> lock(mutex_);
-  for (auto& task : tasks_) {
-    if (task->id == id) {
-      task->should_remove = true;
-      return;
+  auto it = timer_ids_.find(id);
+  if (it == timer_ids_.end())
+    return;
+
+  impl::PendingTaskBase* task = it->second;
+  timer_ids_.erase(it);
+  task->should_remove = true;
+  if (!task->loop)
+    pending_timers_--;
+  // A repeated timer that is currently running isn't in the heap; it will be
+  // dropped once it finishes.
+  if (task != running_task_) {
+    canceled_timers_++;
+    if (canceled_timers_ >= kMinCanceledTimersToCompact &&
+        canceled_timers_ > timers_.size() / 2) {
+      RemoveCanceledTimers();
     }
   }
 }
@@ -105,64 +132,93 @@ void TaskRunner::Run(std::function<void(RunLoop)> wrapper) {
   wrapper([this]() {
     while (running_) {
       // Handle a task.  This will only handle one task, then loop.
-      if (HandleTask())
+      uint64_t wait_ms;
+      if (HandleTask(&wait_ms))
         continue;
 
       if (!HasPendingWork()) {
         waiting_.SignalAllIfNotSet();
       }
 
-      // We don't have any work to do, wait for a while.
-      OnIdle();
+      // We don't have any work to do, wait until there is.
+      OnIdle(wait_ms);
     }
 
     // If we stop early, delete any pending tasks.  This must be done on the
     // worker thread so we can delete JavaScript objects.
-    tasks_.clear();
+    std::deque<std::unique_ptr<impl::PendingTaskBase>> tasks[kNumTaskQueues];
+    std::vector<std::unique_ptr<impl::PendingTaskBase>> timers;
+    {
+      std::unique_lock<Mutex> lock(mutex_);
+      for (size_t i = 0; i < kNumTaskQueues; i++)
+        tasks[i].swap(tasks_[i]);
+      timers.swap(timers_);
+      timer_ids_.clear();
+      canceled_timers_ = pending_timers_ = 0;
+    }
+    for (auto& queue : tasks)
+      queue.clear();
+    timers.clear();
     waiting_.SignalAllIfNotSet();
   });
 }
 
-void TaskRunner::OnIdle() {
-  // TODO: Since we have no work, we will never add work ourselves.  Consider
-  // using signalling rather than polling.
-  clock_->SleepSeconds(0.001);
+void TaskRunner::OnIdle(uint64_t wait_ms) {
+  std::unique_lock<Mutex> lock(mutex_);
+  if (!running_ || has_new_task_)
+    return;
+
+  if (wait_ms == std::numeric_limits<uint64_t>::max())
+    signal_.wait(lock);
+  else
+    clock_->WaitForSignal(&signal_, &lock, wait_ms);
 }
 
-bool TaskRunner::HandleTask() {
+bool TaskRunner::HandleTask(uint64_t* wait_ms) {
   // We need to be careful here because:
   // 1) We may be called from another thread to change tasks.
   // 2) The callback may change tasks (including its own).
+  // So we remove the task from the queues while it is being called.
 
   const uint64_t now = clock_->GetMonotonicTime();
-  impl::PendingTaskBase* task = nullptr;
+  std::unique_ptr<impl::PendingTaskBase> task;
   {
-    // Find the earliest timer we can finish.  If there are multiple with the
-    // same time, pick the one registered earlier (lower ID).
     std::unique_lock<Mutex> lock(mutex_);
-    uint64_t min_time = std::numeric_limits<uint64_t>::max();
-    TaskPriority max_priority = TaskPriority::Timer;
-    for (auto it = tasks_.begin(); it != tasks_.end();) {
-      if ((*it)->should_remove) {
-        it = tasks_.erase(it);
-      } else {
-        if ((*it)->priority > max_priority) {
-          max_priority = (*it)->priority;
-          task = it->get();
-        } else if (max_priority == TaskPriority::Timer) {
-          const uint64_t it_time = (*it)->start_ms + (*it)->delay_ms;
-          if (it_time <= now && it_time < min_time) {
-            min_time = it_time;
-            task = it->get();
-          }
-        }
-        ++it;
+    has_new_task_ = false;
+
+    // Internal tasks run before timers; higher priorities are run first.
+    for (size_t i = kNumTaskQueues; i > 0 && !task; i--) {
+      auto& queue = tasks_[i - 1];
+      if (!queue.empty()) {
+        task = std::move(queue.front());
+        queue.pop_front();
       }
     }
-  }
 
-  if (!task)
-    return false;
+    if (!task) {
+      while (!timers_.empty() && timers_.front()->should_remove) {
+        PopTimer();
+        canceled_timers_--;
+      }
+      if (timers_.empty()) {
+        *wait_ms = std::numeric_limits<uint64_t>::max();
+        return false;
+      }
+
+      const uint64_t run_at = timers_.front()->run_at_ms();
+      if (run_at > now) {
+        *wait_ms = run_at - now;
+        return false;
+      }
+
+      task = PopTimer();
+      if (!task->loop) {
+        timer_ids_.erase(task->id);
+        pending_timers_--;
+      }
+    }
+    running_task_ = task.get();
+  }
 
 #ifdef USING_V8
   if (!is_worker_) {
@@ -180,13 +236,50 @@ bool TaskRunner::HandleTask() {
   (void)is_worker_;
 #endif
 
-  if (task->loop) {
+  std::unique_lock<Mutex> lock(mutex_);
+  running_task_ = nullptr;
+  if (task->loop && !task->should_remove) {
     task->start_ms = now;
+    timers_.emplace_back(std::move(task));
+    std::push_heap(timers_.begin(), timers_.end(), TimerOrder());
   } else {
-    task->should_remove = true;
-    // Will be removed in the next iteration.
+    // Destroy the task outside the lock since it may own arbitrary objects.
+    lock.unlock();
+    task.reset();
   }
   return true;
 }
 
+void TaskRunner::AddTask(impl::PendingTaskBase* task) {
+  if (task->priority == TaskPriority::Timer) {
+    timers_.emplace_back(task);
+    std::push_heap(timers_.begin(), timers_.end(), TimerOrder());
+    timer_ids_.emplace(task->id, task);
+    if (!task->loop)
+      pending_timers_++;
+  } else {
+    tasks_[static_cast<size_t>(task->priority) - 1].emplace_back(task);
+  }
+  has_new_task_ = true;
+  signal_.notify_all();
+}
+
+std::unique_ptr<impl::PendingTaskBase> TaskRunner::PopTimer() {
+  std::pop_heap(timers_.begin(), timers_.end(), TimerOrder());
+  std::unique_ptr<impl::PendingTaskBase> ret = std::move(timers_.back());
+  timers_.pop_back();
+  return ret;
+}
+
+void TaskRunner::RemoveCanceledTimers() {
+  auto it = std::remove_if(
+      timers_.begin(), timers_.end(),
+      [](const std::unique_ptr<impl::PendingTaskBase>& task) -> bool {
+        return task->should_remove;
+      });
+  timers_.erase(it, timers_.end());
+  std::make_heap(timers_.begin(), timers_.end(), TimerOrder());
+  canceled_timers_ = 0;
+}
+
 }  // namespace shaka
@@ -18,12 +18,15 @@
 #include <glog/logging.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
-#include <list>
 #include <memory>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "src/core/ref_ptr.h"
 #include "src/debug/mutex.h"
@@ -56,6 +59,11 @@ class PendingTaskBase {
   /** Performs the task. */
   virtual void Call() = 0;
 
+  /** @return The time (in milliseconds) the task should run at. */
+  uint64_t run_at_ms() const {
+    return start_ms + delay_ms;
+  }
+
   uint64_t start_ms;
   const uint64_t delay_ms;
   const TaskPriority priority;
@@ -225,10 +233,11 @@ class TaskRunner {
     auto pending_task =
         new impl::PendingTask<Func>(clock_, std::forward<Func>(callback), name,
                                     priority, 0, id, /* loop */ false);
-    tasks_.emplace_back(pending_task);
     pending_task->event->SetProvider(&worker_);
+    auto event = pending_task->event;
+    AddTask(pending_task);
 
-    return pending_task->event;
+    return event;
   }
 
   /**
@@ -244,10 +253,9 @@ class TaskRunner {
     std::unique_lock<Mutex> lock(mutex_);
     const int id = ++next_id_;
 
-    tasks_.emplace_back(
-        new impl::PendingTask<Func>(clock_, std::forward<Func>(callback), "",
-                                    TaskPriority::Timer, delay_ms, id,
-                                    /* loop= */ false));
+    AddTask(new impl::PendingTask<Func>(clock_, std::forward<Func>(callback),
+                                        "", TaskPriority::Timer, delay_ms, id,
+                                        /* loop= */ false));
 
     return id;
   }
@@ -268,10 +276,9 @@ class TaskRunner {
     std::unique_lock<Mutex> lock(mutex_);
     const int id = ++next_id_;
 
-    tasks_.emplace_back(
-        new impl::PendingTask<Func>(clock_, std::forward<Func>(callback), "",
-                                    TaskPriority::Timer, delay_ms, id,
-                                    /* loop= */ true));
+    AddTask(new impl::PendingTask<Func>(clock_, std::forward<Func>(callback),
+                                        "", TaskPriority::Timer, delay_ms, id,
+                                        /* loop= */ true));
 
     return id;
   }
@@ -292,22 +299,68 @@ class TaskRunner {
   void Run(std::function<void(RunLoop)> wrapper);
 
   /**
-   * Called when there is no work to be done.  This should yield to other
-   * threads and/or wait until more work is scheduled.
+   * Called when there is no work to be done.  This waits until more work is
+   * scheduled or until the given number of milliseconds pass on |clock_|.
    */
-  void OnIdle();
+  void OnIdle(uint64_t wait_ms);
 
   /**
    * Pops a task from the queue and handles it.
+   * @param wait_ms [OUT] If there was no task to run, will contain the number
+   *   of milliseconds until the next timer is due.
    * @return True if there were any task in the queue, false otherwise.
    */
-  bool HandleTask();
+  bool HandleTask(uint64_t* wait_ms);
+
+  /**
+   * Adds a new task to the queues and wakes the worker.  This takes ownership
+   * of the task.  |mutex_| must be held.
+   */
+  void AddTask(impl::PendingTaskBase* task);
+
+  /** Removes the earliest timer from the heap.  |mutex_| must be held. */
+  std::unique_ptr<impl::PendingTaskBase> PopTimer();
 
+  /** Removes all canceled timers from the heap.  |mutex_| must be held. */
+  void RemoveCanceledTimers();
+
+  /**
+   * Orders timers so the earliest is at the top of the heap.  If there are
+   * multiple with the same time, the one registered earlier (lower ID) is
+   * first.
+   */
+  struct TimerOrder {
+    bool operator()(const std::unique_ptr<impl::PendingTaskBase>& a,
+                    const std::unique_ptr<impl::PendingTaskBase>& b) const {
+      const uint64_t a_time = a->run_at_ms();
+      const uint64_t b_time = b->run_at_ms();
+      return a_time > b_time || (a_time == b_time && a->id > b->id);
+    }
+  };
 
-  // TODO: Consider a different data structure.
-  std::list<std::unique_ptr<impl::PendingTaskBase>> tasks_;
+  static constexpr const size_t kNumTaskQueues =
+      static_cast<size_t>(TaskPriority::Immediate);
+
+  // A FIFO queue of non-timer tasks for each priority; the index is the
+  // priority minus one.
+  std::deque<std::unique_ptr<impl::PendingTaskBase>> tasks_[kNumTaskQueues];
+  // A min-heap of timers, ordered using TimerOrder.  Canceled timers stay in
+  // the heap until they reach the top or there are enough to compact.
+  std::vector<std::unique_ptr<impl::PendingTaskBase>> timers_;
+  // Maps the ID of active timers to the task.
+  std::unordered_map<int, impl::PendingTaskBase*> timer_ids_;
+  // The number of canceled timers still in |timers_|.
+  size_t canceled_timers_;
+  // The number of non-repeating timers that haven't fired yet.
+  size_t pending_timers_;
+  // The task currently being run, if any.
+  impl::PendingTaskBase* running_task_;
+  // Set when a task is added; this ensures we don't wait if a task was added
+  // after we last looked.
+  bool has_new_task_;
 
   mutable Mutex mutex_;
+  std::condition_variable_any signal_;
   const util::Clock* clock_;
   ThreadEvent<void> waiting_;
   std::atomic<bool> running_;
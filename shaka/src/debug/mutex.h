@@ -16,8 +16,10 @@
 #define SHAKA_EMBEDDED_DEBUG_MUTEX_H_
 
 #include <glog/logging.h>
+#include <stdint.h>
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -38,10 +40,28 @@ namespace shaka {
  * it is suggested to use a ThreadEvent instead (to track deadlocks).
  *
  * If _Mutex implements the SharedMutex concept, so does this.
+ *
+ * This also counts how often the lock is taken and how often (and for how long)
+ * a thread had to wait for it, so lock contention can be measured.  The counts
+ * are only available when DEBUG_DEADLOCKS is defined.
  */
 template <typename _Mutex>
 class DebugMutex : public Waitable {
  public:
+  /** Lock contention statistics, see GetStats(). */
+  struct Stats {
+    /** The number of times the exclusive lock was acquired. */
+    uint64_t lock_count = 0;
+    /** The number of times the exclusive lock was already held by another. */
+    uint64_t contended_lock_count = 0;
+    /** The number of times a shared lock was acquired. */
+    uint64_t shared_lock_count = 0;
+    /** The number of times a shared lock had to wait for the mutex. */
+    uint64_t contended_shared_lock_count = 0;
+    /** The total time, in nanoseconds, threads spent waiting for the mutex. */
+    uint64_t wait_nanoseconds = 0;
+  };
+
   explicit DebugMutex(const std::string& name)
     : Waitable(name), locked_by_(std::thread::id()) {}
   ~DebugMutex() override {
@@ -53,6 +73,26 @@ class DebugMutex : public Waitable {
     return locked_by_;
   }
 
+  /** @return The lock contention statistics for this mutex. */
+  Stats GetStats() const {
+    Stats ret;
+    ret.lock_count = lock_count_;
+    ret.contended_lock_count = contended_lock_count_;
+    ret.shared_lock_count = shared_lock_count_;
+    ret.contended_shared_lock_count = contended_shared_lock_count_;
+    ret.wait_nanoseconds = wait_nanoseconds_;
+    return ret;
+  }
+
+  /** Resets the lock contention statistics. */
+  void ResetStats() {
+    lock_count_ = 0;
+    contended_lock_count_ = 0;
+    shared_lock_count_ = 0;
+    contended_shared_lock_count_ = 0;
+    wait_nanoseconds_ = 0;
+  }
+
   void lock() {
     CHECK(!holds_shared_lock())
         << "Cannot hold shared and unique lock at once.";
@@ -64,7 +104,13 @@ class DebugMutex : public Waitable {
     // deadlocks for the exclusive lock.
 #endif
 
-    mutex_.lock();
+    if (!mutex_.try_lock()) {
+      contended_lock_count_++;
+      const auto start = std::chrono::steady_clock::now();
+      mutex_.lock();
+      RecordWait(start);
+    }
+    lock_count_++;
 
     locked_by_ = std::this_thread::get_id();
   }
@@ -76,8 +122,10 @@ class DebugMutex : public Waitable {
 
     bool ret = mutex_.try_lock();
 
-    if (ret)
+    if (ret) {
+      lock_count_++;
       locked_by_ = std::this_thread::get_id();
+    }
 
     return ret;
   }
@@ -99,7 +147,13 @@ class DebugMutex : public Waitable {
     // for the exclusive lock because there can be multiple readers and it could
     // report a false-positive.
 
-    mutex_.lock_shared();
+    if (!mutex_.try_lock_shared()) {
+      contended_shared_lock_count_++;
+      const auto start = std::chrono::steady_clock::now();
+      mutex_.lock_shared();
+      RecordWait(start);
+    }
+    shared_lock_count_++;
 
     add_shared_lock();
   }
@@ -109,10 +163,12 @@ class DebugMutex : public Waitable {
     CHECK_NE(locked_by_, std::this_thread::get_id())
         << "Cannot get shared lock with exclusive lock held.";
 
-    bool ret = mutex_.try_lock();
+    bool ret = mutex_.try_lock_shared();
 
-    if (ret)
+    if (ret) {
+      shared_lock_count_++;
       add_shared_lock();
+    }
 
     return ret;
   }
@@ -126,6 +182,12 @@ class DebugMutex : public Waitable {
   }
 
  private:
+  void RecordWait(std::chrono::steady_clock::time_point start) {
+    const auto delta = std::chrono::steady_clock::now() - start;
+    wait_nanoseconds_ +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(delta).count();
+  }
+
   bool holds_shared_lock() {
     std::unique_lock<std::mutex> lock(shared_locked_by_lock_);
     return shared_locked_by_.count(std::this_thread::get_id()) > 0;
@@ -144,6 +206,12 @@ class DebugMutex : public Waitable {
   std::atomic<std::thread::id> locked_by_;
   std::atomic<bool> is_upgrading_{false};
 
+  std::atomic<uint64_t> lock_count_{0};
+  std::atomic<uint64_t> contended_lock_count_{0};
+  std::atomic<uint64_t> shared_lock_count_{0};
+  std::atomic<uint64_t> contended_shared_lock_count_{0};
+  std::atomic<uint64_t> wait_nanoseconds_{0};
+
   std::mutex shared_locked_by_lock_;
   std::unordered_set<std::thread::id> shared_locked_by_;
 };
@@ -15,9 +15,21 @@
 #include "src/debug/thread.h"
 
 #include <glog/logging.h>
+#if defined(OS_MAC) || defined(OS_IOS)
+#  include <pthread/qos.h>
+#elif defined(OS_LINUX)
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/resource.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
 
+#include <cerrno>
+#include <cstring>
 #include <utility>
 
+#include "shaka/media/default_media_player.h"
 #include "src/debug/waiting_tracker.h"
 #include "src/util/utils.h"
 
@@ -58,4 +70,58 @@ Thread::~Thread() {
 #endif
 }
 
+// static
+bool Thread::SetCurrentThreadAffinity(const std::vector<size_t>& cpus) {
+  if (cpus.empty())
+    return true;
+#ifdef OS_LINUX
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t cpu : cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      LOG(ERROR) << "Invalid CPU index: " << cpu;
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  const int code = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (code != 0) {
+    LOG(ERROR) << "Error setting thread affinity: " << strerror(code);
+    return false;
+  }
+  return true;
+#else
+  LOG(WARNING) << "Thread affinity isn't supported on this platform";
+  return false;
+#endif
+}
+
+// static
+bool Thread::SetCurrentThreadPriority(media::ThreadPriority priority) {
+#if defined(OS_MAC) || defined(OS_IOS)
+  qos_class_t qos = QOS_CLASS_DEFAULT;
+  if (priority == media::ThreadPriority::Low)
+    qos = QOS_CLASS_UTILITY;
+  else if (priority == media::ThreadPriority::High)
+    qos = QOS_CLASS_USER_INTERACTIVE;
+  const int code = pthread_set_qos_class_self_np(qos, 0);
+#elif defined(OS_LINUX)
+  // Linux threads each have their own nice value.
+  int nice = 0;
+  if (priority == media::ThreadPriority::Low)
+    nice = 10;
+  else if (priority == media::ThreadPriority::High)
+    nice = -10;
+  const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+  const int code = setpriority(PRIO_PROCESS, tid, nice) == 0 ? 0 : errno;
+#else
+  const int code = ENOTSUP;
+#endif
+  if (code != 0) {
+    LOG(ERROR) << "Error setting thread priority: " << strerror(code);
+    return false;
+  }
+  return true;
+}
+
 }  // namespace shaka
@@ -15,12 +15,19 @@
 #ifndef SHAKA_EMBEDDED_DEBUG_THREAD_H_
 #define SHAKA_EMBEDDED_DEBUG_THREAD_H_
 
+#include <stdint.h>
+
 #include <functional>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace shaka {
 
+namespace media {
+enum class ThreadPriority : uint8_t;
+}  // namespace media
+
 class Thread final {
  public:
   Thread(const std::string& name, std::function<void()> callback);
@@ -57,6 +64,24 @@ class Thread final {
     thread_.join();
   }
 
+  /**
+   * Limits the calling thread to run on the given CPU cores.  This is only
+   * supported on Linux.
+   *
+   * @param cpus The indices of the cores to run on; if empty, this does
+   *   nothing.
+   * @return True on success, false on error or if unsupported.
+   */
+  static bool SetCurrentThreadAffinity(const std::vector<size_t>& cpus);
+
+  /**
+   * Changes the scheduling priority of the calling thread.  Raising the
+   * priority may need extra permissions.
+   *
+   * @return True on success, false on error.
+   */
+  static bool SetCurrentThreadPriority(media::ThreadPriority priority);
+
  private:
   const std::string name_;
   std::thread thread_;
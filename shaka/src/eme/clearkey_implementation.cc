@@ -217,13 +217,14 @@ ClearKeyImplementation::~ClearKeyImplementation() {}
 
 bool ClearKeyImplementation::GetExpiration(const std::string& session_id,
                                            int64_t* expiration) const {
+  util::shared_lock<util::shared_mutex> lock(mutex_);
   *expiration = -1;
   return sessions_.count(session_id) != 0;
 }
 
 bool ClearKeyImplementation::GetKeyStatuses(
     const std::string& session_id, std::vector<KeyStatusInfo>* statuses) const {
-  std::unique_lock<std::mutex> lock(mutex_);
+  util::shared_lock<util::shared_mutex> lock(mutex_);
   if (sessions_.count(session_id) == 0)
     return false;
 
@@ -244,7 +245,7 @@ void ClearKeyImplementation::CreateSessionAndGenerateRequest(
     Data data) {
   DCHECK(session_type == MediaKeySessionType::Temporary);
 
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<util::shared_mutex> lock(mutex_);
 
   const std::string session_id = std::to_string(++cur_session_id_);
   // The indexer will create a new object since it doesn't exist.
@@ -274,7 +275,7 @@ void ClearKeyImplementation::Load(const std::string& /* session_id */,
 
 void ClearKeyImplementation::Update(const std::string& session_id,
                                     EmePromise promise, Data data) {
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<util::shared_mutex> lock(mutex_);
 
   if (sessions_.count(session_id) == 0) {
     promise.Reject(ExceptionType::InvalidState,
@@ -297,14 +298,16 @@ void ClearKeyImplementation::Update(const std::string& session_id,
   session->callable = false;
   // Move all keys into the session.
   session->keys.splice(session->keys.end(), std::move(keys));
+  UpdateKeyTable();
   helper_->OnKeyStatusChange(session_id);
   promise.Resolve();
 }
 
 void ClearKeyImplementation::Close(const std::string& session_id,
                                    EmePromise promise) {
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<util::shared_mutex> lock(mutex_);
   sessions_.erase(session_id);
+  UpdateKeyTable();
   promise.Resolve();
 }
 
@@ -318,114 +321,134 @@ DecryptStatus ClearKeyImplementation::Decrypt(const FrameEncryptionInfo* info,
                                               const uint8_t* data,
                                               size_t data_size,
                                               uint8_t* dest) const {
-  std::unique_lock<std::mutex> lock(mutex_);
+  util::shared_lock<util::shared_mutex> lock(mutex_);
 
-  const std::vector<uint8_t>* key = nullptr;
-  for (auto& session_pair : sessions_) {
-    for (auto& cur_key : session_pair.second.keys) {
-      if (cur_key.key_id == info->key_id) {
-        key = &cur_key.key;
-        break;
-      }
-    }
-  }
-  if (!key) {
+  auto it = keys_.find(info->key_id);
+  if (it == keys_.end()) {
     LOG(ERROR) << "Unable to find key ID: "
                << util::ToHexString(info->key_id.data(), info->key_id.size());
     return DecryptStatus::KeyNotFound;
   }
 
-  util::Decryptor decryptor(info->scheme, *key, info->iv);
-  if (info->subsamples.empty()) {
-    return DecryptBlock(info, data, data_size, 0, dest, &decryptor);
-  } else {
-    size_t block_offset = 0;
-    for (const auto& subsample : info->subsamples) {
-      if (data_size < subsample.clear_bytes ||
-          data_size - subsample.clear_bytes < subsample.protected_bytes) {
-        LOG(ERROR) << "Input data not large enough for subsamples";
-        return DecryptStatus::OtherError;
-      }
+  const Session::Key* key = it->second;
+  std::unique_ptr<util::Decryptor> decryptor =
+      key->TakeDecryptor(info->scheme, info->iv);
+  const DecryptStatus ret =
+      DecryptSample(info, data, data_size, dest, decryptor.get());
+  key->CacheDecryptor(std::move(decryptor));
+  return ret;
+}
 
-      // The clear portion appears first.
-      memcpy(dest, data, subsample.clear_bytes);
-      data += subsample.clear_bytes;
-      dest += subsample.clear_bytes;
-      data_size -= subsample.clear_bytes;
-
-      // Then the encrypted portion.
-      const auto ret = DecryptBlock(info, data, subsample.protected_bytes,
-                                    block_offset, dest, &decryptor);
-      if (ret != DecryptStatus::Success)
-        return ret;
-      data += subsample.protected_bytes;
-      dest += subsample.protected_bytes;
-      data_size -= subsample.protected_bytes;
-      block_offset =
-          (block_offset + subsample.protected_bytes) % AES_BLOCK_SIZE;
-
-      // iv changing is handled by Decryptor.
-    }
-    if (data_size != 0) {
-      LOG(ERROR) << "Data remaining after subsample handling";
+DecryptStatus ClearKeyImplementation::DecryptSample(
+    const FrameEncryptionInfo* info, const uint8_t* data, size_t data_size,
+    uint8_t* dest, util::Decryptor* decryptor) const {
+  if (info->subsamples.empty())
+    return DecryptBlock(info, data, data_size, 0, dest, decryptor);
+
+  size_t block_offset = 0;
+  for (const auto& subsample : info->subsamples) {
+    if (data_size < subsample.clear_bytes ||
+        data_size - subsample.clear_bytes < subsample.protected_bytes) {
+      LOG(ERROR) << "Input data not large enough for subsamples";
       return DecryptStatus::OtherError;
     }
-    return DecryptStatus::Success;
+
+    // The clear portion appears first.
+    if (dest != data)
+      memcpy(dest, data, subsample.clear_bytes);
+    data += subsample.clear_bytes;
+    dest += subsample.clear_bytes;
+    data_size -= subsample.clear_bytes;
+
+    // Then the encrypted portion.
+    const auto ret = DecryptBlock(info, data, subsample.protected_bytes,
+                                  block_offset, dest, decryptor);
+    if (ret != DecryptStatus::Success)
+      return ret;
+    data += subsample.protected_bytes;
+    dest += subsample.protected_bytes;
+    data_size -= subsample.protected_bytes;
+    block_offset = (block_offset + subsample.protected_bytes) % AES_BLOCK_SIZE;
+
+    // iv changing is handled by Decryptor.
   }
+  if (data_size != 0) {
+    LOG(ERROR) << "Data remaining after subsample handling";
+    return DecryptStatus::OtherError;
+  }
+  return DecryptStatus::Success;
 }
 
 DecryptStatus ClearKeyImplementation::DecryptBlock(
     const FrameEncryptionInfo* info, const uint8_t* data, size_t data_size,
     size_t block_offset, uint8_t* dest, util::Decryptor* decryptor) const {
-  size_t num_bytes_read = 0;
-  if (block_offset != 0) {
-    if (info->pattern.clear_blocks != 0) {
-      LOG(ERROR) << "Cannot have block offset when using pattern encryption";
-      return DecryptStatus::OtherError;
+  if (info->pattern.clear_blocks == 0) {
+    // The whole range is encrypted, so after finishing the partial block from
+    // the previous subsample, decrypt the rest at once.
+    size_t num_bytes_read = 0;
+    if (block_offset != 0) {
+      num_bytes_read =
+          std::min<size_t>(data_size, AES_BLOCK_SIZE - block_offset);
+      if (!decryptor->DecryptPartialBlock(data, num_bytes_read, block_offset,
+                                          dest)) {
+        return DecryptStatus::OtherError;
+      }
     }
-
-    num_bytes_read = std::min<size_t>(data_size, AES_BLOCK_SIZE - block_offset);
-    if (!decryptor->DecryptPartialBlock(data, num_bytes_read, block_offset,
-                                        dest)) {
+    if (num_bytes_read < data_size &&
+        !decryptor->Decrypt(data + num_bytes_read, data_size - num_bytes_read,
+                            dest + num_bytes_read)) {
       return DecryptStatus::OtherError;
     }
+    return DecryptStatus::Success;
   }
 
-  if (info->pattern.clear_blocks != 0) {
-    const size_t protected_size =
-        AES_BLOCK_SIZE * info->pattern.encrypted_blocks;
-    const size_t clear_size = AES_BLOCK_SIZE * info->pattern.clear_blocks;
-    const size_t pattern_size_in_blocks =
-        info->pattern.encrypted_blocks + info->pattern.clear_blocks;
-    const size_t data_size_in_blocks = data_size / AES_BLOCK_SIZE;
-    for (size_t i = 0; i < data_size_in_blocks / pattern_size_in_blocks; i++) {
-      if (!decryptor->Decrypt(data + num_bytes_read, protected_size,
-                              dest + num_bytes_read)) {
-        return DecryptStatus::OtherError;
-      }
-      num_bytes_read += protected_size;
+  if (block_offset != 0) {
+    LOG(ERROR) << "Cannot have block offset when using pattern encryption";
+    return DecryptStatus::OtherError;
+  }
 
-      memcpy(dest + num_bytes_read, data + num_bytes_read, clear_size);
-      num_bytes_read += clear_size;
-    }
+  // With pattern encryption, only the first |encrypted_blocks| of each pattern
+  // are encrypted; the rest, including a partial pattern at the end without
+  // all its encrypted blocks, is clear.  The encrypted runs are usually a
+  // single block, so rather than decrypting them one at a time, gather them
+  // into one buffer, decrypt that at once, and put them back.  The cipher
+  // state carries from one encrypted run to the next, skipping the clear
+  // blocks, so this gives the same result.
+  const size_t encrypted_size =
+      AES_BLOCK_SIZE * info->pattern.encrypted_blocks;
+  const size_t pattern_size =
+      AES_BLOCK_SIZE *
+      (info->pattern.encrypted_blocks + info->pattern.clear_blocks);
+  if (dest != data)
+    memcpy(dest, data, data_size);
+  if (encrypted_size == 0)
+    return DecryptStatus::Success;
 
-    // If the last pattern block isn't big enough for the whole
-    // encrypted_blocks, then it is ignored.
-    if (data_size_in_blocks % pattern_size_in_blocks >=
-        info->pattern.encrypted_blocks) {
-      if (!decryptor->Decrypt(data + num_bytes_read, protected_size,
-                              dest + num_bytes_read)) {
+  uint8_t buffer[256 * AES_BLOCK_SIZE];
+  size_t offset = 0;
+  while (offset + encrypted_size <= data_size) {
+    if (encrypted_size > sizeof(buffer)) {
+      // Large runs are decrypted directly.
+      if (!decryptor->Decrypt(data + offset, encrypted_size, dest + offset))
         return DecryptStatus::OtherError;
-      }
-      num_bytes_read += protected_size;
+      offset += pattern_size;
+      continue;
     }
 
-    memcpy(dest + num_bytes_read, data + num_bytes_read,
-           data_size - num_bytes_read);
-  } else {
-    if (!decryptor->Decrypt(data + num_bytes_read, data_size - num_bytes_read,
-                            dest + num_bytes_read)) {
+    const size_t start = offset;
+    size_t buffer_size = 0;
+    while (offset + encrypted_size <= data_size &&
+           buffer_size + encrypted_size <= sizeof(buffer)) {
+      memcpy(buffer + buffer_size, data + offset, encrypted_size);
+      buffer_size += encrypted_size;
+      offset += pattern_size;
+    }
+
+    if (!decryptor->Decrypt(buffer, buffer_size, buffer))
       return DecryptStatus::OtherError;
+    for (size_t i = 0; i < buffer_size; i += encrypted_size) {
+      memcpy(dest + start + i / encrypted_size * pattern_size, buffer + i,
+             encrypted_size);
     }
   }
 
@@ -434,16 +457,72 @@ DecryptStatus ClearKeyImplementation::DecryptBlock(
 
 void ClearKeyImplementation::LoadKeyForTesting(std::vector<uint8_t> key_id,
                                                std::vector<uint8_t> key) {
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<util::shared_mutex> lock(mutex_);
   const std::string session_id = std::to_string(++cur_session_id_);
   sessions_.emplace(session_id, Session());
   sessions_.at(session_id).keys.emplace_back(std::move(key_id), std::move(key));
+  UpdateKeyTable();
+}
+
+void ClearKeyImplementation::UpdateKeyTable() {
+  // This is only called when sessions change, which is rare; so just rebuild
+  // the whole table.  If multiple sessions have the same key ID, any of the
+  // keys can be used.
+  keys_.clear();
+  for (auto& session_pair : sessions_) {
+    for (auto& key : session_pair.second.keys)
+      keys_.emplace(key.key_id, &key);
+  }
+}
+
+size_t ClearKeyImplementation::KeyIdHash::operator()(
+    const std::vector<uint8_t>& key_id) const {
+  // FNV-1a; key IDs are random, so this only needs to be fast.
+  size_t ret = 2166136261u;
+  for (uint8_t b : key_id)
+    ret = (ret ^ b) * 16777619u;
+  return ret;
 }
 
 ClearKeyImplementation::Session::Key::Key(std::vector<uint8_t> key_id,
                                           std::vector<uint8_t> key)
-    : key_id(std::move(key_id)), key(std::move(key)) {}
-ClearKeyImplementation::Session::Key::~Key() {}
+    : key_id(std::move(key_id)), key(std::move(key)) {
+  for (auto& slot : cached_decryptors_)
+    slot.store(nullptr, std::memory_order_relaxed);
+}
+ClearKeyImplementation::Session::Key::~Key() {
+  for (auto& slot : cached_decryptors_)
+    delete slot.load(std::memory_order_relaxed);
+}
+
+std::unique_ptr<util::Decryptor>
+ClearKeyImplementation::Session::Key::TakeDecryptor(
+    EncryptionScheme scheme, const std::vector<uint8_t>& iv) const {
+  for (auto& slot : cached_decryptors_) {
+    if (!slot.load(std::memory_order_relaxed))
+      continue;
+    std::unique_ptr<util::Decryptor> ret(
+        slot.exchange(nullptr, std::memory_order_acquire));
+    if (ret && ret->scheme() == scheme && ret->Reset(iv))
+      return ret;
+  }
+  return std::unique_ptr<util::Decryptor>(
+      new util::Decryptor(scheme, key, iv));
+}
+
+void ClearKeyImplementation::Session::Key::CacheDecryptor(
+    std::unique_ptr<util::Decryptor> decryptor) const {
+  for (auto& slot : cached_decryptors_) {
+    util::Decryptor* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, decryptor.get(),
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+      decryptor.release();
+      return;
+    }
+  }
+  // All the slots are full, so just destroy this one.
+}
 
 ClearKeyImplementation::Session::Session() {}
 ClearKeyImplementation::Session::~Session() {}
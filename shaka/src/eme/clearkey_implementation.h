@@ -15,7 +15,9 @@
 #ifndef SHAKA_EMBEDDED_EME_CLEARKEY_FACTORY_H_
 #define SHAKA_EMBEDDED_EME_CLEARKEY_FACTORY_H_
 
+#include <atomic>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -24,6 +26,7 @@
 #include "shaka/eme/implementation.h"
 #include "shaka/eme/implementation_helper.h"
 #include "src/util/decryptor.h"
+#include "src/util/shared_lock.h"
 
 #define AES_BLOCK_SIZE 16u
 
@@ -73,9 +76,27 @@ class ClearKeyImplementation final : public Implementation {
       Key(std::vector<uint8_t> key_id, std::vector<uint8_t> key);
       ~Key();
 
-      // TODO: Consider storing keys in OpenSSL key objects instead.
+      SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(Key);
+
+      /**
+       * Gets a decryptor for this key that is set up for the given frame.  This
+       * reuses a cached decryptor if there is one, which avoids setting up the
+       * cipher again.
+       */
+      std::unique_ptr<util::Decryptor> TakeDecryptor(
+          EncryptionScheme scheme, const std::vector<uint8_t>& iv) const;
+
+      /** Stores the given decryptor so a later frame can reuse it. */
+      void CacheDecryptor(std::unique_ptr<util::Decryptor> decryptor) const;
+
       std::vector<uint8_t> key_id;
       std::vector<uint8_t> key;  // This contains the raw AES key.
+
+     private:
+      // Decryptors that aren't in use.  Each Decrypt call takes one out of a
+      // slot and puts it back after, so this doesn't need a lock.  This holds
+      // enough for several threads decrypting at once.
+      mutable std::atomic<util::Decryptor*> cached_decryptors_[8];
     };
 
     Session();
@@ -90,10 +111,19 @@ class ClearKeyImplementation final : public Implementation {
     bool callable = false;
   };
 
+  struct KeyIdHash {
+    size_t operator()(const std::vector<uint8_t>& key_id) const;
+  };
+
+  friend class ClearKeyImplementationBenchmark;
   friend class ClearKeyImplementationTest;
   friend class media::DecoderIntegration;
   friend class media::DecoderDecryptIntegration;
 
+  DecryptStatus DecryptSample(const FrameEncryptionInfo* info,
+                              const uint8_t* data, size_t data_size,
+                              uint8_t* dest, util::Decryptor* decryptor) const;
+
   DecryptStatus DecryptBlock(const FrameEncryptionInfo* info,
                              const uint8_t* data, size_t data_size,
                              size_t block_offset, uint8_t* dest,
@@ -101,8 +131,17 @@ class ClearKeyImplementation final : public Implementation {
 
   void LoadKeyForTesting(std::vector<uint8_t> key_id, std::vector<uint8_t> key);
 
-  mutable std::mutex mutex_;
+  /** Rebuilds |keys_| after the keys of a session change. */
+  void UpdateKeyTable();
+
+  // Decrypt only needs a shared lock, so frames can be decrypted in parallel;
+  // changing the sessions needs an exclusive lock.
+  mutable util::shared_mutex mutex_;
   std::unordered_map<std::string, Session> sessions_;
+  // Maps a key ID to the key in |sessions_|.  Sessions and keys are stored in
+  // node-based containers, so these pointers are stable.
+  std::unordered_map<std::vector<uint8_t>, const Session::Key*, KeyIdHash>
+      keys_;
   ImplementationHelper* helper_;
   uint32_t cur_session_id_;
 };
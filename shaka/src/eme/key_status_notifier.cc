@@ -0,0 +1,63 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/eme/key_status_notifier.h"
+
+#include <algorithm>
+
+namespace shaka {
+namespace eme {
+
+KeyStatusNotifier::KeyStatusNotifier() : mutex_("KeyStatusNotifier") {}
+
+KeyStatusNotifier::~KeyStatusNotifier() {}
+
+// static
+KeyStatusNotifier* KeyStatusNotifier::Instance() {
+  static KeyStatusNotifier* instance = new KeyStatusNotifier;
+  return instance;
+}
+
+void KeyStatusNotifier::AddListener(const Implementation* cdm,
+                                    Listener* listener) {
+  std::unique_lock<Mutex> lock(mutex_);
+  for (auto& pair : listeners_) {
+    if (pair.second == listener) {
+      pair.first = cdm;
+      return;
+    }
+  }
+  listeners_.emplace_back(cdm, listener);
+}
+
+void KeyStatusNotifier::RemoveListener(Listener* listener) {
+  std::unique_lock<Mutex> lock(mutex_);
+  listeners_.erase(
+      std::remove_if(listeners_.begin(), listeners_.end(),
+                     [&](const std::pair<const Implementation*, Listener*>& p) {
+                       return p.second == listener;
+                     }),
+      listeners_.end());
+}
+
+void KeyStatusNotifier::OnKeyStatusChange(const Implementation* cdm) {
+  std::unique_lock<Mutex> lock(mutex_);
+  for (auto& pair : listeners_) {
+    if (pair.first == cdm)
+      pair.second->OnKeyStatusChange();
+  }
+}
+
+}  // namespace eme
+}  // namespace shaka
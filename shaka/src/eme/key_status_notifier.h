@@ -0,0 +1,88 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_EME_KEY_STATUS_NOTIFIER_H_
+#define SHAKA_EMBEDDED_EME_KEY_STATUS_NOTIFIER_H_
+
+#include <utility>
+#include <vector>
+
+#include "src/debug/mutex.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace eme {
+
+class Implementation;
+
+/**
+ * Tracks internal listeners for key changes in EME implementations.  The
+ * implementation reports key changes through
+ * ImplementationHelper::OnKeyStatusChange, which forwards them here.  This
+ * allows the media pipeline to resume decoding as soon as a key is added rather
+ * than polling the CDM.
+ *
+ * This type is thread-safe.
+ */
+class KeyStatusNotifier {
+ public:
+  class Listener {
+   public:
+    virtual ~Listener() {}
+
+    /**
+     * Called when the keys of the implementation changed.  This is called with
+     * a lock held, so this should return quickly and can't add or remove
+     * listeners.  This may be called with locks held inside the CDM, so this
+     * shouldn't wait on other locks either.
+     */
+    virtual void OnKeyStatusChange() = 0;
+  };
+
+  KeyStatusNotifier();
+  ~KeyStatusNotifier();
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(KeyStatusNotifier);
+
+  /**
+   * @return The global instance of the notifier.  This is never destroyed so
+   *   it can be used during shutdown.
+   */
+  static KeyStatusNotifier* Instance();
+
+  /**
+   * Adds a listener for key changes in the given implementation.  If the
+   * listener was already added, this replaces the implementation it listens
+   * to.
+   */
+  void AddListener(const Implementation* cdm, Listener* listener);
+
+  /**
+   * Removes the given listener.  Once this returns, the listener will no longer
+   * be called.
+   */
+  void RemoveListener(Listener* listener);
+
+  /** Calls the listeners for the given implementation. */
+  void OnKeyStatusChange(const Implementation* cdm);
+
+ private:
+  Mutex mutex_;
+  std::vector<std::pair<const Implementation*, Listener*>> listeners_;
+};
+
+}  // namespace eme
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_EME_KEY_STATUS_NOTIFIER_H_
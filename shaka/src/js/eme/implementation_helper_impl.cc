@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "src/core/js_manager_impl.h"
+#include "src/eme/key_status_notifier.h"
 #include "src/js/eme/media_key_session.h"
 #include "src/js/eme/media_keys.h"
 #include "src/js/events/event.h"
@@ -67,6 +68,10 @@ void ImplementationHelperImpl::OnKeyStatusChange(
   if (session) {
     session->ScheduleEvent<events::Event>(EventType::KeyStatusesChange);
   }
+
+  // Wake up any decoders that are waiting for a key.
+  shaka::eme::KeyStatusNotifier::Instance()->OnKeyStatusChange(
+      media_keys_->GetCdm());
 }
 
 }  // namespace eme
@@ -111,6 +111,18 @@ RefPtr<MediaSource> MediaSource::FindMediaSource(const std::string& url) {
   return media_sources_[url];
 }
 
+// static
+size_t MediaSource::EstimateTotalBufferedSize() {
+  size_t ret = 0;
+  for (auto& pair : media_sources_) {
+    if (pair.second->audio_buffer_)
+      ret += pair.second->audio_buffer_->EstimateSize();
+    if (pair.second->video_buffer_)
+      ret += pair.second->video_buffer_->EstimateSize();
+  }
+  return ret;
+}
+
 void MediaSource::Trace(memory::HeapTracer* tracer) const {
   EventTarget::Trace(tracer);
   tracer->Trace(&audio_buffer_);
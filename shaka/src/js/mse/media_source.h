@@ -55,6 +55,11 @@ class MediaSource : public events::EventTarget, public media::Demuxer::Client {
 
   static bool IsTypeSupported(const std::string& mime_type);
   static RefPtr<MediaSource> FindMediaSource(const std::string& url);
+  /**
+   * @return The estimated number of bytes buffered in the SourceBuffers of
+   *   every MediaSource.
+   */
+  static size_t EstimateTotalBufferedSize();
 
   void Trace(memory::HeapTracer* tracer) const override;
 
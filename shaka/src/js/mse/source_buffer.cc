@@ -14,6 +14,7 @@
 
 #include "src/js/mse/source_buffer.h"
 
+#include <algorithm>
 #include <cmath>
 #include <utility>
 
@@ -28,12 +29,26 @@ namespace shaka {
 namespace js {
 namespace mse {
 
+namespace {
+
+// These match the default limits in Chromium.  Once a buffer is full, appends
+// evict old frames behind the playhead, or fail with QuotaExceededError.
+constexpr const size_t kMaxVideoBufferSize = 150 * 1024 * 1024;
+constexpr const size_t kMaxAudioBufferSize = 12 * 1024 * 1024;
+
+/** The maximum number of bytes buffered in all SourceBuffers combined. */
+constexpr const size_t kMaxTotalBufferSize = 200 * 1024 * 1024;
+
+}  // namespace
+
 SourceBuffer::SourceBuffer(const std::string& mime,
                            RefPtr<MediaSource> media_source)
     : mode(AppendMode::SEGMENTS),
       updating(false),
       demuxer_(mime, media_source.get(), &frames_),
       media_source_(media_source),
+      player_(nullptr),
+      max_size_(kMaxVideoBufferSize),
       timestamp_offset_(0),
       append_window_start_(0),
       append_window_end_(HUGE_VAL /* Infinity */) {
@@ -56,12 +71,15 @@ void SourceBuffer::Trace(memory::HeapTracer* tracer) const {
 
 bool SourceBuffer::Attach(const std::string& mime, media::MediaPlayer* player,
                           bool is_video) {
+  player_ = player;
+  max_size_ = is_video ? kMaxVideoBufferSize : kMaxAudioBufferSize;
   return player->AddMseBuffer(mime, is_video, &frames_);
 }
 
 void SourceBuffer::Detach() {
   demuxer_.Stop();
   media_source_ = nullptr;
+  player_ = nullptr;
 }
 
 ExceptionOr<void> SourceBuffer::AppendBuffer(ByteBuffer data) {
@@ -79,6 +97,14 @@ ExceptionOr<void> SourceBuffer::AppendBuffer(ByteBuffer data) {
     media_source_->ScheduleEvent<events::Event>(EventType::SourceOpen);
   }
 
+  if (!EvictCodedFrames(data.size())) {
+    return JsError::DOMException(
+        QuotaExceededError,
+        "The SourceBuffer is full and no buffered data could be evicted.");
+  }
+
+  // The append completes once the segment is demuxed, so the buffered ranges
+  // include it by "updateend".
   append_buffer_ = std::move(data);
   demuxer_.AppendData(
       timestamp_offset_, append_window_start_, append_window_end_,
@@ -103,10 +129,13 @@ ExceptionOr<void> SourceBuffer::Remove(double start, double end) {
                                  "Already performing an update.");
   }
 
-  // TODO: Consider running this on a background thread.
-  frames_.Remove(start, end);
+  // This runs on the demuxer thread so the event loop isn't blocked while the
+  // frames are freed.
+  demuxer_.Remove(
+      start, end,
+      std::bind(&SourceBuffer::OnRemoveComplete, this, std::placeholders::_1));
 
-  ScheduleEvent<events::Event>(EventType::UpdateEnd);
+  updating = true;
   return {};
 }
 
@@ -114,6 +143,10 @@ media::BufferedRanges SourceBuffer::GetBufferedRanges() const {
   return frames_.GetBufferedRanges();
 }
 
+size_t SourceBuffer::EstimateSize() const {
+  return frames_.EstimateSize();
+}
+
 ExceptionOr<RefPtr<TimeRanges>> SourceBuffer::GetBuffered() const {
   if (!media_source_) {
     return JsError::DOMException(
@@ -215,6 +248,38 @@ void SourceBuffer::OnAppendComplete(bool success) {
   ScheduleEvent<events::Event>(EventType::UpdateEnd);
 }
 
+void SourceBuffer::OnRemoveComplete(bool success) {
+  VLOG(1) << "Finish removing media: " << (success ? "success" : "error");
+  updating = false;
+  if (!success)
+    ScheduleEvent<events::Event>(EventType::Error);
+  ScheduleEvent<events::Event>(EventType::UpdateEnd);
+}
+
+bool SourceBuffer::EvictCodedFrames(size_t append_size) {
+  // Limit this buffer so all the buffers together stay within the global
+  // budget; this only evicts from this buffer, other buffers will evict when
+  // they are appended to.
+  const size_t size = frames_.EstimateSize();
+  const size_t total =
+      std::max(size, MediaSource::EstimateTotalBufferedSize());
+  const size_t others = total - size;
+  const size_t max_size =
+      others >= kMaxTotalBufferSize
+          ? 0
+          : std::min(max_size_, kMaxTotalBufferSize - others);
+  if (size + append_size <= max_size)
+    return true;
+  if (append_size > max_size)
+    return false;
+
+  DCHECK(player_);
+  const size_t new_size =
+      frames_.EvictBefore(player_->CurrentTime(), max_size - append_size);
+  VLOG(1) << "Evicted " << (size - new_size) << " bytes from SourceBuffer";
+  return new_size + append_size <= max_size;
+}
+
 
 SourceBufferFactory::SourceBufferFactory() {
   AddListenerField(EventType::UpdateStart, &SourceBuffer::on_update_start);
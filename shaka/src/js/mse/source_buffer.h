@@ -57,6 +57,8 @@ class SourceBuffer : public events::EventTarget {
   ExceptionOr<void> Remove(double start, double end);
 
   media::BufferedRanges GetBufferedRanges() const;
+  /** @return The estimated number of bytes of buffered frames. */
+  size_t EstimateSize() const;
   ExceptionOr<RefPtr<TimeRanges>> GetBuffered() const;
 
   double TimestampOffset() const;
@@ -78,11 +80,22 @@ class SourceBuffer : public events::EventTarget {
  private:
   /** Called when an append operation completes. */
   void OnAppendComplete(bool success);
+  /** Called when a remove operation completes. */
+  void OnRemoveComplete(bool success);
+  /**
+   * Implements the "coded frame eviction algorithm" from MSE.  This removes
+   * buffered frames behind the playhead so |append_size| more bytes fit in
+   * both this buffer's and the global memory budget.
+   * @return Whether there is room for the new data.
+   */
+  bool EvictCodedFrames(size_t append_size);
 
   media::ElementaryStream frames_;
   media::DemuxerThread demuxer_;
 
   Member<MediaSource> media_source_;
+  media::MediaPlayer* player_;
+  size_t max_size_;
   ByteBuffer append_buffer_;
   double timestamp_offset_;
   double append_window_start_;
@@ -15,7 +15,9 @@
 #include "src/js/xml_http_request.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cstdlib>
 #include <cerrno>
 #include <cstring>
 #include <stdexcept>
@@ -43,6 +45,27 @@ constexpr size_t kProgressInterval = 15;
 
 constexpr const char* kCookieFileName = "net_cookies.dat";
 
+/**
+ * A response type (from Firefox) where, during "progress" events, |response|
+ * only contains the data received since the previous "progress" event.  This
+ * allows the app to append a segment to a SourceBuffer as it downloads.
+ */
+constexpr const char* kChunkedResponseType = "moz-chunked-arraybuffer";
+
+/** The initial size of a body buffer when the size isn't known. */
+constexpr const size_t kMinBodySize = 64 * 1024;
+
+/**
+ * The biggest body buffer we will allocate up-front based on the
+ * Content-Length header; this avoids allocating huge buffers for bad headers.
+ * This is enough for a media segment; bigger bodies grow as they download.
+ */
+constexpr const size_t kMaxPreallocatedBodySize = 16 * 1024 * 1024;
+
+std::atomic<uint64_t> g_bytes_received{0};
+std::atomic<uint64_t> g_bytes_copied{0};
+std::atomic<uint64_t> g_buffer_allocations{0};
+
 size_t UploadCallback(void* buffer, size_t member_size, size_t member_count,
                       void* user_data) {
   auto* request = reinterpret_cast<XMLHttpRequest*>(user_data);
@@ -128,8 +151,12 @@ bool ParseStatusLine(const char* buffer, size_t length, int* code,
 XMLHttpRequest::XMLHttpRequest()
     : ready_state(XMLHttpRequest::ReadyState::Unsent),
       mutex_("XMLHttpRequest"),
+      body_(nullptr),
+      body_size_(0),
+      body_capacity_(0),
       curl_(curl_easy_init()),
       request_headers_(nullptr),
+      chunked_(false),
       with_credentials_(false) {
   AddListenerField(EventType::Abort, &on_abort);
   AddListenerField(EventType::Error, &on_error);
@@ -149,6 +176,7 @@ XMLHttpRequest::~XMLHttpRequest() {
   abort_pending_ = true;
   JsManagerImpl::Instance()->NetworkThread()->AbortRequest(this);
 
+  FreeBody();
   curl_easy_cleanup(curl_);
   if (request_headers_)
     curl_slist_free_all(request_headers_);
@@ -156,6 +184,22 @@ XMLHttpRequest::~XMLHttpRequest() {
 }
 // \endcond Doxygen_Skip
 
+// static
+XMLHttpRequest::Stats XMLHttpRequest::GetStats() {
+  Stats ret;
+  ret.bytes_received = g_bytes_received;
+  ret.bytes_copied = g_bytes_copied;
+  ret.buffer_allocations = g_buffer_allocations;
+  return ret;
+}
+
+// static
+void XMLHttpRequest::ResetStats() {
+  g_bytes_received = 0;
+  g_bytes_copied = 0;
+  g_buffer_allocations = 0;
+}
+
 void XMLHttpRequest::Trace(memory::HeapTracer* tracer) const {
   // No need to trace on_* members as EventTarget handles it.
   EventTarget::Trace(tracer);
@@ -203,6 +247,15 @@ std::string XMLHttpRequest::GetAllResponseHeaders() const {
   return ret;
 }
 
+std::string XMLHttpRequest::ResponseText() const {
+  // This is only created when asked for since most requests only use the
+  // ArrayBuffer.
+  std::unique_lock<Mutex> lock(mutex_);
+  g_bytes_copied += response.size();
+  return std::string(reinterpret_cast<const char*>(response.data()),
+                     response.size());
+}
+
 shaka::optional<std::string> XMLHttpRequest::GetResponseHeader(
     const std::string& name) const {
   std::unique_lock<Mutex> lock(mutex_);
@@ -256,11 +309,13 @@ ExceptionOr<void> XMLHttpRequest::Send(
       return JsError::DOMException(InvalidStateError,
                                    "The object's state must be OPENED.");
     }
-    if (response_type != "arraybuffer") {
+    if (response_type != "arraybuffer" &&
+        response_type != kChunkedResponseType) {
       return JsError::DOMException(
           NotSupportedError,
           "Response type " + response_type + " is not supported");
     }
+    chunked_ = response_type == kChunkedResponseType;
 
     if (maybe_data.has_value()) {
       if (holds_alternative<ByteBuffer>(*maybe_data)) {
@@ -322,6 +377,17 @@ void XMLHttpRequest::RaiseProgressEvents() {
   if (abort_pending_)
     return;
 
+  if (chunked_) {
+    std::unique_lock<Mutex> lock(mutex_);
+    // Once the request completes, FinishResponse() gives the last chunk to
+    // |response| and the final "progress" event has already been scheduled.
+    if (ready_state == XMLHttpRequest::ReadyState::Done)
+      return;
+    // Give the received data to the ArrayBuffer; the next chunk is downloaded
+    // into a new buffer.
+    GiveBodyToResponse();
+  }
+
   if (ready_state == XMLHttpRequest::ReadyState::Opened) {
     this->ready_state = XMLHttpRequest::ReadyState::HeadersReceived;
     RaiseEvent<events::Event>(EventType::ReadyStateChange);
@@ -355,7 +421,11 @@ void XMLHttpRequest::OnDataReceived(uint8_t* buffer, size_t length) {
         std::bind(&XMLHttpRequest::RaiseProgressEvents, req));
   }
 
-  temp_data_.AppendCopy(buffer, length);
+  if (body_size_ + length > body_capacity_)
+    GrowBody(body_size_ + length);
+  std::memcpy(body_ + body_size_, buffer, length);
+  body_size_ += length;
+  g_bytes_received += length;
 }
 
 void XMLHttpRequest::OnHeaderReceived(const uint8_t* buffer, size_t length) {
@@ -429,7 +499,6 @@ size_t XMLHttpRequest::OnUpload(uint8_t* buffer, size_t length) {
 void XMLHttpRequest::Reset() {
   Abort();
   response.Clear();
-  response_text = "";
   response_type = "arraybuffer";
   response_url = "";
   status = 0;
@@ -438,11 +507,12 @@ void XMLHttpRequest::Reset() {
 
   last_progress_time_ = 0;
   estimated_size_ = 0;
+  chunked_ = false;
   parsing_headers_ = false;
   abort_pending_ = false;
 
   response_headers_.clear();
-  temp_data_.Clear();
+  FreeBody();
   upload_data_.Clear();
 
   curl_easy_reset(curl_);
@@ -482,7 +552,7 @@ void XMLHttpRequest::OnRequestComplete(CURLcode code) {
     const auto res =
         curl_easy_getinfo(curl_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len);
     if (res == 0) {
-      if (len < 0 && temp_data_.Size() > 0) {
+      if (len < 0 && body_size_ > 0) {
         // We don't know when the request ends; assume we have everything so
         // long as we have seen the headers and gotten some data back.  This
         // could mask a real network abort, but we'll probably get errors
@@ -491,7 +561,7 @@ void XMLHttpRequest::OnRequestComplete(CURLcode code) {
                         "We can't tell if the request was aborted due to lack "
                         "of Content-Length header.";
         code = CURLE_OK;
-      } else if (len > 0 && temp_data_.Size() == static_cast<size_t>(len)) {
+      } else if (len > 0 && body_size_ == static_cast<size_t>(len)) {
         // Since we have the Content-Length header, we know when we have
         // received all the data.  Only ignore when we have received everything.
         VLOG(1) << "Ignoring CURLE_RECV_ERROR due to possible iOS bug.";
@@ -502,10 +572,8 @@ void XMLHttpRequest::OnRequestComplete(CURLcode code) {
 #endif
 
   if (code == CURLE_OK) {
-    response_text = temp_data_.CreateString();
-    response.SetFromDynamicBuffer(temp_data_);
-    temp_data_.Clear();
-
+    // The body is given to |response| in FinishResponse() since JavaScript may
+    // already be using |response| for chunked requests.
     char* url;
     curl_easy_getinfo(curl_, CURLINFO_EFFECTIVE_URL, &url);
     response_url = url;
@@ -523,6 +591,14 @@ void XMLHttpRequest::OnRequestComplete(CURLcode code) {
   // Abort().
   if (!abort_pending_) {
     this->ready_state = XMLHttpRequest::ReadyState::Done;
+    if (code == CURLE_OK) {
+      // This is scheduled with the same priority as the events so it runs
+      // before them.
+      RefPtr<XMLHttpRequest> req(this);
+      JsManagerImpl::Instance()->MainThread()->AddInternalTask(
+          TaskPriority::Events, "Finish XHR response",
+          std::bind(&XMLHttpRequest::FinishResponse, req));
+    }
     ScheduleEvent<events::Event>(EventType::ReadyStateChange);
 
     double total_size = CurrentDownloadSize(curl_);
@@ -545,6 +621,60 @@ void XMLHttpRequest::OnRequestComplete(CURLcode code) {
   }
 }
 
+void XMLHttpRequest::FinishResponse() {
+  std::unique_lock<Mutex> lock(mutex_);
+  // The object may have been reused for another request before this ran.
+  if (abort_pending_ || ready_state != XMLHttpRequest::ReadyState::Done)
+    return;
+
+  GiveBodyToResponse();
+}
+
+void XMLHttpRequest::GiveBodyToResponse() {
+  if (!body_) {
+    GrowBody(0);
+  } else if (body_capacity_ - body_size_ > kMinBodySize) {
+    // The ArrayBuffer keeps the whole allocation alive, so don't keep the
+    // unused space from growing the buffer or from a bad Content-Length.
+    // Shrinking usually happens in place without a copy.
+    body_ = reinterpret_cast<uint8_t*>(  // NOLINT
+        std::realloc(body_, std::max<size_t>(body_size_, 1)));
+    CHECK(body_);
+  }
+
+  // Give the body to the ArrayBuffer directly instead of copying it.
+  response.SetFromAllocatedBuffer(body_, body_size_);
+  body_ = nullptr;
+  body_size_ = body_capacity_ = 0;
+}
+
+void XMLHttpRequest::GrowBody(size_t size) {
+  size_t capacity;
+  if (!body_ && !chunked_ && estimated_size_ >= size &&
+      estimated_size_ <= kMaxPreallocatedBodySize) {
+    // Allocate the whole body at once based on the Content-Length header.
+    capacity = static_cast<size_t>(estimated_size_);
+  } else {
+    capacity = std::max({size, body_capacity_ * 2, kMinBodySize});
+  }
+  // Always allocate something so we get a valid pointer.
+  capacity = std::max<size_t>(capacity, 1);
+
+  // Use malloc so this can be given to JavaScript, see ByteBuffer.
+  uint8_t* old_body = body_;
+  body_ = reinterpret_cast<uint8_t*>(std::realloc(body_, capacity));  // NOLINT
+  CHECK(body_);
+  if (old_body && body_ != old_body)
+    g_bytes_copied += body_size_;
+  g_buffer_allocations++;
+  body_capacity_ = capacity;
+}
+
+void XMLHttpRequest::FreeBody() {
+  std::free(body_);  // NOLINT
+  body_ = nullptr;
+  body_size_ = body_capacity_ = 0;
+}
 
 XMLHttpRequestFactory::XMLHttpRequestFactory() {
   AddConstant("UNSENT", XMLHttpRequest::ReadyState::Unsent);
@@ -555,7 +685,7 @@ XMLHttpRequestFactory::XMLHttpRequestFactory() {
 
   AddReadOnlyProperty("readyState", &XMLHttpRequest::ready_state);
   AddReadOnlyProperty("response", &XMLHttpRequest::response);
-  AddReadOnlyProperty("responseText", &XMLHttpRequest::response_text);
+  AddGenericProperty("responseText", &XMLHttpRequest::ResponseText);
   AddReadWriteProperty("responseType", &XMLHttpRequest::response_type);
   AddReadOnlyProperty("responseURL", &XMLHttpRequest::response_url);
   AddReadOnlyProperty("status", &XMLHttpRequest::status);
@@ -30,7 +30,6 @@
 #include "src/mapping/byte_string.h"
 #include "src/mapping/enum.h"
 #include "src/mapping/exception_or.h"
-#include "src/util/dynamic_buffer.h"
 
 namespace shaka {
 class NetworkThread;
@@ -44,6 +43,10 @@ namespace js {
  * Notes:
  * - Only supports asynchronous mode.
  * - Only support 'arraybuffer' responseType, but still sets responseText.
+ * - Supports Firefox's 'moz-chunked-arraybuffer' responseType, where the
+ *   response during "progress" events is only the newly received data.
+ * - The response body is downloaded directly into the memory used by the
+ *   response ArrayBuffer, sized using the Content-Length header if possible.
  * - Send() supports string, ArrayBuffer, or ArrayBufferView.
  * - Supports responseURL.
  * - Supports request/response headers.
@@ -67,17 +70,37 @@ class XMLHttpRequest : public events::EventTarget {
     Done = 4,
   };
 
+  /** Counters for how response bodies were handled, across all requests. */
+  struct Stats {
+    /** The number of body bytes received from the network. */
+    uint64_t bytes_received = 0;
+    /**
+     * The number of body bytes copied after they were received; for example,
+     * when the buffer needs to grow or when creating responseText.
+     */
+    uint64_t bytes_copied = 0;
+    /** The number of times a body buffer was allocated or grown. */
+    uint64_t buffer_allocations = 0;
+  };
+
   XMLHttpRequest();
   static XMLHttpRequest* Create() {
     return new XMLHttpRequest();
   }
 
+  /** @return The current stats for all requests. */
+  static Stats GetStats();
+
+  /** Resets the stats counters to zero. */
+  static void ResetStats();
+
   void Trace(memory::HeapTracer* tracer) const override;
   bool IsShortLived() const override;
 
   void Abort();
   std::string GetAllResponseHeaders() const;
   optional<std::string> GetResponseHeader(const std::string& name) const;
+  std::string ResponseText() const;
   ExceptionOr<void> Open(const std::string& method, const std::string& url,
                          optional<bool> async, optional<std::string> user,
                          optional<std::string> password);
@@ -113,7 +136,6 @@ class XMLHttpRequest : public events::EventTarget {
 
   ReadyState ready_state;
   ByteBuffer response;
-  std::string response_text;
   std::string response_type;
   std::string response_url;
   int status;
@@ -128,11 +150,37 @@ class XMLHttpRequest : public events::EventTarget {
   /** Called when the request completes. */
   void OnRequestComplete(CURLcode code);
 
+  /**
+   * Gives the downloaded body to |response|.  This is called on the main
+   * thread once the request completes successfully, since JavaScript may be
+   * reading |response|.
+   */
+  void FinishResponse();
+
+  /**
+   * Gives |body_| to |response| without copying it, shrinking it first if it
+   * has a lot of unused space.  |mutex_| must be held.
+   */
+  void GiveBodyToResponse();
+
+  /**
+   * Grows |body_| so it can hold at least |size| bytes.  |mutex_| must be
+   * held.
+   */
+  void GrowBody(size_t size);
+
+  /** Frees the pending response body.  |mutex_| must be held. */
+  void FreeBody();
+
   void Reset();
 
   mutable Mutex mutex_;
   std::map<std::string, std::string> response_headers_;
-  util::DynamicBuffer temp_data_;
+  // The response body as it is downloaded.  This is allocated with malloc()
+  // so it can become the response ArrayBuffer without a copy.
+  uint8_t* body_;
+  size_t body_size_;
+  size_t body_capacity_;
   ByteBuffer upload_data_;
 
   CURL* curl_;
@@ -140,6 +188,8 @@ class XMLHttpRequest : public events::EventTarget {
   size_t upload_pos_;
   uint64_t last_progress_time_;
   double estimated_size_;
+  // Whether the request uses the 'moz-chunked-arraybuffer' response type.
+  bool chunked_;
   bool parsing_headers_;
   bool with_credentials_;
   std::atomic<bool> abort_pending_;
@@ -79,6 +79,14 @@ void ByteBuffer::SetFromBuffer(const void* buffer, size_t size) {
   std::memcpy(ptr_, buffer, size_);
 }
 
+void ByteBuffer::SetFromAllocatedBuffer(uint8_t* buffer, size_t size) {
+  Clear();
+  CHECK(buffer);
+  own_ptr_ = true;
+  size_ = size;
+  ptr_ = buffer;
+}
+
 bool ByteBuffer::TryConvert(Handle<JsValue> value) {
 #if defined(USING_V8)
   if (value.IsEmpty())
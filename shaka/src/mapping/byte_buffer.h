@@ -73,6 +73,14 @@ class ByteBuffer : public GenericConverter, public memory::Traceable {
   /** Similar to SetFromDynamicBuffer, except accepts a single buffer source. */
   void SetFromBuffer(const void* buffer, size_t size);
 
+  /**
+   * Clears the buffer and takes ownership of the given block of memory without
+   * copying it.  The block MUST have been allocated with malloc() since it will
+   * be given to JavaScript; it may be bigger than |size|.  This can be called
+   * from any thread.
+   */
+  void SetFromAllocatedBuffer(uint8_t* buffer, size_t size);
+
 
   bool TryConvert(Handle<JsValue> value) override;
   ReturnVal<JsValue> ToJsValue() const override;
@@ -0,0 +1,310 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_kernels.h"
+
+#include <glog/logging.h>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#include <cstring>
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/** The largest channel count that has a specialized interleave loop. */
+constexpr const size_t kMaxSpecializedChannels = 8;
+
+// Samples in the planes may not be aligned; these compile to a single move.
+template <typename T>
+T Load(const uint8_t* src) {
+  T ret;
+  std::memcpy(&ret, src, sizeof(T));
+  return ret;
+}
+
+template <typename T>
+void Store(uint8_t* dest, T value) {
+  std::memcpy(dest, &value, sizeof(T));
+}
+
+/**
+ * Interleaves |Channels| planes of samples of type |T|.  Since the channel
+ * count is a constant, the compiler can unroll the inner loop.
+ */
+template <typename T, size_t Channels>
+void InterleaveScalar(const uint8_t* const* planes, size_t count,
+                      uint8_t* dest) {
+  for (size_t i = 0; i < count; i++) {
+    for (size_t c = 0; c < Channels; c++) {
+      Store<T>(dest, Load<T>(planes[c] + i * sizeof(T)));
+      dest += sizeof(T);
+    }
+  }
+}
+
+template <typename T, size_t Channels>
+struct Interleaver {
+  static void Run(const uint8_t* const* planes, size_t count, uint8_t* dest) {
+    InterleaveScalar<T, Channels>(planes, count, dest);
+  }
+};
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+// Stereo is by far the most common layout, so use SIMD for it.
+template <>
+struct Interleaver<uint16_t, 2> {
+  static void Run(const uint8_t* const* planes, size_t count, uint8_t* dest) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+#  if defined(__SSE2__)
+      const __m128i left =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + i * 2));
+      const __m128i right =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + i * 2));
+      auto* out = reinterpret_cast<__m128i*>(dest + i * 4);
+      _mm_storeu_si128(out, _mm_unpacklo_epi16(left, right));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(left, right));
+#  else
+      uint16x8x2_t value;
+      value.val[0] =
+          vld1q_u16(reinterpret_cast<const uint16_t*>(planes[0] + i * 2));
+      value.val[1] =
+          vld1q_u16(reinterpret_cast<const uint16_t*>(planes[1] + i * 2));
+      vst2q_u16(reinterpret_cast<uint16_t*>(dest + i * 4), value);
+#  endif
+    }
+    const uint8_t* rest[] = {planes[0] + i * 2, planes[1] + i * 2};
+    InterleaveScalar<uint16_t, 2>(rest, count - i, dest + i * 4);
+  }
+};
+
+template <>
+struct Interleaver<uint32_t, 2> {
+  static void Run(const uint8_t* const* planes, size_t count, uint8_t* dest) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+#  if defined(__SSE2__)
+      const __m128i left =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + i * 4));
+      const __m128i right =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + i * 4));
+      auto* out = reinterpret_cast<__m128i*>(dest + i * 8);
+      _mm_storeu_si128(out, _mm_unpacklo_epi32(left, right));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(left, right));
+#  else
+      uint32x4x2_t value;
+      value.val[0] =
+          vld1q_u32(reinterpret_cast<const uint32_t*>(planes[0] + i * 4));
+      value.val[1] =
+          vld1q_u32(reinterpret_cast<const uint32_t*>(planes[1] + i * 4));
+      vst2q_u32(reinterpret_cast<uint32_t*>(dest + i * 8), value);
+#  endif
+    }
+    const uint8_t* rest[] = {planes[0] + i * 4, planes[1] + i * 4};
+    InterleaveScalar<uint32_t, 2>(rest, count - i, dest + i * 8);
+  }
+};
+#endif
+
+/**
+ * Interleaves samples that are moved as type |T|.  Interleaving only copies
+ * bits, so formats with the same sample size share an implementation.
+ */
+template <typename T>
+void InterleaveAs(const uint8_t* const* planes, size_t channel_count,
+                  size_t first_sample, size_t sample_count, uint8_t* dest) {
+  if (channel_count > kMaxSpecializedChannels) {
+    for (size_t i = first_sample; i < first_sample + sample_count; i++) {
+      for (size_t c = 0; c < channel_count; c++) {
+        Store<T>(dest, Load<T>(planes[c] + i * sizeof(T)));
+        dest += sizeof(T);
+      }
+    }
+    return;
+  }
+
+  const uint8_t* src[kMaxSpecializedChannels];
+  for (size_t c = 0; c < channel_count; c++)
+    src[c] = planes[c] + first_sample * sizeof(T);
+  switch (channel_count) {
+    case 1:
+      std::memcpy(dest, src[0], sample_count * sizeof(T));
+      break;
+#define CASE(N)                                      \
+  case N:                                            \
+    Interleaver<T, N>::Run(src, sample_count, dest); \
+    break
+    CASE(2);
+    CASE(3);
+    CASE(4);
+    CASE(5);
+    CASE(6);
+    CASE(7);
+    CASE(8);
+#undef CASE
+  }
+}
+
+/** Multiplies |count| samples of the given format by |gain|, in (0, 1). */
+template <SampleFormat Format>
+void ScaleSamples(double gain, uint8_t* data, size_t count);
+
+template <>
+void ScaleSamples<SampleFormat::PackedS16>(double gain, uint8_t* data,
+                                           size_t count) {
+  // Use Q15 fixed-point.  Since the gain is less than 1, it fits in 16 bits.
+  const int16_t factor = static_cast<int16_t>(gain * (1 << 15));
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i factors = _mm_set1_epi16(factor);
+  for (; i + 8 <= count; i += 8) {
+    auto* ptr = reinterpret_cast<__m128i*>(data + i * 2);
+    const __m128i value = _mm_loadu_si128(ptr);
+    // Combine the halves into the full 32-bit products, then shift them back.
+    const __m128i low = _mm_mullo_epi16(value, factors);
+    const __m128i high = _mm_mulhi_epi16(value, factors);
+    const __m128i first = _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 15);
+    const __m128i second = _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 15);
+    _mm_storeu_si128(ptr, _mm_packs_epi32(first, second));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= count; i += 8) {
+    auto* ptr = reinterpret_cast<int16_t*>(data + i * 2);
+    vst1q_s16(ptr, vqdmulhq_n_s16(vld1q_s16(ptr), factor));
+  }
+#endif
+  for (; i < count; i++) {
+    uint8_t* ptr = data + i * 2;
+    Store<int16_t>(ptr,
+                   static_cast<int16_t>((Load<int16_t>(ptr) * factor) >> 15));
+  }
+}
+
+template <>
+void ScaleSamples<SampleFormat::PackedS32>(double gain, uint8_t* data,
+                                           size_t count) {
+  // Use Q31 fixed-point.
+  const int32_t factor = static_cast<int32_t>(gain * (1u << 31));
+  size_t i = 0;
+#if defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    auto* ptr = reinterpret_cast<int32_t*>(data + i * 4);
+    vst1q_s32(ptr, vqdmulhq_n_s32(vld1q_s32(ptr), factor));
+  }
+#endif
+  // SSE2 doesn't have a signed 32-bit multiply, so leave this to the compiler.
+  for (; i < count; i++) {
+    uint8_t* ptr = data + i * 4;
+    const int64_t value = Load<int32_t>(ptr);
+    Store<int32_t>(ptr, static_cast<int32_t>((value * factor) >> 31));
+  }
+}
+
+template <>
+void ScaleSamples<SampleFormat::PackedFloat>(double gain, uint8_t* data,
+                                             size_t count) {
+  const float factor = static_cast<float>(gain);
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128 factors = _mm_set1_ps(factor);
+  for (; i + 4 <= count; i += 4) {
+    auto* ptr = reinterpret_cast<float*>(data + i * 4);
+    _mm_storeu_ps(ptr, _mm_mul_ps(_mm_loadu_ps(ptr), factors));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    auto* ptr = reinterpret_cast<float*>(data + i * 4);
+    vst1q_f32(ptr, vmulq_n_f32(vld1q_f32(ptr), factor));
+  }
+#endif
+  for (; i < count; i++) {
+    uint8_t* ptr = data + i * 4;
+    Store<float>(ptr, Load<float>(ptr) * factor);
+  }
+}
+
+}  // namespace
+
+void InterleaveSamples(SampleFormat format, const uint8_t* const* planes,
+                       size_t channel_count, size_t first_sample,
+                       size_t sample_count, uint8_t* dest) {
+  switch (format) {
+    case SampleFormat::PackedU8:
+    case SampleFormat::PlanarU8:
+      InterleaveAs<uint8_t>(planes, channel_count, first_sample, sample_count,
+                            dest);
+      break;
+    case SampleFormat::PackedS16:
+    case SampleFormat::PlanarS16:
+      InterleaveAs<uint16_t>(planes, channel_count, first_sample, sample_count,
+                             dest);
+      break;
+    case SampleFormat::PackedS32:
+    case SampleFormat::PlanarS32:
+    case SampleFormat::PackedFloat:
+    case SampleFormat::PlanarFloat:
+      InterleaveAs<uint32_t>(planes, channel_count, first_sample, sample_count,
+                             dest);
+      break;
+    case SampleFormat::PackedS64:
+    case SampleFormat::PlanarS64:
+    case SampleFormat::PackedDouble:
+    case SampleFormat::PlanarDouble:
+      InterleaveAs<uint64_t>(planes, channel_count, first_sample, sample_count,
+                             dest);
+      break;
+    default:
+      LOG(DFATAL) << "Unsupported sample format: " << format;
+      break;
+  }
+}
+
+bool ApplyGain(SampleFormat format, double gain, uint8_t* data, size_t size) {
+  void (*scale)(double, uint8_t*, size_t);
+  size_t sample_size;
+  switch (format) {
+    case SampleFormat::PackedS16:
+    case SampleFormat::PlanarS16:
+      scale = &ScaleSamples<SampleFormat::PackedS16>;
+      sample_size = 2;
+      break;
+    case SampleFormat::PackedS32:
+    case SampleFormat::PlanarS32:
+      scale = &ScaleSamples<SampleFormat::PackedS32>;
+      sample_size = 4;
+      break;
+    case SampleFormat::PackedFloat:
+    case SampleFormat::PlanarFloat:
+      scale = &ScaleSamples<SampleFormat::PackedFloat>;
+      sample_size = 4;
+      break;
+    default:
+      return false;
+  }
+
+  if (gain <= 0)
+    std::memset(data, 0, size);
+  else if (gain < 1)
+    scale(gain, data, size / sample_size);
+  return true;
+}
+
+}  // namespace media
+}  // namespace shaka
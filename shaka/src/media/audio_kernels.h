@@ -0,0 +1,59 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_AUDIO_KERNELS_H_
+#define SHAKA_EMBEDDED_MEDIA_AUDIO_KERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shaka/media/frames.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * Packs planar samples into a single buffer of interleaved samples:
+ *   planes[0] -> | 1A | 1B | 1C |
+ *   planes[1] -> | 2A | 2B | 2C |
+ *   dest      -> | 1A | 2A | 1B | 2B | 1C | 2C |
+ *
+ * The planes don't need to be aligned.  Stereo 16-bit and 32-bit samples use
+ * SIMD instructions when available; up to 8 channels use a loop specialized
+ * for the channel count.
+ *
+ * @param format The format of the samples; only the sample size is used.
+ * @param planes The planes to read from, one per channel.
+ * @param channel_count The number of channels.
+ * @param first_sample The index of the first sample to read in each plane.
+ * @param sample_count The number of samples to read from each plane.
+ * @param dest The buffer to write to.  This must hold
+ *   |sample_count * channel_count| samples.
+ */
+void InterleaveSamples(SampleFormat format, const uint8_t* const* planes,
+                       size_t channel_count, size_t first_sample,
+                       size_t sample_count, uint8_t* dest);
+
+/**
+ * Multiplies the given samples by |gain|, in place.  This supports
+ * 16-bit, 32-bit, and float samples.  The gain is clamped to [0, 1].
+ *
+ * @return True on success, false if the format isn't supported.
+ */
+bool ApplyGain(SampleFormat format, double gain, uint8_t* data, size_t size);
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_AUDIO_KERNELS_H_
@@ -15,9 +15,10 @@
 #include "src/media/audio_renderer_common.h"
 
 #include <algorithm>
-#include <cstring>
 #include <functional>
-#include <vector>
+
+#include "src/media/audio_kernels.h"
+#include "src/media/media_executor.h"
 
 namespace shaka {
 namespace media {
@@ -72,6 +73,11 @@ double BytesToSeconds(std::shared_ptr<DecodedFrame> frame, size_t bytes) {
          frame->stream_info->sample_rate;
 }
 
+size_t BytesPerSecond(std::shared_ptr<DecodedFrame> frame) {
+  return BytesPerSample(frame) * frame->stream_info->channel_count *
+         frame->stream_info->sample_rate;
+}
+
 /**
  * Calculates the byte sync needed to play the next frame.
  *
@@ -97,12 +103,18 @@ int64_t GetSyncBytes(double prev_time, size_t bytes_written,
 
 }  // namespace
 
-AudioRendererCommon::AudioRendererCommon()
+AudioRendererCommon::AudioRendererCommon(DeviceMode mode)
     : mutex_("AudioRendererCommon"),
       on_play_("AudioRendererCommon"),
+      mode_(mode),
+      waiting_for_frame_(false),
       clock_(&util::Clock::Instance),
       player_(nullptr),
       input_(nullptr),
+      sync_time_(0),
+      bytes_written_(0),
+      sync_position_(0),
+      rate_(1),
       volume_(1),
       muted_(false),
       needs_resync_(true),
@@ -115,6 +127,8 @@ AudioRendererCommon::~AudioRendererCommon() {
   thread_.join();
   if (player_)
     player_->RemoveClient(this);
+  if (input_)
+    input_->RemoveClient(this);
 }
 
 void AudioRendererCommon::SetPlayer(const MediaPlayer* player) {
@@ -132,14 +146,21 @@ void AudioRendererCommon::SetPlayer(const MediaPlayer* player) {
 
 void AudioRendererCommon::Attach(const DecodedStream* stream) {
   std::unique_lock<Mutex> lock(mutex_);
+  if (input_)
+    input_->RemoveClient(this);
+
   input_ = stream;
   needs_resync_ = true;
-  if (stream)
+  if (stream) {
+    stream->AddClient(this);
     on_play_.SignalAllIfNotSet();
+  }
 }
 
 void AudioRendererCommon::Detach() {
   std::unique_lock<Mutex> lock(mutex_);
+  if (input_)
+    input_->RemoveClient(this);
   input_ = nullptr;
   SetDeviceState(/* is_playing= */ false);
 }
@@ -174,10 +195,49 @@ void AudioRendererCommon::Stop() {
   on_play_.SignalAllIfNotSet();
 }
 
+size_t AudioRendererCommon::ReadSamples(uint8_t* dest, size_t size) {
+  DCHECK(mode_ == DeviceMode::Pull);
+  return ring_.Read(dest, size);
+}
+
+bool AudioRendererCommon::AppendBuffer(const uint8_t* data, size_t size) {
+  DCHECK(mode_ == DeviceMode::Pull) << "Push devices must override this";
+  // This only happens if the device stops reading; the A/V sync will resync
+  // once it plays again, so just drop the samples.
+  if (!ring_.Write(data, size))
+    LOG(WARNING) << "Audio buffer is full, dropping samples";
+  return true;
+}
+
+void AudioRendererCommon::ClearBuffer() {
+  DCHECK(mode_ == DeviceMode::Pull) << "Push devices must override this";
+  ring_.Clear();
+}
+
+size_t AudioRendererCommon::GetBytesBuffered() const {
+  DCHECK(mode_ == DeviceMode::Pull) << "Push devices must override this";
+  return ring_.ReadableBytes();
+}
+
+bool AudioRendererCommon::AppendSamples(const uint8_t* data, size_t size) {
+  if (rate_ == 1)
+    return AppendBuffer(data, size);
+
+  while (size > 0) {
+    size_t consumed;
+    const size_t produced = stretcher_.Process(data, size, &consumed);
+    if (produced > 0 && !AppendBuffer(stretcher_.output(), produced))
+      return false;
+    data += consumed;
+    size -= consumed;
+  }
+  return true;
+}
+
 bool AudioRendererCommon::FillSilence(size_t bytes) {
   while (bytes > 0) {
     const size_t to_write = std::min(bytes, sizeof(kSilenceBuffer));
-    if (!AppendBuffer(kSilenceBuffer, to_write))
+    if (!AppendSamples(kSilenceBuffer, to_write))
       return false;
     bytes_written_ += to_write;
     bytes -= to_write;
@@ -207,24 +267,22 @@ bool AudioRendererCommon::WriteFrame(std::shared_ptr<DecodedFrame> frame,
     const size_t per_channel_sync = sync_bytes / channel_count;
     const size_t skipped_samples = per_channel_sync / sample_size;
     if (sample_count > skipped_samples) {
-      std::vector<uint8_t> temp(frame->linesize[0] * channel_count -
-                                sync_bytes);
-      uint8_t* output = temp.data();
-      for (size_t sample = skipped_samples; sample < sample_count; sample++) {
-        for (size_t channel = 0; channel < channel_count; channel++) {
-          std::memcpy(output, frame->data[channel] + sample * sample_size,
-                      sample_size);
-          output += sample_size;
-        }
-      }
-      if (!AppendBuffer(temp.data(), temp.size()))
+      const size_t size =
+          (sample_count - skipped_samples) * sample_size * channel_count;
+      if (interleave_buffer_.size() < size)
+        interleave_buffer_.resize(size);
+      InterleaveSamples(get<SampleFormat>(frame->format), frame->data.data(),
+                        channel_count, skipped_samples,
+                        sample_count - skipped_samples,
+                        interleave_buffer_.data());
+      if (!AppendSamples(interleave_buffer_.data(), size))
         return false;
-      bytes_written_ += temp.size();
+      bytes_written_ += size;
     }
   } else {
     if (frame->linesize[0] > sync_bytes) {
-      if (!AppendBuffer(frame->data[0] + sync_bytes,
-                        frame->linesize[0] - sync_bytes)) {
+      if (!AppendSamples(frame->data[0] + sync_bytes,
+                         frame->linesize[0] - sync_bytes)) {
         return false;
       }
       bytes_written_ += frame->linesize[0] - sync_bytes;
@@ -233,11 +291,20 @@ bool AudioRendererCommon::WriteFrame(std::shared_ptr<DecodedFrame> frame,
   return true;
 }
 
+void AudioRendererCommon::WillWaitForFrame() {
+  // Reset before looking for the frame so a frame added after we look will
+  // still wake us up.
+  on_play_.Reset();
+  waiting_for_frame_ = true;
+}
+
 void AudioRendererCommon::SetClock(const util::Clock* clock) {
   clock_ = clock;
 }
 
 void AudioRendererCommon::ThreadMain() {
+  MediaExecutor::ConfigureCurrentThread(/* audio= */ true);
+
   std::unique_lock<Mutex> lock(mutex_);
   while (!shutdown_) {
     if (!player_ || !input_) {
@@ -245,9 +312,10 @@ void AudioRendererCommon::ThreadMain() {
       continue;
     }
 
-    // TODO(#15): Support playback rate.  For the moment, mute audio.
+    // Mute audio at rates we can't stretch to.
+    const double rate = player_->PlaybackRate();
     const bool is_playing =
-        player_->PlaybackRate() == 1 &&
+        (rate == 1 || AudioTimeStretcher::IsRateSupported(rate)) &&
         player_->PlaybackState() == VideoPlaybackState::Playing;
     SetDeviceState(is_playing);
     if (!is_playing) {
@@ -256,10 +324,26 @@ void AudioRendererCommon::ThreadMain() {
     }
 
     double time = player_->CurrentTime();
+    if (mode_ == DeviceMode::Pull && !needs_resync_ && cur_frame_) {
+      // The device reports what it has actually played, so check that matches
+      // the media time.  This catches the device clock drifting from the
+      // player's clock and underflows, which counting written bytes can't.
+      const uint64_t played = ring_.read_position() - sync_position_;
+      const double played_time =
+          sync_time_ +
+          static_cast<double>(played) / BytesPerSecond(cur_frame_) * rate_;
+      if (std::abs(played_time - time) > kSyncLimit) {
+        VLOG(1) << "Audio is " << (played_time - time)
+                << " seconds off, resyncing";
+        needs_resync_ = true;
+      }
+    }
+
     const size_t buffered_bytes = GetBytesBuffered();
     std::shared_ptr<DecodedFrame> next;
     if (needs_resync_ || !cur_frame_) {
       ClearBuffer();
+      WillWaitForFrame();
       next = input_->GetFrame(time, FrameLocation::Near);
     } else {
       const double buffered_extra =
@@ -270,14 +354,20 @@ void AudioRendererCommon::ThreadMain() {
         continue;
       }
 
+      WillWaitForFrame();
       next = input_->GetFrame(cur_frame_->pts, FrameLocation::After);
     }
 
     if (!next) {
-      util::Unlocker<Mutex> unlock(&lock);
-      clock_->SleepSeconds(0.1);
+      // Wait for OnFrameAdded (or any other change) rather than polling.
+      {
+        util::Unlocker<Mutex> unlock(&lock);
+        on_play_.GetValue();
+      }
+      waiting_for_frame_ = false;
       continue;
     }
+    waiting_for_frame_ = false;
 
     if (!IsFrameSimilar(cur_frame_, next)) {
       // If we've changed to another stream, reset the audio device to the new
@@ -296,6 +386,11 @@ void AudioRendererCommon::ThreadMain() {
 
       if (!InitDevice(next, muted_ ? 0 : volume_))
         return;
+      if (mode_ == DeviceMode::Pull) {
+        // Leave room for cleared samples the device hasn't skipped over yet.
+        ring_.Reset(static_cast<size_t>(2 * (kBufferTarget + kSyncLimit) *
+                                        BytesPerSecond(next)));
+      }
       SetDeviceState(/* is_playing= */ true);
       needs_resync_ = true;
     }
@@ -305,6 +400,13 @@ void AudioRendererCommon::ThreadMain() {
       sync_bytes = GetSyncBytes(time, 0, next);
       sync_time_ = time;
       bytes_written_ = 0;
+      sync_position_ = ring_.write_position();
+      rate_ = rate;
+      if (rate != 1) {
+        stretcher_.Reset(get<SampleFormat>(next->format),
+                         next->stream_info->channel_count,
+                         next->stream_info->sample_rate, rate);
+      }
     } else {
       sync_bytes = GetSyncBytes(sync_time_, bytes_written_, next);
     }
@@ -340,5 +442,12 @@ void AudioRendererCommon::OnSeeking() {
   on_play_.SignalAllIfNotSet();
 }
 
+void AudioRendererCommon::OnFrameAdded() {
+  // This is called with the stream's client lock held, which Attach and Detach
+  // acquire while holding |mutex_|, so this can't use |mutex_|.
+  if (waiting_for_frame_)
+    on_play_.SignalAllIfNotSet();
+}
+
 }  // namespace media
 }  // namespace shaka
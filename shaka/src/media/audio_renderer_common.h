@@ -15,13 +15,18 @@
 #ifndef SHAKA_EMBEDDED_MEDIA_AUDIO_RENDERER_COMMON_H_
 #define SHAKA_EMBEDDED_MEDIA_AUDIO_RENDERER_COMMON_H_
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include "shaka/media/frames.h"
 #include "shaka/media/renderer.h"
+#include "shaka/media/streams.h"
 #include "src/debug/mutex.h"
 #include "src/debug/thread.h"
 #include "src/debug/thread_event.h"
+#include "src/media/audio_ring_buffer.h"
+#include "src/media/audio_time_stretch.h"
 #include "src/util/buffer_writer.h"
 #include "src/util/clock.h"
 
@@ -47,15 +52,38 @@ namespace media {
  * handle the unlikely case of not having enough data or too much data to match
  * the frame times.
  *
+ * Devices can either be pushed samples with AppendBuffer, or they can pull
+ * samples with ReadSamples (e.g. from an audio callback).  In pull mode, the
+ * samples are passed through a lock-free ring buffer, so the device never
+ * waits on the renderer; the device also reports exactly what it has played,
+ * which is used to keep the audio in sync with the media time.
+ *
+ * At other playback rates, the samples are passed through a time-stretcher,
+ * which keeps the pitch the same.  The sync still uses media time, so bytes
+ * are counted before they are stretched.
+ *
  * This renderer only supports playing content the audio device natively
  * supports.  This cannot convert to a different sample format.
  *
- * This type is fully thread-safe; all the pure-virtual methods are called with
- * a lock held, so derived classes do not need to use locks.
+ * This type is fully thread-safe; all the virtual methods are called with a
+ * lock held, so derived classes do not need to use locks.
  */
-class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
+class AudioRendererCommon : public AudioRenderer,
+                            MediaPlayer::Client,
+                            StreamBase::Client {
  public:
-  AudioRendererCommon();
+  /** Defines how samples are passed to the audio device. */
+  enum class DeviceMode {
+    /** Samples are given to the device with AppendBuffer. */
+    Push,
+    /**
+     * The device reads samples with ReadSamples; the renderer provides the
+     * buffer methods.
+     */
+    Pull,
+  };
+
+  explicit AudioRendererCommon(DeviceMode mode = DeviceMode::Push);
   ~AudioRendererCommon() override;
 
   void SetPlayer(const MediaPlayer* player) override;
@@ -74,6 +102,18 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
    */
   void Stop();
 
+  /**
+   * Reads the next samples to play into the given buffer.  This should only be
+   * called in pull mode, from the device's thread.  This doesn't lock or
+   * allocate, so it can be called from a real-time audio callback.
+   *
+   * @param dest The buffer to read into.
+   * @param size The number of bytes to read.
+   * @return The number of bytes read.  If there isn't enough buffered, the
+   *   caller should fill the remaining bytes with silence.
+   */
+  size_t ReadSamples(uint8_t* dest, size_t size);
+
  private:
   enum class SyncStatus {
     Success,
@@ -86,7 +126,8 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
    * frame.  The device should start paused.
    *
    * If the audio device is already initialized, this must reset it first.  If
-   * there is any buffered audio, that should be dropped.
+   * there is any buffered audio, that should be dropped.  In pull mode, the
+   * device must not read samples until it is started with SetDeviceState.
    *
    * @param frame The frame to initialize for.
    * @param volume The current effective volume.
@@ -98,23 +139,24 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
 
   /**
    * Appends the given data to the end of the audio buffer.  It is assumed the
-   * data is copied into the buffer.
+   * data is copied into the buffer.  Push devices must override this; by
+   * default, this writes to the buffer ReadSamples reads from.
    *
    * @param data The data to buffer.
    * @param size The number of bytes in data.
    * @return True on success, false on error.
    */
-  virtual bool AppendBuffer(const uint8_t* data, size_t size) = 0;
+  virtual bool AppendBuffer(const uint8_t* data, size_t size);
 
   /** Clears any already-buffered audio data in the device. */
-  virtual void ClearBuffer() = 0;
+  virtual void ClearBuffer();
 
   /**
    * Returns the number of bytes that are currently buffered.  It is preferred
    * to return the exact value based on what the hardware is playing; but this
    * may only return the amount internally buffered.
    */
-  virtual size_t GetBytesBuffered() const = 0;
+  virtual size_t GetBytesBuffered() const;
 
   /** Changes whether the device is playing or paused. */
   virtual void SetDeviceState(bool is_playing) = 0;
@@ -126,6 +168,12 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
    */
   virtual void UpdateVolume(double volume) = 0;
 
+  /**
+   * Appends the given samples to the device, stretching them if we aren't
+   * playing at normal speed.
+   */
+  bool AppendSamples(const uint8_t* data, size_t size);
+
   /** Fills the audio device with the given number of bytes of silence. */
   bool FillSilence(size_t bytes);
 
@@ -139,6 +187,12 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
 
   bool WriteFrame(std::shared_ptr<DecodedFrame> frame, size_t sync_bytes);
 
+  /**
+   * Prepares to wait for a frame to be added, if we don't find one.  This must
+   * be called before looking for the next frame.
+   */
+  void WillWaitForFrame();
+
   void SetClock(const util::Clock* clock);
 
   void ThreadMain();
@@ -149,18 +203,34 @@ class AudioRendererCommon : public AudioRenderer, MediaPlayer::Client {
   void OnPlaybackRateChanged(double old_rate, double new_rate) override;
   void OnSeeking() override;
 
+  void OnFrameAdded() override;
 
   friend class AudioRendererCommonTest;
   mutable Mutex mutex_;
   ThreadEvent<void> on_play_;
+  const DeviceMode mode_;
+  // Holds the samples the device reads in pull mode.
+  AudioRingBuffer ring_;
+  // Set while waiting for the stream to get a frame; this is read without the
+  // lock since OnFrameAdded can't lock |mutex_|.
+  std::atomic<bool> waiting_for_frame_;
 
   const util::Clock* clock_;
   const MediaPlayer* player_;
   const DecodedStream* input_;
 
+  // Holds the packed samples of planar frames; reused to avoid allocating for
+  // every frame.
+  std::vector<uint8_t> interleave_buffer_;
+  AudioTimeStretcher stretcher_;
+  // The playback rate the buffered samples were stretched for.
+  double rate_;
   std::shared_ptr<DecodedFrame> cur_frame_;
   double sync_time_;
   uint64_t bytes_written_;
+  // The ring buffer write position at |sync_time_|, used to find how much has
+  // been played since then.
+  uint64_t sync_position_;
   double volume_;
   bool muted_;
   bool needs_resync_;
@@ -0,0 +1,97 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_ring_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace shaka {
+namespace media {
+
+AudioRingBuffer::AudioRingBuffer()
+    : capacity_(0), write_pos_(0), clear_pos_(0), read_pos_(0) {}
+
+AudioRingBuffer::~AudioRingBuffer() {}
+
+void AudioRingBuffer::Reset(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  if (size != capacity_) {
+    data_.reset(new uint8_t[size]);
+    capacity_ = size;
+  }
+  write_pos_ = 0;
+  clear_pos_ = 0;
+  read_pos_ = 0;
+}
+
+bool AudioRingBuffer::Write(const uint8_t* data, size_t size) {
+  // Cleared data may still be in use by the consumer until its next read, so
+  // only the space it has actually read can be overwritten.
+  const uint64_t write = write_pos_.load(std::memory_order_relaxed);
+  const uint64_t read = read_pos_.load(std::memory_order_acquire);
+  if (size > capacity_ - static_cast<size_t>(write - read))
+    return false;
+
+  // The data may wrap around the end of the buffer, so copy in two parts.
+  const size_t offset = static_cast<size_t>(write & (capacity_ - 1));
+  const size_t first = std::min(size, capacity_ - offset);
+  std::memcpy(data_.get() + offset, data, first);
+  std::memcpy(data_.get(), data + first, size - first);
+
+  write_pos_.store(write + size, std::memory_order_release);
+  return true;
+}
+
+void AudioRingBuffer::Clear() {
+  clear_pos_.store(write_pos_.load(std::memory_order_relaxed),
+                   std::memory_order_release);
+}
+
+size_t AudioRingBuffer::Read(uint8_t* dest, size_t size) {
+  // Load the read positions before |write_pos_|.  |clear_pos_| is never past
+  // |write_pos_|, but the producer can Write() and Clear() between the loads;
+  // loading |write_pos_| first could give a clear position after it.
+  const uint64_t read =
+      std::max(read_pos_.load(std::memory_order_relaxed),
+               clear_pos_.load(std::memory_order_acquire));
+  const uint64_t write = write_pos_.load(std::memory_order_acquire);
+  const size_t to_read =
+      std::min<size_t>(size, static_cast<size_t>(write - read));
+
+  const size_t offset = static_cast<size_t>(read & (capacity_ - 1));
+  const size_t first = std::min(to_read, capacity_ - offset);
+  std::memcpy(dest, data_.get() + offset, first);
+  std::memcpy(dest + first, data_.get(), to_read - first);
+
+  read_pos_.store(read + to_read, std::memory_order_release);
+  return to_read;
+}
+
+size_t AudioRingBuffer::ReadableBytes() const {
+  // As in Read(), the write position must be loaded last.
+  const uint64_t read = read_position();
+  return static_cast<size_t>(write_pos_.load(std::memory_order_acquire) -
+                             read);
+}
+
+uint64_t AudioRingBuffer::read_position() const {
+  return std::max(read_pos_.load(std::memory_order_acquire),
+                  clear_pos_.load(std::memory_order_acquire));
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_AUDIO_RING_BUFFER_H_
+#define SHAKA_EMBEDDED_MEDIA_AUDIO_RING_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * A fixed-size, lock-free ring buffer of bytes with a single producer and a
+ * single consumer.  This is used to pass samples from the renderer thread to
+ * a real-time audio callback; the consumer side never locks or allocates.
+ *
+ * Positions are counted in bytes since the buffer was reset and never wrap,
+ * so they can also be used to track how much has been played.
+ *
+ * Write() and Clear() must only be called by the producer; Read() must only be
+ * called by the consumer.  Reset() must only be called while neither side is
+ * running.
+ */
+class AudioRingBuffer {
+ public:
+  AudioRingBuffer();
+  ~AudioRingBuffer();
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(AudioRingBuffer);
+
+  /** @return The number of bytes the buffer can hold. */
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /**
+   * Drops all the data and changes the size of the buffer.  The capacity is
+   * rounded up to a power of 2.
+   */
+  void Reset(size_t capacity);
+
+  /**
+   * Copies the given data into the buffer.  Data is only written if all of it
+   * fits, so samples are never split.  Space used by cleared data is only freed
+   * once the consumer reads again.
+   * @return True on success, false if there isn't enough room.
+   */
+  bool Write(const uint8_t* data, size_t size);
+
+  /**
+   * Drops the data that hasn't been read yet.  The consumer will skip it on
+   * its next read.
+   */
+  void Clear();
+
+  /**
+   * Reads up to |size| bytes from the buffer.
+   * @return The number of bytes read.
+   */
+  size_t Read(uint8_t* dest, size_t size);
+
+  /** @return The number of bytes that can be read right now. */
+  size_t ReadableBytes() const;
+
+  /** @return The total number of bytes written since the last Reset(). */
+  uint64_t write_position() const {
+    return write_pos_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @return The total number of bytes read or dropped since the last Reset().
+   */
+  uint64_t read_position() const;
+
+ private:
+  std::unique_ptr<uint8_t[]> data_;
+  size_t capacity_;
+  // Only changed by the producer.
+  std::atomic<uint64_t> write_pos_;
+  // The position of the last Clear(); the consumer skips to here.
+  std::atomic<uint64_t> clear_pos_;
+  // Only changed by the consumer.
+  std::atomic<uint64_t> read_pos_;
+};
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_AUDIO_RING_BUFFER_H_
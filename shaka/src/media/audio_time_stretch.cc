@@ -0,0 +1,466 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_time_stretch.h"
+
+#include <glog/logging.h>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/** The duration, in seconds, of each cross-fade. */
+constexpr const double kOverlapSeconds = 0.01;
+
+/**
+ * How far, in seconds, to search in each direction for a matching segment.
+ * This should be at least half the period of the lowest expected pitch.
+ */
+constexpr const double kSearchSeconds = 0.008;
+
+/** Positions are first checked with this step, then refined around the best. */
+constexpr const size_t kCoarseStep = 4;
+
+/** The number of extra segments of input to buffer at a time. */
+constexpr const size_t kBlockSegments = 4;
+
+constexpr const double kPi = 3.14159265358979323846;
+
+template <typename T>
+T Load(const uint8_t* src) {
+  T ret;
+  std::memcpy(&ret, src, sizeof(T));
+  return ret;
+}
+
+template <typename T>
+void Store(uint8_t* dest, T value) {
+  std::memcpy(dest, &value, sizeof(T));
+}
+
+/** Rounds and clamps the given value to the range of |T|. */
+template <typename T>
+T Saturate(double value) {
+  const double clamped =
+      std::min(std::max(std::round(value),
+                        static_cast<double>(std::numeric_limits<T>::min())),
+               static_cast<double>(std::numeric_limits<T>::max()));
+  return static_cast<T>(clamped);
+}
+
+size_t SampleSize(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::PackedU8:
+    case SampleFormat::PlanarU8:
+      return 1;
+    case SampleFormat::PackedS16:
+    case SampleFormat::PlanarS16:
+      return 2;
+    case SampleFormat::PackedS32:
+    case SampleFormat::PlanarS32:
+    case SampleFormat::PackedFloat:
+    case SampleFormat::PlanarFloat:
+      return 4;
+    case SampleFormat::PackedS64:
+    case SampleFormat::PlanarS64:
+    case SampleFormat::PackedDouble:
+    case SampleFormat::PlanarDouble:
+      return 8;
+    default:
+      LOG(DFATAL) << "Unsupported sample format: " << format;
+      return 1;
+  }
+}
+
+void S16ToFloat(const uint8_t* src, size_t count, float* dest) {
+  constexpr const float kScale = 1.0f / 32768;
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(kScale);
+  for (; i + 8 <= count; i += 8) {
+    const __m128i value =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    // Sign-extend to 32-bits by putting each sample in the high half.
+    const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16);
+    const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16);
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+    _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= count; i += 8) {
+    const int16x8_t value =
+        vld1q_s16(reinterpret_cast<const int16_t*>(src + i * 2));
+    vst1q_f32(dest + i,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(value))),
+                          kScale));
+    vst1q_f32(dest + i + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(value))),
+                          kScale));
+  }
+#endif
+  for (; i < count; i++)
+    dest[i] = Load<int16_t>(src + i * 2) * kScale;
+}
+
+void FloatToS16(const float* src, size_t count, uint8_t* dest) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(32768);
+  for (; i + 8 <= count; i += 8) {
+    const __m128i low =
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+    const __m128i high =
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+    // This saturates, so 1.0 becomes 32767.
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 2),
+                     _mm_packs_epi32(low, high));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= count; i += 8) {
+    const int32x4_t low = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), 32768));
+    const int32x4_t high =
+        vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), 32768));
+    vst1q_s16(reinterpret_cast<int16_t*>(dest + i * 2),
+              vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+  }
+#endif
+  for (; i < count; i++)
+    Store<int16_t>(dest + i * 2, Saturate<int16_t>(src[i] * 32768.0));
+}
+
+/** Converts |count| samples of the given format to float in [-1, 1]. */
+void ToFloat(SampleFormat format, const uint8_t* src, size_t count,
+             float* dest) {
+  switch (format) {
+    case SampleFormat::PackedS16:
+    case SampleFormat::PlanarS16:
+      S16ToFloat(src, count, dest);
+      break;
+    case SampleFormat::PackedFloat:
+    case SampleFormat::PlanarFloat:
+      std::memcpy(dest, src, count * sizeof(float));
+      break;
+    case SampleFormat::PackedU8:
+    case SampleFormat::PlanarU8:
+      for (size_t i = 0; i < count; i++)
+        dest[i] = (src[i] - 128) / 128.0f;
+      break;
+    case SampleFormat::PackedS32:
+    case SampleFormat::PlanarS32:
+      for (size_t i = 0; i < count; i++)
+        dest[i] = static_cast<float>(Load<int32_t>(src + i * 4) / 2147483648.0);
+      break;
+    case SampleFormat::PackedS64:
+    case SampleFormat::PlanarS64:
+      for (size_t i = 0; i < count; i++) {
+        dest[i] = static_cast<float>(Load<int64_t>(src + i * 8) /
+                                     9223372036854775808.0);
+      }
+      break;
+    case SampleFormat::PackedDouble:
+    case SampleFormat::PlanarDouble:
+      for (size_t i = 0; i < count; i++)
+        dest[i] = static_cast<float>(Load<double>(src + i * 8));
+      break;
+    default:
+      LOG(DFATAL) << "Unsupported sample format: " << format;
+      break;
+  }
+}
+
+/** Converts |count| float samples back to the given format. */
+void FromFloat(SampleFormat format, const float* src, size_t count,
+               uint8_t* dest) {
+  switch (format) {
+    case SampleFormat::PackedS16:
+    case SampleFormat::PlanarS16:
+      FloatToS16(src, count, dest);
+      break;
+    case SampleFormat::PackedFloat:
+    case SampleFormat::PlanarFloat:
+      std::memcpy(dest, src, count * sizeof(float));
+      break;
+    case SampleFormat::PackedU8:
+    case SampleFormat::PlanarU8:
+      for (size_t i = 0; i < count; i++)
+        dest[i] = Saturate<uint8_t>(src[i] * 128.0 + 128);
+      break;
+    case SampleFormat::PackedS32:
+    case SampleFormat::PlanarS32:
+      for (size_t i = 0; i < count; i++)
+        Store<int32_t>(dest + i * 4, Saturate<int32_t>(src[i] * 2147483648.0));
+      break;
+    case SampleFormat::PackedS64:
+    case SampleFormat::PlanarS64:
+      for (size_t i = 0; i < count; i++) {
+        // Doubles near the limit round up past it, so clamp the float first.
+        const double value = std::min(std::max(src[i], -1.0f), 0.99999994f);
+        Store<int64_t>(dest + i * 8,
+                       static_cast<int64_t>(value * 9223372036854775808.0));
+      }
+      break;
+    case SampleFormat::PackedDouble:
+    case SampleFormat::PlanarDouble:
+      for (size_t i = 0; i < count; i++)
+        Store<double>(dest + i * 8, src[i]);
+      break;
+    default:
+      LOG(DFATAL) << "Unsupported sample format: " << format;
+      break;
+  }
+}
+
+/**
+ * Calculates the dot product of |a| and |b|, which measures how similar they
+ * are.
+ * @param energy [OUT] Will contain the dot product of |b| with itself.
+ */
+float Correlate(const float* a, const float* b, size_t count, float* energy) {
+  float dot = 0;
+  float sum = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128 dots = _mm_setzero_ps();
+  __m128 sums = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    const __m128 x = _mm_loadu_ps(a + i);
+    const __m128 y = _mm_loadu_ps(b + i);
+    dots = _mm_add_ps(dots, _mm_mul_ps(x, y));
+    sums = _mm_add_ps(sums, _mm_mul_ps(y, y));
+  }
+  float parts[4];
+  _mm_storeu_ps(parts, dots);
+  dot = parts[0] + parts[1] + parts[2] + parts[3];
+  _mm_storeu_ps(parts, sums);
+  sum = parts[0] + parts[1] + parts[2] + parts[3];
+#elif defined(__ARM_NEON)
+  float32x4_t dots = vdupq_n_f32(0);
+  float32x4_t sums = vdupq_n_f32(0);
+  for (; i + 4 <= count; i += 4) {
+    const float32x4_t x = vld1q_f32(a + i);
+    const float32x4_t y = vld1q_f32(b + i);
+    dots = vmlaq_f32(dots, x, y);
+    sums = vmlaq_f32(sums, y, y);
+  }
+  dot = vgetq_lane_f32(dots, 0) + vgetq_lane_f32(dots, 1) +
+        vgetq_lane_f32(dots, 2) + vgetq_lane_f32(dots, 3);
+  sum = vgetq_lane_f32(sums, 0) + vgetq_lane_f32(sums, 1) +
+        vgetq_lane_f32(sums, 2) + vgetq_lane_f32(sums, 3);
+#endif
+  for (; i < count; i++) {
+    dot += a[i] * b[i];
+    sum += b[i] * b[i];
+  }
+  *energy = sum;
+  return dot;
+}
+
+/** Fades from |from| to |to| using the given weights of |to|. */
+void CrossFade(const float* from, const float* to, const float* window,
+               size_t count, float* dest) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    const __m128 x = _mm_loadu_ps(from + i);
+    const __m128 y = _mm_loadu_ps(to + i);
+    const __m128 w = _mm_loadu_ps(window + i);
+    _mm_storeu_ps(dest + i, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), w)));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    const float32x4_t x = vld1q_f32(from + i);
+    const float32x4_t y = vld1q_f32(to + i);
+    const float32x4_t w = vld1q_f32(window + i);
+    vst1q_f32(dest + i, vmlaq_f32(x, vsubq_f32(y, x), w));
+  }
+#endif
+  for (; i < count; i++)
+    dest[i] = from[i] + (to[i] - from[i]) * window[i];
+}
+
+}  // namespace
+
+AudioTimeStretcher::AudioTimeStretcher()
+    : format_(SampleFormat::Unknown),
+      channel_count_(0),
+      sample_size_(0),
+      rate_(1),
+      overlap_(0),
+      search_(0),
+      capacity_(0),
+      input_count_(0),
+      skip_(0),
+      position_(0),
+      started_(false) {}
+
+AudioTimeStretcher::~AudioTimeStretcher() {}
+
+void AudioTimeStretcher::Reset(SampleFormat format, size_t channel_count,
+                               size_t sample_rate, double rate) {
+  DCHECK(IsRateSupported(rate));
+  DCHECK_GT(channel_count, 0u);
+  format_ = format;
+  channel_count_ = channel_count;
+  sample_size_ = SampleSize(format);
+  rate_ = rate;
+  overlap_ =
+      std::max<size_t>(static_cast<size_t>(sample_rate * kOverlapSeconds), 1);
+  search_ =
+      std::max<size_t>(static_cast<size_t>(sample_rate * kSearchSeconds), 1);
+  // Each segment needs its cross-fade and the part after it (for the next
+  // cross-fade), plus room to search on either side.
+  capacity_ = 2 * search_ + (2 + kBlockSegments) * overlap_;
+
+  // Use a raised-cosine fade; the two halves sum to 1, so the volume is
+  // constant across the fade.
+  window_.resize(overlap_ * channel_count);
+  for (size_t i = 0; i < overlap_; i++) {
+    const float weight =
+        static_cast<float>(0.5 - 0.5 * std::cos(kPi * (i + 0.5) / overlap_));
+    std::fill(window_.begin() + i * channel_count,
+              window_.begin() + (i + 1) * channel_count, weight);
+  }
+
+  input_.resize(capacity_ * channel_count);
+  mono_.resize(capacity_);
+  tail_.resize(overlap_ * channel_count);
+  tail_mono_.resize(overlap_);
+  mix_.resize(overlap_ * channel_count);
+  // The most segments a single call can produce is when the input buffer is
+  // full and segments are as close together as possible.
+  const size_t max_segments =
+      static_cast<size_t>(capacity_ / (overlap_ * rate)) + 2;
+  output_.resize(max_segments * overlap_ * channel_count * sample_size_);
+
+  input_count_ = 0;
+  skip_ = 0;
+  position_ = 0;
+  started_ = false;
+}
+
+size_t AudioTimeStretcher::Process(const uint8_t* data, size_t size,
+                                   size_t* consumed) {
+  const size_t frame_size = sample_size_ * channel_count_;
+  size_t available = size / frame_size;
+
+  // At fast rates, segments can skip past input we haven't seen yet.
+  const size_t skipped = std::min(skip_, available);
+  skip_ -= skipped;
+  available -= skipped;
+  data += skipped * frame_size;
+
+  const size_t count = std::min(available, capacity_ - input_count_);
+  float* input = input_.data() + input_count_ * channel_count_;
+  ToFloat(format_, data, count * channel_count_, input);
+  for (size_t i = 0; i < count; i++) {
+    float sum = 0;
+    for (size_t channel = 0; channel < channel_count_; channel++)
+      sum += input[i * channel_count_ + channel];
+    mono_[input_count_ + i] = sum;
+  }
+  input_count_ += count;
+  *consumed = (skipped + count) * frame_size;
+
+  size_t segments = 0;
+  while (true) {
+    const size_t target = static_cast<size_t>(position_);
+    if (target + search_ + 2 * overlap_ > input_count_)
+      break;
+    DCHECK_LE((segments + 1) * overlap_ * frame_size, output_.size());
+    AddSegment(started_ ? FindSegment(target) : target, segments * overlap_);
+    started_ = true;
+    position_ += overlap_ * rate_;
+    segments++;
+  }
+
+  // Drop the input before where the next segment can start.
+  const size_t target = static_cast<size_t>(position_);
+  const size_t drop = target > search_ ? target - search_ : 0;
+  if (drop >= input_count_) {
+    skip_ += drop - input_count_;
+    input_count_ = 0;
+  } else if (drop > 0) {
+    const size_t remaining = input_count_ - drop;
+    std::memmove(input_.data(), input_.data() + drop * channel_count_,
+                 remaining * channel_count_ * sizeof(float));
+    std::memmove(mono_.data(), mono_.data() + drop, remaining * sizeof(float));
+    input_count_ = remaining;
+  }
+  position_ -= drop;
+
+  return segments * overlap_ * frame_size;
+}
+
+size_t AudioTimeStretcher::FindSegment(size_t target) const {
+  const size_t first = target > search_ ? target - search_ : 0;
+  const size_t last = target + search_;
+
+  // Normalize by the energy so louder segments aren't preferred.
+  size_t best = target;
+  float best_score = -std::numeric_limits<float>::infinity();
+  auto check = [&](size_t pos) {
+    float energy;
+    const float dot =
+        Correlate(tail_mono_.data(), mono_.data() + pos, overlap_, &energy);
+    const float score = dot / std::sqrt(energy + 1e-9f);
+    if (score > best_score) {
+      best_score = score;
+      best = pos;
+    }
+  };
+
+  // Check the ideal position first so it wins ties (e.g. for silence).
+  check(target);
+  for (size_t pos = first; pos <= last; pos += kCoarseStep)
+    check(pos);
+  const size_t center = best;
+  const size_t start =
+      center > first + kCoarseStep - 1 ? center - (kCoarseStep - 1) : first;
+  const size_t end = std::min(last, center + kCoarseStep - 1);
+  for (size_t pos = start; pos <= end; pos++)
+    check(pos);
+  return best;
+}
+
+void AudioTimeStretcher::AddSegment(size_t position, size_t output_offset) {
+  const size_t count = overlap_ * channel_count_;
+  const float* segment = input_.data() + position * channel_count_;
+  uint8_t* dest =
+      output_.data() + output_offset * channel_count_ * sample_size_;
+  if (started_) {
+    CrossFade(tail_.data(), segment, window_.data(), count, mix_.data());
+    FromFloat(format_, mix_.data(), count, dest);
+  } else {
+    FromFloat(format_, segment, count, dest);
+  }
+
+  // The next segment fades in over what would have followed this one.
+  std::memcpy(tail_.data(), segment + count, count * sizeof(float));
+  std::memcpy(tail_mono_.data(), mono_.data() + position + overlap_,
+              overlap_ * sizeof(float));
+}
+
+}  // namespace media
+}  // namespace shaka
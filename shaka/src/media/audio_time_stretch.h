@@ -0,0 +1,138 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_AUDIO_TIME_STRETCH_H_
+#define SHAKA_EMBEDDED_MEDIA_AUDIO_TIME_STRETCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "shaka/media/frames.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * Changes the speed of audio without changing its pitch.  This uses WSOLA
+ * (waveform similarity overlap-add): the output is built from short segments
+ * of the input that are cross-faded together.  Segments are taken from the
+ * input at |rate| times the output speed, and each one is shifted slightly to
+ * the position that best lines up with the end of the previous one, so the
+ * waveforms match and the seams aren't audible.
+ *
+ * Samples are processed in fixed-size blocks; all the buffers are allocated
+ * in Reset(), so processing never allocates.  Samples are stretched as float;
+ * converting 16-bit and float samples and the inner loops use SIMD
+ * instructions when available.
+ *
+ * This type is not thread-safe.
+ */
+class AudioTimeStretcher {
+ public:
+  /** The slowest rate that can be played. */
+  static constexpr const double kMinRate = 0.5;
+  /** The fastest rate that can be played. */
+  static constexpr const double kMaxRate = 4;
+
+  AudioTimeStretcher();
+  ~AudioTimeStretcher();
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(AudioTimeStretcher);
+
+  /** @return Whether audio can be played at the given rate. */
+  static bool IsRateSupported(double rate) {
+    return rate >= kMinRate && rate <= kMaxRate;
+  }
+
+  /**
+   * Prepares to stretch a new stream of samples.  This drops any buffered
+   * samples.
+   *
+   * @param format The format of the samples.  Planar formats are treated as
+   *   their packed equivalent; the samples must already be interleaved.
+   * @param channel_count The number of channels.
+   * @param sample_rate The sample rate, in Hz.
+   * @param rate The playback rate; this must be supported.
+   */
+  void Reset(SampleFormat format, size_t channel_count, size_t sample_rate,
+             double rate);
+
+  /**
+   * Stretches the given interleaved samples.  This consumes as much input as
+   * fits in the internal buffer and produces as much output as possible.  Call
+   * this again with the remaining input until all of it is consumed.  Some
+   * input is held back for the next call, since matching segments needs to
+   * look ahead.
+   *
+   * @param data The samples to stretch.
+   * @param size The number of bytes in |data|.
+   * @param consumed [OUT] Will contain the number of input bytes used.
+   * @return The number of output bytes, stored in output().
+   */
+  size_t Process(const uint8_t* data, size_t size, size_t* consumed);
+
+  /** @return The samples produced by the last call to Process. */
+  const uint8_t* output() const {
+    return output_.data();
+  }
+
+ private:
+  /** @return The best input position for the next segment near |target|. */
+  size_t FindSegment(size_t target) const;
+
+  /** Adds a segment at the given input position to the output. */
+  void AddSegment(size_t position, size_t output_offset);
+
+  SampleFormat format_;
+  size_t channel_count_;
+  size_t sample_size_;
+  double rate_;
+
+  // The number of samples (per channel) of each cross-fade, which is also the
+  // number of samples output per segment.
+  size_t overlap_;
+  // The number of samples (per channel) to search in each direction.
+  size_t search_;
+  // The number of samples (per channel) the input buffer can hold.
+  size_t capacity_;
+
+  // The cross-fade weights, repeated for each channel.
+  std::vector<float> window_;
+  // The buffered input, as interleaved float samples.
+  std::vector<float> input_;
+  // The sum of the channels of |input_|, used to match segments.
+  std::vector<float> mono_;
+  size_t input_count_;
+  // The number of input samples to drop before buffering more.
+  size_t skip_;
+  // The part of the input that followed the previous segment; the next
+  // segment is cross-faded with this.
+  std::vector<float> tail_;
+  std::vector<float> tail_mono_;
+  // Holds one cross-faded segment before it is converted.
+  std::vector<float> mix_;
+  std::vector<uint8_t> output_;
+
+  // The ideal input position of the next segment, relative to |input_|.
+  double position_;
+  bool started_;
+};
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_AUDIO_TIME_STRETCH_H_
@@ -28,6 +28,21 @@ Decoder::Decoder() {}
 Decoder::~Decoder() {}
 // \endcond Doxygen_Skip
 
+MediaStatus Decoder::DecodeFrames(
+    const std::vector<std::shared_ptr<EncodedFrame>>& input,
+    const eme::Implementation* eme,
+    std::vector<std::shared_ptr<DecodedFrame>>* frames, size_t* decoded_count,
+    std::string* extra_info) {
+  *decoded_count = 0;
+  for (auto& frame : input) {
+    const MediaStatus status = Decode(frame, eme, frames, extra_info);
+    if (status != MediaStatus::Success)
+      return status;
+    (*decoded_count)++;
+  }
+  return MediaStatus::Success;
+}
+
 std::unique_ptr<Decoder> Decoder::CreateDefaultDecoder() {
 #if defined(HAS_FFMPEG_DECODER)
   return std::unique_ptr<Decoder>(new ffmpeg::FFmpegDecoder);
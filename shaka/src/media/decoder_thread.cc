@@ -17,27 +17,93 @@
 #include <glog/logging.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "src/util/clock.h"
-#include "src/util/utils.h"
 
 namespace shaka {
 namespace media {
 
 namespace {
 
-/** The number of seconds to keep decoded ahead of the playhead. */
-constexpr const double kDecodeBufferSize = 1;
+/**
+ * The number of seconds of decoded frames to keep behind the playhead, unless
+ * that would go over the memory limit.
+ */
+constexpr const double kDecodedBehind = 1;
+
+/**
+ * If decoding takes more than this fraction of real time, decode further ahead
+ * so a run of slow frames (e.g. a complex GOP) doesn't run out the buffer.
+ */
+constexpr const double kComfortableLoad = 0.5;
+
+/**
+ * When playback runs out of decoded frames, multiply the decode-ahead by this,
+ * up to kMaxUnderrunBoost.
+ */
+constexpr const double kUnderrunGrowth = 1.5;
+constexpr const double kMaxUnderrunBoost = 4;
+
+/** The minimum number of frames to decode ahead, even over the memory limit. */
+constexpr const double kMinFramesAhead = 2;
+
+/** The weight of a new sample in the moving averages of the decode stats. */
+constexpr const double kStatsWeight = 0.1;
+
+/**
+ * The maximum number of frames to decode at once.  The lock is held while
+ * decoding, so this limits how long a seek has to wait.
+ */
+constexpr const size_t kMaxFramesPerBatch = 8;
 
 /** The number of seconds gap before we assume we are at the end. */
 constexpr const double kEndDelta = 0.1;
 
-double DecodedAheadOf(StreamBase* stream, double time) {
-  for (auto& range : stream->GetBufferedRanges()) {
+/**
+ * The maximum number of seconds to wait before checking the state again.  Most
+ * changes wake the thread directly, but some (e.g. playback rate changes or a
+ * CDM that doesn't report key changes) don't.
+ */
+constexpr const double kMaxWaitTime = 0.2;
+
+/** The playback rate at which we only decode keyframes. */
+constexpr const double kMinTrickPlayRate = 4;
+
+/**
+ * The maximum number of keyframes to decode per (wall-clock) second when only
+ * decoding keyframes.  At high rates, keyframes are skipped to stay under this.
+ */
+constexpr const double kTrickPlayFrameRate = 8;
+
+/**
+ * The number of (wall-clock) seconds to decode keyframes ahead of the playhead
+ * when only decoding keyframes.
+ */
+constexpr const double kTrickPlayLookAhead = 0.5;
+
+/**
+ * If two seeks happen within this many seconds, the app is scrubbing; we only
+ * decode the keyframe at each seek target until the seeks stop for this long.
+ */
+constexpr const double kScrubInterval = 0.25;
+
+double MovingAverage(double average, double sample) {
+  if (std::isnan(average))
+    return sample;
+  return average + (sample - average) * kStatsWeight;
+}
+
+double MonotonicSeconds() {
+  return util::Clock::Instance.GetMonotonicTime() / 1000.0;
+}
+
+double DecodedAheadOf(const StreamBase* stream, double time) {
+  for (auto& range : *stream->GetBufferedRangesSnapshot()) {
     if (range.end > time) {
       if (range.start < time + StreamBase::kMaxGapSize) {
         return range.end - std::max(time, range.start);
@@ -52,10 +118,12 @@ double DecodedAheadOf(StreamBase* stream, double time) {
 
 }  // namespace
 
-DecoderThread::DecoderThread(Client* client, DecodedStream* output)
+DecoderThread::DecoderThread(Client* client, DecodedStream* output,
+                             bool is_video)
     : mutex_("DecoderThread"),
-      signal_("DecoderChanged"),
+      waiting_for_frame_(false),
       client_(client),
+      is_video_(is_video),
       input_(nullptr),
       output_(output),
       decoder_(nullptr),
@@ -64,138 +132,433 @@ DecoderThread::DecoderThread(Client* client, DecodedStream* output)
       shutdown_(false),
       did_flush_(false),
       raised_waiting_event_(false),
-      thread_("Decoder", std::bind(&DecoderThread::ThreadMain, this)) {}
+      key_frames_only_(false),
+      last_seek_time_(-INFINITY),
+      scrub_end_time_(-INFINITY),
+      decode_ahead_(limits_.min_seconds),
+      frame_decode_time_(NAN),
+      frame_duration_(NAN),
+      frame_size_(NAN),
+      underrun_boost_(1),
+      underruns_(0),
+      in_underrun_(true),
+      decrypt_stage_(
+          MediaExecutor::GlobalThreadingPolicy().decrypt_jobs_per_stream),
+      job_("Decoder", /* pinned= */ false,
+           std::bind(&DecoderThread::DecodeStep, this)) {}
 
 DecoderThread::~DecoderThread() {
   {
     std::unique_lock<Mutex> lock(mutex_);
     shutdown_ = true;
-    signal_.SignalAllIfNotSet();
+    if (input_)
+      input_->RemoveClient(this);
+    eme::KeyStatusNotifier::Instance()->RemoveListener(this);
   }
-  thread_.join();
+  // Don't hold the lock since this waits for a running DecodeStep().
+  job_.Stop();
 }
 
 void DecoderThread::Attach(const ElementaryStream* input) {
   VLOG(2) << "Attach";
   std::unique_lock<Mutex> lock(mutex_);
+  if (input_)
+    input_->RemoveClient(this);
   input_ = input;
-  if (input && decoder_)
-    signal_.SignalAllIfNotSet();
+  input_cursor_ = ElementaryStream::Cursor(input);
+  decrypt_stage_.Attach(input);
+  if (input) {
+    input->AddClient(this);
+    Wake();
+  }
 }
 
 void DecoderThread::Detach() {
   VLOG(2) << "Detach";
   std::unique_lock<Mutex> lock(mutex_);
+  if (input_)
+    input_->RemoveClient(this);
   input_ = nullptr;
+  decrypt_stage_.Detach();
   Reset();
 }
 
 void DecoderThread::OnSeek() {
   VLOG(2) << "OnSeek";
   std::unique_lock<Mutex> lock(mutex_);
-  Reset();
+  const double now = MonotonicSeconds();
+  if (now - last_seek_time_ < kScrubInterval)
+    scrub_end_time_ = now + kScrubInterval;
+  last_seek_time_ = now;
+  // The playhead hasn't moved yet, so the next DecodeStep() decides whether
+  // the frames already decoded can be kept.  Only keyframes are decoded in
+  // key-frame-only mode, so there is nothing worth keeping.
+  if (key_frames_only_)
+    Reset();
+  Wake();
 }
 
 void DecoderThread::SetCdm(eme::Implementation* cdm) {
   VLOG(2) << "SetCdm: " << cdm;
   std::unique_lock<Mutex> lock(mutex_);
   cdm_ = cdm;
+  decrypt_stage_.SetCdm(cdm);
+  if (cdm)
+    eme::KeyStatusNotifier::Instance()->AddListener(cdm, this);
+  else
+    eme::KeyStatusNotifier::Instance()->RemoveListener(this);
+  Wake();
 }
 
 void DecoderThread::SetDecoder(Decoder* decoder) {
   VLOG(2) << "SetDecoder: " << decoder;
   std::unique_lock<Mutex> lock(mutex_);
   decoder_ = decoder;
-  if (decoder && input_)
-    signal_.SignalAllIfNotSet();
+  if (decoder)
+    Wake();
+}
+
+void DecoderThread::SetPriority(MediaPriority priority) {
+  job_.SetPriority(priority);
+  decrypt_stage_.SetPriority(priority);
 }
 
-void DecoderThread::ThreadMain() {
+void DecoderThread::SetDecodeBufferLimits(const DecodeBufferLimits& limits) {
   std::unique_lock<Mutex> lock(mutex_);
-  while (!shutdown_) {
-    if (!input_ || !decoder_) {
-      if (input_)
-        LOG(DFATAL) << "No decoder provided and no default decoder exists";
+  limits_ = limits;
+  decrypt_stage_.SetMaxBytes(limits.max_bytes);
+  double decode_behind;
+  GetBufferTargets(client_->PlaybackRate(), &decode_ahead_, &decode_behind);
+  Wake();
+}
 
-      signal_.ResetAndWaitWhileUnlocked(lock);
-      continue;
-    }
+DecodingStats DecoderThread::GetStats() const {
+  std::unique_lock<Mutex> lock(mutex_);
+  DecodingStats ret;
+  ret.underruns = underruns_;
+  ret.decode_ahead = decode_ahead_;
+  ret.frame_decode_time =
+      std::isnan(frame_decode_time_) ? 0 : frame_decode_time_;
+  ret.frame_size =
+      std::isnan(frame_size_) ? 0 : static_cast<size_t>(frame_size_);
+  return ret;
+}
+
+void DecoderThread::OnFrameAdded() {
+  // Don't wake up for every demuxed frame while we are busy decoding or have
+  // enough decoded already.
+  if (waiting_for_frame_)
+    Wake();
+}
+
+void DecoderThread::OnKeyStatusChange() {
+  VLOG(2) << "Key status changed";
+  Wake();
+}
 
-    const double cur_time = client_->CurrentTime();
-    double last_time = last_frame_time_;
+double DecoderThread::DecodeStep() {
+  std::unique_lock<Mutex> lock(mutex_);
+  if (shutdown_)
+    return INFINITY;
+  if (!input_ || !decoder_) {
+    if (input_)
+      LOG(DFATAL) << "No decoder provided and no default decoder exists";
+    return INFINITY;
+  }
+
+  const double cur_time = client_->CurrentTime();
+  const double rate = client_->PlaybackRate();
+  const bool scrubbing = MonotonicSeconds() < scrub_end_time_;
+  // Audio can be played at high rates and every frame is needed, so only
+  // video skips frames.
+  const bool key_frames_only =
+      is_video_ && (scrubbing || rate >= kMinTrickPlayRate);
+  if (key_frames_only != key_frames_only_) {
+    VLOG(1) << (key_frames_only ? "Starting" : "Stopping")
+            << " key-frame-only decoding";
+    key_frames_only_ = key_frames_only;
+    // The decoded frames aren't continuous between the modes, so start over
+    // from the current time.  Keep the frame being displayed though.
+    last_frame_time_ = NAN;
+    did_flush_ = false;
+    output_->Remove(0, cur_time - StreamBase::kMaxGapSize);
+    output_->Remove(cur_time, INFINITY);
+  }
+  if (key_frames_only)
+    return DecodeKeyFrame(cur_time, rate, scrubbing);
 
-    if (DecodedAheadOf(output_, cur_time) > kDecodeBufferSize) {
-      VLOG(2) << "Enough buffered";
-      util::Unlocker<Mutex> unlock(&lock);
-      util::Clock::Instance.SleepSeconds(0.025);
-      continue;
+  double last_time = last_frame_time_;
+  if (!std::isnan(last_time) && !CanContinueDecoding(cur_time)) {
+    VLOG(2) << "Playhead moved away from the decoded frames";
+    Reset();
+    last_time = NAN;
+  }
+
+  double decode_behind;
+  GetBufferTargets(rate, &decode_ahead_, &decode_behind);
+  const double decoded_ahead = DecodedAheadOf(output_, cur_time);
+  if (decoded_ahead > decode_ahead_) {
+    VLOG(2) << "Enough buffered";
+    // Wait until the playhead moves far enough that we need to decode more.
+    double delay = kMaxWaitTime;
+    if (rate > 0 && client_->PlaybackState() == VideoPlaybackState::Playing)
+      delay = std::min(delay, (decoded_ahead - decode_ahead_) / rate);
+    return delay;
+  }
+
+  // Evict frames that are not near the current time.  This ensures we don't
+  // keep frames buffered forever.
+  output_->Remove(0, cur_time - decode_behind);
+
+  // Set this before looking for frames so if a frame is added after we look,
+  // OnFrameAdded will wake us up.
+  waiting_for_frame_ = true;
+  DCHECK(batch_.empty());
+  if (std::isnan(last_time)) {
+    decoder_->ResetDecoder();
+    // Move the time forward a bit to allow gaps at the start.  This will move
+    // backward to find a keyframe anyway.
+    auto frame = input_->GetFrame(cur_time + StreamBase::kMaxGapSize,
+                                  FrameLocation::KeyFrameBefore);
+    if (frame) {
+      batch_.emplace_back(frame);
+      input_cursor_.Seek(frame->dts);
     }
+  } else {
+    // Always decode the next frame, even if it is after a gap.  The cursor
+    // remembers where the last frame was, so this doesn't need to search.
+    input_cursor_.Seek(last_time);
+    input_cursor_.Read(1, HUGE_VAL, &batch_);
+  }
+  if (!batch_.empty()) {
+    waiting_for_frame_ = false;
+    // Decode the frames that follow in the same batch, as long as they are
+    // within the decode buffer.  Until we know how big the frames are, only
+    // decode one so the memory limit isn't exceeded.
+    const size_t max_frames =
+        std::isnan(frame_size_) ? 1 : kMaxFramesPerBatch;
+    input_cursor_.Read(max_frames - batch_.size(), cur_time + decode_ahead_,
+                       &batch_);
+  }
 
-    // Evict frames that are not near the current time.  This ensures we don't
-    // keep frames buffered forever.
-    output_->Remove(0, cur_time - kDecodeBufferSize);
-
-    std::shared_ptr<EncodedFrame> frame;
-    if (std::isnan(last_time)) {
-      decoder_->ResetDecoder();
-      // Move the time forward a bit to allow gaps at the start.  This will move
-      // backward to find a keyframe anyway.
-      frame = input_->GetFrame(cur_time + StreamBase::kMaxGapSize,
-                               FrameLocation::KeyFrameBefore);
+  if (batch_.empty()) {
+    if (!std::isnan(last_time) &&
+        last_time + kEndDelta >= client_->Duration() && !did_flush_) {
+      // If this is the last frame, pass the null to DecodeFrame, which will
+      // flush the decoder.
+      did_flush_ = true;
     } else {
-      frame = input_->GetFrame(last_time, FrameLocation::After);
+      const double time = std::isnan(last_time) ? cur_time : last_time;
+      VLOG(2) << "No frame available at: " << time;
+      // New frames will wake us up.  Still wake up periodically since the
+      // duration may change or the playhead may move into buffered content.
+      return kMaxWaitTime;
     }
+  }
 
-    if (!frame) {
-      if (!std::isnan(last_time) &&
-          last_time + kEndDelta >= client_->Duration() && !did_flush_) {
-        // If this is the last frame, pass the null to DecodeFrame, which will
-        // flush the decoder.
-        did_flush_ = true;
-      } else {
-        const double time = std::isnan(last_time) ? cur_time : last_time;
-        VLOG(2) << "No frame available at: " << time;
-        util::Unlocker<Mutex> unlock(&lock);
-        util::Clock::Instance.SleepSeconds(0.025);
-        continue;
-      }
+  return DecodeBatch(/* flush= */ false);
+}
+
+double DecoderThread::DecodeKeyFrame(double cur_time, double rate,
+                                     bool scrubbing) {
+  // Nothing wakes us up when the scrubbing stops, so wake up on our own.
+  double wait = kMaxWaitTime;
+  if (scrubbing)
+    wait = std::min(wait, scrub_end_time_ - MonotonicSeconds());
+
+  output_->Remove(0, cur_time - kDecodedBehind);
+
+  waiting_for_frame_ = true;
+  std::shared_ptr<EncodedFrame> frame;
+  if (std::isnan(last_frame_time_)) {
+    frame = input_->GetFrame(cur_time + StreamBase::kMaxGapSize,
+                             FrameLocation::KeyFrameBefore);
+  } else if (!scrubbing) {
+    // Skip keyframes that would be displayed too briefly to be seen, and any
+    // that the playhead has already passed.
+    const double next_time =
+        std::max(cur_time, last_frame_time_ + rate / kTrickPlayFrameRate);
+    frame = input_->GetFrame(next_time, FrameLocation::KeyFrameAfter);
+    if (frame && frame->pts > cur_time + rate * kTrickPlayLookAhead) {
+      VLOG(2) << "Enough keyframes decoded";
+      waiting_for_frame_ = false;
+      return std::min(
+          wait, (frame->pts - cur_time) / rate - kTrickPlayLookAhead);
     }
+  } else {
+    // While scrubbing, we only need the frame at the seek target, which we
+    // already decoded.
+    return wait;
+  }
+  if (!frame) {
+    VLOG(2) << "No keyframe available at: " << cur_time;
+    return wait;
+  }
+
+  // Decode the keyframe on its own, then flush the decoder so the frame is
+  // output now rather than waiting for the frames that follow it.
+  waiting_for_frame_ = false;
+  decoder_->ResetDecoder();
+  batch_.emplace_back(frame);
+  return DecodeBatch(/* flush= */ true);
+}
 
-    std::string error;
-    std::vector<std::shared_ptr<DecodedFrame>> decoded;
-    const MediaStatus decode_status =
-        decoder_->Decode(frame, cdm_, &decoded, &error);
-    if (decode_status == MediaStatus::KeyNotFound) {
-      VLOG(2) << "Key not found";
-      // If we don't have the required key, signal the <video> and wait.
-      if (!raised_waiting_event_) {
-        raised_waiting_event_ = true;
-        client_->OnWaitingForKey();
+double DecoderThread::DecodeBatch(bool flush) {
+  std::string error;
+  std::vector<std::shared_ptr<DecodedFrame>> decoded;
+  size_t decoded_count = 0;
+  MediaStatus decode_status = MediaStatus::Success;
+  if (!batch_.empty()) {
+    if (!flush) {
+      // Use the clear copies of any frames that were decrypted ahead.
+      for (auto& frame : batch_) {
+        auto decrypted = decrypt_stage_.TakeFrame(frame);
+        if (decrypted)
+          frame = std::move(decrypted);
       }
-      // TODO: Consider adding a signal for new keys so we can avoid polling and
-      // just wait on a condition variable.
-      util::Unlocker<Mutex> unlock(&lock);
-      util::Clock::Instance.SleepSeconds(0.2);
-      continue;
     }
-    if (decode_status != MediaStatus::Success) {
-      VLOG(2) << "Decoder error: " << error;
-      client_->OnError(error);
-      break;
+
+    const auto start = std::chrono::steady_clock::now();
+    decode_status = decoder_->DecodeFrames(batch_, cdm_, &decoded,
+                                           &decoded_count, &error);
+    // Keyframes decoded on their own are slower than usual, so only measure
+    // normal decoding.
+    if (!flush && decoded_count > 0) {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      UpdateStats(elapsed.count() / decoded_count, decoded);
     }
+  }
+  if (decode_status == MediaStatus::Success && (flush || batch_.empty())) {
+    // Passing nullptr flushes the decoder.
+    decode_status = decoder_->Decode(nullptr, cdm_, &decoded, &error);
+  }
+
+  // Check whether playback was waiting for these frames before adding them.
+  if (!flush && !decoded.empty())
+    CheckForUnderrun(client_->CurrentTime());
+
+  // Keep any frames decoded before an error; the next batch will start after
+  // the last frame that was decoded.
+  for (auto& decoded_frame : decoded) {
+    output_->AddFrame(decoded_frame);
+  }
+  if (decoded_count > 0)
+    last_frame_time_ = batch_[decoded_count - 1]->dts;
+  batch_.clear();
 
-    raised_waiting_event_ = false;
-    for (auto& decoded_frame : decoded) {
-      output_->AddFrame(decoded_frame);
+  if (decode_status == MediaStatus::KeyNotFound) {
+    VLOG(2) << "Key not found";
+    // If we don't have the required key, signal the <video> and wait.
+    if (!raised_waiting_event_) {
+      raised_waiting_event_ = true;
+      client_->OnWaitingForKey();
     }
+    // We'll be woken up when the CDM reports new keys.
+    return kMaxWaitTime;
+  }
+  if (decode_status != MediaStatus::Success) {
+    VLOG(2) << "Decoder error: " << error;
+    client_->OnError(error);
+    // Decoder errors are fatal, so stop decoding.
+    shutdown_ = true;
+    return INFINITY;
+  }
 
-    if (frame)
-      last_frame_time_ = frame->dts;
+  raised_waiting_event_ = false;
+  // Run again right away, but let other jobs run between batches.
+  return 0;
+}
+
+void DecoderThread::GetBufferTargets(double rate, double* ahead,
+                                     double* behind) const {
+  *behind = kDecodedBehind;
+  *ahead = limits_.min_seconds;
+  if (!std::isnan(frame_decode_time_) && frame_duration_ > 0) {
+    // The fraction of real time spent decoding.
+    const double load =
+        frame_decode_time_ / frame_duration_ * std::max(rate, 1.0);
+    *ahead *= std::max(load / kComfortableLoad, 1.0);
+  }
+  *ahead = std::max(std::min(*ahead * underrun_boost_, limits_.max_seconds),
+                    limits_.min_seconds);
+
+  if (limits_.max_bytes > 0 && frame_size_ > 0 && frame_duration_ > 0) {
+    const double max_seconds =
+        limits_.max_bytes / frame_size_ * frame_duration_;
+    if (*ahead + *behind > max_seconds) {
+      // Only keep the frame being displayed behind the playhead.
+      *behind = StreamBase::kMaxGapSize;
+      *ahead =
+          std::max(max_seconds - *behind, kMinFramesAhead * frame_duration_);
+    }
+  }
+}
+
+void DecoderThread::UpdateStats(
+    double frame_decode_time,
+    const std::vector<std::shared_ptr<DecodedFrame>>& decoded) {
+  frame_decode_time_ = MovingAverage(frame_decode_time_, frame_decode_time);
+  for (auto& frame : decoded) {
+    frame_size_ = MovingAverage(frame_size_, frame->EstimateSize());
+    if (frame->duration > 0)
+      frame_duration_ = MovingAverage(frame_duration_, frame->duration);
+  }
+}
+
+void DecoderThread::CheckForUnderrun(double cur_time) {
+  if (DecodedAheadOf(output_, cur_time) > 0) {
+    in_underrun_ = false;
+    return;
   }
+
+  // Only count it once playback has had decoded frames, and if there were
+  // frames to decode; otherwise this is a seek or the end of the input.
+  const VideoPlaybackState state = client_->PlaybackState();
+  if (in_underrun_ ||
+      (state != VideoPlaybackState::Playing &&
+       state != VideoPlaybackState::Buffering) ||
+      DecodedAheadOf(input_, cur_time) == 0) {
+    return;
+  }
+
+  in_underrun_ = true;
+  underruns_++;
+  underrun_boost_ = std::min(underrun_boost_ * kUnderrunGrowth,
+                             kMaxUnderrunBoost);
+  VLOG(1) << "Ran out of decoded frames at " << cur_time
+          << ", decoding further ahead";
+}
+
+bool DecoderThread::CanContinueDecoding(double cur_time) const {
+  // The decoder continues after the last frame decoded, so the playhead needs
+  // to be in the last decoded range.
+  auto ranges = output_->GetBufferedRangesSnapshot();
+  double decoded_end = last_frame_time_;
+  if (!ranges->empty()) {
+    if (cur_time + StreamBase::kMaxGapSize < ranges->back().start)
+      return false;
+    decoded_end = std::max(decoded_end, ranges->back().end);
+  }
+  // If playback ran out of decoded frames, the playhead waits at the end.
+  if (cur_time <= decoded_end + StreamBase::kMaxGapSize)
+    return true;
+
+  // The playhead is past the decoded frames.  Keep decoding from the last
+  // frame unless starting over from a later keyframe gets there sooner.
+  auto key_frame = input_->GetFrame(cur_time + StreamBase::kMaxGapSize,
+                                    FrameLocation::KeyFrameBefore);
+  return !key_frame || key_frame->dts <= last_frame_time_;
+}
+
+void DecoderThread::Wake() {
+  job_.Wake();
 }
 
 void DecoderThread::Reset() {
   last_frame_time_ = NAN;
+  // Playback waits for the first frames after a seek; that isn't an underrun.
+  in_underrun_ = true;
   did_flush_ = false;
   // Remove all the existing frames.  We'll decode them again anyway and this
   // ensures we don't keep future frames forever when seeking backwards.
@@ -15,28 +15,44 @@
 #ifndef SHAKA_EMBEDDED_MEDIA_DECODER_THREAD_H_
 #define SHAKA_EMBEDDED_MEDIA_DECODER_THREAD_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "shaka/media/decoder.h"
+#include "shaka/media/media_player.h"
 #include "shaka/media/streams.h"
 #include "src/debug/mutex.h"
-#include "src/debug/thread.h"
-#include "src/debug/thread_event.h"
+#include "src/eme/key_status_notifier.h"
+#include "src/media/decrypt_stage.h"
+#include "src/media/media_executor.h"
 #include "src/util/macros.h"
 
 namespace shaka {
 
-namespace eme {
-class Implementation;
-}  // namespace eme
-
 namespace media {
 
 /**
- * Handles the thread that decodes input content.  This handles synchronizing
- * the threads and connecting the Decoder to the Stream.
+ * Handles decoding input content.  This handles synchronizing the threads and
+ * connecting the Decoder to the Stream.  The decoding is done by a job on the
+ * shared MediaExecutor rather than a dedicated thread.
+ *
+ * The job doesn't poll; it only runs when it has something to do.  It is woken
+ * up when new frames are added to the input, when a new key is added to the
+ * CDM, when seeking, or when the playhead moves far enough that more frames
+ * need to be decoded.  Seeking keeps the frames already decoded if the new
+ * time is within them, so short seeks don't need to decode anything again.
+ *
+ * When playing video at a high rate or when the app is scrubbing (seeking
+ * repeatedly in a short time), this only decodes keyframes.  Decoding every
+ * frame would be wasted work since most of them would never be displayed, and
+ * the decoder wouldn't be able to keep up anyway.
+ *
+ * If the threading policy allows it, encrypted frames are decrypted ahead of
+ * the decoder by a DecryptStage, so the decoder is given clear frames.
  */
-class DecoderThread {
+class DecoderThread : StreamBase::Client, eme::KeyStatusNotifier::Listener {
  public:
   class Client {
    public:
@@ -46,6 +62,8 @@ class DecoderThread {
     // both.
     virtual double CurrentTime() const = 0;
     virtual double Duration() const = 0;
+    virtual double PlaybackRate() const = 0;
+    virtual VideoPlaybackState PlaybackState() const = 0;
     virtual void OnWaitingForKey() = 0;
 
     virtual void OnError(const std::string& error) = 0;
@@ -54,9 +72,11 @@ class DecoderThread {
   /**
    * @param client A client object for callback events.
    * @param output The object to put decoded frames into.
+   * @param is_video Whether this decodes video.  Audio is always decoded
+   *   continuously, since every frame is played.
    */
-  DecoderThread(Client* client, DecodedStream* output);
-  ~DecoderThread();
+  DecoderThread(Client* client, DecodedStream* output, bool is_video);
+  ~DecoderThread() override;
 
   SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(DecoderThread);
 
@@ -67,8 +87,8 @@ class DecoderThread {
   void Detach();
 
   /**
-   * Called when the video seeks.  This should reset any internal data and start
-   * over decoding.
+   * Called when the video seeks.  This starts over decoding unless the new time
+   * is within the frames already decoded.
    */
   void OnSeek();
 
@@ -77,15 +97,65 @@ class DecoderThread {
   /** Sets the decoder used to decode frames. */
   void SetDecoder(Decoder* decoder);
 
+  /** Sets the priority of decoding compared to other streams. */
+  void SetPriority(MediaPriority priority);
+
+  /** Sets how far ahead of the playhead frames are decoded. */
+  void SetDecodeBufferLimits(const DecodeBufferLimits& limits);
+
+  /** @return The current statistics about decoding. */
+  DecodingStats GetStats() const;
+
  private:
-  void ThreadMain();
+  void OnFrameAdded() override;
+  void OnKeyStatusChange() override;
+
+  /**
+   * Decodes the next batch of frames.
+   * @return The number of seconds until this should be run again, unless it is
+   *   woken up sooner.
+   */
+  double DecodeStep();
+  /**
+   * Decodes the next keyframe to display in key-frame-only mode.
+   * @return The number of seconds until this should be run again.
+   */
+  double DecodeKeyFrame(double cur_time, double rate, bool scrubbing);
+  /**
+   * Decodes the frames in |batch_| and adds them to the output.  If |batch_| is
+   * empty or |flush| is true, this also flushes the decoder.
+   * @return The number of seconds until this should be run again.
+   */
+  double DecodeBatch(bool flush);
+  /**
+   * @return Whether we can keep decoding after the last frame decoded, keeping
+   *   the frames already decoded, given the current playhead.
+   */
+  bool CanContinueDecoding(double cur_time) const;
+  /**
+   * Gets the number of seconds of decoded frames to keep ahead of and behind
+   * the playhead, based on the limits and how long frames take to decode.
+   */
+  void GetBufferTargets(double rate, double* ahead, double* behind) const;
+  /** Updates the moving averages from a batch of decoded frames. */
+  void UpdateStats(double frame_decode_time,
+                   const std::vector<std::shared_ptr<DecodedFrame>>& decoded);
+  /** Records an underrun if playback ran out of decoded frames. */
+  void CheckForUnderrun(double cur_time);
   void Reset();
 
-  Mutex mutex_;
-  ThreadEvent<void> signal_;
+  /** Wakes up the decoder job.  This can be called without |mutex_|. */
+  void Wake();
+
+  mutable Mutex mutex_;
+  std::atomic<bool> waiting_for_frame_;
 
   Client* const client_;
+  const bool is_video_;
   const ElementaryStream* input_;
+  ElementaryStream::Cursor input_cursor_;
+  // The frames being decoded; this is a member to reuse the allocation.
+  std::vector<std::shared_ptr<EncodedFrame>> batch_;
   DecodedStream* const output_;
   Decoder* decoder_;
 
@@ -94,8 +164,28 @@ class DecoderThread {
   bool shutdown_;
   bool did_flush_;
   bool raised_waiting_event_;
-
-  Thread thread_;
+  bool key_frames_only_;
+  // The monotonic time, in seconds, of the last seek; and when we should stop
+  // considering the app to be scrubbing.
+  double last_seek_time_;
+  double scrub_end_time_;
+
+  DecodeBufferLimits limits_;
+  // The current target for the number of seconds to decode ahead.
+  double decode_ahead_;
+  // Moving averages of the decoded frames, or NAN if none have been decoded.
+  double frame_decode_time_;
+  double frame_duration_;
+  double frame_size_;
+  // Multiplies the decode-ahead; this grows each time there is an underrun.
+  double underrun_boost_;
+  uint32_t underruns_;
+  bool in_underrun_;
+
+  // Decrypts the input ahead of the decoder.
+  DecryptStage decrypt_stage_;
+  // Should be last so the job is stopped before the fields are destroyed.
+  MediaExecutor::Job job_;
 };
 
 }  // namespace media
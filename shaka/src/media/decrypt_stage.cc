@@ -0,0 +1,310 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/decrypt_stage.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "src/util/utils.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/** The number of seconds after the decoder's position to decrypt. */
+constexpr const double kMaxWindowSeconds = 2;
+
+/**
+ * The maximum number of bytes of frames to decrypt ahead; this limits the
+ * memory used by the decrypted copies.  The decoder's limit can lower this.
+ */
+constexpr const size_t kMaxWindowBytes = 32 * 1024 * 1024;
+
+/**
+ * The number of zero bytes to add after the decrypted data.  Some decoders
+ * (e.g. FFmpeg) read past the end of the data for speed.
+ */
+constexpr const size_t kPaddingSize = 64;
+
+/** A clear copy of an encrypted frame; this owns the decrypted data. */
+class DecryptedFrame final : public EncodedFrame {
+ public:
+  DecryptedFrame(const EncodedFrame& encrypted,
+                 std::unique_ptr<uint8_t[]> buffer)
+      : EncodedFrame(encrypted.stream_info, encrypted.pts, encrypted.dts,
+                     encrypted.duration, encrypted.is_key_frame, buffer.get(),
+                     encrypted.data_size, encrypted.timestamp_offset, nullptr),
+        buffer_(std::move(buffer)) {}
+
+ private:
+  const std::unique_ptr<uint8_t[]> buffer_;
+};
+
+}  // namespace
+
+DecryptStage::DecryptStage(size_t job_count, MediaExecutor* executor)
+    : mutex_("DecryptStage"),
+      waiting_for_frame_(false),
+      key_status_changed_(false),
+      input_(nullptr),
+      cdm_(nullptr),
+      window_bytes_(0),
+      max_window_bytes_(kMaxWindowBytes),
+      position_(NAN),
+      decrypting_count_(0),
+      key_changes_(0),
+      waiting_for_key_(false),
+      shutdown_(false) {
+  for (size_t i = 0; i < job_count; i++) {
+    jobs_.emplace_back(new MediaExecutor::Job(
+        "Decrypt", /* pinned= */ false,
+        std::bind(&DecryptStage::DecryptStep, this), executor));
+  }
+}
+
+DecryptStage::~DecryptStage() {
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    shutdown_ = true;
+    if (input_)
+      input_->RemoveClient(this);
+    eme::KeyStatusNotifier::Instance()->RemoveListener(this);
+  }
+  // Don't hold the lock since this waits for a running DecryptStep().
+  for (auto& job : jobs_)
+    job->Stop();
+}
+
+void DecryptStage::Attach(const ElementaryStream* input) {
+  if (jobs_.empty())
+    return;
+
+  std::unique_lock<Mutex> lock(mutex_);
+  if (input_)
+    input_->RemoveClient(this);
+  input_ = input;
+  input_cursor_ = ElementaryStream::Cursor(input);
+  position_ = NAN;
+  ResetWindow(-INFINITY);
+  // Nothing is decrypted until the decoder takes its first frame, since we
+  // don't know where it will start.
+  if (input)
+    input->AddClient(this);
+}
+
+void DecryptStage::Detach() {
+  Attach(nullptr);
+}
+
+void DecryptStage::SetCdm(eme::Implementation* cdm) {
+  if (jobs_.empty())
+    return;
+
+  std::unique_lock<Mutex> lock(mutex_);
+  // The old CDM can be destroyed once this returns.
+  while (decrypting_count_ > 0)
+    decrypt_done_.wait(lock);
+
+  cdm_ = cdm;
+  if (cdm)
+    eme::KeyStatusNotifier::Instance()->AddListener(cdm, this);
+  else
+    eme::KeyStatusNotifier::Instance()->RemoveListener(this);
+  // The new CDM may have the keys the old one was missing.
+  key_status_changed_ = true;
+  Wake();
+}
+
+void DecryptStage::SetMaxBytes(size_t max_bytes) {
+  std::unique_lock<Mutex> lock(mutex_);
+  max_window_bytes_ =
+      max_bytes > 0 ? std::min(max_bytes, kMaxWindowBytes) : kMaxWindowBytes;
+  // If the limit was raised, there may be more frames to decrypt.
+  Wake();
+}
+
+void DecryptStage::SetPriority(MediaPriority priority) {
+  for (auto& job : jobs_)
+    job->SetPriority(priority);
+}
+
+std::shared_ptr<EncodedFrame> DecryptStage::TakeFrame(
+    const std::shared_ptr<EncodedFrame>& frame) {
+  if (jobs_.empty())
+    return nullptr;
+
+  std::unique_lock<Mutex> lock(mutex_);
+  if (!input_)
+    return nullptr;
+
+  // Drop any frames the decoder skipped.
+  position_ = frame->dts;
+  while (!window_.empty() && window_.front()->frame->dts < frame->dts)
+    PopEntry();
+
+  std::shared_ptr<EncodedFrame> ret;
+  if (!window_.empty() && window_.front()->frame == frame) {
+    // If the frame isn't ready, the decoder will decrypt it itself; that
+    // isn't slower than waiting for it.
+    if (window_.front()->state == State::Decrypted)
+      ret = window_.front()->decrypted;
+    PopEntry();
+  } else if (frame->encryption_info || frame->dts > input_cursor_.time()) {
+    // The decoder seeked or got ahead of us, so start again after this frame.
+    VLOG(2) << "Decrypting ahead from " << frame->dts;
+    ResetWindow(frame->dts);
+  }
+
+  // The window moved, so there may be more frames to decrypt.
+  Wake();
+  return ret;
+}
+
+DecryptStage::Entry::Entry(std::shared_ptr<EncodedFrame> frame)
+    : frame(std::move(frame)), state(State::Pending) {}
+DecryptStage::Entry::~Entry() {}
+
+void DecryptStage::OnFrameAdded() {
+  // Only wake up if we ran out of frames; otherwise we are already busy or
+  // have enough decrypted.
+  if (waiting_for_frame_)
+    Wake();
+}
+
+void DecryptStage::OnKeyStatusChange() {
+  // This can't take our lock, so the frames are retried in DecryptStep().
+  key_status_changed_ = true;
+  Wake();
+}
+
+double DecryptStage::DecryptStep() {
+  std::unique_lock<Mutex> lock(mutex_);
+  if (key_status_changed_.exchange(false)) {
+    key_changes_++;
+    waiting_for_key_ = false;
+    for (auto& entry : window_) {
+      if (entry->state == State::NeedsKey)
+        entry->state = State::Pending;
+    }
+  }
+  if (shutdown_ || !input_ || !cdm_ || std::isnan(position_))
+    return INFINITY;
+
+  // If there is nothing to do, we'll be woken up when there is.
+  std::shared_ptr<Entry> entry = NextEntry();
+  if (!entry)
+    return INFINITY;
+
+  entry->state = State::Decrypting;
+  decrypting_count_++;
+  const eme::Implementation* cdm = cdm_;
+  const uint64_t key_changes = key_changes_;
+  const EncodedFrame& frame = *entry->frame;
+  std::unique_ptr<uint8_t[]> buffer(
+      new uint8_t[frame.data_size + kPaddingSize]);
+  MediaStatus status;
+  {
+    util::Unlocker<Mutex> unlock(&lock);
+    memset(buffer.get() + frame.data_size, 0, kPaddingSize);
+    status = frame.Decrypt(cdm, buffer.get());
+  }
+  decrypting_count_--;
+  decrypt_done_.notify_all();
+
+  // Note the decoder may have already taken the frame; then this is dropped.
+  switch (status) {
+    case MediaStatus::Success:
+      entry->decrypted =
+          std::make_shared<DecryptedFrame>(frame, std::move(buffer));
+      entry->state = State::Decrypted;
+      break;
+    case MediaStatus::KeyNotFound:
+      if (key_changes != key_changes_ || key_status_changed_) {
+        // A key was added while decrypting, so try again.
+        entry->state = State::Pending;
+      } else {
+        // Stop reading frames until a key is added, since the ones that follow
+        // probably need the same key.
+        VLOG(2) << "Waiting for a key to decrypt ahead";
+        entry->state = State::NeedsKey;
+        waiting_for_key_ = true;
+      }
+      break;
+    default:
+      // The decoder will decrypt the frame itself and report the error.
+      entry->state = State::Failed;
+      break;
+  }
+
+  // Run again right away, but let other jobs run between frames.
+  return 0;
+}
+
+std::shared_ptr<DecryptStage::Entry> DecryptStage::NextEntry() {
+  for (auto& entry : window_) {
+    if (entry->state == State::Pending)
+      return entry;
+  }
+  if (waiting_for_key_)
+    return nullptr;
+
+  // Set this before reading so if a frame is added after we look,
+  // OnFrameAdded will wake us up.
+  waiting_for_frame_ = true;
+  while (window_bytes_ < max_window_bytes_) {
+    read_frames_.clear();
+    if (input_cursor_.Read(1, position_ + kMaxWindowSeconds, &read_frames_) ==
+        0) {
+      return nullptr;
+    }
+    waiting_for_frame_ = false;
+
+    // Clear frames are given to the decoder as-is.
+    std::shared_ptr<EncodedFrame>& frame = read_frames_[0];
+    if (!frame->encryption_info)
+      continue;
+    window_bytes_ += frame->data_size;
+    window_.emplace_back(std::make_shared<Entry>(std::move(frame)));
+    return window_.back();
+  }
+  waiting_for_frame_ = false;
+  return nullptr;
+}
+
+void DecryptStage::PopEntry() {
+  window_bytes_ -= window_.front()->frame->data_size;
+  window_.pop_front();
+}
+
+void DecryptStage::ResetWindow(double time) {
+  window_.clear();
+  window_bytes_ = 0;
+  waiting_for_key_ = false;
+  input_cursor_.Seek(time);
+}
+
+void DecryptStage::Wake() {
+  for (auto& job : jobs_)
+    job->Wake();
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,169 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_DECRYPT_STAGE_H_
+#define SHAKA_EMBEDDED_MEDIA_DECRYPT_STAGE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "shaka/eme/implementation.h"
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/debug/mutex.h"
+#include "src/eme/key_status_notifier.h"
+#include "src/media/media_executor.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * Decrypts encrypted frames ahead of the decoder.  Without this, each frame is
+ * decrypted by the decoder right before it is decoded, so the decoder waits for
+ * it.  This instead runs several jobs on the shared MediaExecutor that decrypt
+ * the frames that follow the one being decoded, in parallel, into clear copies;
+ * the decoder then uses the clear copy if it is ready.
+ *
+ * This only decrypts a bounded window after the last frame the decoder took, so
+ * it doesn't hold a decrypted copy of the whole stream.  Decrypting pauses when
+ * the CDM doesn't have the key and the frames are retried once keys are added.
+ * If the decoder gets to a frame that isn't ready, or if it seeks, it decrypts
+ * the frame itself as usual and this starts again after that frame.
+ *
+ * This type is thread-safe.
+ */
+class DecryptStage : StreamBase::Client, eme::KeyStatusNotifier::Listener {
+ public:
+  /**
+   * @param job_count The number of frames to decrypt in parallel.  If 0, this
+   *   does nothing and the decoder decrypts every frame.
+   */
+  explicit DecryptStage(size_t job_count,
+                        MediaExecutor* executor = MediaExecutor::Instance());
+  ~DecryptStage() override;
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(DecryptStage);
+
+  /** Starts decrypting frames from the given stream. */
+  void Attach(const ElementaryStream* input);
+
+  /** Stops decrypting and drops any decrypted frames. */
+  void Detach();
+
+  /**
+   * Sets the CDM to decrypt with.  This waits for any frames being decrypted
+   * with the old one.
+   */
+  void SetCdm(eme::Implementation* cdm);
+
+  /**
+   * Limits the number of bytes of frames to decrypt ahead, or 0 to use the
+   * default limit.  This never decrypts further ahead than the default.
+   */
+  void SetMaxBytes(size_t max_bytes);
+
+  /** Sets the priority of decrypting compared to other streams. */
+  void SetPriority(MediaPriority priority);
+
+  /**
+   * Called by the decoder before decoding the given frame, in decoding order.
+   * This drops the decrypted frames before it and decrypts the frames that
+   * follow it.
+   *
+   * @return A clear copy of the frame, or nullptr if the frame is clear or
+   *   hasn't been decrypted yet.
+   */
+  std::shared_ptr<EncodedFrame> TakeFrame(
+      const std::shared_ptr<EncodedFrame>& frame);
+
+ private:
+  enum class State : uint8_t {
+    Pending,
+    Decrypting,
+    Decrypted,
+    NeedsKey,
+    Failed,
+  };
+
+  struct Entry {
+    explicit Entry(std::shared_ptr<EncodedFrame> frame);
+    ~Entry();
+
+    const std::shared_ptr<EncodedFrame> frame;
+    std::shared_ptr<EncodedFrame> decrypted;
+    State state;
+  };
+
+  void OnFrameAdded() override;
+  void OnKeyStatusChange() override;
+
+  /**
+   * Decrypts the next frame that needs it.
+   * @return The number of seconds until this should be run again.
+   */
+  double DecryptStep();
+
+  /**
+   * Gets the next frame to decrypt.  This reads more frames from the input if
+   * there is room in the window.
+   */
+  std::shared_ptr<Entry> NextEntry();
+
+  /** Removes the oldest frame from the window. */
+  void PopEntry();
+
+  /** Removes all the frames and starts reading after the given time. */
+  void ResetWindow(double time);
+
+  /** Wakes up the jobs.  This can be called without |mutex_|. */
+  void Wake();
+
+  mutable Mutex mutex_;
+  // Signaled when a frame has finished decrypting.
+  std::condition_variable_any decrypt_done_;
+  std::atomic<bool> waiting_for_frame_;
+  std::atomic<bool> key_status_changed_;
+
+  const ElementaryStream* input_;
+  ElementaryStream::Cursor input_cursor_;
+  // Reused when reading frames to avoid allocating.
+  std::vector<std::shared_ptr<EncodedFrame>> read_frames_;
+  eme::Implementation* cdm_;
+
+  // The encrypted frames after the last one the decoder took, in decoding
+  // order, and the total size of them.
+  std::deque<std::shared_ptr<Entry>> window_;
+  size_t window_bytes_;
+  size_t max_window_bytes_;
+  // The DTS of the last frame the decoder took, or NAN if it hasn't started.
+  double position_;
+  size_t decrypting_count_;
+  // Counts the key changes that have been handled, so a frame that was missing
+  // a key can tell if one was added while it was decrypting.
+  uint64_t key_changes_;
+  bool waiting_for_key_;
+  bool shutdown_;
+
+  // Should be last so the jobs are stopped before the fields are destroyed.
+  std::vector<std::unique_ptr<MediaExecutor::Job>> jobs_;
+};
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_DECRYPT_STAGE_H_
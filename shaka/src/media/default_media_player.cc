@@ -21,11 +21,56 @@
 #ifdef OS_IOS
 #  include "src/media/ios/av_media_player.h"
 #endif
+#include "src/media/media_executor.h"
 #include "src/media/mse_media_player.h"
 
+#define DEFINE_SPECIAL_METHODS(Type)            \
+  Type::~Type() {}                              \
+  Type::Type(const Type&) = default;            \
+  Type::Type(Type&&) = default;                 \
+  Type& Type::operator=(const Type&) = default; \
+  Type& Type::operator=(Type&&) = default
+
 namespace shaka {
 namespace media {
 
+namespace {
+
+/** The default number of seconds to keep decoded ahead of the playhead. */
+constexpr const double kDefaultMinDecodeAhead = 1;
+constexpr const double kDefaultMaxDecodeAhead = 4;
+
+/** The default maximum number of bytes of decoded frames per stream. */
+constexpr const size_t kDefaultMaxDecodedBytes = 256 * 1024 * 1024;
+
+}  // namespace
+
+// \cond Doxygen_Skip
+MediaThreadingPolicy::MediaThreadingPolicy()
+    : codec_thread_budget(0),
+      frame_threading(true),
+      slice_threading(true),
+      decrypt_jobs_per_stream(0),
+      media_thread_priority(ThreadPriority::Normal),
+      audio_thread_priority(ThreadPriority::Normal) {}
+DEFINE_SPECIAL_METHODS(MediaThreadingPolicy);
+
+
+DecodeBufferLimits::DecodeBufferLimits()
+    : DecodeBufferLimits(kDefaultMinDecodeAhead, kDefaultMaxDecodeAhead,
+                         kDefaultMaxDecodedBytes) {}
+DecodeBufferLimits::DecodeBufferLimits(double min_seconds, double max_seconds,
+                                       size_t max_bytes)
+    : min_seconds(min_seconds), max_seconds(max_seconds), max_bytes(max_bytes) {}
+DEFINE_SPECIAL_METHODS(DecodeBufferLimits);
+
+
+DecodingStats::DecodingStats()
+    : underruns(0), decode_ahead(0), frame_decode_time(0), frame_size(0) {}
+DEFINE_SPECIAL_METHODS(DecodingStats);
+// \endcond Doxygen_Skip
+
+
 class DefaultMediaPlayer::Impl {
  public:
   Impl(ClientList* clients, VideoRenderer* video_renderer,
@@ -57,6 +102,41 @@ void DefaultMediaPlayer::SetDecoders(Decoder* video_decoder,
   impl_->mse_player.SetDecoders(video_decoder, audio_decoder);
 }
 
+void DefaultMediaPlayer::SetPriority(MediaPriority priority) {
+  impl_->mse_player.SetPriority(priority);
+}
+
+void DefaultMediaPlayer::SetDecodeBufferLimits(
+    const DecodeBufferLimits& limits) {
+  impl_->mse_player.SetDecodeBufferLimits(limits);
+}
+
+DecodingStats DefaultMediaPlayer::VideoDecodingStats() const {
+  return impl_->mse_player.GetDecodingStats(/* video= */ true);
+}
+
+DecodingStats DefaultMediaPlayer::AudioDecodingStats() const {
+  return impl_->mse_player.GetDecodingStats(/* video= */ false);
+}
+
+// static
+bool DefaultMediaPlayer::SetMediaThreadCount(size_t thread_count) {
+  if (thread_count == 0)
+    return false;
+  return MediaExecutor::SetGlobalThreadCount(thread_count);
+}
+
+// static
+void DefaultMediaPlayer::SetMediaThreadingPolicy(
+    const MediaThreadingPolicy& policy) {
+  MediaExecutor::SetGlobalThreadingPolicy(policy);
+}
+
+// static
+MediaThreadingPolicy DefaultMediaPlayer::GetMediaThreadingPolicy() {
+  return MediaExecutor::GlobalThreadingPolicy();
+}
+
 const void* DefaultMediaPlayer::GetIosView() {
 #ifdef OS_IOS
   return impl_->av_player.GetIosView();
@@ -23,6 +23,7 @@
 
 #include "src/core/js_manager_impl.h"
 #include "src/media/media_utils.h"
+#include "src/util/utils.h"
 
 namespace shaka {
 namespace media {
@@ -43,29 +44,38 @@ std::string ShortContainerName(const std::string& mime) {
 DemuxerThread::DemuxerThread(const std::string& mime, Demuxer::Client* client,
                              ElementaryStream* stream)
     : mutex_("DemuxerThread"),
-      new_data_("New demuxed data"),
       client_(client),
       mime_(mime),
       shutdown_(false),
-      data_(nullptr),
-      data_size_(0),
-      timestamp_offset_(0),
-      window_start_(0),
-      window_end_(HUGE_VAL),
+      stopped_(false),
+      failed_(false),
       need_key_frame_(true),
       stream_(stream),
-      thread_(ShortContainerName(mime) + " demuxer",
-              std::bind(&DemuxerThread::ThreadMain, this)) {}
+      // The demuxer may be suspended in a Coroutine between appends, so it
+      // must always be resumed on the same thread; this includes destroying
+      // it, see Stop().
+      job_(ShortContainerName(mime) + " demuxer", /* pinned= */ true,
+           std::bind(&DemuxerThread::DemuxStep, this)) {}
 
 DemuxerThread::~DemuxerThread() {
-  if (thread_.joinable())
-    Stop();
+  Stop();
 }
 
 void DemuxerThread::Stop() {
-  shutdown_ = true;
-  new_data_.SignalAllIfNotSet();
-  thread_.join();
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    shutdown_ = true;
+    signal_.notify_all();
+  }
+
+  // Let the job destroy the demuxer on its own thread.
+  job_.Wake();
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    while (!stopped_)
+      signal_.wait(lock);
+  }
+  job_.Stop();
 }
 
 void DemuxerThread::AppendData(double timestamp_offset, double window_start,
@@ -75,72 +85,107 @@ void DemuxerThread::AppendData(double timestamp_offset, double window_start,
   DCHECK(data);
   DCHECK_GT(data_size, 0u);
 
-  std::unique_lock<Mutex> lock(mutex_);
-  data_ = data;
-  data_size_ = data_size;
-  timestamp_offset_ = timestamp_offset;
-  window_start_ = window_start;
-  window_end_ = window_end;
-  on_complete_ = std::move(on_complete);
-
-  new_data_.SignalAll();
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    DCHECK(!operation_) << "Only one operation can be pending";
+    operation_.reset(new Operation{/* is_remove */ false, timestamp_offset,
+                                   window_start, window_end, data, data_size,
+                                   std::move(on_complete)});
+  }
+  job_.Wake();
 }
 
-void DemuxerThread::ThreadMain() {
-  using namespace std::placeholders;  // NOLINT
-  auto* factory = DemuxerFactory::GetFactory();
-  if (factory)
-    demuxer_ = factory->Create(mime_, client_);
-  if (!demuxer_) {
-    // If we get an error before we append the first segment, then we won't have
-    // a callback yet, so we have nowhere to send the error to.  Wait until we
-    // get the first segment.
+void DemuxerThread::Remove(double start, double end,
+                           std::function<void(bool)> on_complete) {
+  {
     std::unique_lock<Mutex> lock(mutex_);
-    if (!on_complete_ && !shutdown_) {
-      new_data_.ResetAndWaitWhileUnlocked(lock);
-    }
-    CallOnComplete(false);
-    return;
+    DCHECK(!operation_) << "Only one operation can be pending";
+    operation_.reset(new Operation{/* is_remove */ true, 0, start, end,
+                                   nullptr, 0, std::move(on_complete)});
   }
+  job_.Wake();
+}
 
-  while (!shutdown_) {
-    std::unique_lock<Mutex> lock(mutex_);
-    std::vector<std::shared_ptr<EncodedFrame>> frames;
-    if (!demuxer_->Demux(timestamp_offset_, data_, data_size_, &frames)) {
-      CallOnComplete(false);
-      break;
+double DemuxerThread::DemuxStep() {
+  std::unique_lock<Mutex> lock(mutex_);
+  if (shutdown_) {
+    if (!stopped_) {
+      // Destroying the demuxer resumes its Coroutine so it can exit, so this
+      // must happen on this thread.  Only this job touches |demuxer_|.
+      std::unique_ptr<Demuxer> demuxer = std::move(demuxer_);
+      {
+        util::Unlocker<Mutex> unlock(&lock);
+        demuxer.reset();
+      }
+      stopped_ = true;
+      signal_.notify_all();
+    }
+    return INFINITY;
+  }
+  if (!operation_)
+    return INFINITY;
+
+  // The operation can't change until it completes, so it can be used without
+  // the lock; Stop() can still get the lock while demuxing.
+  const Operation& op = *operation_;
+  bool success;
+  {
+    util::Unlocker<Mutex> unlock(&lock);
+    if (op.is_remove) {
+      stream_->Remove(op.start, op.end);
+      success = true;
+    } else {
+      if (!demuxer_ && !failed_) {
+        auto* factory = DemuxerFactory::GetFactory();
+        if (factory)
+          demuxer_ = factory->Create(mime_, client_);
+        // If we couldn't create a demuxer, every append will fail; removes
+        // still work.
+        failed_ = !demuxer_;
+      }
+      success = !failed_ && DemuxData(op);
+      // The demuxer can't recover from errors, so fail any later appends.
+      failed_ = !success;
     }
+  }
 
-    for (auto& frame : frames) {
-      if (frame->pts < window_start_ ||
-          frame->pts + frame->duration > window_end_) {
-        need_key_frame_ = true;
-        VLOG(2) << "Dropping frame outside append window, pts=" << frame->pts;
+  std::unique_ptr<Operation> done = std::move(operation_);
+  CallOnComplete(std::move(done->on_complete), success);
+  return INFINITY;
+}
+
+bool DemuxerThread::DemuxData(const Operation& op) {
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  if (!demuxer_->Demux(op.timestamp_offset, op.data, op.data_size, &frames))
+    return false;
+
+  for (auto& frame : frames) {
+    if (frame->pts < op.start || frame->pts + frame->duration > op.end) {
+      need_key_frame_ = true;
+      VLOG(2) << "Dropping frame outside append window, pts=" << frame->pts;
+      continue;
+    }
+    if (need_key_frame_) {
+      if (frame->is_key_frame) {
+        need_key_frame_ = false;
+      } else {
+        VLOG(2) << "Dropping frame while looking for key frame, pts="
+                << frame->pts;
         continue;
       }
-      if (need_key_frame_) {
-        if (frame->is_key_frame) {
-          need_key_frame_ = false;
-        } else {
-          VLOG(2) << "Dropping frame while looking for key frame, pts="
-                  << frame->pts;
-          continue;
-        }
-      }
-      stream_->AddFrame(frame);
     }
-    CallOnComplete(true);
-    new_data_.ResetAndWaitWhileUnlocked(lock);
+    stream_->AddFrame(frame);
   }
+  return true;
 }
 
-void DemuxerThread::CallOnComplete(bool success) {
-  if (on_complete_) {
+void DemuxerThread::CallOnComplete(std::function<void(bool)> on_complete,
+                                   bool success) {
+  if (on_complete) {
     // on_complete must be invoked on the event thread.
     JsManagerImpl::Instance()->MainThread()->AddInternalTask(
         TaskPriority::Internal, "Append done",
-        std::bind(on_complete_, success));
-    on_complete_ = std::function<void(bool)>();
+        std::bind(std::move(on_complete), success));
   }
 }
 
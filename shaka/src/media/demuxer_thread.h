@@ -15,7 +15,7 @@
 #ifndef SHAKA_EMBEDDED_MEDIA_DEMUXER_THREAD_H_
 #define SHAKA_EMBEDDED_MEDIA_DEMUXER_THREAD_H_
 
-#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <memory>
 #include <string>
@@ -23,8 +23,7 @@
 #include "shaka/media/demuxer.h"
 #include "shaka/media/streams.h"
 #include "src/debug/mutex.h"
-#include "src/debug/thread.h"
-#include "src/debug/thread_event.h"
+#include "src/media/media_executor.h"
 #include "src/media/types.h"
 #include "src/util/buffer_reader.h"
 #include "src/util/macros.h"
@@ -33,8 +32,13 @@ namespace shaka {
 namespace media {
 
 /**
- * Handles the thread that demuxes input content.  This handles synchronizing
- * the threads and connecting the Demuxer to the Stream.
+ * Handles demuxing input content.  This handles synchronizing the threads and
+ * connecting the Demuxer to the Stream.  The demuxing is done by a job on the
+ * shared MediaExecutor rather than a dedicated thread.
+ *
+ * Only one append or remove can be pending at a time; the caller must wait for
+ * its callback before starting another, like SourceBuffer does while it is
+ * updating.
  *
  * All callbacks given to this object will be called on the event thread.
  */
@@ -52,19 +56,22 @@ class DemuxerThread {
 
   SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(DemuxerThread);
 
-  /** Stops the background thread and joins it. */
+  /**
+   * Stops demuxing and waits for the current operation to finish.  The
+   * demuxer is destroyed on the job's thread.
+   */
   void Stop();
 
   /**
-   * Appends the given data to be demuxed.
+   * Starts demuxing the given data.
    *
    * @param timestamp_offset The number of seconds to move the media timestamps
    *   forward.
    * @param window_start The time (in seconds) to start the append window.  Any
    *   frames outside the append window are ignored.
    * @param window_end The time (in seconds) to end the append window.
-   * @param data The data pointer; it must remain alive until a call to either
-   *     on_complete or on_error.
+   * @param data The data pointer; it must remain alive until on_complete is
+   *     called or this object is stopped.
    * @param data_size The number of bytes in |data|.
    * @param on_complete The callback to invoke once the append completes.
    */
@@ -72,28 +79,56 @@ class DemuxerThread {
                   double window_end, const uint8_t* data, size_t data_size,
                   std::function<void(bool)> on_complete);
 
+  /**
+   * Removes the frames in the given range from the stream.  This is done in
+   * the background so the caller isn't blocked while the frames are freed.
+   *
+   * @param start The time (in seconds) to start removing.
+   * @param end The time (in seconds) to stop removing.
+   * @param on_complete The callback to invoke once the remove completes.
+   */
+  void Remove(double start, double end, std::function<void(bool)> on_complete);
+
  private:
-  void ThreadMain();
-  void CallOnComplete(bool success);
+  struct Operation {
+    bool is_remove;
+    // For appends, these are the timestamp offset and the append window; for
+    // removes, |start| and |end| are the range to remove.
+    double timestamp_offset;
+    double start;
+    double end;
+    const uint8_t* data;
+    size_t data_size;
+    std::function<void(bool)> on_complete;
+  };
+
+  /**
+   * Runs the pending operation, if any.
+   * @return The number of seconds until this should be run again.
+   */
+  double DemuxStep();
+  bool DemuxData(const Operation& op);
+  void CallOnComplete(std::function<void(bool)> on_complete, bool success);
 
   Mutex mutex_;
+  std::condition_variable_any signal_;
+  // The pending append or remove; this is reset once its callback is posted.
+  std::unique_ptr<Operation> operation_;
+
   std::unique_ptr<Demuxer> demuxer_;
-  ThreadEvent<void> new_data_;
-  std::function<void(bool)> on_complete_;
   Demuxer::Client* client_;
   std::string mime_;
-  std::atomic<bool> shutdown_;
-  const uint8_t* data_;
-  size_t data_size_;
-  double timestamp_offset_;
-  double window_start_;
-  double window_end_;
+  bool shutdown_;
+  // Whether the job has destroyed the demuxer after |shutdown_| was set.
+  bool stopped_;
+  // Whether the demuxer failed; every later append will fail.
+  bool failed_;
   bool need_key_frame_;
 
   ElementaryStream* stream_;
 
-  // Should be last so the thread starts after all the fields are initialized.
-  Thread thread_;
+  // Should be last so the job is stopped before the fields are destroyed.
+  MediaExecutor::Job job_;
 };
 
 }  // namespace media
@@ -16,8 +16,12 @@
 
 #include <glog/logging.h>
 
+#include <functional>
+
 extern "C" {
+#include <libavutil/hwcontext.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 }
 
 namespace shaka {
@@ -29,6 +33,16 @@ namespace {
 bool MapFrameFormat(bool is_video, AVFrame* frame,
                     variant<PixelFormat, SampleFormat>* format) {
   if (is_video) {
+    const AVPixFmtDescriptor* desc =
+        av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (frame->format != AV_PIX_FMT_VIDEOTOOLBOX && desc &&
+        (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+      // Keep other hardware frames on the GPU; they are only read back if the
+      // renderer needs to.
+      *format = PixelFormat::HardwareFrame;
+      return true;
+    }
+
     switch (frame->format) {
       case AV_PIX_FMT_YUV420P:
         *format = PixelFormat::YUV420P;
@@ -109,7 +123,13 @@ FFmpegDecodedFrame::FFmpegDecodedFrame(
     const std::vector<size_t>& linesize)
     : DecodedFrame(stream, pts, dts, duration, format, frame->nb_samples, data,
                    linesize),
-      frame_(frame) {}
+      frame_(frame) {
+  if (holds_alternative<PixelFormat>(format) &&
+      get<PixelFormat>(format) == PixelFormat::HardwareFrame) {
+    SetHardwareFrameMapper(
+        std::bind(&FFmpegDecodedFrame::MapHardware, this));
+  }
+}
 
 FFmpegDecodedFrame::~FFmpegDecodedFrame() {
   av_frame_unref(frame_);
@@ -126,7 +146,10 @@ FFmpegDecodedFrame* FFmpegDecodedFrame::CreateFrame(
 
   std::vector<const uint8_t*> data;
   std::vector<size_t> linesize;
-  if (info->is_video && get<PixelFormat>(format) == PixelFormat::VideoToolbox) {
+  if (info->is_video &&
+      (get<PixelFormat>(format) == PixelFormat::VideoToolbox ||
+       get<PixelFormat>(format) == PixelFormat::HardwareFrame)) {
+    // FFmpeg stores the hardware surface in data[3].
     data.emplace_back(frame->data[3]);
     linesize.emplace_back(0);
   } else {
@@ -168,6 +191,39 @@ size_t FFmpegDecodedFrame::EstimateSize() const {
   return size;
 }
 
+std::shared_ptr<DecodedFrame> FFmpegDecodedFrame::MapHardware() const {
+  if (!frame_->hw_frames_ctx)
+    return nullptr;
+
+  AVFrame* mapped = av_frame_alloc();
+  if (!mapped)
+    return nullptr;
+  auto* frames_ctx =
+      reinterpret_cast<AVHWFramesContext*>(frame_->hw_frames_ctx->data);
+
+  // Mapping the surface lets the renderer copy directly from GPU memory.  Not
+  // every driver supports it, so fall back to downloading the frame.
+  mapped->format = frames_ctx->sw_format;
+  int code = av_hwframe_map(mapped, frame_, AV_HWFRAME_MAP_READ);
+  if (code < 0) {
+    av_frame_unref(mapped);
+    mapped->format = frames_ctx->sw_format;
+    code = av_hwframe_transfer_data(mapped, frame_, 0);
+  }
+
+  std::shared_ptr<DecodedFrame> ret;
+  if (code < 0) {
+    LOG(ERROR) << "Error reading hardware frame: " << av_err2str(code);
+  } else {
+    // Mapping doesn't always set this, but CreateFrame reads the planes from
+    // it.  The new frame holds a reference to the mapping.
+    mapped->extended_data = mapped->data;
+    ret.reset(CreateFrame(stream_info, mapped, pts, duration));
+  }
+  av_frame_free(&mapped);
+  return ret;
+}
+
 }  // namespace ffmpeg
 }  // namespace media
 }  // namespace shaka
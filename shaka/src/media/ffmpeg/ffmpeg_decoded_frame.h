@@ -53,6 +53,9 @@ class FFmpegDecodedFrame final : public DecodedFrame {
                      const std::vector<const uint8_t*>& data,
                      const std::vector<size_t>& linesize);
 
+  /** Maps or downloads a HardwareFrame frame; see MapHardwareFrame. */
+  std::shared_ptr<DecodedFrame> MapHardware() const;
+
   AVFrame* frame_;
 };
 
@@ -16,10 +16,15 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
 #include "src/media/ffmpeg/ffmpeg_decoded_frame.h"
+#include "src/media/ffmpeg/ffmpeg_frame_pool.h"
+#include "src/media/media_executor.h"
 #include "src/media/media_utils.h"
 #include "src/util/utils.h"
 
@@ -34,6 +39,42 @@ namespace {
                      std::string("Error from FFmpeg: ") + av_err2str(code))
 #define ALLOC_ERROR_STR "Error allocating memory"
 
+#ifdef ENABLE_HARDWARE_DECODE
+/** The number of extra hardware surfaces to hold decoded frames. */
+constexpr const int kExtraHardwareFrames = 32;
+#endif
+
+/** The number of video decoders that share the codec thread budget. */
+std::atomic<size_t> g_video_decoder_count{0};
+
+/**
+ * Sets up the codec threads for a new codec context, based on the threading
+ * policy.  |ctx| must be counted in g_video_decoder_count if it is for video.
+ */
+void ConfigureThreads(AVCodecContext* ctx) {
+  const MediaThreadingPolicy policy = MediaExecutor::GlobalThreadingPolicy();
+  int thread_type = 0;
+  if (policy.frame_threading)
+    thread_type |= FF_THREAD_FRAME;
+  if (policy.slice_threading)
+    thread_type |= FF_THREAD_SLICE;
+
+  if (ctx->codec_type != AVMEDIA_TYPE_VIDEO) {
+    // Audio doesn't need multiple threads; leave the budget to the video.
+    ctx->thread_count = 1;
+  } else if (thread_type == 0) {
+    ctx->thread_count = 1;
+  } else {
+    const size_t budget = policy.codec_thread_budget
+                              ? policy.codec_thread_budget
+                              : std::thread::hardware_concurrency();
+    const size_t decoders = std::max<size_t>(g_video_decoder_count, 1);
+    ctx->thread_count =
+        static_cast<int>(std::max<size_t>(budget / decoders, 1));
+    ctx->thread_type = thread_type;
+  }
+}
+
 const AVCodec* FindCodec(const std::string& codec_name) {
 #ifdef ENABLE_HARDWARE_DECODE
   const AVCodec* hybrid = nullptr;
@@ -85,8 +126,8 @@ FFmpegDecoder::FFmpegDecoder()
 }
 
 FFmpegDecoder::~FFmpegDecoder() {
+  FreeContext();
   // It is safe if these fields are nullptr.
-  avcodec_free_context(&decoder_ctx_);
   av_frame_free(&received_frame_);
 #ifdef ENABLE_HARDWARE_DECODE
   av_buffer_unref(&hw_device_ctx_);
@@ -112,7 +153,11 @@ MediaCapabilitiesInfo FFmpegDecoder::DecodingInfo(
 
 void FFmpegDecoder::ResetDecoder() {
   std::unique_lock<Mutex> lock(mutex_);
-  avcodec_free_context(&decoder_ctx_);
+  // Keep the context so seeking within the same stream doesn't need to open
+  // the codec (and the hardware device) again.  If the stream changes, the
+  // next frame will reconfigure the decoder anyway.
+  if (decoder_ctx_)
+    avcodec_flush_buffers(decoder_ctx_);
 }
 
 MediaStatus FFmpegDecoder::Decode(
@@ -130,8 +175,9 @@ MediaStatus FFmpegDecoder::Decode(
       VLOG(1) << "Reconfiguring decoder";
       // Flush the old decoder to get any existing frames.
       if (decoder_ctx_) {
+        // This gets EOF if the decoder was already flushed.
         const int send_code = avcodec_send_packet(decoder_ctx_, nullptr);
-        if (send_code != 0) {
+        if (send_code != 0 && send_code != AVERROR_EOF) {
           LogError(send_code, extra_info);
           return MediaStatus::FatalError;
         }
@@ -184,10 +230,12 @@ MediaStatus FFmpegDecoder::Decode(
     if (send_code == 0) {
       sent_frame = true;
     } else if (send_code == AVERROR_EOF) {
-      // If we get EOF, this is either a flush or we are closing.  Either way,
-      // stop.  If this is a flush, we can't reuse the decoder, so reset it.
-      avcodec_free_context(&decoder_ctx_);
-      break;
+      // The decoder was already flushed, so it won't accept more frames until
+      // it is reset.  Resetting it is cheaper than creating a new one.
+      avcodec_flush_buffers(decoder_ctx_);
+      if (!input)
+        break;
+      continue;
     } else if (send_code != AVERROR(EAGAIN)) {
       LogError(send_code, extra_info);
       return MediaStatus::FatalError;
@@ -261,12 +309,14 @@ bool FFmpegDecoder::InitializeDecoder(std::shared_ptr<const StreamInfo> info,
   }
 #endif
 
-  avcodec_free_context(&decoder_ctx_);
+  FreeContext();
   decoder_ctx_ = avcodec_alloc_context3(decoder);
   if (!decoder_ctx_) {
     *extra_info = ALLOC_ERROR_STR;
     return false;
   }
+  if (decoder_ctx_->codec_type == AVMEDIA_TYPE_VIDEO)
+    g_video_decoder_count++;
 
   if (!received_frame_) {
     received_frame_ = av_frame_alloc();
@@ -276,8 +326,14 @@ bool FFmpegDecoder::InitializeDecoder(std::shared_ptr<const StreamInfo> info,
     }
   }
 
-  decoder_ctx_->thread_count = 0;  // Default is 1; 0 means auto-detect.
+  ConfigureThreads(decoder_ctx_);
   decoder_ctx_->opaque = this;
+  // Decode into pooled buffers so they are reused once the frames are evicted.
+  decoder_ctx_->get_buffer2 = &FFmpegFramePool::GetBuffer;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+  // The pool is thread-safe, so frame threads can call it directly.
+  decoder_ctx_->thread_safe_callbacks = 1;
+#endif
   decoder_ctx_->pkt_timebase = {.num = info->time_scale.numerator,
                                 .den = info->time_scale.denominator};
 
@@ -306,6 +362,9 @@ bool FFmpegDecoder::InitializeDecoder(std::shared_ptr<const StreamInfo> info,
     }
     decoder_ctx_->get_format = &GetPixelFormat;
     decoder_ctx_->hw_device_ctx = av_buffer_ref(hw_device_ctx_);
+    // Decoded frames keep their surface until they are rendered, so the pool
+    // needs room for the frames buffered ahead of the playhead.
+    decoder_ctx_->extra_hw_frames = kExtraHardwareFrames;
   }
 #endif
 
@@ -331,6 +390,12 @@ bool FFmpegDecoder::InitializeDecoder(std::shared_ptr<const StreamInfo> info,
   return true;
 }
 
+void FFmpegDecoder::FreeContext() {
+  if (decoder_ctx_ && decoder_ctx_->codec_type == AVMEDIA_TYPE_VIDEO)
+    g_video_decoder_count--;
+  avcodec_free_context(&decoder_ctx_);
+}
+
 bool FFmpegDecoder::ReadFromDecoder(
     std::shared_ptr<const StreamInfo> stream_info,
     std::shared_ptr<EncodedFrame> input,
@@ -61,6 +61,7 @@ class FFmpegDecoder : public Decoder {
   bool InitializeDecoder(std::shared_ptr<const StreamInfo> info,
                          bool allow_hardware,
                          std::string* extra_info);
+  void FreeContext();
   bool ReadFromDecoder(std::shared_ptr<const StreamInfo> stream_info,
                        std::shared_ptr<EncodedFrame> input,
                        std::vector<std::shared_ptr<DecodedFrame>>* decoded,
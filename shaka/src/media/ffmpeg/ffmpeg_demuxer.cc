@@ -37,7 +37,12 @@ namespace ffmpeg {
 
 namespace {
 
-constexpr const size_t kInitialBufferSize = 2048;
+/**
+ * The size of the AVIO buffer.  FFmpeg copies the appended data into this
+ * buffer in chunks of this size, so a larger buffer means fewer calls to
+ * OnRead and fewer small reads while parsing.
+ */
+constexpr const size_t kIoBufferSize = 64 * 1024;
 
 void LogError(int code) {
   LOG(ERROR) << "Error from FFmpeg: " << av_err2str(code);
@@ -394,9 +399,7 @@ Rational<uint32_t> GetSarFromHevc(const std::vector<uint8_t>& extra_data) {
 FFmpegDemuxer::FFmpegDemuxer(Demuxer::Client* client,
                              const std::string& mime_type,
                              const std::string& container)
-    : signal_("FFmpegDemuxer"),
-      mutex_("FFmpegDemuxer"),
-      mime_type_(mime_type),
+    : mime_type_(mime_type),
       container_(container),
       io_(nullptr),
       demuxer_ctx_(nullptr),
@@ -407,15 +410,15 @@ FFmpegDemuxer::FFmpegDemuxer(Demuxer::Client* client,
       input_size_(0),
       input_pos_(0),
       state_(State::Waiting),
-      thread_("FFmepgDemuxer", std::bind(&FFmpegDemuxer::ThreadMain, this)) {}
+      routine_("FFmpegDemuxer", std::bind(&FFmpegDemuxer::DemuxLoop, this)) {}
 
 FFmpegDemuxer::~FFmpegDemuxer() {
-  {
-    std::unique_lock<Mutex> lock(mutex_);
-    state_ = State::Stopping;
-    signal_.SignalAll();
-  }
-  thread_.join();
+  // If the demuxer is waiting for input, let it exit; any pending reads will
+  // fail, which will stop the loop.
+  state_ = State::Stopping;
+  if (routine_.started() && !routine_.finished())
+    routine_.Resume();
+  demuxer_ctx_.reset();
 
   if (io_) {
     // If an IO buffer was allocated by libavformat, it must be freed by us.
@@ -435,7 +438,6 @@ void FFmpegDemuxer::Reset() {
 bool FFmpegDemuxer::Demux(double timestamp_offset, const uint8_t* data,
                           size_t size,
                           std::vector<std::shared_ptr<EncodedFrame>>* frames) {
-  std::unique_lock<Mutex> lock(mutex_);
   if (state_ != State::Waiting) {
     DCHECK(state_ == State::Errored || state_ == State::Stopping);
     return false;
@@ -447,11 +449,10 @@ bool FFmpegDemuxer::Demux(double timestamp_offset, const uint8_t* data,
   input_size_ = size;
   input_pos_ = 0;
 
+  // This runs until all the input has been read or there is an error.
   state_ = State::Parsing;
-  while (state_ == State::Parsing) {
-    signal_.SignalAll();
-    signal_.ResetAndWaitWhileUnlocked(lock);
-  }
+  routine_.Resume();
+  DCHECK(state_ != State::Parsing);
 
   output_ = nullptr;
   input_ = nullptr;
@@ -459,14 +460,14 @@ bool FFmpegDemuxer::Demux(double timestamp_offset, const uint8_t* data,
   return state_ == State::Waiting;
 }
 
+// static
 int FFmpegDemuxer::OnRead(void* user, uint8_t* buffer, int size) {
   auto* that = reinterpret_cast<FFmpegDemuxer*>(user);
-  std::unique_lock<Mutex> lock(that->mutex_);
   while (that->input_pos_ >= that->input_size_ &&
-         (that->state_ == State::Parsing || that->state_ == State::Waiting)) {
+         that->state_ == State::Parsing) {
+    // Return to Demux() until we get more data.
     that->state_ = State::Waiting;
-    that->signal_.SignalAll();
-    that->signal_.ResetAndWaitWhileUnlocked(lock);
+    that->routine_.Yield();
   }
   if (that->state_ != State::Parsing) {
     DCHECK(that->state_ == State::Errored || that->state_ == State::Stopping);
@@ -480,13 +481,13 @@ int FFmpegDemuxer::OnRead(void* user, uint8_t* buffer, int size) {
   return to_read;
 }
 
-void FFmpegDemuxer::ThreadMain() {
+void FFmpegDemuxer::DemuxLoop() {
   // Allocate a context for custom IO.
   // NOTE: The buffer may be reallocated/resized by libavformat later.
   // It is always our responsibility to free it later with av_free.
   io_ = avio_alloc_context(
-      reinterpret_cast<unsigned char*>(av_malloc(kInitialBufferSize)),
-      kInitialBufferSize,
+      reinterpret_cast<unsigned char*>(av_malloc(kIoBufferSize)),
+      kIoBufferSize,
       0,     // write_flag (read-only)
       this,  // opaque user data
       &OnRead,
@@ -509,48 +510,40 @@ void FFmpegDemuxer::ThreadMain() {
     }
   }
 
-  std::unique_lock<Mutex> lock(mutex_);
   while (true) {
-    while (state_ == State::Waiting) {
-      signal_.SignalAll();
-      signal_.ResetAndWaitWhileUnlocked(lock);
-    }
-    if (state_ != State::Parsing)
-      return;
-
     AVPacket pkt;
-    {
-      util::Unlocker<Mutex> unlock(&lock);
-      int ret = av_read_frame(demuxer_ctx_.get(), &pkt);
-      if (ret == AVERROR_SHAKA_RESET_DEMUXER) {
-        // Special case for Shaka where we need to reinit the demuxer.
-        VLOG(1) << "Reinitializing demuxer";
-        {
-          std::unique_lock<Mutex> lock(mutex_);
-          // Re-read the input data with the new demuxer.
-          input_pos_ = 0;
-        }
-
-        if (!ReinitDemuxer())
-          return OnError();
-        ret = av_read_frame(demuxer_ctx_.get(), &pkt);
-      }
-      if (ret < 0) {
-        av_packet_unref(&pkt);
-        LogError(ret);
+    int ret = av_read_frame(demuxer_ctx_.get(), &pkt);
+    if (ret == AVERROR_SHAKA_RESET_DEMUXER) {
+      // Special case for Shaka where we need to reinit the demuxer.
+      VLOG(1) << "Reinitializing demuxer";
+      // Re-read the input data with the new demuxer.
+      input_pos_ = 0;
+
+      if (!ReinitDemuxer())
         return OnError();
-      }
+      ret = av_read_frame(demuxer_ctx_.get(), &pkt);
+    }
+    if (ret < 0) {
+      av_packet_unref(&pkt);
+      if (state_ != State::Stopping)
+        LogError(ret);
+      return OnError();
+    }
+    if (state_ != State::Parsing) {
+      // We are being destroyed; FFmpeg may still return buffered frames.
+      av_packet_unref(&pkt);
+      return;
+    }
 
-      UpdateEncryptionInfo();
+    UpdateEncryptionInfo();
 
-      // Ignore discard flags.  The demuxer will set this when we try to read
-      // content behind media we have already read.
-      pkt.flags &= ~AV_PKT_FLAG_DISCARD;
+    // Ignore discard flags.  The demuxer will set this when we try to read
+    // content behind media we have already read.
+    pkt.flags &= ~AV_PKT_FLAG_DISCARD;
 
-      VLOG(3) << "Read frame at dts=" << pkt.dts;
-      DCHECK_EQ(pkt.stream_index, 0);
-      DCHECK_EQ(demuxer_ctx_->nb_streams, 1u);
-    }
+    VLOG(3) << "Read frame at dts=" << pkt.dts;
+    DCHECK_EQ(pkt.stream_index, 0);
+    DCHECK_EQ(demuxer_ctx_->nb_streams, 1u);
 
     auto* frame = ffmpeg::FFmpegEncodedFrame::MakeFrame(&pkt, cur_stream_info_,
                                                         timestamp_offset_);
@@ -561,7 +554,6 @@ void FFmpegDemuxer::ThreadMain() {
     } else {
       av_packet_unref(&pkt);
       state_ = State::Errored;
-      signal_.SignalAll();
       return;
     }
   }
@@ -688,10 +680,8 @@ void FFmpegDemuxer::UpdateEncryptionInfo() {
 }
 
 void FFmpegDemuxer::OnError() {
-  std::unique_lock<Mutex> lock(mutex_);
   if (state_ != State::Stopping)
     state_ = State::Errored;
-  signal_.SignalAllIfNotSet();
 }
 
 
@@ -25,9 +25,7 @@ extern "C" {
 
 #include "shaka/media/demuxer.h"
 #include "shaka/media/stream_info.h"
-#include "src/debug/mutex.h"
-#include "src/debug/thread.h"
-#include "src/debug/thread_event.h"
+#include "src/util/coroutine.h"
 
 namespace shaka {
 namespace media {
@@ -36,6 +34,11 @@ namespace ffmpeg {
 /**
  * An implementation of the Demuxer type that uses FFmpeg to demux frames.  This
  * produces FFmpegEncodedFrame objects.
+ *
+ * FFmpeg pulls its input through a blocking read callback, so the demux loop
+ * runs in a Coroutine.  When the appended data runs out, the read callback
+ * yields back to Demux() instead of blocking; the next Demux() call resumes
+ * where it left off.  All the work happens on the thread calling Demux().
  */
 class FFmpegDemuxer : public Demuxer {
  public:
@@ -70,25 +73,20 @@ class FFmpegDemuxer : public Demuxer {
 
   static int OnRead(void* user, uint8_t* buffer, int size);
 
-  void ThreadMain();
+  void DemuxLoop();
 
   bool ReinitDemuxer();
   void UpdateEncryptionInfo();
   void OnError();
 
-  ThreadEvent<void> signal_;
-  Mutex mutex_;
   const std::string mime_type_;
   const std::string container_;
 
-  // These fields can only be used from the background thread and aren't
-  // protected by the mutex.
   std::shared_ptr<const StreamInfo> cur_stream_info_;
   AVIOContext* io_;
   FormatContext demuxer_ctx_;
   Demuxer::Client* client_;
 
-  // These fields are protected by the mutex.
   std::vector<std::shared_ptr<EncodedFrame>>* output_;
   double timestamp_offset_;
   const uint8_t* input_;
@@ -96,8 +94,7 @@ class FFmpegDemuxer : public Demuxer {
   size_t input_pos_;
   State state_;
 
-  // Needs to be last so fields are initialized when the thread starts.
-  Thread thread_;
+  util::Coroutine routine_;
 };
 
 class FFmpegDemuxerFactory : public DemuxerFactory {
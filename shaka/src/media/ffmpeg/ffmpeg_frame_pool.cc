@@ -0,0 +1,221 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/ffmpeg/ffmpeg_frame_pool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace shaka {
+namespace media {
+namespace ffmpeg {
+
+size_t FFmpegFramePool::KeyHash::operator()(const Key& key) const {
+  size_t ret = std::hash<int>()(key.format);
+  ret = ret * 31 + std::hash<int>()(key.width);
+  ret = ret * 31 + std::hash<int>()(key.height);
+  ret = ret * 31 + std::hash<size_t>()(key.size);
+  return ret;
+}
+
+FFmpegFramePool::FFmpegFramePool()
+    : mutex_("FFmpegFramePool"),
+      max_pooled_bytes_(kDefaultMaxPooledBytes),
+      in_use_bytes_(0),
+      pooled_bytes_(0),
+      peak_bytes_(0),
+      requests_(0),
+      allocations_(0) {}
+
+FFmpegFramePool::~FFmpegFramePool() {
+  Clear();
+}
+
+// static
+FFmpegFramePool* FFmpegFramePool::Instance() {
+  // Leaked so buffers can be released during static destruction.
+  static FFmpegFramePool* instance = new FFmpegFramePool;
+  return instance;
+}
+
+// static
+int FFmpegFramePool::GetBuffer(AVCodecContext* ctx, AVFrame* frame,
+                               int flags) {
+  // Hardware frames are allocated by the hardware context; and decoders
+  // without DR1 don't support custom buffers.
+  const AVPixFmtDescriptor* desc =
+      av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+  if (ctx->codec_type != AVMEDIA_TYPE_VIDEO || ctx->hw_frames_ctx ||
+      !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) || !desc ||
+      (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+  }
+
+  return Instance()->Allocate(ctx, frame);
+}
+
+void FFmpegFramePool::SetMaxPooledBytes(size_t bytes) {
+  std::unique_lock<Mutex> lock(mutex_);
+  max_pooled_bytes_ = bytes;
+  TrimLocked(bytes);
+}
+
+void FFmpegFramePool::Clear() {
+  std::unique_lock<Mutex> lock(mutex_);
+  TrimLocked(0);
+}
+
+FFmpegFramePool::Stats FFmpegFramePool::GetStats() const {
+  std::unique_lock<Mutex> lock(mutex_);
+  Stats ret;
+  ret.requests = requests_;
+  ret.allocations = allocations_;
+  ret.in_use_bytes = in_use_bytes_;
+  ret.pooled_bytes = pooled_bytes_;
+  ret.peak_bytes = peak_bytes_;
+  return ret;
+}
+
+void FFmpegFramePool::ResetStats() {
+  std::unique_lock<Mutex> lock(mutex_);
+  requests_ = allocations_ = 0;
+  peak_bytes_ = in_use_bytes_ + pooled_bytes_;
+}
+
+// static
+void FFmpegFramePool::Release(void* opaque, uint8_t* /* data */) {
+  auto* buffer = reinterpret_cast<Buffer*>(opaque);
+  FFmpegFramePool* pool = buffer->pool;
+
+  std::unique_lock<Mutex> lock(pool->mutex_);
+  pool->in_use_bytes_ -= buffer->key.size;
+  if (buffer->key.size > pool->max_pooled_bytes_) {
+    pool->FreeBuffer(buffer);
+    return;
+  }
+
+  pool->TrimLocked(pool->max_pooled_bytes_ - buffer->key.size);
+  pool->free_buffers_[buffer->key].emplace_back(buffer);
+  pool->pooled_bytes_ += buffer->key.size;
+}
+
+int FFmpegFramePool::Allocate(AVCodecContext* ctx, AVFrame* frame) {
+  const auto format = static_cast<AVPixelFormat>(frame->format);
+  int width = frame->width;
+  int height = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+
+  // This matches the layout avcodec_default_get_buffer2 uses: increase the
+  // alignment of the width until every line size is aligned.  The line sizes
+  // can't be aligned individually since some decoders assume the planes have
+  // proportional line sizes.
+  int linesizes[4];
+  bool unaligned;
+  do {
+    const int code = av_image_fill_linesizes(linesizes, format, width);
+    if (code < 0)
+      return code;
+    width += width & ~(width - 1);
+
+    unaligned = false;
+    for (size_t i = 0; i < 4; i++)
+      unaligned |= linesizes[i] % linesize_align[i] != 0;
+  } while (unaligned);
+
+  uint8_t* planes[4];
+  const int size =
+      av_image_fill_pointers(planes, format, height, nullptr, linesizes);
+  if (size < 0)
+    return size;
+
+  Buffer* buffer = TakeBuffer(
+      {frame->format, frame->width, frame->height, static_cast<size_t>(size)});
+  if (!buffer)
+    return AVERROR(ENOMEM);
+  frame->buf[0] = av_buffer_create(buffer->data, size, &Release, buffer, 0);
+  if (!frame->buf[0]) {
+    Release(buffer, buffer->data);
+    return AVERROR(ENOMEM);
+  }
+
+  av_image_fill_pointers(frame->data, format, height, buffer->data, linesizes);
+  for (size_t i = 0; i < 4; i++)
+    frame->linesize[i] = linesizes[i];
+  frame->extended_data = frame->data;
+  return 0;
+}
+
+FFmpegFramePool::Buffer* FFmpegFramePool::TakeBuffer(const Key& key) {
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    requests_++;
+    in_use_bytes_ += key.size;
+    auto it = free_buffers_.find(key);
+    if (it != free_buffers_.end()) {
+      DCHECK(!it->second.empty());
+      Buffer* ret = it->second.back();
+      it->second.pop_back();
+      if (it->second.empty())
+        free_buffers_.erase(it);
+      pooled_bytes_ -= key.size;
+      return ret;
+    }
+
+    allocations_++;
+    peak_bytes_ = std::max(peak_bytes_, in_use_bytes_ + pooled_bytes_);
+  }
+
+  // Allocate outside the lock since large allocations can be slow.  Add
+  // padding since some decoders read past the end of the planes.
+  auto* data = reinterpret_cast<uint8_t*>(
+      av_malloc(key.size + AV_INPUT_BUFFER_PADDING_SIZE));
+  if (!data) {
+    std::unique_lock<Mutex> lock(mutex_);
+    in_use_bytes_ -= key.size;
+    return nullptr;
+  }
+  return new Buffer{this, key, data};
+}
+
+void FFmpegFramePool::FreeBuffer(Buffer* buffer) {
+  av_free(buffer->data);
+  delete buffer;
+}
+
+void FFmpegFramePool::TrimLocked(size_t max_bytes) {
+  for (auto it = free_buffers_.begin();
+       it != free_buffers_.end() && pooled_bytes_ > max_bytes;) {
+    auto& buffers = it->second;
+    while (!buffers.empty() && pooled_bytes_ > max_bytes) {
+      pooled_bytes_ -= buffers.back()->key.size;
+      FreeBuffer(buffers.back());
+      buffers.pop_back();
+    }
+    if (buffers.empty())
+      it = free_buffers_.erase(it);
+    else
+      ++it;
+  }
+}
+
+}  // namespace ffmpeg
+}  // namespace media
+}  // namespace shaka
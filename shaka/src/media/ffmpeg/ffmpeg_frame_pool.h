@@ -0,0 +1,138 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_FFMPEG_FFMPEG_FRAME_POOL_H_
+#define SHAKA_EMBEDDED_MEDIA_FFMPEG_FFMPEG_FRAME_POOL_H_
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "src/debug/mutex.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+namespace ffmpeg {
+
+/**
+ * A pool of video frame buffers that FFmpeg decodes into.  This is installed
+ * as the AVCodecContext::get_buffer2 callback.  Once the last reference to a
+ * frame is dropped (i.e. when the FFmpegDecodedFrame is evicted from the
+ * stream), its buffer is returned here and reused for the next frame with the
+ * same pixel format and resolution.
+ *
+ * Unlike FFmpeg's internal pool, this is shared between decoders and outlives
+ * them, so the buffers are kept across seeks and decoder reconfigurations.
+ *
+ * This type is thread-safe.
+ */
+class FFmpegFramePool {
+ public:
+  /** The default value for the maximum number of unused bytes to keep. */
+  static constexpr const size_t kDefaultMaxPooledBytes = 64 * 1024 * 1024;
+
+  struct Stats {
+    /** The number of buffers given to the decoder. */
+    uint64_t requests;
+    /** The number of buffers that needed to be allocated. */
+    uint64_t allocations;
+    /** The number of bytes currently held by decoded frames. */
+    size_t in_use_bytes;
+    /** The number of bytes currently waiting in the pool. */
+    size_t pooled_bytes;
+    /** The largest total number of bytes allocated at once. */
+    size_t peak_bytes;
+
+    /** @return The fraction of requests that reused a buffer. */
+    double hit_rate() const {
+      return requests ? 1 - static_cast<double>(allocations) / requests : 0;
+    }
+  };
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(FFmpegFramePool);
+
+  static FFmpegFramePool* Instance();
+
+  /**
+   * The AVCodecContext::get_buffer2 callback.  This uses the pool for
+   * software video frames and uses the default allocator for everything else.
+   */
+  static int GetBuffer(AVCodecContext* ctx, AVFrame* frame, int flags);
+
+  /**
+   * Sets the maximum number of bytes of unused buffers to keep.  Buffers
+   * returned beyond this are freed.  Setting this to 0 disables pooling.
+   */
+  void SetMaxPooledBytes(size_t bytes);
+
+  /** Frees all the unused buffers. */
+  void Clear();
+
+  Stats GetStats() const;
+  /** Resets the request counters and sets the peak to the current usage. */
+  void ResetStats();
+
+ private:
+  struct Key {
+    int format;
+    int width;
+    int height;
+    size_t size;
+
+    bool operator==(const Key& other) const {
+      return format == other.format && width == other.width &&
+             height == other.height && size == other.size;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  struct Buffer {
+    FFmpegFramePool* pool;
+    Key key;
+    uint8_t* data;
+  };
+
+  FFmpegFramePool();
+  ~FFmpegFramePool();
+
+  static void Release(void* opaque, uint8_t* data);
+
+  int Allocate(AVCodecContext* ctx, AVFrame* frame);
+  Buffer* TakeBuffer(const Key& key);
+  void FreeBuffer(Buffer* buffer);
+  void TrimLocked(size_t max_bytes);
+
+  mutable Mutex mutex_;
+  std::unordered_map<Key, std::vector<Buffer*>, KeyHash> free_buffers_;
+  size_t max_pooled_bytes_;
+  size_t in_use_bytes_;
+  size_t pooled_bytes_;
+  size_t peak_bytes_;
+  uint64_t requests_;
+  uint64_t allocations_;
+};
+
+}  // namespace ffmpeg
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_FFMPEG_FFMPEG_FRAME_POOL_H_
@@ -0,0 +1,80 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/frame_reclaimer.h"
+
+#include <functional>
+#include <iterator>
+#include <utility>
+
+namespace shaka {
+namespace media {
+
+FrameReclaimer::FrameReclaimer()
+    : mutex_("FrameReclaimer"),
+      busy_(false),
+      thread_("FrameReclaimer",
+              std::bind(&FrameReclaimer::ThreadMain, this)) {}
+
+// The instance is leaked, so this is never called; the thread is never joined.
+FrameReclaimer::~FrameReclaimer() {}
+
+// static
+FrameReclaimer* FrameReclaimer::Instance() {
+  static FrameReclaimer* instance = new FrameReclaimer;
+  return instance;
+}
+
+void FrameReclaimer::Release(std::vector<std::shared_ptr<BaseFrame>>* frames) {
+  if (frames->empty())
+    return;
+
+  std::unique_lock<Mutex> lock(mutex_);
+  if (pending_.empty()) {
+    pending_.swap(*frames);
+    signal_.notify_all();
+  } else {
+    // The thread is already going to wake up, so just add to the queue.
+    pending_.insert(pending_.end(), std::make_move_iterator(frames->begin()),
+                    std::make_move_iterator(frames->end()));
+    frames->clear();
+  }
+}
+
+void FrameReclaimer::WaitUntilIdle() {
+  std::unique_lock<Mutex> lock(mutex_);
+  while (busy_ || !pending_.empty())
+    signal_.wait(lock);
+}
+
+void FrameReclaimer::ThreadMain() {
+  std::unique_lock<Mutex> lock(mutex_);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  while (true) {
+    while (pending_.empty())
+      signal_.wait(lock);
+
+    frames.swap(pending_);
+    busy_ = true;
+    lock.unlock();
+    // Destroy the frames outside the lock so new frames can be queued.
+    frames.clear();
+    lock.lock();
+    busy_ = false;
+    signal_.notify_all();
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,75 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_FRAME_RECLAIMER_H_
+#define SHAKA_EMBEDDED_MEDIA_FRAME_RECLAIMER_H_
+
+#include <condition_variable>
+#include <memory>
+#include <vector>
+
+#include "shaka/media/frames.h"
+#include "src/debug/mutex.h"
+#include "src/debug/thread.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * Destroys frames on a background thread.  Dropping the last reference to a
+ * decoded frame can free several MB, so evicting many frames at once can take
+ * a long time.  Streams pass the frames they remove here so the memory is
+ * released without blocking the caller or holding the stream lock.
+ *
+ * This type is thread-safe.
+ */
+class FrameReclaimer {
+ public:
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(FrameReclaimer);
+
+  /**
+   * @return The global instance of the reclaimer.  This is never destroyed so
+   *   it can be used during shutdown.
+   */
+  static FrameReclaimer* Instance();
+
+  /**
+   * Takes the references in the given vector and drops them on the background
+   * thread.  The vector is left empty.
+   */
+  void Release(std::vector<std::shared_ptr<BaseFrame>>* frames);
+
+  /** Blocks until every frame given to Release() has been dropped. */
+  void WaitUntilIdle();
+
+ private:
+  FrameReclaimer();
+  ~FrameReclaimer();
+
+  void ThreadMain();
+
+  Mutex mutex_;
+  std::condition_variable_any signal_;
+  std::vector<std::shared_ptr<BaseFrame>> pending_;
+  bool busy_;
+
+  // Should be last so the thread starts after all the fields are initialized.
+  Thread thread_;
+};
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_FRAME_RECLAIMER_H_
@@ -16,6 +16,8 @@
 
 #include <glog/logging.h>
 
+#include <utility>
+
 namespace shaka {
 namespace media {
 
@@ -28,6 +30,7 @@ std::ostream& operator<<(std::ostream& os, PixelFormat format) {
     CASE(NV12);
     CASE(RGB24);
     CASE(VideoToolbox);
+    CASE(HardwareFrame);
 #undef CASE
 
     default:
@@ -99,6 +102,7 @@ size_t GetPlaneCount(variant<PixelFormat, SampleFormat> format,
         return 2;
       case PixelFormat::RGB24:
       case PixelFormat::VideoToolbox:
+      case PixelFormat::HardwareFrame:
         return 1;
 
       default:
@@ -167,7 +171,10 @@ size_t EncodedFrame::EstimateSize() const {
 }
 
 
-class DecodedFrame::Impl {};
+class DecodedFrame::Impl {
+ public:
+  std::function<std::shared_ptr<DecodedFrame>()> map_hardware_frame;
+};
 
 DecodedFrame::DecodedFrame(std::shared_ptr<const StreamInfo> stream, double pts,
                            double dts, double duration,
@@ -196,5 +203,18 @@ size_t DecodedFrame::EstimateSize() const {
   return ret;
 }
 
+std::shared_ptr<DecodedFrame> DecodedFrame::MapHardwareFrame() const {
+  if (!impl_ || !impl_->map_hardware_frame)
+    return nullptr;
+  return impl_->map_hardware_frame();
+}
+
+void DecodedFrame::SetHardwareFrameMapper(
+    std::function<std::shared_ptr<DecodedFrame>()> mapper) {
+  if (!impl_)
+    impl_.reset(new Impl);
+  impl_->map_hardware_frame = std::move(mapper);
+}
+
 }  // namespace media
 }  // namespace shaka
@@ -0,0 +1,353 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/media_executor.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+#include "src/util/utils.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/** The maximum number of threads used when the count isn't given. */
+constexpr const size_t kMaxDefaultThreadCount = 8;
+
+/**
+ * The number of jobs a worker runs in priority order before it runs the lowest
+ * priority queued job, so lower priorities always make progress.
+ */
+constexpr const size_t kAgingInterval = 8;
+
+std::atomic<size_t> g_thread_count{0};
+std::atomic<bool> g_instance_created{false};
+
+struct GlobalPolicy {
+  GlobalPolicy() : mutex("MediaThreadingPolicy") {}
+
+  Mutex mutex;
+  MediaThreadingPolicy policy;
+};
+
+GlobalPolicy* GetGlobalPolicy() {
+  // Leaked so it can be used during static destruction.
+  static GlobalPolicy* policy = new GlobalPolicy;
+  return policy;
+}
+
+size_t DefaultThreadCount() {
+  const size_t cores = std::thread::hardware_concurrency();
+  return std::min(std::max<size_t>(cores, 2), kMaxDefaultThreadCount);
+}
+
+}  // namespace
+
+MediaExecutor::Job::Job(const std::string& name, bool pinned,
+                        std::function<double()> callback,
+                        MediaExecutor* executor)
+    : executor_(executor),
+      name_(name),
+      pinned_(pinned),
+      callback_(std::move(callback)),
+      priority_(MediaPriority::Normal),
+      queued_(false),
+      running_(false),
+      wake_pending_(false),
+      stopped_(false) {
+  std::unique_lock<Mutex> lock(executor_->mutex_);
+  // Spread the jobs between the workers; this is the only worker a pinned job
+  // will run on.
+  worker_ = executor_->next_worker_++ % executor_->workers_.size();
+  timer_ = executor_->timers_.end();
+}
+
+MediaExecutor::Job::~Job() {
+  Stop();
+}
+
+void MediaExecutor::Job::Wake() {
+  std::unique_lock<Mutex> lock(executor_->mutex_);
+  if (stopped_ || queued_)
+    return;
+  if (running_) {
+    // Run it again once the current call returns.
+    wake_pending_ = true;
+    return;
+  }
+  executor_->Cancel(this);
+  executor_->Enqueue(this);
+}
+
+void MediaExecutor::Job::SetPriority(MediaPriority priority) {
+  std::unique_lock<Mutex> lock(executor_->mutex_);
+  if (priority == priority_)
+    return;
+  // Move it to the queue for the new priority.
+  const bool was_queued = queued_;
+  if (was_queued)
+    executor_->Cancel(this);
+  priority_ = priority;
+  if (was_queued)
+    executor_->Enqueue(this);
+}
+
+void MediaExecutor::Job::Stop() {
+  std::unique_lock<Mutex> lock(executor_->mutex_);
+  stopped_ = true;
+  executor_->Cancel(this);
+  while (running_)
+    executor_->job_done_.wait(lock);
+}
+
+
+MediaExecutor::MediaExecutor(size_t thread_count)
+    : mutex_("MediaExecutor"),
+      timer_owner_(nullptr),
+      next_worker_(0),
+      shutdown_(false) {
+  CHECK_GT(thread_count, 0u);
+  std::unique_lock<Mutex> lock(mutex_);
+  for (size_t i = 0; i < thread_count; i++) {
+    workers_.emplace_back(new Worker);
+    Worker* worker = workers_.back().get();
+    worker->index = i;
+    worker->runs_since_aging = 0;
+    worker->idle = false;
+    worker->thread.reset(new Thread(
+        "Media" + std::to_string(i),
+        std::bind(&MediaExecutor::ThreadMain, this, worker)));
+  }
+}
+
+MediaExecutor::~MediaExecutor() {
+  {
+    std::unique_lock<Mutex> lock(mutex_);
+    DCHECK(timers_.empty()) << "All jobs must be stopped first";
+    shutdown_ = true;
+    for (auto& worker : workers_)
+      worker->signal.notify_all();
+  }
+  for (auto& worker : workers_)
+    worker->thread->join();
+}
+
+// static
+MediaExecutor* MediaExecutor::Instance() {
+  // Leaked so jobs can be stopped during static destruction.
+  static MediaExecutor* instance = [] {
+    g_instance_created = true;
+    const size_t count = g_thread_count;
+    return new MediaExecutor(count ? count : DefaultThreadCount());
+  }();
+  return instance;
+}
+
+// static
+bool MediaExecutor::SetGlobalThreadCount(size_t thread_count) {
+  if (g_instance_created) {
+    LOG(ERROR) << "The media thread count must be set before creating players";
+    return false;
+  }
+  g_thread_count = thread_count;
+  return true;
+}
+
+// static
+void MediaExecutor::SetGlobalThreadingPolicy(
+    const MediaThreadingPolicy& policy) {
+  GlobalPolicy* global = GetGlobalPolicy();
+  std::unique_lock<Mutex> lock(global->mutex);
+  global->policy = policy;
+}
+
+// static
+MediaThreadingPolicy MediaExecutor::GlobalThreadingPolicy() {
+  GlobalPolicy* global = GetGlobalPolicy();
+  std::unique_lock<Mutex> lock(global->mutex);
+  return global->policy;
+}
+
+// static
+void MediaExecutor::ConfigureCurrentThread(bool audio) {
+  const MediaThreadingPolicy policy = GlobalThreadingPolicy();
+  Thread::SetCurrentThreadAffinity(policy.cpu_affinity);
+  Thread::SetCurrentThreadPriority(audio ? policy.audio_thread_priority
+                                         : policy.media_thread_priority);
+}
+
+void MediaExecutor::Enqueue(Job* job) {
+  DCHECK(!job->queued_ && !job->running_);
+  Worker* worker = workers_[job->worker_].get();
+  worker->queues[static_cast<size_t>(job->priority_)].emplace_back(job);
+  job->queued_ = true;
+  WakeWorker(worker, job->pinned_);
+}
+
+void MediaExecutor::Cancel(Job* job) {
+  if (job->queued_) {
+    auto& queue =
+        workers_[job->worker_]->queues[static_cast<size_t>(job->priority_)];
+    queue.erase(std::find(queue.begin(), queue.end(), job));
+    job->queued_ = false;
+  }
+  if (job->timer_ != timers_.end()) {
+    timers_.erase(job->timer_);
+    job->timer_ = timers_.end();
+  }
+}
+
+void MediaExecutor::WakeWorker(Worker* preferred, bool pinned) {
+  // Prefer the worker that owns the queue; otherwise any idle worker can steal
+  // the job.
+  // Clear the idle flag so the next job wakes a different worker.
+  if (preferred->idle || pinned) {
+    preferred->idle = false;
+    preferred->signal.notify_all();
+    return;
+  }
+  for (auto& worker : workers_) {
+    if (worker->idle) {
+      worker->idle = false;
+      worker->signal.notify_all();
+      return;
+    }
+  }
+}
+
+void MediaExecutor::MoveDueTimers(Clock::time_point now) {
+  while (!timers_.empty() && timers_.begin()->first <= now) {
+    Job* job = timers_.begin()->second;
+    timers_.erase(timers_.begin());
+    job->timer_ = timers_.end();
+    Enqueue(job);
+  }
+}
+
+MediaExecutor::Job* MediaExecutor::TakeJobWithPriority(Worker* worker,
+                                                       size_t priority) {
+  auto& own = worker->queues[priority];
+  if (!own.empty()) {
+    Job* ret = own.front();
+    own.pop_front();
+    return ret;
+  }
+
+  // Look at the other workers, starting with the next one so the stealing is
+  // spread out.
+  for (size_t i = 1; i < workers_.size(); i++) {
+    Worker* other = workers_[(worker->index + i) % workers_.size()].get();
+    auto& queue = other->queues[priority];
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+      if (!(*it)->pinned_) {
+        Job* ret = *it;
+        queue.erase(it);
+        // Keep it on this worker from now on.
+        ret->worker_ = worker->index;
+        return ret;
+      }
+    }
+  }
+  return nullptr;
+}
+
+MediaExecutor::Job* MediaExecutor::TakeJob(Worker* worker) {
+  if (worker->runs_since_aging >= kAgingInterval) {
+    // Give the lowest priority job a turn, otherwise a steady stream of higher
+    // priority work would starve it.
+    for (size_t priority = 0; priority < kPriorityCount; priority++) {
+      if (Job* job = TakeJobWithPriority(worker, priority)) {
+        worker->runs_since_aging = 0;
+        return job;
+      }
+    }
+    return nullptr;
+  }
+
+  for (size_t priority = kPriorityCount; priority-- > 0;) {
+    if (Job* job = TakeJobWithPriority(worker, priority)) {
+      worker->runs_since_aging++;
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void MediaExecutor::ThreadMain(Worker* worker) {
+  ConfigureCurrentThread(/* audio= */ false);
+
+  std::unique_lock<Mutex> lock(mutex_);
+  while (!shutdown_) {
+    MoveDueTimers(Clock::now());
+    Job* job = TakeJob(worker);
+    if (!job) {
+      worker->idle = true;
+      if (timers_.empty() || (timer_owner_ && timer_owner_ != worker)) {
+        worker->signal.wait(lock);
+      } else {
+        timer_owner_ = worker;
+        // Copy the time since the timer can be removed while waiting.
+        const Clock::time_point next_timer = timers_.begin()->first;
+        worker->signal.wait_until(lock, next_timer);
+      }
+      worker->idle = false;
+      continue;
+    }
+
+    if (timer_owner_ == worker) {
+      // Let another idle worker wait for the timers while this runs the job.
+      timer_owner_ = nullptr;
+      if (!timers_.empty())
+        WakeWorker(worker, /* pinned= */ false);
+    }
+
+    job->queued_ = false;
+    job->running_ = true;
+    double delay;
+    {
+      util::Unlocker<Mutex> unlock(&lock);
+      delay = job->callback_();
+    }
+    job->running_ = false;
+
+    if (job->stopped_) {
+      job_done_.notify_all();
+    } else if (job->wake_pending_ || delay <= 0) {
+      job->wake_pending_ = false;
+      Enqueue(job);
+    } else if (!std::isinf(delay)) {
+      const auto time =
+          Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                             std::chrono::duration<double>(delay));
+      job->timer_ = timers_.emplace(time, job);
+      // If this is the next timer, make sure a sleeping worker sees it.
+      if (job->timer_ == timers_.begin()) {
+        if (timer_owner_)
+          timer_owner_->signal.notify_all();
+        else
+          WakeWorker(workers_[job->worker_].get(), job->pinned_);
+      }
+    }
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,196 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_MEDIA_MEDIA_EXECUTOR_H_
+#define SHAKA_EMBEDDED_MEDIA_MEDIA_EXECUTOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shaka/media/default_media_player.h"
+#include "src/debug/mutex.h"
+#include "src/debug/thread.h"
+#include "src/util/macros.h"
+
+namespace shaka {
+namespace media {
+
+/**
+ * A pool of threads that is shared by the media pipelines of every player.
+ * Instead of each stream having a dedicated thread that mostly sleeps, each
+ * one creates a Job that is run on the pool when it has work to do.
+ *
+ * Each worker thread has its own queue of jobs.  A job is queued on the worker
+ * that last ran it so the decoder state stays in that core's cache; idle
+ * workers steal jobs from the other queues.  Jobs with a higher priority are
+ * run first, so a foreground player isn't slowed down by thumbnails; every few
+ * runs a worker picks the lowest priority job instead so busy foreground
+ * players can't starve the background ones.
+ *
+ * This type is thread-safe.
+ */
+class MediaExecutor {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * A recurring task run on the executor.  The callback is never run on more
+   * than one thread at a time.  It returns the number of seconds to wait before
+   * it should be run again; it will be run sooner if Wake() is called.  This
+   * can return 0 to yield to other jobs, or INFINITY to wait for Wake().
+   */
+  class Job {
+   public:
+    /**
+     * Creates a new job.  It isn't run until Wake() is called.
+     *
+     * @param name The name of the job, for debugging.
+     * @param pinned If true, the job is always run on the same thread.  This is
+     *   needed when the job uses thread-local state, like a Coroutine.
+     * @param callback The callback to run.
+     */
+    Job(const std::string& name, bool pinned, std::function<double()> callback,
+        MediaExecutor* executor = MediaExecutor::Instance());
+    ~Job();
+
+    SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(Job);
+
+    const std::string& name() const {
+      return name_;
+    }
+
+    /** Runs the job as soon as possible. */
+    void Wake();
+
+    /** Sets the priority used to pick between queued jobs. */
+    void SetPriority(MediaPriority priority);
+
+    /**
+     * Stops the job.  This waits for the callback to return if it is running
+     * and it won't be run again.  This can't be called from the callback.
+     */
+    void Stop();
+
+   private:
+    friend MediaExecutor;
+
+    MediaExecutor* const executor_;
+    const std::string name_;
+    const bool pinned_;
+    const std::function<double()> callback_;
+
+    // These are protected by the executor's mutex.
+    MediaPriority priority_;
+    size_t worker_;
+    bool queued_;
+    bool running_;
+    bool wake_pending_;
+    bool stopped_;
+    std::multimap<Clock::time_point, Job*>::iterator timer_;
+  };
+
+  /** Creates a new executor with the given number of worker threads. */
+  explicit MediaExecutor(size_t thread_count);
+  ~MediaExecutor();
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(MediaExecutor);
+
+  /**
+   * @return The global instance of the executor.  This is never destroyed so it
+   *   can be used during shutdown.
+   */
+  static MediaExecutor* Instance();
+
+  /**
+   * Sets the number of threads the global instance will use.  This must be
+   * called before the first player is created.
+   *
+   * @return True on success, false if the global instance already exists.
+   */
+  static bool SetGlobalThreadCount(size_t thread_count);
+
+  /** Sets the threading policy used by media threads and decoders. */
+  static void SetGlobalThreadingPolicy(const MediaThreadingPolicy& policy);
+
+  /** @return The current threading policy. */
+  static MediaThreadingPolicy GlobalThreadingPolicy();
+
+  /**
+   * Applies the CPU affinity and priority from the threading policy to the
+   * calling thread.
+   *
+   * @param audio True if this is an audio thread, false for other media
+   *   threads.
+   */
+  static void ConfigureCurrentThread(bool audio);
+
+  size_t thread_count() const {
+    return workers_.size();
+  }
+
+ private:
+  static constexpr const size_t kPriorityCount =
+      static_cast<size_t>(MediaPriority::Foreground) + 1;
+
+  struct Worker {
+    size_t index;
+    // The queued jobs, one queue per priority.
+    std::deque<Job*> queues[kPriorityCount];
+    std::condition_variable_any signal;
+    // The number of jobs run since a lower priority job was given a turn.
+    size_t runs_since_aging;
+    // Whether the worker is waiting for a job.
+    bool idle;
+    std::unique_ptr<Thread> thread;
+  };
+
+  /** Queues the given job and wakes a worker to run it. */
+  void Enqueue(Job* job);
+  /** Removes the job from its queue and its timer, if set. */
+  void Cancel(Job* job);
+  /** Wakes a worker that can run jobs from the given queue. */
+  void WakeWorker(Worker* preferred, bool pinned);
+  /** Queues the jobs whose timers have expired. */
+  void MoveDueTimers(Clock::time_point now);
+  /**
+   * Takes a job with the given priority, from the worker's own queue or by
+   * stealing from another worker, or nullptr if none.
+   */
+  Job* TakeJobWithPriority(Worker* worker, size_t priority);
+  /** Takes the next job to run on the given worker, or nullptr if none. */
+  Job* TakeJob(Worker* worker);
+  void ThreadMain(Worker* worker);
+
+  Mutex mutex_;
+  // Signaled when a job stops running.
+  std::condition_variable_any job_done_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::multimap<Clock::time_point, Job*> timers_;
+  // The idle worker that is waiting for the next timer, or nullptr.  The other
+  // idle workers wait until they are woken so only one wakes when it expires.
+  Worker* timer_owner_;
+  size_t next_worker_;
+  bool shutdown_;
+};
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_MEDIA_MEDIA_EXECUTOR_H_
@@ -31,6 +31,7 @@ MseMediaPlayer::MseMediaPlayer(ClientList* clients,
                                VideoRenderer* video_renderer,
                                AudioRenderer* audio_renderer)
     : mutex_("MseMediaPlayer"),
+      cache_mutex_("MseMediaPlayer::Cache"),
       pipeline_manager_(std::bind(&MseMediaPlayer::OnStatusChanged, this,
                                   std::placeholders::_1),
                         std::bind(&MseMediaPlayer::OnSeek, this),
@@ -42,8 +43,8 @@ MseMediaPlayer::MseMediaPlayer(ClientList* clients,
                         &util::Clock::Instance, &pipeline_manager_),
       old_state_(VideoPlaybackState::Initializing),
       ready_state_(VideoReadyState::NotAttached),
-      video_(this),
-      audio_(this),
+      video_(this, /* is_video= */ true),
+      audio_(this, /* is_video= */ false),
       video_renderer_(video_renderer),
       audio_renderer_(audio_renderer),
       clients_(clients),
@@ -69,6 +70,23 @@ void MseMediaPlayer::SetDecoders(Decoder* video_decoder,
   audio_.SetDecoder(audio_decoder);
 }
 
+void MseMediaPlayer::SetPriority(MediaPriority priority) {
+  std::unique_lock<SharedMutex> lock(mutex_);
+  video_.SetPriority(priority);
+  audio_.SetPriority(priority);
+}
+
+void MseMediaPlayer::SetDecodeBufferLimits(const DecodeBufferLimits& limits) {
+  std::unique_lock<SharedMutex> lock(mutex_);
+  video_.SetDecodeBufferLimits(limits);
+  audio_.SetDecodeBufferLimits(limits);
+}
+
+DecodingStats MseMediaPlayer::GetDecodingStats(bool video) const {
+  util::shared_lock<SharedMutex> lock(mutex_);
+  return video ? video_.GetDecodingStats() : audio_.GetDecodingStats();
+}
+
 MediaCapabilitiesInfo MseMediaPlayer::DecodingInfo(
     const MediaDecodingConfiguration& config) const {
   if (config.type != MediaDecodingType::MediaSource ||
@@ -116,12 +134,7 @@ void MseMediaPlayer::RemoveClient(MediaPlayer::Client* client) const {
 
 std::vector<BufferedRange> MseMediaPlayer::GetBuffered() const {
   util::shared_lock<SharedMutex> lock(mutex_);
-  std::vector<std::vector<BufferedRange>> ranges;
-  for (auto* ptr : {&video_, &audio_}) {
-    if (ptr->IsAttached())
-      ranges.emplace_back(ptr->GetBuffered());
-  }
-  return IntersectionOfBufferedRanges(ranges);
+  return GetIntersection(/* decoded= */ false, &buffered_cache_);
 }
 
 VideoReadyState MseMediaPlayer::ReadyState() const {
@@ -388,12 +401,37 @@ void MseMediaPlayer::OnWaitingForKey() {
 
 std::vector<BufferedRange> MseMediaPlayer::GetDecoded() const {
   util::shared_lock<SharedMutex> lock(mutex_);
-  std::vector<std::vector<BufferedRange>> ranges;
-  for (auto* ptr : {&video_, &audio_}) {
-    if (ptr->IsAttached())
-      ranges.emplace_back(ptr->GetDecodedStream()->GetBufferedRanges());
+  return GetIntersection(/* decoded= */ true, &decoded_cache_);
+}
+
+std::vector<BufferedRange> MseMediaPlayer::GetIntersection(
+    bool decoded, CachedRanges* cache) const {
+  std::shared_ptr<const std::vector<BufferedRange>> snapshots[2];
+  uint64_t versions[2] = {0, 0};
+  const Source* sources[2] = {&video_, &audio_};
+  for (size_t i = 0; i < 2; i++) {
+    if (sources[i]->IsAttached()) {
+      const StreamBase* stream = sources[i]->GetInput();
+      if (decoded)
+        stream = sources[i]->GetDecodedStream();
+      snapshots[i] = stream->GetBufferedRangesSnapshot(&versions[i]);
+    }
   }
-  return IntersectionOfBufferedRanges(ranges);
+
+  // Stream versions are unique across streams, so if they match, the cached
+  // value was calculated from the same ranges.
+  std::unique_lock<Mutex> lock(cache_mutex_);
+  if (versions[0] != cache->versions[0] || versions[1] != cache->versions[1]) {
+    std::vector<std::vector<BufferedRange>> ranges;
+    for (auto& snapshot : snapshots) {
+      if (snapshot)
+        ranges.emplace_back(*snapshot);
+    }
+    cache->ranges = IntersectionOfBufferedRanges(ranges);
+    cache->versions[0] = versions[0];
+    cache->versions[1] = versions[1];
+  }
+  return cache->ranges;
 }
 
 void MseMediaPlayer::DebugThreadMain() {
@@ -431,9 +469,9 @@ void MseMediaPlayer::DebugThreadMain() {
 }
 
 
-MseMediaPlayer::Source::Source(MseMediaPlayer* player)
+MseMediaPlayer::Source::Source(MseMediaPlayer* player, bool is_video)
     : default_decoder_(Decoder::CreateDefaultDecoder()),
-      decoder_thread_(player, &decoded_frames_),
+      decoder_thread_(player, &decoded_frames_, is_video),
       input_(nullptr),
       decoder_(nullptr) {
   decoder_thread_.SetDecoder(GetDecoder());
@@ -445,6 +483,10 @@ const DecodedStream* MseMediaPlayer::Source::GetDecodedStream() const {
   return &decoded_frames_;
 }
 
+const ElementaryStream* MseMediaPlayer::Source::GetInput() const {
+  return input_;
+}
+
 Decoder* MseMediaPlayer::Source::GetDecoder() const {
   return decoder_ ? decoder_ : default_decoder_.get();
 }
@@ -487,5 +529,18 @@ void MseMediaPlayer::Source::SetCdm(eme::Implementation* cdm) {
   decoder_thread_.SetCdm(cdm);
 }
 
+void MseMediaPlayer::Source::SetPriority(MediaPriority priority) {
+  decoder_thread_.SetPriority(priority);
+}
+
+void MseMediaPlayer::Source::SetDecodeBufferLimits(
+    const DecodeBufferLimits& limits) {
+  decoder_thread_.SetDecodeBufferLimits(limits);
+}
+
+DecodingStats MseMediaPlayer::Source::GetDecodingStats() const {
+  return decoder_thread_.GetStats();
+}
+
 }  // namespace media
 }  // namespace shaka
@@ -44,6 +44,9 @@ class MseMediaPlayer final : public MediaPlayer, DecoderThread::Client {
   ~MseMediaPlayer() override;
 
   void SetDecoders(Decoder* video_decoder, Decoder* audio_decoder);
+  void SetPriority(MediaPriority priority);
+  void SetDecodeBufferLimits(const DecodeBufferLimits& limits);
+  DecodingStats GetDecodingStats(bool video) const;
 
   MediaCapabilitiesInfo DecodingInfo(
       const MediaDecodingConfiguration& config) const override;
@@ -93,10 +96,11 @@ class MseMediaPlayer final : public MediaPlayer, DecoderThread::Client {
  private:
   class Source final {
    public:
-    explicit Source(MseMediaPlayer* player);
+    Source(MseMediaPlayer* player, bool is_video);
     ~Source();
 
     const DecodedStream* GetDecodedStream() const;
+    const ElementaryStream* GetInput() const;
     Decoder* GetDecoder() const;
     void SetDecoder(Decoder* decoder);
 
@@ -108,6 +112,9 @@ class MseMediaPlayer final : public MediaPlayer, DecoderThread::Client {
     void Detach();
     void OnSeek();
     void SetCdm(eme::Implementation* cdm);
+    void SetPriority(MediaPriority priority);
+    void SetDecodeBufferLimits(const DecodeBufferLimits& limits);
+    DecodingStats GetDecodingStats() const;
 
    private:
     const std::unique_ptr<Decoder> default_decoder_;
@@ -119,6 +126,17 @@ class MseMediaPlayer final : public MediaPlayer, DecoderThread::Client {
     Decoder* decoder_;
   };
 
+  /**
+   * Holds the intersection of the buffered ranges of the attached streams and
+   * the versions of the stream ranges it was calculated from.
+   */
+  struct CachedRanges {
+    uint64_t versions[2] = {0, 0};
+    std::vector<BufferedRange> ranges;
+  };
+
+  std::vector<BufferedRange> GetIntersection(bool decoded,
+                                             CachedRanges* cache) const;
   void OnStatusChanged(VideoPlaybackState status);
   void ReadyStateChanged(VideoReadyState ready_state);
   void OnSeek();
@@ -129,6 +147,11 @@ class MseMediaPlayer final : public MediaPlayer, DecoderThread::Client {
   void DebugThreadMain();
 
   mutable SharedMutex mutex_;
+  // These are only recalculated when the stream ranges change since they are
+  // polled by the PipelineMonitor.
+  mutable Mutex cache_mutex_;
+  mutable CachedRanges buffered_cache_;
+  mutable CachedRanges decoded_cache_;
   PipelineManager pipeline_manager_;
   PipelineMonitor pipeline_monitor_;
   VideoPlaybackState old_state_;
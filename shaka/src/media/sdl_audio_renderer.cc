@@ -16,7 +16,13 @@
 
 #include <SDL2/SDL.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
 #include "shaka/utils.h"
+#include "src/media/audio_kernels.h"
 #include "src/media/audio_renderer_common.h"
 #include "src/util/utils.h"
 
@@ -78,7 +84,13 @@ bool InitSdl() {
 class SdlAudioRenderer::Impl : public AudioRendererCommon {
  public:
   explicit Impl(const std::string& device_name)
-      : device_name_(device_name), audio_device_(0), volume_(0) {
+      : AudioRendererCommon(DeviceMode::Pull),
+        device_name_(device_name),
+        audio_device_(0),
+        format_(0),
+        silence_(0),
+        sample_format_(SampleFormat::Unknown),
+        volume_(0) {
     // Use "playback" mode on iOS.  This ensures the audio remains playing when
     // locked or muted.
     SDL_SetHint(SDL_HINT_AUDIO_CATEGORY, "playback");
@@ -110,6 +122,8 @@ class SdlAudioRenderer::Impl : public AudioRendererCommon {
     audio_spec.freq = frame->stream_info->sample_rate;
     audio_spec.channels = static_cast<Uint8>(frame->stream_info->channel_count);
     audio_spec.samples = static_cast<Uint16>(frame->sample_count);
+    audio_spec.callback = &Impl::OnAudioCallback;
+    audio_spec.userdata = this;
 
     const char* device = device_name_.empty() ? nullptr : device_name_.c_str();
     audio_device_ =
@@ -120,31 +134,31 @@ class SdlAudioRenderer::Impl : public AudioRendererCommon {
     }
 
     format_ = obtained_audio_spec.format;
+    silence_ = obtained_audio_spec.silence;
+    sample_format_ = get<SampleFormat>(frame->format);
     volume_ = volume;
+    // Allocate here since the callback can't allocate.
+    mix_buffer_.resize(obtained_audio_spec.size);
     return true;
   }
 
-  bool AppendBuffer(const uint8_t* data, size_t size) override {
-    std::vector<uint8_t> temp(size);
-    SDL_MixAudioFormat(temp.data(), data, format_, size,
-                       static_cast<int>(volume_ * SDL_MIX_MAXVOLUME));
-    if (SDL_QueueAudio(audio_device_, temp.data(), size) != 0) {
-      LOG(DFATAL) << "Error appending audio: " << SDL_GetError();
-      return false;
+  /** Called by SDL on its audio thread when it needs more samples. */
+  static void OnAudioCallback(void* user_data, Uint8* stream, int size) {
+    auto* impl = reinterpret_cast<Impl*>(user_data);
+    const size_t length = static_cast<size_t>(size);
+    const size_t read = impl->ReadSamples(stream, length);
+    std::memset(stream + read, impl->silence_, length - read);
+
+    const double volume = impl->volume_.load(std::memory_order_relaxed);
+    if (volume < 1 && !ApplyGain(impl->sample_format_, volume, stream, read)) {
+      // SDL_MixAudioFormat adds to the buffer, so it needs to be silent.
+      const size_t to_mix = std::min(read, impl->mix_buffer_.size());
+      std::memcpy(impl->mix_buffer_.data(), stream, to_mix);
+      std::memset(stream, impl->silence_, to_mix);
+      SDL_MixAudioFormat(stream, impl->mix_buffer_.data(), impl->format_,
+                         static_cast<Uint32>(to_mix),
+                         static_cast<int>(volume * SDL_MIX_MAXVOLUME));
     }
-    return true;
-  }
-
-  void ClearBuffer() override {
-    if (audio_device_ != 0)
-      SDL_ClearQueuedAudio(audio_device_);
-  }
-
-  size_t GetBytesBuffered() const override {
-    if (audio_device_ != 0)
-      return SDL_GetQueuedAudioSize(audio_device_);
-    else
-      return 0;
   }
 
   void SetDeviceState(bool is_playing) override {
@@ -153,7 +167,7 @@ class SdlAudioRenderer::Impl : public AudioRendererCommon {
   }
 
   void UpdateVolume(double volume) override {
-    volume_ = volume;
+    volume_.store(volume, std::memory_order_relaxed);
   }
 
   void ResetDevice() {
@@ -166,7 +180,13 @@ class SdlAudioRenderer::Impl : public AudioRendererCommon {
   const std::string device_name_;
   SDL_AudioDeviceID audio_device_;
   SDL_AudioFormat format_;
-  double volume_;
+  Uint8 silence_;
+  SampleFormat sample_format_;
+  // This is read by the audio callback, so it can't be protected by the lock.
+  std::atomic<double> volume_;
+  // Holds the samples to apply the volume with SDL; sized when opening the
+  // device so the callback doesn't allocate.
+  std::vector<uint8_t> mix_buffer_;
 };
 
 
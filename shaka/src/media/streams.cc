@@ -18,249 +18,574 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <deque>
 #include <iterator>
-#include <list>
-#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "src/debug/mutex.h"
+#include "src/media/frame_reclaimer.h"
 #include "src/media/media_utils.h"
 #include "src/util/macros.h"
+#include "src/util/utils.h"
 
 namespace shaka {
 namespace media {
 
 namespace {
 
-// These exist to reduce the number of if checks for ordering.  This is done
-// by using a single if at the beginning of the method and using a function
-// pointer to one of these methods.
-
-template <bool OrderByDts = true>
-double GetTime(const std::shared_ptr<BaseFrame>& a) {
-  return a->dts;
-}
-template <>
-double GetTime<false>(const std::shared_ptr<BaseFrame>& a) {
-  return a->pts;
-}
+/**
+ * The next buffered range version to hand out.  This is shared between all
+ * streams so a version uniquely identifies both the stream and its ranges.
+ */
+std::atomic<uint64_t> g_next_version{1};
 
-#ifndef NDEBUG
-template <bool OrderByDts>
-bool FrameLessThan(const std::shared_ptr<BaseFrame>& a,
-                   const std::shared_ptr<BaseFrame>& b) {
-  return GetTime<OrderByDts>(a) < GetTime<OrderByDts>(b);
-}
-#endif
+/**
+ * Holds a frame in a buffered range.  This stores the time the stream is
+ * ordered by (either PTS or DTS) alongside the frame so searching doesn't need
+ * to follow the frame pointers.
+ */
+struct FrameEntry {
+  FrameEntry(double time, std::shared_ptr<BaseFrame> frame)
+      : time(time), frame(std::move(frame)) {}
 
-template <bool OrderByDts>
-bool FrameExtendsPast(const std::shared_ptr<BaseFrame>& a,
-                      const std::shared_ptr<BaseFrame>& b) {
-  return GetTime<OrderByDts>(a) + a->duration + StreamBase::kMaxGapSize >=
-         GetTime<OrderByDts>(b);
-}
+  double time;
+  std::shared_ptr<BaseFrame> frame;
+};
 
-template <typename Iter>
-void UpdatePtsRanges(Iter range) {
-  DCHECK(!range->frames.empty());
-  range->start_pts = HUGE_VAL;
-  range->end_pts = -HUGE_VAL;
-  for (auto& frame : range->frames) {
-    range->start_pts = std::min(range->start_pts, frame->pts);
-    range->end_pts = std::max(range->end_pts, frame->pts + frame->duration);
-  }
+bool EntryExtendsPast(const FrameEntry& a, const FrameEntry& b) {
+  return a.time + a.frame->duration + StreamBase::kMaxGapSize >= b.time;
 }
 
 /**
- * Returns an iterator to the first element in |list| that is greater than or
- * equal to |frame|.
- *
- * This performs a linear search through |list| to find the element.  This will
- * perform a forward or reverse search depending on which would (likely) be
- * better.
- *
- * If we are inserting a frame at the end, this is O(1) time (usual case),
- * otherwise this is O(n).
- *
- * This returns a non-const iterator because a standard library bug in
- * libstdc++ 4.8 makes std::list::insert require non-const iterators.
- * See: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=57158
+ * Holds a contiguous range of frames.  Frames are stored in a std::deque, which
+ * is a chunked array, so we get random-access (and binary searches) while
+ * still having cheap appends/removals at either end, which are the common
+ * cases for demuxing and evicting frames.
  */
-template <bool OrderByDts>
-std::list<std::shared_ptr<BaseFrame>>::iterator FrameLowerBound(
-    const std::list<std::shared_ptr<BaseFrame>>& list, double time) {
-  auto& mutable_list =
-      const_cast<std::list<std::shared_ptr<BaseFrame>>&>(list);  // NOLINT
-  if (list.empty())
-    return mutable_list.end();
-
-  if (time - GetTime<OrderByDts>(list.front()) <
-      GetTime<OrderByDts>(list.back()) - time) {
-    // Closer to the front, find the first element that is not less than |time|.
-    auto notLessThan = [&time](const std::shared_ptr<BaseFrame>& other) {
-      return GetTime<OrderByDts>(other) >= time;
-    };
-    return std::find_if(mutable_list.begin(), mutable_list.end(), notLessThan);
-  }
-
-  // Closer to the end, first use a reverse search to find the first (in
-  // reverse order) that is less than |time|.
-  auto isLessThan = [&time](const std::shared_ptr<BaseFrame>& other) {
-    return GetTime<OrderByDts>(other) < time;
-  };
-  auto rit =
-      std::find_if(mutable_list.rbegin(), mutable_list.rend(), isLessThan);
-  // |*rit| is equal to the first element (going backwards) that is less than
-  // |frame|.  We want to return |rit - 1| as a forward iterator, namely the
-  // first element that is not less than |frame|.  The |base()| of a reverse
-  // iterator is the same element as |*(rit - 1)|, so return that.
-  // See: http://en.cppreference.com/w/cpp/iterator/reverse_iterator/base
-  return rit.base();
-}
-
 struct Range {
   Range() {}
+  Range(const Range&) = default;
+  Range(Range&&) = default;
   ~Range() {}
 
-  SHAKA_NON_COPYABLE_TYPE(Range);
+  Range& operator=(const Range&) = default;
+  Range& operator=(Range&&) = default;
+
+  /** @return The index of the first frame that is not before |time|. */
+  size_t LowerBound(double time) const {
+    return std::lower_bound(frames.begin(), frames.end(), time,
+                            [](const FrameEntry& entry, double time) {
+                              return entry.time < time;
+                            }) -
+           frames.begin();
+  }
+
+  /** @return The index of the first frame that is after |time|. */
+  size_t UpperBound(double time) const {
+    return std::upper_bound(frames.begin(), frames.end(), time,
+                            [](double time, const FrameEntry& entry) {
+                              return time < entry.time;
+                            }) -
+           frames.begin();
+  }
+
+  /**
+   * @return The index of the first keyframe at or after the given index, or
+   *   frames.size() if there isn't one.
+   */
+  size_t NextKeyFrame(size_t index) const {
+    if (index >= frames.size())
+      return frames.size();
+    auto it = std::lower_bound(key_frames.begin(), key_frames.end(),
+                               frames[index].time);
+    return it == key_frames.end() ? frames.size() : LowerBound(*it);
+  }
+
+  /** @return The index of the last keyframe at or before the given index. */
+  size_t PrevKeyFrame(size_t index) const {
+    DCHECK_LT(index, frames.size());
+    auto it = std::upper_bound(key_frames.begin(), key_frames.end(),
+                               frames[index].time);
+    DCHECK(it != key_frames.begin());
+    return LowerBound(*std::prev(it));
+  }
+
+  /**
+   * Inserts the given frame into this range.  If there is already a frame with
+   * the same time, it is replaced.
+   * @return The frame that was replaced, or nullptr.
+   */
+  std::shared_ptr<BaseFrame> Insert(double time,
+                                    std::shared_ptr<BaseFrame> frame) {
+    const bool is_key_frame = frame->is_key_frame;
+    start_pts = std::min(start_pts, frame->pts);
+    end_pts = std::max(end_pts, frame->pts + frame->duration);
+    min_pts_offset = std::min(min_pts_offset, frame->pts - time);
+    max_pts_offset = std::max(max_pts_offset, frame->pts - time);
+    max_duration = std::max(max_duration, frame->duration);
+
+    // Appending is by far the most common case, so check that first.
+    if (frames.empty() || frames.back().time < time) {
+      frames.emplace_back(time, std::move(frame));
+    } else if (time < frames.front().time) {
+      frames.emplace_front(time, std::move(frame));
+    } else {
+      auto it = frames.begin() + LowerBound(time);
+      if (it != frames.end() && it->time == time) {
+        if (it->frame->is_key_frame && !is_key_frame) {
+          key_frames.erase(
+              std::lower_bound(key_frames.begin(), key_frames.end(), time));
+        }
+        const bool was_key_frame = it->frame->is_key_frame;
+        std::shared_ptr<BaseFrame> replaced = std::move(it->frame);
+        it->frame = std::move(frame);
+        // The old frame may have defined the PTS range.
+        UpdatePtsRange();
+        if (!was_key_frame && is_key_frame) {
+          key_frames.insert(
+              std::lower_bound(key_frames.begin(), key_frames.end(), time),
+              time);
+        }
+        return replaced;
+      } else {
+        frames.emplace(it, time, std::move(frame));
+      }
+    }
+
+    if (is_key_frame) {
+      if (key_frames.empty() || key_frames.back() < time) {
+        key_frames.push_back(time);
+      } else {
+        key_frames.insert(
+            std::lower_bound(key_frames.begin(), key_frames.end(), time),
+            time);
+      }
+    }
+    return nullptr;
+  }
+
+  /** Moves all the frames from |other|, which is after this range, to here. */
+  void Append(Range* other) {
+    frames.insert(frames.end(), std::make_move_iterator(other->frames.begin()),
+                  std::make_move_iterator(other->frames.end()));
+    key_frames.insert(key_frames.end(), other->key_frames.begin(),
+                      other->key_frames.end());
+    MergeBounds(*other);
+    other->frames.clear();
+    other->key_frames.clear();
+  }
+
+  /** Moves all the frames from |other|, which is before this range, to here. */
+  void Prepend(Range* other) {
+    frames.insert(frames.begin(),
+                  std::make_move_iterator(other->frames.begin()),
+                  std::make_move_iterator(other->frames.end()));
+    key_frames.insert(key_frames.begin(), other->key_frames.begin(),
+                      other->key_frames.end());
+    MergeBounds(*other);
+    other->frames.clear();
+    other->key_frames.clear();
+  }
+
+  /**
+   * Moves the frames in [0, |end|) into a new range.  The returned range
+   * should be inserted before this one.
+   */
+  Range SplitBefore(size_t end) {
+    DCHECK_GT(end, 0u);
+    DCHECK_LT(end, frames.size());
+    Range ret;
+    ret.frames.insert(ret.frames.end(),
+                      std::make_move_iterator(frames.begin()),
+                      std::make_move_iterator(frames.begin() + end));
+    ret.MergeBounds(*this);
+
+    auto key_end = std::lower_bound(key_frames.begin(), key_frames.end(),
+                                    frames[end].time);
+    ret.key_frames.insert(ret.key_frames.end(), key_frames.begin(), key_end);
+    key_frames.erase(key_frames.begin(), key_end);
+    frames.erase(frames.begin(), frames.begin() + end);
+
+    ret.UpdatePtsRange();
+    UpdatePtsRange();
+    return ret;
+  }
+
+  /**
+   * Removes the frames in [|begin|, |end|).  The removed frames are moved into
+   * |removed| so they can be destroyed outside the lock.
+   */
+  void Erase(size_t begin, size_t end,
+             std::vector<std::shared_ptr<BaseFrame>>* removed) {
+    DCHECK_LE(begin, end);
+    DCHECK_LE(end, frames.size());
+    if (begin == end)
+      return;
+
+    for (size_t i = begin; i < end; i++)
+      removed->emplace_back(std::move(frames[i].frame));
+
+    auto key_begin = std::lower_bound(key_frames.begin(), key_frames.end(),
+                                      frames[begin].time);
+    auto key_end = end == frames.size()
+                       ? key_frames.end()
+                       : std::lower_bound(key_begin, key_frames.end(),
+                                          frames[end].time);
+    key_frames.erase(key_begin, key_end);
+    frames.erase(frames.begin() + begin, frames.begin() + end);
+    if (!frames.empty())
+      UpdatePtsRange();
+  }
+
+  /** Moves all the frames into |removed|, leaving this range empty. */
+  void Release(std::vector<std::shared_ptr<BaseFrame>>* removed) {
+    for (auto& entry : frames)
+      removed->emplace_back(std::move(entry.frame));
+    frames.clear();
+    key_frames.clear();
+  }
+
+  /**
+   * Recalculates |start_pts| and |end_pts|.  Since the frames are sorted, we
+   * can use the offset bounds to only look at the frames near either end.
+   */
+  void UpdatePtsRange() {
+    DCHECK(!frames.empty());
+    start_pts = HUGE_VAL;
+    for (auto& entry : frames) {
+      if (entry.time + min_pts_offset > start_pts)
+        break;
+      start_pts = std::min(start_pts, entry.frame->pts);
+    }
+    end_pts = -HUGE_VAL;
+    for (auto it = frames.rbegin(); it != frames.rend(); it++) {
+      if (it->time + max_pts_offset + max_duration < end_pts)
+        break;
+      end_pts = std::max(end_pts, it->frame->pts + it->frame->duration);
+    }
+  }
 
-  std::list<std::shared_ptr<BaseFrame>> frames;
+  /** The frames in this range, sorted by time. */
+  std::deque<FrameEntry> frames;
+  /** The times of the keyframes in |frames|, sorted. */
+  std::deque<double> key_frames;
 
   double start_pts = HUGE_VAL;
   double end_pts = -HUGE_VAL;
+
+  // These hold bounds on the difference between the PTS and the sort time and
+  // on the frame durations.  They are only ever expanded, so they may be larger
+  // than needed after removing frames, but they will still be valid bounds.
+  // These allow us to use binary searches on PTS even when sorting on DTS.
+  double min_pts_offset = 0;
+  double max_pts_offset = 0;
+  double max_duration = 0;
+
+ private:
+  void MergeBounds(const Range& other) {
+    start_pts = std::min(start_pts, other.start_pts);
+    end_pts = std::max(end_pts, other.end_pts);
+    min_pts_offset = std::min(min_pts_offset, other.min_pts_offset);
+    max_pts_offset = std::max(max_pts_offset, other.max_pts_offset);
+    max_duration = std::max(max_duration, other.max_duration);
+  }
 };
 
+/**
+ * Holds the buffered ranges of a stream.  Once published, an Index is only
+ * changed in place while no reader holds it; see StreamBase::Impl::Writer.
+ */
+struct Index {
+  Index() : version(g_next_version++), estimated_size(0) {}
+
+  /**
+   * @return An iterator to the first buffered range whose last frame is at or
+   *   after the given time.
+   */
+  std::vector<Range>::const_iterator FindRange(double time) const {
+    return std::partition_point(
+        ranges.begin(), ranges.end(),
+        [&](const Range& range) { return range.frames.back().time < time; });
+  }
+
+  /**
+   * Called after the start or end of any buffered range has changed.  This
+   * invalidates the cached summary.
+   */
+  void RangesChanged() {
+    version = g_next_version++;
+  }
+
+  /** Called after a frame was removed to update the estimated size. */
+  void FrameRemoved(const BaseFrame& frame) {
+    DCHECK_GE(estimated_size, frame.EstimateSize());
+    estimated_size -= frame.EstimateSize();
+  }
+
+  std::vector<Range> ranges;
+  uint64_t version;
+  // The sum of the estimated sizes of all the frames, updated as frames are
+  // added and removed so EstimateSize doesn't need to visit every frame.
+  size_t estimated_size;
+};
+
+/**
+ * Deletes an Index that is no longer published.  The frames that were removed
+ * from the stream may only be held by the old index, and it may be dropped by
+ * a reader, so pass the frames to the FrameReclaimer to destroy them.
+ */
+void DeleteIndex(Index* index) {
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  for (Range& range : index->ranges)
+    range.Release(&frames);
+  delete index;
+  FrameReclaimer::Instance()->Release(&frames);
+}
+
 }  // namespace
 
 class StreamBase::Impl {
  public:
+  /**
+   * Gives a writer a mutable Index; |mutex| must be held.  If no reader holds
+   * the published index, it is changed in place while holding |index_mutex|.
+   * Otherwise this changes a copy and publishes it when destroyed, so the
+   * writer never waits for readers.
+   */
+  class Writer {
+   public:
+    explicit Writer(Impl* impl) : impl_(impl), lock_(impl->index_mutex) {
+      // Readers only copy |index| while holding |index_mutex|, so if we are
+      // the only owner, no reader can use it until we unlock.  The fence makes
+      // the reads of the last reader happen before our changes.
+      if (impl->index.use_count() == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        index_ = impl->index.get();
+      } else {
+        copy_.reset(new Index(*impl->index), &DeleteIndex);
+        index_ = copy_.get();
+        lock_.unlock();
+      }
+    }
+
+    ~Writer() {
+      if (copy_) {
+        lock_.lock();
+        impl_->index.swap(copy_);
+        lock_.unlock();
+        // |copy_| now holds the old index, which is dropped outside the lock.
+      }
+    }
+
+    SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(Writer);
+
+    Index& operator*() {
+      return *index_;
+    }
+    Index* operator->() {
+      return index_;
+    }
+
+   private:
+    Impl* impl_;
+    std::unique_lock<Mutex> lock_;
+    std::shared_ptr<Index> copy_;
+    Index* index_;
+  };
+
   explicit Impl(bool order_by_dts)
-      : mutex("StreamBase"), order_by_dts(order_by_dts) {}
+      : mutex("StreamBase"),
+        index_mutex("StreamBase::Index"),
+        index(new Index, &DeleteIndex),
+        summary_mutex("StreamBase::Summary"),
+        summary_version(0),
+        clients_mutex("StreamBase::Clients"),
+        order_by_dts(order_by_dts) {}
+
+  /** @return The time the given frame is sorted by. */
+  double GetTime(const BaseFrame& frame) const {
+    return order_by_dts ? frame.dts : frame.pts;
+  }
+
+  /** @return The published index, which won't change while it is held. */
+  std::shared_ptr<const Index> GetIndex() const {
+    std::unique_lock<Mutex> lock(index_mutex);
+    return index;
+  }
 
+  void AssertRangesSorted(const Index& index) const;
+
+  // Only held by writers, so adding and removing frames don't interleave.
+  // Readers use the published |index| instead.
   Mutex mutex;
-  std::list<Range> buffered_ranges;
+
+  // Only held to copy or replace |index|, or while a writer changes an index
+  // no reader holds.
+  mutable Mutex index_mutex;
+  std::shared_ptr<Index> index;
+
+  // The buffered ranges as reported by GetBufferedRanges, only rebuilt when
+  // the version of the index changes.
+  Mutex summary_mutex;
+  std::shared_ptr<const std::vector<BufferedRange>> summary;
+  uint64_t summary_version;
+
+  // This is held while calling the clients, so RemoveClient can wait for
+  // any callbacks to finish.
+  Mutex clients_mutex;
+  std::vector<Client*> clients;
+
   const bool order_by_dts;
 };
 
 
+StreamBase::Client::Client() {}
+StreamBase::Client::~Client() {}
+
+
 StreamBase::StreamBase(bool order_by_dts) : impl_(new Impl(order_by_dts)) {}
 
 StreamBase::~StreamBase() {}
 
 size_t StreamBase::EstimateSize() const {
-  std::unique_lock<Mutex> lock(impl_->mutex);
-
-  size_t size = 0;
-  for (auto& range : impl_->buffered_ranges) {
-    for (auto& frame : range.frames)
-      size += frame->EstimateSize();
-  }
-  return size;
+  std::unique_lock<Mutex> lock(impl_->index_mutex);
+  return impl_->index->estimated_size;
 }
 
 void StreamBase::AddFrameInternal(std::shared_ptr<BaseFrame> frame) {
+  // Declared before the locks so a replaced frame is destroyed outside them.
+  std::shared_ptr<BaseFrame> replaced;
   std::unique_lock<Mutex> lock(impl_->mutex);
   DCHECK(frame);
 
-  auto extendsPast =
-      impl_->order_by_dts ? &FrameExtendsPast<true> : &FrameExtendsPast<false>;
-  auto lowerBound =
-      impl_->order_by_dts ? &FrameLowerBound<true> : &FrameLowerBound<false>;
-  auto getTime = impl_->order_by_dts ? &GetTime<true> : &GetTime<false>;
-
-  // Find the first buffered range that ends after |frame|.
-  auto range_it =
-      std::find_if(impl_->buffered_ranges.begin(), impl_->buffered_ranges.end(),
-                   [&](const Range& range) {
-                     return extendsPast(range.frames.back(), frame);
-                   });
-
-  if (range_it == impl_->buffered_ranges.end()) {
-    // |frame| was after every existing range, create a new one.
-    impl_->buffered_ranges.emplace_back();
-    impl_->buffered_ranges.back().start_pts = frame->pts;
-    impl_->buffered_ranges.back().end_pts = frame->pts + frame->duration;
-    impl_->buffered_ranges.back().frames.emplace_back(frame);
-  } else if (!extendsPast(frame, range_it->frames.front())) {
-    // |frame| is before this range, so it starts a new range before this one.
-    auto it = impl_->buffered_ranges.emplace(range_it);
-    it->start_pts = frame->pts;
-    it->end_pts = frame->pts + frame->duration;
-    it->frames.emplace_back(frame);
-  } else {
-    // |frame| is inside the current range.
-    auto frame_it = lowerBound(range_it->frames, getTime(frame));
-    range_it->start_pts = std::min(range_it->start_pts, frame->pts);
-    range_it->end_pts =
-        std::max(range_it->end_pts, frame->pts + frame->duration);
-    if (frame_it != range_it->frames.end() &&
-        getTime(*frame_it) == getTime(frame)) {
-      swap(*frame_it, frame);
+  {
+    Impl::Writer index(impl_.get());
+    auto& ranges = index->ranges;
+    const FrameEntry entry(impl_->GetTime(*frame), frame);
+    bool changed = true;
+    index->estimated_size += frame->EstimateSize();
+
+    // Find the first buffered range that ends after |frame|.  The ranges are
+    // sorted and don't overlap, so this can be a binary search.
+    auto range_it = std::partition_point(
+        ranges.begin(), ranges.end(), [&](const Range& range) {
+          return !EntryExtendsPast(range.frames.back(), entry);
+        });
+
+    if (range_it == ranges.end()) {
+      // |frame| was after every existing range, create a new one.
+      ranges.emplace_back();
+      replaced = ranges.back().Insert(entry.time, std::move(frame));
+    } else if (!EntryExtendsPast(entry, range_it->frames.front())) {
+      // |frame| is before this range, so it starts a new range before this one.
+      range_it = ranges.emplace(range_it);
+      replaced = range_it->Insert(entry.time, std::move(frame));
     } else {
-      range_it->frames.insert(frame_it, frame);
+      // |frame| is inside the current range.
+      const BufferedRange old_range(range_it->start_pts, range_it->end_pts);
+      replaced = range_it->Insert(entry.time, std::move(frame));
+      changed =
+          old_range != BufferedRange(range_it->start_pts, range_it->end_pts);
     }
-  }
 
-  // If the frame closed a gap, then merge the buffered ranges.
-  DCHECK_NE(0u, impl_->buffered_ranges.size());
-  for (auto it = std::next(impl_->buffered_ranges.begin());
-       it != impl_->buffered_ranges.end();) {
-    auto prev = std::prev(it);
-    if (extendsPast(prev->frames.back(), it->frames.front())) {
-      // Move all elements from |it->frames| to the end of |prev->frames|.
-      // Since both lists are sorted and |prev < it|, this will remain sorted.
-      prev->frames.splice(prev->frames.end(), it->frames);
-      prev->start_pts = std::min(prev->start_pts, it->start_pts);
-      prev->end_pts = std::max(prev->end_pts, it->end_pts);
-      it = impl_->buffered_ranges.erase(it);
-    } else {
-      it++;
+    if (replaced)
+      index->FrameRemoved(*replaced);
+
+    // If the frame closed a gap, then merge the buffered ranges.  Remove() can
+    // also leave adjacent ranges that are close enough to be merged, so check
+    // every pair; there are only ever a handful of ranges.  Move the frames
+    // from the smaller range into the larger one to reduce copying.
+    for (size_t i = 1; i < ranges.size();) {
+      Range& prev = ranges[i - 1];
+      Range& next = ranges[i];
+      if (!EntryExtendsPast(prev.frames.back(), next.frames.front())) {
+        i++;
+        continue;
+      }
+
+      if (prev.frames.size() < next.frames.size()) {
+        next.Prepend(&prev);
+        ranges.erase(ranges.begin() + i - 1);
+      } else {
+        prev.Append(&next);
+        ranges.erase(ranges.begin() + i);
+      }
+      changed = true;
     }
+    if (changed)
+      index->RangesChanged();
+
+    impl_->AssertRangesSorted(*index);
   }
+  lock.unlock();
 
-  AssertRangesSorted();
+  std::unique_lock<Mutex> clients_lock(impl_->clients_mutex);
+  for (Client* client : impl_->clients)
+    client->OnFrameAdded();
 }
 
 std::vector<BufferedRange> StreamBase::GetBufferedRanges() const {
-  std::unique_lock<Mutex> lock(impl_->mutex);
-  AssertRangesSorted();
+  return *GetBufferedRangesSnapshot();
+}
 
-  std::vector<BufferedRange> ret;
-  ret.reserve(impl_->buffered_ranges.size());
-  for (const Range& range : impl_->buffered_ranges) {
-    ret.emplace_back(range.start_pts, range.end_pts);
+std::shared_ptr<const std::vector<BufferedRange>>
+StreamBase::GetBufferedRangesSnapshot(uint64_t* version) const {
+  auto index = impl_->GetIndex();
+  if (version)
+    *version = index->version;
+
+  std::unique_lock<Mutex> summary_lock(impl_->summary_mutex);
+  if (impl_->summary && impl_->summary_version == index->version)
+    return impl_->summary;
+
+  auto* summary = new std::vector<BufferedRange>;
+  summary->reserve(index->ranges.size());
+  for (const Range& range : index->ranges)
+    summary->emplace_back(range.start_pts, range.end_pts);
+  std::shared_ptr<const std::vector<BufferedRange>> ret(summary);
+  // Another reader may have cached a newer index, so don't replace it.
+  if (impl_->summary_version < index->version) {
+    impl_->summary = ret;
+    impl_->summary_version = index->version;
   }
   return ret;
 }
 
+uint64_t StreamBase::GetBufferedRangesVersion() const {
+  std::unique_lock<Mutex> lock(impl_->index_mutex);
+  return impl_->index->version;
+}
+
+void StreamBase::AddClient(Client* client) const {
+  std::unique_lock<Mutex> lock(impl_->clients_mutex);
+  if (!util::contains(impl_->clients, client))
+    impl_->clients.emplace_back(client);
+}
+
+void StreamBase::RemoveClient(Client* client) const {
+  std::unique_lock<Mutex> lock(impl_->clients_mutex);
+  util::RemoveElement(&impl_->clients, client);
+}
+
 size_t StreamBase::CountFramesBetween(double start_time,
                                       double end_time) const {
-  std::unique_lock<Mutex> lock(impl_->mutex);
-  AssertRangesSorted();
-
-  auto getTime = impl_->order_by_dts ? &GetTime<true> : &GetTime<false>;
-  auto lowerBound =
-      impl_->order_by_dts ? &FrameLowerBound<true> : &FrameLowerBound<false>;
+  auto index = impl_->GetIndex();
+  impl_->AssertRangesSorted(*index);
 
   // Find the first buffered range that includes or is after |start_time|.
-  auto range_it =
-      std::find_if(impl_->buffered_ranges.begin(), impl_->buffered_ranges.end(),
-                   [&](const Range& range) {
-                     return getTime(range.frames.back()) >= start_time;
-                   });
-
   size_t num_frames = 0;
-  for (; range_it != impl_->buffered_ranges.end(); range_it++) {
-    // |start| points to the frame that starts at or greater than
-    // |start_time|.
-    auto start = lowerBound(range_it->frames, start_time);
-    auto end = lowerBound(range_it->frames, end_time);
-    DCHECK(start != range_it->frames.end());
-    num_frames += std::distance(start, end);
-    if (getTime(*start) == start_time && start != end)
-      num_frames--;
-    if (end != range_it->frames.end())
+  for (auto range_it = index->FindRange(start_time);
+       range_it != index->ranges.end(); range_it++) {
+    // |start| is the first frame after |start_time|, |end| is the first frame
+    // at or after |end_time|.
+    const size_t start = range_it->UpperBound(start_time);
+    const size_t end = range_it->LowerBound(end_time);
+    if (end > start)
+      num_frames += end - start;
+    if (end != range_it->frames.size())
       break;
   }
 
@@ -271,85 +596,163 @@ void StreamBase::Remove(double start, double end) {
   // Note that remove always uses PTS, even when sorting using DTS.  This is
   // intended to work like the MSE definition.
 
+  // The removed frames are destroyed by the FrameReclaimer so the lock is only
+  // held while finding and detaching them.
+  std::vector<std::shared_ptr<BaseFrame>> removed;
   std::unique_lock<Mutex> lock(impl_->mutex);
-  bool is_removing = false;
-  for (auto it = impl_->buffered_ranges.begin();
-       it != impl_->buffered_ranges.end();) {
-    // These represent the range of frames within this buffer to delete.
-    auto frame_del_start = is_removing ? it->frames.begin() : it->frames.end();
-    auto frame_del_end = it->frames.end();
-
-    for (auto frame = it->frames.begin(); frame != it->frames.end(); frame++) {
+  {
+    Impl::Writer index(impl_.get());
+    auto& ranges = index->ranges;
+    bool is_removing = false;
+    bool changed = false;
+    for (size_t i = 0; i < ranges.size();) {
+      Range& range = ranges[i];
+      const size_t size = range.frames.size();
+
+      // These represent the range of frames within this buffer to delete.
+      size_t del_start = 0;
+      size_t search_from = 0;
       if (!is_removing) {
-        // Only start deleting frames whose start time is in the range.
-        if ((*frame)->pts >= start && (*frame)->pts < end) {
-          is_removing = true;
-          frame_del_start = frame;
+        if (range.end_pts < start || range.start_pts >= end) {
+          i++;
+          continue;
         }
-      } else if ((*frame)->pts >= end && (*frame)->is_key_frame) {
-        // The MSE spec says to remove up to the next key frame.
-        frame_del_end = frame;
-        is_removing = false;
-        break;
+
+        // Only start deleting frames whose start time is in the range.  Frames
+        // outside these indices can't have a PTS in the range.
+        const size_t search_end =
+            std::min(size, range.LowerBound(end - range.min_pts_offset));
+        del_start = range.LowerBound(start - range.max_pts_offset);
+        while (del_start < search_end &&
+               (range.frames[del_start].frame->pts < start ||
+                range.frames[del_start].frame->pts >= end)) {
+          del_start++;
+        }
+        if (del_start == search_end) {
+          i++;
+          continue;
+        }
+
+        is_removing = true;
+        search_from = del_start + 1;
       }
-    }
 
-    if (frame_del_start != it->frames.begin() &&
-        frame_del_start != it->frames.end() &&
-        frame_del_end != it->frames.end()) {
-      // We deleted a partial range, so we need to split the buffered range.
-      auto new_it = impl_->buffered_ranges.emplace(it);  // new_it + 1 == it
-
-      // Move the elements before |frame_del_start| from |it->frames| to
-      // |new_it->frames|.
-      new_it->frames.splice(new_it->frames.end(), it->frames,
-                            it->frames.begin(), frame_del_start);
-
-      it->frames.erase(it->frames.begin(), frame_del_end);
-      UpdatePtsRanges(it);
-      UpdatePtsRanges(new_it);
-      it++;  // list::emplace() doesn't invalidate any iterators.
-    } else {
-      it->frames.erase(frame_del_start, frame_del_end);
-      if (it->frames.empty()) {
-        it = impl_->buffered_ranges.erase(it);
+      // The MSE spec says to remove up to the next key frame.  Frames before
+      // this index can't have a PTS after |end|.
+      size_t del_end = size;
+      for (size_t key = range.NextKeyFrame(std::max(
+               search_from, range.LowerBound(end - range.max_pts_offset)));
+           key < size; key = range.NextKeyFrame(key + 1)) {
+        if (range.frames[key].frame->pts >= end) {
+          del_end = key;
+          is_removing = false;
+          break;
+        }
+      }
+
+      changed |= del_end > del_start;
+      if (del_start == 0 && del_end == size) {
+        range.Release(&removed);
+        ranges.erase(ranges.begin() + i);
+      } else if (del_start != 0 && del_end != size) {
+        // We deleted a partial range, so we need to split the buffered range.
+        Range new_range = range.SplitBefore(del_start);
+        range.Erase(0, del_end - del_start, &removed);
+        ranges.emplace(ranges.begin() + i, std::move(new_range));
+        i += 2;
       } else {
-        UpdatePtsRanges(it);
-        it++;
+        range.Erase(del_start, del_end, &removed);
+        i++;
       }
     }
-  }
+    if (changed)
+      index->RangesChanged();
+    for (auto& frame : removed)
+      index->FrameRemoved(*frame);
 
-  AssertRangesSorted();
+    impl_->AssertRangesSorted(*index);
+  }
+  lock.unlock();
+  FrameReclaimer::Instance()->Release(&removed);
 }
 
-void StreamBase::Clear() {
+size_t StreamBase::EvictBefore(double time, size_t max_size) {
+  std::vector<std::shared_ptr<BaseFrame>> removed;
   std::unique_lock<Mutex> lock(impl_->mutex);
-  impl_->buffered_ranges.clear();
+  size_t ret;
+  {
+    Impl::Writer index(impl_.get());
+    auto& ranges = index->ranges;
+    bool changed = false;
+    while (index->estimated_size > max_size && !ranges.empty()) {
+      // The first GOP is everything before the second keyframe.  If the range
+      // doesn't start with a keyframe, the frames before the first one can't
+      // be decoded anyway, so they are removed with the first GOP.
+      Range& range = ranges.front();
+      const size_t size = range.frames.size();
+      const size_t gop_end = range.NextKeyFrame(1);
+      const double gop_end_time =
+          gop_end == size ? range.end_pts : range.frames[gop_end].frame->pts;
+      if (gop_end_time > time)
+        break;
+
+      const size_t start = removed.size();
+      if (gop_end == size) {
+        range.Release(&removed);
+        ranges.erase(ranges.begin());
+      } else {
+        range.Erase(0, gop_end, &removed);
+      }
+      for (size_t i = start; i < removed.size(); i++)
+        index->FrameRemoved(*removed[i]);
+      changed = true;
+    }
+    if (changed)
+      index->RangesChanged();
+
+    impl_->AssertRangesSorted(*index);
+    ret = index->estimated_size;
+  }
+  lock.unlock();
+  FrameReclaimer::Instance()->Release(&removed);
+  return ret;
 }
 
-void StreamBase::DebugPrint(bool all_frames) const {
+void StreamBase::Clear() {
+  std::vector<std::shared_ptr<BaseFrame>> removed;
   std::unique_lock<Mutex> lock(impl_->mutex);
-  DebugPrintLocked(all_frames);
+  {
+    Impl::Writer index(impl_.get());
+    if (!index->ranges.empty()) {
+      for (auto& range : index->ranges)
+        range.Release(&removed);
+      index->ranges.clear();
+      index->RangesChanged();
+      index->estimated_size = 0;
+    }
+  }
+  lock.unlock();
+  FrameReclaimer::Instance()->Release(&removed);
 }
 
-void StreamBase::DebugPrintLocked(bool all_frames) const {
-  AssertRangesSorted();
+void StreamBase::DebugPrint(bool all_frames) const {
+  auto index = impl_->GetIndex();
+  impl_->AssertRangesSorted(*index);
 
   fprintf(stderr, "Stream order by %s:\n", impl_->order_by_dts ? "DTS" : "PTS");
-  if (impl_->buffered_ranges.empty())
+  if (index->ranges.empty())
     fprintf(stderr, "  Nothing buffered\n");
   size_t range_i = 0;
-  for (const Range& range : impl_->buffered_ranges) {
+  for (const Range& range : index->ranges) {
     fprintf(stderr, "  Range[%zu, %zu frames]: %.2f-%.2f\n", range_i,
             range.frames.size(), range.start_pts, range.end_pts);
     if (all_frames) {
       size_t frame_i = 0;
-      for (const auto& frame : range.frames) {
+      for (const auto& entry : range.frames) {
         fprintf(stderr,
                 "    Frame[%zu]: is_key_frame=%-5s, pts=%.2f, dts=%.2f\n",
-                frame_i, frame->is_key_frame ? "true" : "false", frame->pts,
-                frame->dts);
+                frame_i, entry.frame->is_key_frame ? "true" : "false",
+                entry.frame->pts, entry.frame->dts);
         frame_i++;
       }
     }
@@ -359,85 +762,146 @@ void StreamBase::DebugPrintLocked(bool all_frames) const {
 
 std::shared_ptr<BaseFrame> StreamBase::GetFrameInternal(
     double time, FrameLocation kind) const {
-  std::unique_lock<Mutex> lock(impl_->mutex);
-  AssertRangesSorted();
-
-  auto getTime = impl_->order_by_dts ? &GetTime<true> : &GetTime<false>;
-  auto lowerBound =
-      impl_->order_by_dts ? &FrameLowerBound<true> : &FrameLowerBound<false>;
+  auto snapshot = impl_->GetIndex();
+  impl_->AssertRangesSorted(*snapshot);
 
   // Find the first buffered range that includes or is after |time|.
-  auto it = std::find_if(
-      impl_->buffered_ranges.begin(), impl_->buffered_ranges.end(),
-      [&](const Range& range) { return getTime(range.frames.back()) >= time; });
-
-  if (it == impl_->buffered_ranges.end()) {
-    if (kind == FrameLocation::After || impl_->buffered_ranges.empty())
+  const auto& ranges = snapshot->ranges;
+  auto it = snapshot->FindRange(time);
+  if (it == ranges.end()) {
+    if (kind == FrameLocation::After || kind == FrameLocation::KeyFrameAfter ||
+        ranges.empty()) {
       return nullptr;
+    }
 
-    it = std::prev(impl_->buffered_ranges.end());
+    it = std::prev(ranges.end());
   }
 
-  // |frame_it| points to the frame that starts at or greater than |time|.
-  auto frame_it = lowerBound(it->frames, time);
+  // |index| points to the frame that starts at or greater than |time|.
+  const auto& frames = it->frames;
+  size_t index = it->LowerBound(time);
 
   switch (kind) {
     case FrameLocation::After:
       // Find the frame after |time|.
-      DCHECK(frame_it != it->frames.end());
-      if (getTime(*frame_it) > time)
-        return *frame_it;
-      else if (std::next(frame_it) != it->frames.end())
-        return *std::next(frame_it);
-      else if (std::next(it) != impl_->buffered_ranges.end())
-        return *std::next(it)->frames.begin();
+      DCHECK_LT(index, frames.size());
+      if (frames[index].time > time)
+        return frames[index].frame;
+      else if (index + 1 < frames.size())
+        return frames[index + 1].frame;
+      else if (std::next(it) != ranges.end())
+        return std::next(it)->frames.front().frame;
       else
         return nullptr;
 
     case FrameLocation::Near: {
-      if (frame_it == it->frames.end())
-        return it->frames.back();
+      if (index == frames.size())
+        return frames.back().frame;
 
       // Find the frame before this to see if it is closer.
-      auto prev_it = frame_it;
-      if (frame_it != it->frames.begin())
-        prev_it = std::prev(frame_it);
-      else if (it != impl_->buffered_ranges.begin())
-        prev_it = std::prev(std::prev(it)->frames.end());
-
-      double prev_diff = time - getTime(*prev_it) - (*prev_it)->duration;
-      double diff = getTime(*frame_it) - time;
-      return prev_diff < diff && diff != 0 ? *prev_it : *frame_it;
+      const FrameEntry* prev = &frames[index];
+      if (index != 0)
+        prev = &frames[index - 1];
+      else if (it != ranges.begin())
+        prev = &std::prev(it)->frames.back();
+
+      const double prev_diff = time - prev->time - prev->frame->duration;
+      const double diff = frames[index].time - time;
+      return prev_diff < diff && diff != 0 ? prev->frame : frames[index].frame;
     }
 
     case FrameLocation::KeyFrameBefore:
-      if (frame_it == it->frames.end())
-        frame_it = std::prev(it->frames.end());
-      else if (frame_it != it->frames.begin() && getTime(*frame_it) > time)
-        frame_it--;  // If frame_it is a future frame, move backward.
+      if (index == frames.size())
+        index--;
+      else if (index != 0 && frames[index].time > time)
+        index--;  // If |index| is a future frame, move backward.
+
+      DCHECK(frames.front().frame->is_key_frame);
+      index = it->PrevKeyFrame(index);
+      return frames[index].time <= time ? frames[index].frame : nullptr;
+
+    case FrameLocation::KeyFrameAfter:
+      // Ranges always start with a keyframe, so if there isn't one later in
+      // this range, the next range starts with one.
+      if (index < frames.size() && frames[index].time <= time)
+        index++;
+      index = it->NextKeyFrame(index);
+      if (index < frames.size())
+        return frames[index].frame;
+      else if (std::next(it) != ranges.end())
+        return std::next(it)->frames.front().frame;
+      else
+        return nullptr;
+  }
+}
 
-      DCHECK((*it->frames.begin())->is_key_frame);
-      while (!(*frame_it)->is_key_frame)
-        frame_it--;
+void StreamBase::GetFramesAfterInternal(
+    CursorPosition* position, size_t max_count, double end_time,
+    std::vector<std::shared_ptr<BaseFrame>>* frames) const {
+  auto snapshot = impl_->GetIndex();
+  impl_->AssertRangesSorted(*snapshot);
+
+  // Frames are replaced when adding one with the same time, so if the hint
+  // points to a frame with the same time, it is the last frame read.
+  const auto& ranges = snapshot->ranges;
+  size_t range = position->range;
+  size_t index = position->index;
+  if (range < ranges.size() && index < ranges[range].frames.size() &&
+      ranges[range].frames[index].time == position->time) {
+    index++;
+  } else {
+    auto it = snapshot->FindRange(position->time);
+    if (it == ranges.end())
+      return;
+    range = it - ranges.begin();
+    index = it->UpperBound(position->time);
+  }
 
-      return getTime(*frame_it) <= time ? *frame_it : nullptr;
+  for (size_t count = 0; count < max_count && range < ranges.size();) {
+    const auto& entries = ranges[range].frames;
+    if (index >= entries.size()) {
+      range++;
+      index = 0;
+      continue;
+    }
+    if (entries[index].time > end_time)
+      break;
+
+    frames->emplace_back(entries[index].frame);
+    position->time = entries[index].time;
+    position->range = range;
+    position->index = index;
+    count++;
+    index++;
   }
 }
 
-void StreamBase::AssertRangesSorted() const {
+void StreamBase::Impl::AssertRangesSorted(const Index& index) const {
 #ifndef NDEBUG
-  auto frame_less_than =
-      impl_->order_by_dts ? &FrameLessThan<true> : &FrameLessThan<false>;
   auto range_is_valid = [&](const Range& range) {
     // A buffered range must:
     // - Be non-empty.
     // - Start with a key frame.
     // - Have sorted frames.
+    // - Have an accurate index of the keyframes.
     CHECK(!range.frames.empty());
-    CHECK(range.frames.front()->is_key_frame);
+    CHECK(range.frames.front().frame->is_key_frame);
     CHECK_LE(range.start_pts, range.end_pts);
-    CHECK(std::is_sorted(range.frames.begin(), range.frames.end(),
-                         frame_less_than));
+    CHECK(std::is_sorted(
+        range.frames.begin(), range.frames.end(),
+        [](const FrameEntry& a, const FrameEntry& b) {
+          return a.time < b.time;
+        }));
+    size_t key_frame_count = 0;
+    for (const auto& entry : range.frames) {
+      CHECK_EQ(entry.time, GetTime(*entry.frame));
+      if (entry.frame->is_key_frame) {
+        CHECK_LT(key_frame_count, range.key_frames.size());
+        CHECK_EQ(entry.time, range.key_frames[key_frame_count]);
+        key_frame_count++;
+      }
+    }
+    CHECK_EQ(key_frame_count, range.key_frames.size());
     return true;
   };
   auto range_less_than = [&](const Range& first, const Range& second) {
@@ -455,10 +919,10 @@ void StreamBase::AssertRangesSorted() const {
     return false;
   };
 
-  CHECK(std::all_of(impl_->buffered_ranges.begin(),
-                    impl_->buffered_ranges.end(), range_is_valid));
-  CHECK(std::is_sorted(impl_->buffered_ranges.begin(),
-                       impl_->buffered_ranges.end(), range_less_than));
+  CHECK(std::all_of(index.ranges.begin(), index.ranges.end(),
+                    range_is_valid));
+  CHECK(std::is_sorted(index.ranges.begin(), index.ranges.end(),
+                       range_less_than));
 #endif
 }
 
@@ -103,6 +103,17 @@ class SdlFrameDrawer::Impl {
     if (!frame)
       return nullptr;
 
+    if (get<media::PixelFormat>(frame->format) ==
+        media::PixelFormat::HardwareFrame) {
+      // Map the surface so the pixels are copied straight into the texture
+      // instead of being downloaded into another buffer first.
+      frame = frame->MapHardwareFrame();
+      if (!frame) {
+        LOG(ERROR) << "Error mapping hardware frame";
+        return nullptr;
+      }
+    }
+
     auto sdl_pix_fmt = SdlPixelFormatFromPublic(frame->format);
     if (sdl_pix_fmt == SDL_PIXELFORMAT_UNKNOWN ||
         texture_formats_.count(sdl_pix_fmt) == 0) {
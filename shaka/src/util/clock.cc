@@ -41,5 +41,11 @@ void Clock::SleepSeconds(double seconds) const {
       std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000)));
 }
 
+void Clock::WaitForSignal(std::condition_variable_any* signal,
+                          std::unique_lock<Mutex>* lock,
+                          uint64_t wait_ms) const {
+  signal->wait_for(*lock, std::chrono::milliseconds(wait_ms));
+}
+
 }  // namespace util
 }  // namespace shaka
@@ -17,6 +17,11 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <mutex>
+
+#include "src/debug/mutex.h"
+
 namespace shaka {
 namespace util {
 
@@ -39,6 +44,19 @@ class Clock {
 
   /** Sleeps for the given number of seconds. */
   virtual void SleepSeconds(double seconds) const;
+
+  /**
+   * Waits until the given condition variable is signaled or until the given
+   * number of milliseconds pass on this clock.  This can return early, like
+   * any condition variable wait.
+   *
+   * @param signal The condition variable to wait on.
+   * @param lock The held lock to release while waiting.
+   * @param wait_ms The maximum number of milliseconds to wait.
+   */
+  virtual void WaitForSignal(std::condition_variable_any* signal,
+                             std::unique_lock<Mutex>* lock,
+                             uint64_t wait_ms) const;
 };
 
 }  // namespace util
@@ -0,0 +1,193 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/util/coroutine.h"
+
+#ifdef OS_LINUX
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+#ifdef COROUTINE_ANNOTATE_ASAN
+#  include <sanitizer/common_interface_defs.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace shaka {
+namespace util {
+
+namespace {
+
+#ifdef OS_LINUX
+/**
+ * The size of the stack for the coroutine.  This is only reserved address
+ * space; pages are only committed once they are touched.  This needs to be
+ * large enough for FFmpeg to probe streams, which can run a decoder.
+ */
+constexpr const size_t kStackSize = 4 * 1024 * 1024;
+
+size_t GuardSize() {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+#endif
+
+}  // namespace
+
+Coroutine::Coroutine(const std::string& name, std::function<void()> callback)
+    : name_(name),
+      callback_(std::move(callback)),
+      started_(false),
+      finished_(false),
+#ifdef OS_LINUX
+      stack_(nullptr)
+#  ifdef COROUTINE_ANNOTATE_ASAN
+      ,
+      fake_stack_(nullptr),
+      caller_stack_bottom_(nullptr),
+      caller_stack_size_(0)
+#  endif
+#else
+      mutex_(name),
+      running_(false)
+#endif
+{
+}
+
+Coroutine::~Coroutine() {
+  CHECK(!started_ || finished_) << "Coroutine " << name_
+                                << " destroyed while running";
+#ifndef OS_LINUX
+  if (thread_)
+    thread_->join();
+#endif
+}
+
+void Coroutine::Run() {
+  callback_();
+  finished_ = true;
+}
+
+#ifdef OS_LINUX
+
+void Coroutine::Resume() {
+  DCHECK(!finished_);
+  if (!started_) {
+    started_ = true;
+    void* stack = mmap(nullptr, GuardSize() + kStackSize,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    PCHECK(stack != MAP_FAILED) << "Unable to allocate coroutine stack";
+    stack_ = static_cast<uint8_t*>(stack);
+    // The stack grows down, so the guard page goes at the low end.
+    PCHECK(mprotect(stack_, GuardSize(), PROT_NONE) == 0)
+        << "Unable to protect coroutine stack";
+
+    CHECK_EQ(getcontext(&context_), 0);
+    context_.uc_stack.ss_sp = stack_ + GuardSize();
+    context_.uc_stack.ss_size = kStackSize;
+    // Entry() switches back itself once the callback returns.
+    context_.uc_link = nullptr;
+    // makecontext only passes int arguments, so split the pointer.
+    const uint64_t ptr = reinterpret_cast<uintptr_t>(this);
+    makecontext(&context_, reinterpret_cast<void (*)()>(&Coroutine::Entry), 2,
+                static_cast<uint32_t>(ptr >> 32), static_cast<uint32_t>(ptr));
+  }
+
+#ifdef COROUTINE_ANNOTATE_ASAN
+  void* caller_fake_stack = nullptr;
+  __sanitizer_start_switch_fiber(&caller_fake_stack, stack_ + GuardSize(),
+                                 kStackSize);
+#endif
+  CHECK_EQ(swapcontext(&caller_context_, &context_), 0);
+#ifdef COROUTINE_ANNOTATE_ASAN
+  __sanitizer_finish_switch_fiber(caller_fake_stack, nullptr, nullptr);
+#endif
+
+  if (finished_) {
+    PCHECK(munmap(stack_, GuardSize() + kStackSize) == 0);
+    stack_ = nullptr;
+  }
+}
+
+void Coroutine::Yield() {
+  DCHECK(started_ && !finished_);
+  SwitchToCaller();
+}
+
+void Coroutine::SwitchToCaller() {
+#ifdef COROUTINE_ANNOTATE_ASAN
+  // Once finished, we won't be resumed, so ASan can free our fake stack.
+  __sanitizer_start_switch_fiber(finished_ ? nullptr : &fake_stack_,
+                                 caller_stack_bottom_, caller_stack_size_);
+#endif
+  CHECK_EQ(swapcontext(&context_, &caller_context_), 0);
+#ifdef COROUTINE_ANNOTATE_ASAN
+  __sanitizer_finish_switch_fiber(fake_stack_, &caller_stack_bottom_,
+                                  &caller_stack_size_);
+#endif
+}
+
+// static
+void Coroutine::Entry(uint32_t high, uint32_t low) {
+  const uint64_t ptr = (static_cast<uint64_t>(high) << 32) | low;
+  auto* coroutine = reinterpret_cast<Coroutine*>(static_cast<uintptr_t>(ptr));
+#ifdef COROUTINE_ANNOTATE_ASAN
+  __sanitizer_finish_switch_fiber(nullptr, &coroutine->caller_stack_bottom_,
+                                  &coroutine->caller_stack_size_);
+#endif
+  coroutine->Run();
+  // Switch back directly rather than returning through uc_link so the switch
+  // can be annotated.  This never returns.
+  coroutine->SwitchToCaller();
+}
+
+#else
+
+void Coroutine::Resume() {
+  std::unique_lock<Mutex> lock(mutex_);
+  DCHECK(!finished_);
+  running_ = true;
+  if (!started_) {
+    started_ = true;
+    thread_.reset(
+        new Thread(name_, std::bind(&Coroutine::ThreadMain, this)));
+  } else {
+    signal_.notify_all();
+  }
+  while (running_)
+    signal_.wait(lock);
+}
+
+void Coroutine::Yield() {
+  std::unique_lock<Mutex> lock(mutex_);
+  DCHECK(started_ && !finished_);
+  running_ = false;
+  signal_.notify_all();
+  while (!running_)
+    signal_.wait(lock);
+}
+
+void Coroutine::ThreadMain() {
+  Run();
+
+  std::unique_lock<Mutex> lock(mutex_);
+  running_ = false;
+  signal_.notify_all();
+}
+
+#endif
+
+}  // namespace util
+}  // namespace shaka
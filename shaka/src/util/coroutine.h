@@ -0,0 +1,145 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_UTIL_COROUTINE_H_
+#define SHAKA_EMBEDDED_UTIL_COROUTINE_H_
+
+#ifdef OS_LINUX
+#  include <ucontext.h>
+#endif
+
+// AddressSanitizer needs to be told when we switch stacks.
+#if defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define COROUTINE_ANNOTATE_ASAN
+#  endif
+#elif defined(__SANITIZE_ADDRESS__)
+#  define COROUTINE_ANNOTATE_ASAN
+#endif
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "src/util/macros.h"
+
+#ifndef OS_LINUX
+#  include <condition_variable>
+
+#  include "src/debug/mutex.h"
+#  include "src/debug/thread.h"
+#endif
+
+namespace shaka {
+namespace util {
+
+/**
+ * Runs a callback that can pause itself (Yield) and be continued later
+ * (Resume).  This allows code that expects to block for input (e.g. a library
+ * read callback) to instead return to the caller until more input is given.
+ *
+ * Only one thread may use this at a time, and the callback only runs while a
+ * Resume() call is active.  On Linux this uses a separate stack on the caller's
+ * thread, so switching is cheap; other platforms use a background thread.
+ *
+ * \code{cpp}
+ *   Coroutine routine("Parser", [&]() {
+ *     while (!done) {
+ *       Parse();
+ *       routine.Yield();
+ *     }
+ *   });
+ *   routine.Resume();  // Parses once.
+ * \endcode
+ */
+class Coroutine {
+ public:
+  /**
+   * Creates a new coroutine.  The callback isn't called until the first call
+   * to Resume().
+   *
+   * @param name The name of the coroutine, used for debugging.
+   * @param callback The callback to run.
+   */
+  Coroutine(const std::string& name, std::function<void()> callback);
+
+  /**
+   * Destroys the object.  This can only be destroyed if the callback has
+   * returned or was never started.
+   */
+  ~Coroutine();
+
+  SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(Coroutine);
+
+  /** @return Whether the callback has been started. */
+  bool started() const {
+    return started_;
+  }
+
+  /** @return Whether the callback has returned. */
+  bool finished() const {
+    return finished_;
+  }
+
+  /**
+   * Runs the callback until it calls Yield() or returns.  This cannot be called
+   * from within the callback or after it finishes.
+   */
+  void Resume();
+
+  /**
+   * Pauses the callback and returns to the caller of Resume().  This must be
+   * called from within the callback.
+   */
+  void Yield();
+
+ private:
+  void Run();
+
+  const std::string name_;
+  std::function<void()> callback_;
+  bool started_;
+  bool finished_;
+
+#ifdef OS_LINUX
+  static void Entry(uint32_t high, uint32_t low);
+
+  void SwitchToCaller();
+
+  // The mapping for the stack; this starts with a guard page, so overflowing
+  // the stack crashes rather than writing over other memory.
+  uint8_t* stack_;
+  ucontext_t caller_context_;
+  ucontext_t context_;
+#  ifdef COROUTINE_ANNOTATE_ASAN
+  void* fake_stack_;
+  const void* caller_stack_bottom_;
+  size_t caller_stack_size_;
+#  endif
+#else
+  void ThreadMain();
+
+  Mutex mutex_;
+  std::condition_variable_any signal_;
+  // Whether the callback is allowed to run; this is used to pass control
+  // between the threads.
+  bool running_;
+  std::unique_ptr<Thread> thread_;
+#endif
+};
+
+}  // namespace util
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_UTIL_COROUTINE_H_
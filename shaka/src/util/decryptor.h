@@ -31,6 +31,9 @@ namespace util {
  * so it can be reused for a single decrypt operation.  This will only succeed
  * if all the data is decrypted, meaning for CBC, a whole AES block needs to be
  * given.  It is assumed the output is at least the same size as the input.
+ *
+ * Once an operation is done, the object can be Reset() with a new IV to start
+ * another one with the same key; this avoids setting up the cipher again.
  */
 class Decryptor {
  public:
@@ -40,9 +43,20 @@ class Decryptor {
 
   SHAKA_NON_COPYABLE_OR_MOVABLE_TYPE(Decryptor);
 
+  eme::EncryptionScheme scheme() const {
+    return scheme_;
+  }
+
+  /**
+   * Starts a new decrypt operation with the given IV.  Any state from the
+   * previous operation is dropped.
+   */
+  bool Reset(const std::vector<uint8_t>& iv);
+
   /**
    * Decrypts the given partial block into the given buffer.  This must be
    * given a partial block and |data_size + block_offset <= AES_BLOCK_SIZE|.
+   * |block_offset| must be where the previous call ended within its last block.
    */
   bool DecryptPartialBlock(const uint8_t* data, size_t data_size,
                            uint32_t block_offset, uint8_t* dest);
@@ -16,6 +16,9 @@
 #include <Security/Security.h>
 #include <glog/logging.h>  // NOLINT(build/include_alpha)
 
+#include <algorithm>
+#include <cstring>
+
 #include "src/util/decryptor.h"
 
 namespace shaka {
@@ -45,6 +48,12 @@ Decryptor::Decryptor(eme::EncryptionScheme scheme,
 
 Decryptor::~Decryptor() {}
 
+bool Decryptor::Reset(const std::vector<uint8_t>& iv) {
+  DCHECK_EQ(AES_BLOCK_SIZE, iv.size());
+  iv_.assign(iv.begin(), iv.end());
+  return true;
+}
+
 bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
                                     uint32_t block_offset, uint8_t* dest) {
   if (scheme_ == eme::EncryptionScheme::AesCtr) {
@@ -67,15 +76,19 @@ bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
         return false;
       }
 
-      const size_t to_decrypt = AES_BLOCK_SIZE - block_offset;
-      for (size_t i = 0; i < to_decrypt && i + data_offset < data_size; i++) {
+      const size_t to_decrypt = std::min<size_t>(AES_BLOCK_SIZE - block_offset,
+                                                 data_size - data_offset);
+      for (size_t i = 0; i < to_decrypt; i++) {
         dest[data_offset + i] =
             data[data_offset + i] ^ encrypted_iv[i + block_offset];
       }
 
+      // If this ended within the block, the next call will continue with the
+      // rest of this block's key stream.
+      if (block_offset + to_decrypt == AES_BLOCK_SIZE)
+        IncrementIv(&iv_);
       data_offset += to_decrypt;
       block_offset = 0;
-      IncrementIv(&iv_);
     }
   } else {
     if (block_offset != 0) {
@@ -88,7 +101,12 @@ bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
       return false;
     }
 
-    // This uses AES-CBC.
+    // This uses AES-CBC.  The next IV is the last cipher block; store it
+    // first since this may be decrypting in-place.
+    uint8_t next_iv[AES_BLOCK_SIZE];
+    if (data_size >= AES_BLOCK_SIZE)
+      memcpy(next_iv, data + data_size - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
     size_t length;
     CCCryptorStatus result =
         CCCrypt(kCCDecrypt, kCCAlgorithmAES128, 0, key_.data(), key_.size(),
@@ -102,9 +120,8 @@ bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
       return false;
     }
 
-    if (data_size >= AES_BLOCK_SIZE) {
-      iv_.assign(data + data_size - AES_BLOCK_SIZE, data + data_size);
-    }
+    if (data_size >= AES_BLOCK_SIZE)
+      iv_.assign(next_iv, next_iv + AES_BLOCK_SIZE);
   }
 
   return true;
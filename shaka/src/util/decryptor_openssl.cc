@@ -37,6 +37,23 @@ Decryptor::Decryptor(eme::EncryptionScheme scheme,
 
 Decryptor::~Decryptor() {}
 
+bool Decryptor::Reset(const std::vector<uint8_t>& iv) {
+  DCHECK_EQ(AES_BLOCK_SIZE, iv.size());
+  iv_.assign(iv.begin(), iv.end());
+  if (!extra_->ctx)
+    return true;
+
+  // Only change the IV; the cipher and the expanded key are kept.
+  if (!EVP_DecryptInit_ex(extra_->ctx.get(), nullptr, nullptr, nullptr,
+                          iv_.data()) ||
+      !EVP_CIPHER_CTX_set_padding(extra_->ctx.get(), 0)) {
+    LOG(ERROR) << "Error resetting OpenSSL context: "
+               << ERR_error_string(ERR_get_error(), nullptr);
+    return false;
+  }
+  return true;
+}
+
 bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
                                     uint32_t block_offset, uint8_t* dest) {
   DCHECK_LE(block_offset + data_size, AES_BLOCK_SIZE);
@@ -49,21 +66,16 @@ bool Decryptor::DecryptPartialBlock(const uint8_t* data, size_t data_size,
     return false;
   }
 
-  uint8_t temp_source[AES_BLOCK_SIZE] = {0};
-  uint8_t temp_dest[AES_BLOCK_SIZE];
-  const size_t partial_size =
-      std::min<size_t>(AES_BLOCK_SIZE - block_offset, data_size);
-  memcpy(temp_source + block_offset, data, partial_size);
-
+  // OpenSSL tracks the position within the key stream, so this continues from
+  // |block_offset| in the current block.
   int num_bytes_read;
-  if (!EVP_DecryptUpdate(extra_->ctx.get(), temp_dest, &num_bytes_read,
-                         temp_source, AES_BLOCK_SIZE) ||
-      num_bytes_read != AES_BLOCK_SIZE) {
+  if (!EVP_DecryptUpdate(extra_->ctx.get(), dest, &num_bytes_read, data,
+                         data_size) ||
+      static_cast<size_t>(num_bytes_read) != data_size) {
     LOG(ERROR) << "Error decrypting data: "
                << ERR_error_string(ERR_get_error(), nullptr);
     return false;
   }
-  memcpy(dest, temp_dest + block_offset, partial_size);
   return true;
 }
 
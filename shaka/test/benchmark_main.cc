@@ -0,0 +1,57 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "shaka/js_manager.h"
+#include "src/test/media_files.h"
+#include "src/util/file_system.h"
+
+// The benchmarks are gtest tests that print their timings; they are kept out
+// of the unit tests so they don't slow them down.  Use --gtest_filter to pick
+// which benchmarks to run.
+int main(int argc, char** argv) {
+#ifdef OS_IOS
+  const std::string dynamic_data_dir = std::string(getenv("HOME")) + "/Library";
+  const std::string static_data_dir = ".";
+#else
+  const std::string dynamic_data_dir =
+      shaka::util::FileSystem::DirName(argv[0]);
+  const std::string static_data_dir = dynamic_data_dir;
+#endif
+
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  FLAGS_alsologtostderr = true;
+  google::InitGoogleLogging(argv[0]);
+
+  testing::InitGoogleTest(&argc, argv);
+
+  // Find the location of the media files.
+  shaka::InitMediaFiles(argv[0]);
+
+  // The network benchmarks make requests through the JavaScript event loop.
+  shaka::JsManager::StartupOptions opts;
+  opts.dynamic_data_dir = dynamic_data_dir;
+  opts.static_data_dir = static_data_dir;
+  opts.is_static_relative_to_bundle = true;
+  shaka::JsManager engine(opts);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,126 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/core/network_thread.h"
+
+#include <gtest/gtest.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "src/core/js_manager_impl.h"
+#include "src/core/ref_ptr.h"
+#include "src/js/xml_http_request.h"
+#include "src/test/local_http_server.h"
+
+namespace shaka {
+
+TEST(NetworkThreadBenchmark, ChunkedResponseLatency) {
+  // A 2 second segment encoded in 100ms chunks, like low-latency DASH.
+  constexpr const size_t kChunkCount = 20;
+  constexpr const double kChunkDelay = 0.1;
+  LocalHttpServer server(kChunkCount, kChunkDelay);
+
+  for (const char* type : {"arraybuffer", "moz-chunked-arraybuffer"}) {
+    std::vector<std::chrono::steady_clock::time_point> received_times;
+    size_t event_count;
+    ASSERT_NO_FATAL_FAILURE(
+        DownloadSegment(&server, type, &received_times, &event_count));
+    const auto chunk_times = server.chunk_times();
+    ASSERT_EQ(chunk_times.size(), received_times.size());
+
+    // The time between the server writing a chunk and the app having it.
+    double total_ms = 0;
+    double max_ms = 0;
+    for (size_t i = 0; i < chunk_times.size(); i++) {
+      const double ms = std::chrono::duration<double, std::milli>(
+                            received_times[i] - chunk_times[i])
+                            .count();
+      total_ms += ms;
+      max_ms = std::max(max_ms, ms);
+    }
+    printf("%-24s %.1f ms average latency, %.1f ms max, %zu events\n", type,
+           total_ms / chunk_times.size(), max_ms, event_count);
+  }
+}
+
+TEST(NetworkThreadBenchmark, ConcurrentRequests) {
+  LocalHttpServer server;
+  TaskRunner* main_thread = JsManagerImpl::Instance()->MainThread();
+
+  for (size_t count : {100, 300, 600}) {
+    js::XMLHttpRequest::ResetStats();
+    std::vector<RefPtr<js::XMLHttpRequest>> requests;
+    const auto start = std::chrono::steady_clock::now();
+    main_thread
+        ->AddInternalTask(TaskPriority::Immediate, "",
+                          [&]() {
+                            for (size_t i = 0; i < count; i++) {
+                              RefPtr<js::XMLHttpRequest> xhr =
+                                  new js::XMLHttpRequest();
+                              xhr->Open("GET", server.url(), nullopt, nullopt,
+                                        nullopt);
+                              xhr->Send(nullopt);
+                              requests.emplace_back(xhr);
+                            }
+                          })
+        ->GetValue();
+
+    // Poll from the main thread since that is where the XHR state is used.
+    auto is_done = [&]() {
+      for (auto& xhr : requests) {
+        if (xhr->ready_state != js::XMLHttpRequest::ReadyState::Done)
+          return false;
+      }
+      return true;
+    };
+    const bool finished = WaitOnMainThread(is_done);
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+    size_t succeeded = 0;
+    main_thread
+        ->AddInternalTask(TaskPriority::Immediate, "",
+                          [&]() {
+                            for (auto& xhr : requests) {
+                              if (!finished)
+                                xhr->Abort();
+                              if (xhr->status == 200 &&
+                                  xhr->response.size() == kSegmentSize) {
+                                succeeded++;
+                              }
+                            }
+                            requests.clear();
+                          })
+        ->GetValue();
+    ASSERT_TRUE(finished) << "Timed out waiting for the downloads";
+    EXPECT_EQ(count, succeeded);
+
+    // The bodies should be downloaded directly into the response buffers.
+    const auto stats = js::XMLHttpRequest::GetStats();
+    EXPECT_EQ(count * kSegmentSize, stats.bytes_received);
+    EXPECT_EQ(0u, stats.bytes_copied);
+
+    printf("%4zu concurrent requests: %.1f ms total, %.3f ms per request, "
+           "%" PRIu64 " bytes copied, %" PRIu64 " allocations\n",
+           count, ms, ms / count, stats.bytes_copied,
+           stats.buffer_allocations);
+  }
+}
+
+}  // namespace shaka
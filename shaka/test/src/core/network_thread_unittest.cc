@@ -0,0 +1,105 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/core/network_thread.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "src/core/js_manager_impl.h"
+#include "src/core/ref_ptr.h"
+#include "src/js/xml_http_request.h"
+#include "src/test/local_http_server.h"
+
+namespace shaka {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+}  // namespace
+
+TEST(NetworkThreadTest, ChunkedResponse_GivesDataAsItArrives) {
+  constexpr const size_t kChunkCount = 4;
+  LocalHttpServer server(kChunkCount, /* chunk_delay= */ 0.05);
+
+  std::vector<Clock::time_point> received_times;
+  size_t event_count;
+  ASSERT_NO_FATAL_FAILURE(DownloadSegment(&server, "moz-chunked-arraybuffer",
+                                          &received_times, &event_count));
+  // The data should be given in "progress" events as it arrives, so the first
+  // chunk is available long before the server finishes.
+  EXPECT_GE(event_count, kChunkCount);
+  ASSERT_EQ(kChunkCount, received_times.size());
+  EXPECT_LT(received_times[0], server.chunk_times().back());
+}
+
+TEST(NetworkThreadTest, DownloadsConcurrentRequests) {
+  constexpr const size_t kRequestCount = 50;
+  LocalHttpServer server;
+  TaskRunner* main_thread = JsManagerImpl::Instance()->MainThread();
+
+  js::XMLHttpRequest::ResetStats();
+  std::vector<RefPtr<js::XMLHttpRequest>> requests;
+  main_thread
+      ->AddInternalTask(TaskPriority::Immediate, "",
+                        [&]() {
+                          for (size_t i = 0; i < kRequestCount; i++) {
+                            RefPtr<js::XMLHttpRequest> xhr =
+                                new js::XMLHttpRequest();
+                            xhr->Open("GET", server.url(), nullopt, nullopt,
+                                      nullopt);
+                            xhr->Send(nullopt);
+                            requests.emplace_back(xhr);
+                          }
+                        })
+      ->GetValue();
+
+  // Poll from the main thread since that is where the XHR state is used.
+  auto is_done = [&]() {
+    for (auto& xhr : requests) {
+      if (xhr->ready_state != js::XMLHttpRequest::ReadyState::Done)
+        return false;
+    }
+    return true;
+  };
+  const bool finished = WaitOnMainThread(is_done);
+
+  size_t succeeded = 0;
+  main_thread
+      ->AddInternalTask(TaskPriority::Immediate, "",
+                        [&]() {
+                          for (auto& xhr : requests) {
+                            if (!finished)
+                              xhr->Abort();
+                            if (xhr->status == 200 &&
+                                xhr->response.size() == kSegmentSize) {
+                              succeeded++;
+                            }
+                          }
+                          requests.clear();
+                        })
+      ->GetValue();
+  ASSERT_TRUE(finished) << "Timed out waiting for the downloads";
+  EXPECT_EQ(kRequestCount, succeeded);
+
+  // The bodies should be downloaded directly into the response buffers.
+  const auto stats = js::XMLHttpRequest::GetStats();
+  EXPECT_EQ(kRequestCount * kSegmentSize, stats.bytes_received);
+  EXPECT_EQ(0u, stats.bytes_copied);
+}
+
+}  // namespace shaka
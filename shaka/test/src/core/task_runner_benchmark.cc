@@ -0,0 +1,105 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/core/task_runner.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "src/debug/thread_event.h"
+#include "src/test/test_utils.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+
+TEST(TaskRunnerBenchmark, Throughput) {
+  constexpr const size_t kTaskCount = 100000;
+  constexpr const size_t kTimerCount = 10000;
+
+  TaskRunner runner([](TaskRunner::RunLoop loop) { loop(); },
+                    &util::Clock::Instance, true);
+  size_t count = 0;
+  // Measures both posting the tasks and running them.
+  const double task_ns = BenchmarkNanoseconds(kTaskCount, [&](size_t i) {
+    runner.AddInternalTask(i % 2 ? TaskPriority::Internal
+                                 : TaskPriority::Events,
+                           "", [&]() { count++; });
+    if (i == kTaskCount - 1)
+      runner.WaitUntilFinished();
+  });
+  EXPECT_EQ(kTaskCount, count);
+
+  // Register a lot of pending timers and cancel half of them.
+  std::vector<int> ids;
+  const double timer_ns = BenchmarkNanoseconds(kTimerCount, [&](size_t i) {
+    ids.push_back(runner.AddTimer(1000 + i, []() {}));
+    if (i % 2)
+      runner.CancelTimer(ids[i - 1]);
+  });
+  for (int id : ids)
+    runner.CancelTimer(id);
+
+  printf("AddInternalTask+run=%.0fns AddTimer+CancelTimer=%.0fns\n", task_ns,
+         timer_ns);
+}
+
+TEST(TaskRunnerBenchmark, WakeLatency) {
+  constexpr const size_t kIterations = 200;
+  constexpr const uint64_t kTimerDelayMs = 2;
+
+  TaskRunner runner([](TaskRunner::RunLoop loop) { loop(); },
+                    &util::Clock::Instance, true);
+  using Clock = std::chrono::steady_clock;
+  auto to_ms = [](Clock::duration delta) {
+    return std::chrono::duration<double, std::milli>(delta).count();
+  };
+
+  // The time it takes an idle runner to run a new task.
+  double task_total = 0, task_max = 0;
+  for (size_t i = 0; i < kIterations; i++) {
+    util::Clock::Instance.SleepSeconds(0.001);
+    const auto start = Clock::now();
+    const auto ran_at =
+        runner.AddInternalTask(TaskPriority::Internal, "",
+                               []() { return Clock::now(); })
+            ->GetValue();
+    const double delta = to_ms(ran_at - start);
+    task_total += delta;
+    task_max = std::max(task_max, delta);
+  }
+
+  // How late timers fire compared to their delay.
+  double timer_total = 0, timer_max = 0;
+  for (size_t i = 0; i < kIterations / 10; i++) {
+    ThreadEvent<Clock::time_point> fired("");
+    const auto start = Clock::now();
+    runner.AddTimer(kTimerDelayMs,
+                    [&]() { fired.SignalAllIfNotSet(Clock::now()); });
+    const double delta =
+        std::max(to_ms(fired.GetValue() - start) - kTimerDelayMs, 0.0);
+    timer_total += delta;
+    timer_max = std::max(timer_max, delta);
+  }
+
+  printf("task wake latency:  avg %.3f ms, max %.3f ms\n",
+         task_total / kIterations, task_max);
+  printf("timer lateness:     avg %.3f ms, max %.3f ms\n",
+         timer_total / (kIterations / 10), timer_max);
+}
+
+}  // namespace shaka
@@ -17,6 +17,12 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
 #include "src/debug/thread_event.h"
 #include "src/memory/heap_tracer.h"
 
@@ -26,6 +32,7 @@ namespace {
 
 using testing::_;
 using testing::InSequence;
+using testing::Invoke;
 using testing::MockFunction;
 using testing::NiceMock;
 using testing::Return;
@@ -35,8 +42,38 @@ class MockClock : public util::Clock {
  public:
   MOCK_CONST_METHOD0(GetMonotonicTime, uint64_t());
   MOCK_CONST_METHOD1(SleepSeconds, void(double));
+
+  // Don't wait in real time; the runner will check the fake time again.
+  void WaitForSignal(std::condition_variable_any* /* signal */,
+                     std::unique_lock<Mutex>* /* lock */,
+                     uint64_t /* wait_ms */) const override {}
 };
 
+/** A real clock that signals when the runner starts waiting for a timer. */
+class WaitingClock : public util::Clock {
+ public:
+  WaitingClock() : waiting("WaitingClock") {}
+
+  void WaitForSignal(std::condition_variable_any* signal,
+                     std::unique_lock<Mutex>* lock,
+                     uint64_t wait_ms) const override {
+    waiting.SignalAllIfNotSet();
+    util::Clock::WaitForSignal(signal, lock, wait_ms);
+  }
+
+  mutable ThreadEvent<void> waiting;
+};
+
+/** @return The indices of |delays|, in the order the timers should fire. */
+std::vector<size_t> GetFiringOrder(const std::vector<uint64_t>& delays) {
+  std::vector<size_t> ret(delays.size());
+  std::iota(ret.begin(), ret.end(), 0);
+  std::stable_sort(ret.begin(), ret.end(), [&](size_t a, size_t b) {
+    return delays[a] < delays[b];
+  });
+  return ret;
+}
+
 class TaskWatcher {
  public:
   MOCK_METHOD0(Call, void());
@@ -129,6 +166,36 @@ TEST(TaskRunnerTest, FiresSmallerTimersFirst) {
   runner.WaitUntilFinished();
 }
 
+TEST(TaskRunnerTest, FiresTimersInDeadlineOrder) {
+  NiceMock<MockClock> clock;
+  std::atomic<uint64_t> now{0};
+  ON_CALL(clock, GetMonotonicTime()).WillByDefault(Invoke([&]() {
+    return now.load();
+  }));
+
+  ThreadEvent<void> delay("");
+  TaskRunner runner(
+      [&](TaskRunner::RunLoop loop) {
+        delay.GetValue();
+        loop();
+      },
+      &clock, true);
+
+  // Register the timers out of order with several sharing a deadline; they
+  // all become due at once, so the heap alone decides the order.
+  const std::vector<uint64_t> delays = {30, 10, 20, 10, 50, 0,
+                                        30, 20, 10, 40, 0,  30};
+  std::vector<size_t> order;
+  for (size_t i = 0; i < delays.size(); i++)
+    runner.AddTimer(delays[i], [&order, i]() { order.push_back(i); });
+  now = 100;
+  delay.SignalAll();
+  runner.WaitUntilFinished();
+
+  // Timers with the same deadline fire in the order they were registered.
+  EXPECT_EQ(GetFiringOrder(delays), order);
+}
+
 TEST(TaskRunnerTest, FiresZeroDelayTimers) {
   StrictMock<TaskWatcher> watcher;
   NiceMock<MockClock> clock;
@@ -216,6 +283,54 @@ TEST(TaskRunnerTest, CancelsRepeatedTimers) {
   runner.WaitUntilFinished();
 }
 
+TEST(TaskRunnerTest, CancelsManyTimers) {
+  NiceMock<MockClock> clock;
+  std::atomic<uint64_t> now{0};
+  ON_CALL(clock, GetMonotonicTime()).WillByDefault(Invoke([&]() {
+    return now.load();
+  }));
+
+  ThreadEvent<void> delay("");
+  TaskRunner runner(
+      [&](TaskRunner::RunLoop loop) {
+        delay.GetValue();
+        loop();
+      },
+      &clock, true);
+
+  constexpr const size_t kTimerCount = 100;
+  std::vector<uint64_t> delays;
+  std::vector<int> ids;
+  std::vector<size_t> order;
+  for (size_t i = 0; i < kTimerCount; i++) {
+    delays.push_back((i * 7) % 13);
+    ids.push_back(
+        runner.AddTimer(delays.back(), [&order, i]() { order.push_back(i); }));
+  }
+
+  // Cancel 80 timers.  Once more than half the heap is canceled it is
+  // compacted, so this covers timers removed by compacting and timers that
+  // are only dropped when they reach the top of the heap.
+  std::vector<uint64_t> kept_delays;
+  std::vector<size_t> kept;
+  for (size_t i = 0; i < kTimerCount; i++) {
+    if (i % 5 == 0) {
+      kept_delays.push_back(delays[i]);
+      kept.push_back(i);
+    } else {
+      runner.CancelTimer(ids[i]);
+    }
+  }
+  now = 100;
+  delay.SignalAll();
+  runner.WaitUntilFinished();
+
+  std::vector<size_t> expected;
+  for (size_t i : GetFiringOrder(kept_delays))
+    expected.push_back(kept[i]);
+  EXPECT_EQ(expected, order);
+}
+
 TEST(TaskRunnerTest, IgnoresUnknownWhenCanceling) {
   StrictMock<TaskWatcher> watcher;
   NiceMock<MockClock> clock;
@@ -289,6 +404,21 @@ TEST(TaskRunnerTest, FiresInternalTasksBeforeTimers) {
   runner.WaitUntilFinished();
 }
 
+TEST(TaskRunnerTest, WakesIdleRunnerForInternalTasks) {
+  WaitingClock clock;
+  TaskRunner runner([](TaskRunner::RunLoop loop) { loop(); }, &clock, true);
+
+  // The runner goes idle waiting for a timer an hour away.
+  runner.AddTimer(60 * 60 * 1000, []() {});
+  clock.waiting.GetValue();
+
+  // A task from another thread should wake it without waiting for the timer.
+  auto event = runner.AddInternalTask(TaskPriority::Internal, "", []() {});
+  EXPECT_EQ(std::future_status::ready,
+            event->future().wait_for(std::chrono::seconds(10)));
+  runner.Stop();
+}
+
 TEST(TaskRunnerTest, PassesReturnValues) {
   std::function<double()> cb = []() { return 1234.5; };
   NiceMock<MockClock> clock;
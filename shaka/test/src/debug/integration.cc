@@ -83,6 +83,60 @@ TEST(MutexTest, AllowsMultipleWaitingThreads) {
   thread3.join();
 }
 
+#ifdef DEBUG_DEADLOCKS
+TEST(MutexTest, CountsContention) {
+  Mutex mutex("");
+  ThreadEvent<void> locked("");
+
+  std::thread thread([&]() {
+    std::unique_lock<Mutex> lock(mutex);
+    locked.SignalAll();
+    // Hold the lock until the main thread has to wait for it.
+    while (mutex.GetStats().contended_lock_count == 0)
+      std::this_thread::yield();
+  });
+  locked.GetValue();
+  {
+    std::unique_lock<Mutex> lock(mutex);
+  }
+  thread.join();
+
+  const auto stats = mutex.GetStats();
+  EXPECT_EQ(2u, stats.lock_count);
+  EXPECT_EQ(1u, stats.contended_lock_count);
+  EXPECT_EQ(0u, stats.shared_lock_count);
+  EXPECT_GT(stats.wait_nanoseconds, 0u);
+
+  mutex.ResetStats();
+  EXPECT_EQ(0u, mutex.GetStats().lock_count);
+  EXPECT_EQ(0u, mutex.GetStats().contended_lock_count);
+}
+
+TEST(MutexTest, CountsWritersBlockedByReaders) {
+  SharedMutex mutex("");
+  ThreadEvent<void> locked("");
+
+  std::thread reader([&]() {
+    util::shared_lock<SharedMutex> lock(mutex);
+    locked.SignalAll();
+    // Hold the lock until the writer has to wait for it.
+    while (mutex.GetStats().contended_lock_count == 0)
+      std::this_thread::yield();
+  });
+  locked.GetValue();
+  {
+    std::unique_lock<SharedMutex> lock(mutex);
+  }
+  reader.join();
+
+  const auto stats = mutex.GetStats();
+  EXPECT_EQ(1u, stats.shared_lock_count);
+  EXPECT_EQ(0u, stats.contended_shared_lock_count);
+  EXPECT_EQ(1u, stats.lock_count);
+  EXPECT_EQ(1u, stats.contended_lock_count);
+}
+#endif
+
 #if defined(DEBUG_DEADLOCKS) && defined(GTEST_HAS_DEATH_TEST)
 DEFINE_DEATH_TEST(MutexDeathTest, DontAllowRecursion, "recursive mutex") {
   Mutex mutex("");
@@ -0,0 +1,129 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/eme/clearkey_implementation.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace shaka {
+namespace eme {
+
+namespace {
+
+class MockImplementationHelper : public ImplementationHelper {
+ public:
+  MOCK_CONST_METHOD0(DataPathPrefix, std::string());
+  MOCK_CONST_METHOD4(OnMessage, void(const std::string&, MediaKeyMessageType,
+                                     const uint8_t*, size_t));
+  MOCK_CONST_METHOD1(OnKeyStatusChange, void(const std::string&));
+};
+
+template <size_t N>
+std::vector<uint8_t> MakeVector(const uint8_t (&arr)[N]) {
+  return {arr, arr + N};
+}
+
+constexpr const uint8_t kKey[] = {'1', '2', '3', '4', '5', '6', '7', '8',
+                                  '9', '0', '1', '2', '3', '4', '5', '6'};
+constexpr const uint8_t kIv[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7,
+                                 0x8, 0x9, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf};
+
+}  // namespace
+
+using ::testing::NiceMock;
+
+class ClearKeyImplementationBenchmark : public testing::Test {
+ protected:
+  void LoadKeyForTesting(ClearKeyImplementation* clear_key,
+                         std::vector<uint8_t> key_id,
+                         std::vector<uint8_t> key) {
+    clear_key->LoadKeyForTesting(std::move(key_id), std::move(key));
+  }
+};
+
+TEST_F(ClearKeyImplementationBenchmark, Decrypt) {
+  NiceMock<MockImplementationHelper> helper;
+  ClearKeyImplementation clear_key(&helper);
+  // Use a few keys so the key has to be looked up.
+  for (uint8_t i = 0; i < 8; i++) {
+    LoadKeyForTesting(&clear_key, std::vector<uint8_t>(16, i),
+                      MakeVector(kKey));
+  }
+
+  // About the size of a frame of 4K video.
+  constexpr const size_t kVideoFrameSize = 256 * 1024;
+  // About the size of an AAC frame.
+  constexpr const size_t kAudioFrameSize = 768;
+  // The number of bytes each thread decrypts.
+  constexpr const size_t kTotalSize = 100 * 1024 * 1024;
+  // Typical subsamples for video: a few clear header bytes per NAL unit, with
+  // the protected part being whole blocks.
+  std::vector<SubsampleInfo> subsamples;
+  for (size_t i = 0; i < 16; i++)
+    subsamples.emplace_back(96, kVideoFrameSize / 16 - 96);
+
+  struct {
+    const char* name;
+    size_t frame_size;
+    FrameEncryptionInfo info;
+  } kCases[] = {
+      {"cenc audio", kAudioFrameSize,
+       {EncryptionScheme::AesCtr, std::vector<uint8_t>(16, 5),
+        MakeVector(kIv)}},
+      {"cenc video", kVideoFrameSize,
+       {EncryptionScheme::AesCtr, EncryptionPattern(),
+        std::vector<uint8_t>(16, 5), MakeVector(kIv), subsamples}},
+      {"cbcs 1:9 video", kVideoFrameSize,
+       {EncryptionScheme::AesCbc, EncryptionPattern(1, 9),
+        std::vector<uint8_t>(16, 5), MakeVector(kIv), subsamples}},
+  };
+
+  for (auto& test_case : kCases) {
+    for (size_t thread_count : {1, 4}) {
+      // Each thread decrypts its own frames, like separate streams.
+      auto decrypt = [&]() {
+        std::vector<uint8_t> data(test_case.frame_size, 0x42);
+        std::vector<uint8_t> dest(test_case.frame_size);
+        for (size_t i = 0; i < kTotalSize / test_case.frame_size; i++) {
+          ASSERT_EQ(clear_key.Decrypt(&test_case.info, data.data(),
+                                      data.size(), dest.data()),
+                    DecryptStatus::Success);
+        }
+      };
+
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < thread_count; i++)
+        threads.emplace_back(decrypt);
+      for (auto& thread : threads)
+        thread.join();
+      const double seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+      const double megabytes =
+          static_cast<double>(kTotalSize * thread_count) / (1024 * 1024);
+      printf("%-18s %zu thread(s): %8.1f MB/s\n", test_case.name, thread_count,
+             megabytes / seconds);
+    }
+  }
+}
+
+}  // namespace eme
+}  // namespace shaka
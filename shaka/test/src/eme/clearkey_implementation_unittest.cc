@@ -56,6 +56,12 @@ constexpr const uint8_t kBlockOffsetEncryptedData[] = {
     0xb2, 0xe9, 0xf5, 0x9c, 0xfe, 0xc6, 0xe6, 0xe6, 0x6b, 0x76, 0xcd};
 constexpr const uint8_t kIv[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7,
                                  0x8, 0x9, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf};
+// Blocks 0 and 3 of the bytes 0-68, encrypted together with AES-CBC.  With a
+// 1:2 pattern, these are the only encrypted blocks.
+constexpr const uint8_t kPatternEncryptedBlocks[] = {
+    0xd8, 0xb5, 0x98, 0x48, 0xc7, 0x67, 0x0c, 0x94, 0xb2, 0x9b, 0x54,
+    0xd2, 0x37, 0x9e, 0x2e, 0x7a, 0xea, 0xcc, 0x34, 0x2c, 0x2a, 0x9c,
+    0x3e, 0xef, 0x64, 0x21, 0x3b, 0x6d, 0x6b, 0x8d, 0xda, 0xbd};
 
 }  // namespace
 
@@ -150,6 +156,56 @@ TEST_F(ClearKeyImplementationTest, Decrypt) {
   }
 }
 
+TEST_F(ClearKeyImplementationTest, Decrypt_Subsamples) {
+  NiceMock<MockImplementationHelper> helper;
+  ClearKeyImplementation clear_key(&helper);
+  LoadKeyForTesting(&clear_key, MakeVector(kKeyId), MakeVector(kKey));
+
+  // The protected ranges are one stream, so the first one ends in the middle
+  // of a block and the second one continues from it.
+  std::unique_ptr<FrameEncryptionInfo> info(new FrameEncryptionInfo(
+      EncryptionScheme::AesCtr, EncryptionPattern(), MakeVector(kKeyId),
+      MakeVector(kIv), {SubsampleInfo(3, 5), SubsampleInfo(2, 18)}));
+  std::vector<uint8_t> data = {1, 2, 3};
+  data.insert(data.end(), kEncryptedData, kEncryptedData + 5);
+  data.insert(data.end(), {4, 5});
+  data.insert(data.end(), kEncryptedData + 5, std::end(kEncryptedData));
+  std::vector<uint8_t> expected = {1, 2, 3};
+  expected.insert(expected.end(), kClearData, kClearData + 5);
+  expected.insert(expected.end(), {4, 5});
+  expected.insert(expected.end(), kClearData + 5, std::end(kClearData));
+
+  std::vector<uint8_t> dest(data.size());
+  EXPECT_EQ(
+      clear_key.Decrypt(info.get(), data.data(), data.size(), dest.data()),
+      DecryptStatus::Success);
+  EXPECT_EQ(dest, expected);
+}
+
+TEST_F(ClearKeyImplementationTest, Decrypt_Pattern) {
+  NiceMock<MockImplementationHelper> helper;
+  ClearKeyImplementation clear_key(&helper);
+  LoadKeyForTesting(&clear_key, MakeVector(kKeyId), MakeVector(kKey));
+
+  // With a 1:2 pattern, block 0 is encrypted, 1 and 2 are clear, block 3 is
+  // encrypted, and the partial block at the end is clear.
+  std::unique_ptr<FrameEncryptionInfo> info(
+      new FrameEncryptionInfo(EncryptionScheme::AesCbc, EncryptionPattern(1, 2),
+                              MakeVector(kKeyId), MakeVector(kIv)));
+  std::vector<uint8_t> expected(69);
+  for (size_t i = 0; i < expected.size(); i++)
+    expected[i] = static_cast<uint8_t>(i);
+  std::vector<uint8_t> data = expected;
+  memcpy(data.data(), kPatternEncryptedBlocks, AES_BLOCK_SIZE);
+  memcpy(data.data() + 3 * AES_BLOCK_SIZE,
+         kPatternEncryptedBlocks + AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
+  EXPECT_EQ(
+      clear_key.Decrypt(info.get(), data.data(), data.size(), data.data()),
+      DecryptStatus::Success);
+  EXPECT_EQ(data, expected);
+}
+
 TEST_F(ClearKeyImplementationTest, Decrypt_KeyNotFound) {
   NiceMock<MockImplementationHelper> helper;
   ClearKeyImplementation clear_key(&helper);
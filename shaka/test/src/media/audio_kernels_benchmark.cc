@@ -0,0 +1,132 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_kernels.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "shaka/media/frames.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/**
+ * Interleaves the samples one at a time, like the renderer used to.  This is
+ * the baseline the kernels are compared against.
+ */
+void InterleaveWithMemcpy(const uint8_t* const* planes, size_t channel_count,
+                          size_t sample_size, size_t sample_count,
+                          uint8_t* dest) {
+  for (size_t sample = 0; sample < sample_count; sample++) {
+    for (size_t channel = 0; channel < channel_count; channel++) {
+      std::memcpy(dest, planes[channel] + sample * sample_size, sample_size);
+      dest += sample_size;
+    }
+  }
+}
+
+/** The benchmarks read their output into this so it isn't optimized out. */
+volatile uint8_t g_sink;
+
+/** Creates planes of |size| bytes each, filled with distinct values. */
+std::vector<std::vector<uint8_t>> MakePlanes(size_t channel_count,
+                                             size_t size) {
+  std::vector<std::vector<uint8_t>> ret(channel_count);
+  for (size_t channel = 0; channel < channel_count; channel++) {
+    ret[channel].resize(size);
+    for (size_t i = 0; i < size; i++)
+      ret[channel][i] = static_cast<uint8_t>(i * 7 + channel * 31 + 1);
+  }
+  return ret;
+}
+
+}  // namespace
+
+TEST(AudioKernelsBenchmark, AudioOutput) {
+  // About 20ms of 48kHz audio, a typical frame size.
+  constexpr const size_t kSampleCount = 1024;
+  constexpr const size_t kIterations = 20000;
+  constexpr const double kGain = 0.7;
+  using Clock = std::chrono::steady_clock;
+
+  for (SampleFormat format : {SampleFormat::PlanarS16, SampleFormat::PlanarS32,
+                              SampleFormat::PlanarFloat}) {
+    const size_t sample_size = format == SampleFormat::PlanarS16 ? 2 : 4;
+    for (size_t channels : {2, 6, 8}) {
+      auto planes = MakePlanes(channels, kSampleCount * sample_size);
+      std::vector<const uint8_t*> plane_ptrs;
+      for (auto& plane : planes)
+        plane_ptrs.push_back(plane.data());
+      const size_t size = kSampleCount * sample_size * channels;
+      const double total_samples =
+          static_cast<double>(kSampleCount) * channels * kIterations;
+
+      // Before: allocate per frame, copy one sample at a time, and allocate
+      // again to apply the volume.
+      auto start = Clock::now();
+      for (size_t i = 0; i < kIterations; i++) {
+        std::vector<uint8_t> temp(size);
+        InterleaveWithMemcpy(plane_ptrs.data(), channels, sample_size,
+                             kSampleCount, temp.data());
+        std::vector<uint8_t> mixed(size);
+        std::memcpy(mixed.data(), temp.data(), size);
+        if (format == SampleFormat::PlanarS16) {
+          auto* samples = reinterpret_cast<int16_t*>(mixed.data());
+          for (size_t j = 0; j < size / 2; j++)
+            samples[j] = static_cast<int16_t>(samples[j] * kGain);
+        } else if (format == SampleFormat::PlanarS32) {
+          auto* samples = reinterpret_cast<int32_t*>(mixed.data());
+          for (size_t j = 0; j < size / 4; j++)
+            samples[j] = static_cast<int32_t>(samples[j] * kGain);
+        } else {
+          auto* samples = reinterpret_cast<float*>(mixed.data());
+          for (size_t j = 0; j < size / 4; j++)
+            samples[j] = static_cast<float>(samples[j] * kGain);
+        }
+        g_sink = mixed[i % size];
+      }
+      const double before =
+          std::chrono::duration<double, std::nano>(Clock::now() - start)
+              .count();
+
+      // After: reuse one buffer and use the kernels.
+      std::vector<uint8_t> buffer(size);
+      start = Clock::now();
+      for (size_t i = 0; i < kIterations; i++) {
+        InterleaveSamples(format, plane_ptrs.data(), channels, 0, kSampleCount,
+                          buffer.data());
+        ApplyGain(format, kGain, buffer.data(), size);
+        g_sink = buffer[i % size];
+      }
+      const double after =
+          std::chrono::duration<double, std::nano>(Clock::now() - start)
+              .count();
+
+      printf("%-11s %zu channels: before %.3f ns/sample, after %.3f "
+             "ns/sample\n",
+             (testing::PrintToString(format) + ":").c_str(), channels,
+             before / total_samples, after / total_samples);
+    }
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,349 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_renderer_common.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+class MockMediaPlayer : public MediaPlayer {
+ public:
+  MOCK_CONST_METHOD1(DecodingInfo,
+                     MediaCapabilitiesInfo(const MediaDecodingConfiguration&));
+  MOCK_CONST_METHOD0(VideoPlaybackQuality, struct VideoPlaybackQuality());
+  MOCK_CONST_METHOD1(AddClient, void(Client*));
+  MOCK_CONST_METHOD1(RemoveClient, void(Client*));
+  MOCK_CONST_METHOD0(GetBuffered, std::vector<BufferedRange>());
+  MOCK_CONST_METHOD0(ReadyState, VideoReadyState());
+  MOCK_CONST_METHOD0(PlaybackState, VideoPlaybackState());
+  MOCK_METHOD0(AudioTracks, std::vector<std::shared_ptr<MediaTrack>>());
+  MOCK_CONST_METHOD0(AudioTracks,
+                     std::vector<std::shared_ptr<const MediaTrack>>());
+  MOCK_METHOD0(VideoTracks, std::vector<std::shared_ptr<MediaTrack>>());
+  MOCK_CONST_METHOD0(VideoTracks,
+                     std::vector<std::shared_ptr<const MediaTrack>>());
+  MOCK_METHOD0(TextTracks, std::vector<std::shared_ptr<TextTrack>>());
+  MOCK_CONST_METHOD0(TextTracks,
+                     std::vector<std::shared_ptr<const TextTrack>>());
+  MOCK_METHOD3(AddTextTrack,
+               std::shared_ptr<TextTrack>(TextTrackKind, const std::string&,
+                                          const std::string&));
+  MOCK_METHOD1(SetVideoFillMode, bool(VideoFillMode));
+  MOCK_CONST_METHOD0(Width, uint32_t());
+  MOCK_CONST_METHOD0(Height, uint32_t());
+  MOCK_CONST_METHOD0(Volume, double());
+  MOCK_METHOD1(SetVolume, void(double));
+  MOCK_CONST_METHOD0(Muted, bool());
+  MOCK_METHOD1(SetMuted, void(bool));
+  MOCK_METHOD0(Play, void());
+  MOCK_METHOD0(Pause, void());
+  MOCK_CONST_METHOD0(CurrentTime, double());
+  MOCK_METHOD1(SetCurrentTime, void(double));
+  MOCK_CONST_METHOD0(Duration, double());
+  MOCK_METHOD1(SetDuration, void(double));
+  MOCK_CONST_METHOD0(PlaybackRate, double());
+  MOCK_METHOD1(SetPlaybackRate, void(double));
+  MOCK_METHOD1(AttachSource, bool(const std::string&));
+  MOCK_METHOD0(AttachMse, bool());
+  MOCK_METHOD3(AddMseBuffer,
+               bool(const std::string&, bool, const ElementaryStream*));
+  MOCK_METHOD1(LoadedMetaData, void(double));
+  MOCK_METHOD0(MseEndOfStream, void());
+  MOCK_METHOD2(SetEmeImplementation,
+               bool(const std::string&, eme::Implementation*));
+  MOCK_METHOD0(Detach, void());
+};
+
+/** The sample rate of the latency benchmark. */
+constexpr const size_t kBenchmarkRate = 8000;
+
+/**
+ * An audio device that plays samples in real time on its own thread.  Like
+ * real hardware, its clock can run at a slightly different rate than the
+ * system clock.  Each played sample holds its own index plus one, so this can
+ * tell which media time is being played; for each period played, this records
+ * how far that is from the player's time.
+ */
+class FakeAudioDevice {
+ public:
+  FakeAudioDevice(double clock_rate,
+                  std::function<size_t(uint8_t*, size_t)> read,
+                  std::function<double()> media_time)
+      : clock_rate_(clock_rate),
+        read_(std::move(read)),
+        media_time_(std::move(media_time)),
+        playing_(false),
+        shutdown_(false),
+        first_audio_time_(NAN),
+        thread_(&FakeAudioDevice::ThreadMain, this) {}
+
+  ~FakeAudioDevice() {
+    Stop();
+  }
+
+  void SetPlaying(bool playing) {
+    playing_ = playing;
+  }
+
+  void Stop() {
+    shutdown_ = true;
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  /** @return The media time when the first sample was played. */
+  double first_audio_time() const {
+    return first_audio_time_;
+  }
+
+  const std::vector<double>& offsets() const {
+    return offsets_;
+  }
+
+ private:
+  /** The number of samples played every period; 10ms. */
+  static constexpr const size_t kPeriod = kBenchmarkRate / 100;
+
+  void ThreadMain() {
+    using Clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(0.01 / clock_rate_));
+    int32_t samples[kPeriod];
+    auto next = Clock::now();
+    while (!shutdown_) {
+      next += period;
+      std::this_thread::sleep_until(next);
+      if (!playing_)
+        continue;
+
+      std::memset(samples, 0, sizeof(samples));
+      read_(reinterpret_cast<uint8_t*>(samples), sizeof(samples));
+      if (samples[0] == 0)
+        continue;
+      const double time = media_time_();
+      if (std::isnan(first_audio_time_))
+        first_audio_time_ = time;
+      offsets_.push_back(static_cast<double>(samples[0] - 1) / kBenchmarkRate -
+                         time);
+    }
+  }
+
+  const double clock_rate_;
+  const std::function<size_t(uint8_t*, size_t)> read_;
+  const std::function<double()> media_time_;
+  std::atomic<bool> playing_;
+  std::atomic<bool> shutdown_;
+  // Only used by the device thread until it is stopped.
+  double first_audio_time_;
+  std::vector<double> offsets_;
+  std::thread thread_;
+};
+
+/** Plays to a FakeAudioDevice by queueing samples, like SDL_QueueAudio. */
+class PushAudioRenderer : public AudioRendererCommon {
+ public:
+  PushAudioRenderer(double clock_rate, std::function<double()> media_time)
+      : device_(clock_rate,
+                [this](uint8_t* dest, size_t size) { return Read(dest, size); },
+                std::move(media_time)) {}
+  ~PushAudioRenderer() override {
+    Stop();
+    device_.Stop();
+  }
+
+  FakeAudioDevice* device() {
+    return &device_;
+  }
+
+ private:
+  size_t Read(uint8_t* dest, size_t size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size = std::min(size, queue_.size());
+    std::copy(queue_.begin(), queue_.begin() + size, dest);
+    queue_.erase(queue_.begin(), queue_.begin() + size);
+    return size;
+  }
+
+  bool InitDevice(std::shared_ptr<DecodedFrame>, double) override {
+    ClearBuffer();
+    return true;
+  }
+  bool AppendBuffer(const uint8_t* data, size_t size) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.insert(queue_.end(), data, data + size);
+    return true;
+  }
+  void ClearBuffer() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.clear();
+  }
+  size_t GetBytesBuffered() const override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+  void SetDeviceState(bool is_playing) override {
+    device_.SetPlaying(is_playing);
+  }
+  void UpdateVolume(double) override {}
+
+  mutable std::mutex mutex_;
+  std::deque<uint8_t> queue_;
+  FakeAudioDevice device_;
+};
+
+/** Plays to a FakeAudioDevice that pulls samples from the renderer. */
+class PullAudioRenderer : public AudioRendererCommon {
+ public:
+  PullAudioRenderer(double clock_rate, std::function<double()> media_time)
+      : AudioRendererCommon(DeviceMode::Pull),
+        device_(clock_rate,
+                [this](uint8_t* dest, size_t size) {
+                  return ReadSamples(dest, size);
+                },
+                std::move(media_time)) {}
+  ~PullAudioRenderer() override {
+    Stop();
+    device_.Stop();
+  }
+
+  FakeAudioDevice* device() {
+    return &device_;
+  }
+
+ private:
+  bool InitDevice(std::shared_ptr<DecodedFrame>, double) override {
+    return true;
+  }
+  void SetDeviceState(bool is_playing) override {
+    device_.SetPlaying(is_playing);
+  }
+  void UpdateVolume(double) override {}
+
+  FakeAudioDevice device_;
+};
+
+/**
+ * Plays a few seconds of audio on a fake device whose clock runs at the given
+ * rate, adding frames as they are "decoded".
+ */
+template <typename Renderer>
+void RunLatencyBenchmark(const char* name, double clock_rate) {
+  using Clock = std::chrono::steady_clock;
+  constexpr const double kDuration = 6;
+  constexpr const double kDecodeAhead = 0.2;
+  constexpr const size_t kFrameSamples = kBenchmarkRate / 50;
+
+  const auto start = Clock::now();
+  auto media_time = [start]() {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  NiceMock<MockMediaPlayer> player;
+  ON_CALL(player, PlaybackState())
+      .WillByDefault(Return(VideoPlaybackState::Playing));
+  ON_CALL(player, PlaybackRate()).WillByDefault(Return(1));
+  ON_CALL(player, CurrentTime()).WillByDefault(Invoke(media_time));
+
+  std::shared_ptr<StreamInfo> info(new StreamInfo(
+      "", "", false, {0, 0}, {0, 0}, {}, 0, 0, 1, kBenchmarkRate));
+  DecodedStream stream;
+  std::vector<std::unique_ptr<int32_t[]>> frame_data;
+  {
+    Renderer renderer(clock_rate, media_time);
+    renderer.SetPlayer(&player);
+    renderer.Attach(&stream);
+
+    // Add frames shortly before they are needed, like a decoder would.
+    for (size_t frame = 0; media_time() < kDuration;) {
+      for (; frame * kFrameSamples <
+             (media_time() + kDecodeAhead) * kBenchmarkRate;
+           frame++) {
+        frame_data.emplace_back(new int32_t[kFrameSamples]);
+        for (size_t i = 0; i < kFrameSamples; i++) {
+          frame_data.back()[i] =
+              static_cast<int32_t>(frame * kFrameSamples + i + 1);
+        }
+        const double pts = static_cast<double>(frame) / 50;
+        stream.AddFrame(std::make_shared<DecodedFrame>(
+            info, pts, pts, 0.02, SampleFormat::PackedS32, 0,
+            std::vector<const uint8_t*>{
+                reinterpret_cast<const uint8_t*>(frame_data.back().get())},
+            std::vector<size_t>{kFrameSamples * sizeof(int32_t)}));
+      }
+      util::Clock::Instance.SleepSeconds(0.01);
+    }
+    renderer.device()->Stop();
+
+    const std::vector<double>& offsets = renderer.device()->offsets();
+    double total = 0;
+    double max = 0;
+    for (double offset : offsets) {
+      total += offset;
+      max = std::max(max, std::abs(offset));
+    }
+    const double mean = offsets.empty() ? 0 : total / offsets.size();
+    double variance = 0;
+    for (double offset : offsets)
+      variance += (offset - mean) * (offset - mean);
+    if (!offsets.empty())
+      variance /= offsets.size();
+
+    printf("  %-5s startup %6.2f ms, offset %7.2f ms average, %7.2f ms max, "
+           "jitter %6.2f ms\n",
+           name, renderer.device()->first_audio_time() * 1000, mean * 1000,
+           max * 1000, std::sqrt(variance) * 1000);
+    renderer.Detach();
+  }
+}
+
+}  // namespace
+
+TEST(AudioRendererCommonBenchmark, AudioLatency) {
+  // Real audio hardware can drift from the system clock; exaggerate that so it
+  // shows up within a few seconds.
+  for (double clock_rate : {1.0, 1.04}) {
+    printf("Device clock at %.2fx:\n", clock_rate);
+    RunLatencyBenchmark<PushAudioRenderer>("push:", clock_rate);
+    RunLatencyBenchmark<PullAudioRenderer>("pull:", clock_rate);
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -17,11 +17,16 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <vector>
 
 #include "shaka/media/frames.h"
 #include "shaka/media/streams.h"
 #include "src/debug/thread_event.h"
+#include "src/media/audio_kernels.h"
 #include "src/util/clock.h"
 
 namespace shaka {
@@ -33,6 +38,7 @@ using testing::_;
 using testing::Args;
 using testing::AtLeast;
 using testing::InSequence;
+using testing::Invoke;
 using testing::InvokeWithoutArgs;
 using testing::MockFunction;
 using testing::NiceMock;
@@ -144,6 +150,67 @@ class TestAudioRenderer : public AudioRendererCommon {
   MOCK_METHOD1(UpdateVolume, void(double));
 };
 
+class TestPullAudioRenderer : public AudioRendererCommon {
+ public:
+  TestPullAudioRenderer() : AudioRendererCommon(DeviceMode::Pull) {}
+  ~TestPullAudioRenderer() override {
+    Stop();
+  }
+
+  // ReadSamples is normally protected; redefine it here to expose to tests.
+  size_t ReadSamples(uint8_t* dest, size_t size) {
+    return AudioRendererCommon::ReadSamples(dest, size);
+  }
+
+  MOCK_METHOD2(InitDevice, bool(std::shared_ptr<DecodedFrame>, double));
+  MOCK_METHOD1(SetDeviceState, void(bool));
+  MOCK_METHOD1(UpdateVolume, void(double));
+};
+
+/**
+ * Reads from the renderer like an audio device would until |size| bytes have
+ * been read or a second has passed.
+ */
+std::vector<uint8_t> ReadFromDevice(TestPullAudioRenderer* renderer,
+                                    size_t size) {
+  std::vector<uint8_t> ret(size);
+  size_t read = 0;
+  for (int i = 0; i < 1000 && read < size; i++) {
+    read += renderer->ReadSamples(ret.data() + read, size - read);
+    if (read < size)
+      util::Clock::Instance.SleepSeconds(0.001);
+  }
+  ret.resize(read);
+  return ret;
+}
+
+/**
+ * Interleaves the samples one at a time, like the renderer used to.  This is
+ * used to check the kernels.
+ */
+void InterleaveWithMemcpy(const uint8_t* const* planes, size_t channel_count,
+                          size_t sample_size, size_t sample_count,
+                          uint8_t* dest) {
+  for (size_t sample = 0; sample < sample_count; sample++) {
+    for (size_t channel = 0; channel < channel_count; channel++) {
+      std::memcpy(dest, planes[channel] + sample * sample_size, sample_size);
+      dest += sample_size;
+    }
+  }
+}
+
+/** Creates planes of |size| bytes each, filled with distinct values. */
+std::vector<std::vector<uint8_t>> MakePlanes(size_t channel_count,
+                                             size_t size) {
+  std::vector<std::vector<uint8_t>> ret(channel_count);
+  for (size_t channel = 0; channel < channel_count; channel++) {
+    ret[channel].resize(size);
+    for (size_t i = 0; i < size; i++)
+      ret[channel][i] = static_cast<uint8_t>(i * 7 + channel * 31 + 1);
+  }
+  return ret;
+}
+
 MATCHER_P(MatchesData, data, "") {
   using std::get;
   *result_listener << "where the data is: "
@@ -472,5 +539,156 @@ TEST_F(AudioRendererCommonTest, HandlesSeeks) {
   WAIT_WITH_TIMEOUT(on_done);
 }
 
+TEST_F(AudioRendererCommonTest, StretchesAudioAtOtherRates) {
+  // Use a realistic sample rate so the stretcher has enough samples to match.
+  constexpr const size_t kRate = 8000;
+  constexpr const size_t kFrameSamples = kRate / 10;
+  static const float kSilence[kFrameSamples] = {0};
+  std::shared_ptr<StreamInfo> info(
+      new StreamInfo("", "", false, {0, 0}, {0, 0}, {}, 0, 0, 1, kRate));
+  for (size_t i = 0; i < 10; i++) {
+    const double pts = i * 0.1;
+    stream.AddFrame(std::make_shared<DecodedFrame>(
+        info, pts, pts, 0.1, SampleFormat::PackedFloat, 0,
+        std::vector<const uint8_t*>{
+            reinterpret_cast<const uint8_t*>(kSilence)},
+        std::vector<size_t>{sizeof(kSilence)}));
+  }
+  ON_CALL(player, PlaybackRate()).WillByDefault(Return(2));
+
+  // One second of media at 2x should play for half a second.
+  constexpr const size_t kExpected = kRate / 2 * sizeof(float);
+  std::atomic<size_t> total{0};
+  ThreadEvent<void> did_append("");
+  ON_CALL(renderer, AppendBuffer(_, _))
+      .WillByDefault(Invoke([&](const uint8_t*, size_t size) {
+        // Some samples are held back to match with later frames.
+        if ((total += size) >= kExpected * 9 / 10)
+          did_append.SignalAllIfNotSet();
+        return true;
+      }));
+
+  renderer.Attach(&stream);
+  WAIT_WITH_TIMEOUT(did_append);
+  util::Clock::Instance.SleepSeconds(0.01);
+  EXPECT_LE(total, kExpected);
+}
+
+TEST(AudioRendererCommonPullTest, DevicePullsSamples) {
+  // Use a high enough sample rate that this doesn't buffer enough to wait.
+  constexpr const size_t kRate = 1000;
+  std::shared_ptr<StreamInfo> info(
+      new StreamInfo("", "", false, {0, 0}, {0, 0}, {}, 0, 0, 1, kRate));
+  DecodedStream stream;
+  stream.AddFrame(MakeFrame(info, 0, kData1));
+  stream.AddFrame(MakeFrame(info, 0.004, kData2));
+
+  NiceMock<MockMediaPlayer> player;
+  ON_CALL(player, PlaybackState())
+      .WillByDefault(Return(VideoPlaybackState::Playing));
+  ON_CALL(player, CurrentTime()).WillByDefault(Return(0));
+  ON_CALL(player, PlaybackRate()).WillByDefault(Return(1));
+
+  NiceMock<TestPullAudioRenderer> renderer;
+  ThreadEvent<void> did_start("");
+  ON_CALL(renderer, InitDevice(_, _)).WillByDefault(Return(true));
+  EXPECT_CALL(renderer, SetDeviceState(_)).Times(AtLeast(1));
+  EXPECT_CALL(renderer, SetDeviceState(true))
+      .WillOnce(InvokeWithoutArgs([&]() { did_start.SignalAll(); }))
+      .WillRepeatedly(Return());
+
+  renderer.SetPlayer(&player);
+  renderer.Attach(&stream);
+  WAIT_WITH_TIMEOUT(did_start);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 3, 4, 5, 6, 7, 8}),
+            ReadFromDevice(&renderer, 8));
+
+  // Frames added later should be played without polling.
+  stream.AddFrame(MakeFrame(info, 0.008, kData3));
+  EXPECT_EQ(std::vector<uint8_t>({9, 10}), ReadFromDevice(&renderer, 2));
+
+  renderer.Detach();
+}
+
+TEST(AudioKernelsTest, InterleavesSamples) {
+  // Use an odd sample count and offset so the SIMD loops have a remainder and
+  // unaligned input.
+  constexpr const size_t kSampleCount = 37;
+  constexpr const size_t kFirstSample = 3;
+  const struct {
+    SampleFormat format;
+    size_t sample_size;
+  } kFormats[] = {
+      {SampleFormat::PlanarU8, 1},    {SampleFormat::PlanarS16, 2},
+      {SampleFormat::PlanarS32, 4},   {SampleFormat::PlanarFloat, 4},
+      {SampleFormat::PlanarDouble, 8},
+  };
+  for (const auto& info : kFormats) {
+    const SampleFormat format = info.format;
+    const size_t sample_size = info.sample_size;
+    for (size_t channels : {1, 2, 3, 4, 5, 6, 7, 8, 10}) {
+      auto planes =
+          MakePlanes(channels, (kSampleCount + kFirstSample) * sample_size);
+      std::vector<const uint8_t*> plane_ptrs;
+      std::vector<const uint8_t*> offset_ptrs;
+      for (auto& plane : planes) {
+        plane_ptrs.push_back(plane.data());
+        offset_ptrs.push_back(plane.data() + kFirstSample * sample_size);
+      }
+
+      std::vector<uint8_t> expected(kSampleCount * sample_size * channels);
+      InterleaveWithMemcpy(offset_ptrs.data(), channels, sample_size,
+                           kSampleCount, expected.data());
+      std::vector<uint8_t> actual(expected.size());
+      InterleaveSamples(format, plane_ptrs.data(), channels, kFirstSample,
+                        kSampleCount, actual.data());
+      EXPECT_EQ(expected, actual) << format << ", " << channels << " channels";
+    }
+  }
+}
+
+TEST(AudioKernelsTest, AppliesGain) {
+  // Use enough samples for the SIMD loops plus a remainder.
+  const int16_t s16[] = {0,    1,     -1,    100,   -100, 32767,
+                         -32768, 1000, -1000, 12345, 7,    -7};
+  const int32_t s32[] = {0, 1, -1, 2147483647, -2147483647 - 1, 65536, -65536};
+  const float flt[] = {0, 1, -1, 0.5f, -0.25f, 0.125f, 1e-3f};
+  constexpr const double kGain = 0.5;
+
+  std::vector<int16_t> s16_out(std::begin(s16), std::end(s16));
+  ASSERT_TRUE(ApplyGain(SampleFormat::PackedS16, kGain,
+                        reinterpret_cast<uint8_t*>(s16_out.data()),
+                        sizeof(s16)));
+  for (size_t i = 0; i < s16_out.size(); i++)
+    EXPECT_EQ(s16[i] >> 1, s16_out[i]) << i;
+
+  std::vector<int32_t> s32_out(std::begin(s32), std::end(s32));
+  ASSERT_TRUE(ApplyGain(SampleFormat::PlanarS32, kGain,
+                        reinterpret_cast<uint8_t*>(s32_out.data()),
+                        sizeof(s32)));
+  for (size_t i = 0; i < s32_out.size(); i++)
+    EXPECT_EQ(s32[i] >> 1, s32_out[i]) << i;
+
+  std::vector<float> flt_out(std::begin(flt), std::end(flt));
+  ASSERT_TRUE(ApplyGain(SampleFormat::PackedFloat, kGain,
+                        reinterpret_cast<uint8_t*>(flt_out.data()),
+                        sizeof(flt)));
+  for (size_t i = 0; i < flt_out.size(); i++)
+    EXPECT_EQ(flt[i] * 0.5f, flt_out[i]) << i;
+
+  // Full volume is a no-op and muting clears the samples.
+  ASSERT_TRUE(ApplyGain(SampleFormat::PackedFloat, 1,
+                        reinterpret_cast<uint8_t*>(flt_out.data()),
+                        sizeof(flt)));
+  EXPECT_EQ(flt[3] * 0.5f, flt_out[3]);
+  ASSERT_TRUE(ApplyGain(SampleFormat::PackedFloat, 0,
+                        reinterpret_cast<uint8_t*>(flt_out.data()),
+                        sizeof(flt)));
+  EXPECT_EQ(std::vector<float>(flt_out.size(), 0), flt_out);
+
+  uint8_t u8[] = {1, 2, 3};
+  EXPECT_FALSE(ApplyGain(SampleFormat::PackedU8, kGain, u8, sizeof(u8)));
+}
+
 }  // namespace media
 }  // namespace shaka
@@ -0,0 +1,193 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_ring_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+std::vector<uint8_t> MakeData(size_t size, uint8_t first) {
+  std::vector<uint8_t> ret(size);
+  for (size_t i = 0; i < size; i++)
+    ret[i] = static_cast<uint8_t>(first + i);
+  return ret;
+}
+
+}  // namespace
+
+TEST(AudioRingBufferTest, RoundsCapacityUp) {
+  AudioRingBuffer buffer;
+  buffer.Reset(100);
+  EXPECT_EQ(128u, buffer.capacity());
+  buffer.Reset(64);
+  EXPECT_EQ(64u, buffer.capacity());
+}
+
+TEST(AudioRingBufferTest, ReadsAndWrites) {
+  AudioRingBuffer buffer;
+  buffer.Reset(16);
+  const auto data = MakeData(10, 1);
+  ASSERT_TRUE(buffer.Write(data.data(), data.size()));
+  EXPECT_EQ(10u, buffer.ReadableBytes());
+
+  std::vector<uint8_t> out(6);
+  ASSERT_EQ(6u, buffer.Read(out.data(), out.size()));
+  EXPECT_EQ(MakeData(6, 1), out);
+  EXPECT_EQ(4u, buffer.ReadableBytes());
+
+  // Reads stop at the data that was written.
+  out.assign(10, 0);
+  ASSERT_EQ(4u, buffer.Read(out.data(), out.size()));
+  EXPECT_EQ(MakeData(4, 7), std::vector<uint8_t>(out.begin(), out.begin() + 4));
+  EXPECT_EQ(0u, buffer.ReadableBytes());
+  EXPECT_EQ(10u, buffer.read_position());
+  EXPECT_EQ(10u, buffer.write_position());
+}
+
+TEST(AudioRingBufferTest, WrapsAround) {
+  AudioRingBuffer buffer;
+  buffer.Reset(16);
+  std::vector<uint8_t> out(12);
+  for (uint8_t i = 0; i < 10; i++) {
+    const auto data = MakeData(12, i * 20);
+    ASSERT_TRUE(buffer.Write(data.data(), data.size()));
+    ASSERT_EQ(12u, buffer.Read(out.data(), out.size()));
+    EXPECT_EQ(data, out);
+  }
+  EXPECT_EQ(120u, buffer.read_position());
+}
+
+TEST(AudioRingBufferTest, WontOverwriteUnreadData) {
+  AudioRingBuffer buffer;
+  buffer.Reset(16);
+  const auto data = MakeData(12, 1);
+  ASSERT_TRUE(buffer.Write(data.data(), data.size()));
+  // Writes are all-or-nothing so samples aren't split.
+  EXPECT_FALSE(buffer.Write(data.data(), 8));
+  EXPECT_EQ(12u, buffer.ReadableBytes());
+  EXPECT_TRUE(buffer.Write(data.data(), 4));
+  EXPECT_EQ(16u, buffer.ReadableBytes());
+}
+
+TEST(AudioRingBufferTest, ClearSkipsUnreadData) {
+  AudioRingBuffer buffer;
+  buffer.Reset(16);
+  const auto old_data = MakeData(8, 1);
+  ASSERT_TRUE(buffer.Write(old_data.data(), old_data.size()));
+  buffer.Clear();
+  EXPECT_EQ(0u, buffer.ReadableBytes());
+  EXPECT_EQ(8u, buffer.read_position());
+
+  // The consumer may still be reading the cleared data, so that space isn't
+  // available until it reads again.
+  const auto new_data = MakeData(8, 100);
+  ASSERT_TRUE(buffer.Write(new_data.data(), new_data.size()));
+  EXPECT_FALSE(buffer.Write(new_data.data(), 1));
+
+  std::vector<uint8_t> out(16);
+  ASSERT_EQ(8u, buffer.Read(out.data(), out.size()));
+  EXPECT_EQ(new_data, std::vector<uint8_t>(out.begin(), out.begin() + 8));
+  EXPECT_EQ(16u, buffer.read_position());
+}
+
+TEST(AudioRingBufferTest, SupportsConcurrentProducerAndConsumer) {
+  constexpr const size_t kTotal = 1 << 20;
+  constexpr const size_t kChunk = 48;
+  AudioRingBuffer buffer;
+  buffer.Reset(1024);
+
+  std::thread producer([&]() {
+    uint8_t chunk[kChunk];
+    size_t written = 0;
+    while (written < kTotal) {
+      for (size_t i = 0; i < kChunk; i++)
+        chunk[i] = static_cast<uint8_t>((written + i) * 13);
+      if (buffer.Write(chunk, kChunk))
+        written += kChunk;
+      else
+        std::this_thread::yield();
+    }
+  });
+
+  uint8_t out[100];
+  size_t read = 0;
+  bool matches = true;
+  while (read < kTotal) {
+    const size_t count = buffer.Read(out, sizeof(out));
+    for (size_t i = 0; i < count; i++)
+      matches &= out[i] == static_cast<uint8_t>((read + i) * 13);
+    read += count;
+    if (count == 0)
+      std::this_thread::yield();
+  }
+  producer.join();
+  EXPECT_TRUE(matches);
+}
+
+TEST(AudioRingBufferTest, SupportsConcurrentClears) {
+  // Each chunk holds its index, so the consumer can tell if it reads stale
+  // data; every position is a multiple of the chunk size, so each read is
+  // one whole chunk.
+  constexpr const size_t kChunk = 16;
+  constexpr const uint64_t kChunkCount = 200000;
+  AudioRingBuffer buffer;
+  buffer.Reset(4 * kChunk);
+
+  std::atomic<bool> done{false};
+  std::thread producer([&]() {
+    uint8_t chunk[kChunk] = {0};
+    for (uint64_t index = 1; index <= kChunkCount; index++) {
+      std::memcpy(chunk, &index, sizeof(index));
+      while (!buffer.Write(chunk, kChunk))
+        std::this_thread::yield();
+      if (index % 2 == 0)
+        buffer.Clear();
+    }
+    done = true;
+  });
+
+  uint8_t out[kChunk];
+  uint64_t last_index = 0;
+  bool in_order = true;
+  bool positions_valid = true;
+  while (!done || buffer.ReadableBytes() > 0) {
+    const size_t count = buffer.Read(out, sizeof(out));
+    positions_valid &= buffer.read_position() <= buffer.write_position();
+    positions_valid &= buffer.ReadableBytes() <= buffer.capacity();
+    if (count == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    positions_valid &= count == kChunk;
+    uint64_t index;
+    std::memcpy(&index, out, sizeof(index));
+    in_order &= index > last_index;
+    last_index = index;
+  }
+  producer.join();
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(positions_valid);
+}
+
+}  // namespace media
+}  // namespace shaka
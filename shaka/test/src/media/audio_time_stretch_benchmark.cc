@@ -0,0 +1,96 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_time_stretch.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+constexpr const size_t kSampleRate = 48000;
+constexpr const double kPi = 3.14159265358979323846;
+
+std::vector<int16_t> ToS16(const std::vector<float>& samples) {
+  std::vector<int16_t> ret(samples.size());
+  for (size_t i = 0; i < samples.size(); i++)
+    ret[i] = static_cast<int16_t>(std::lround(samples[i] * 32768));
+  return ret;
+}
+
+}  // namespace
+
+TEST(AudioTimeStretchBenchmark, TimeStretch) {
+  // Stereo music-like content: a few tones plus some noise.
+  constexpr const size_t kChannels = 2;
+  constexpr const size_t kSeconds = 20;
+  constexpr const size_t kSamples = kSampleRate * kSeconds;
+  std::vector<float> input(kSamples * kChannels);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < kSamples; i++) {
+    seed = seed * 1103515245 + 12345;
+    const double noise = static_cast<double>(seed >> 16) / 65536 - 0.5;
+    const double value = 0.3 * std::sin(2 * kPi * 220 * i / kSampleRate) +
+                         0.2 * std::sin(2 * kPi * 330 * i / kSampleRate) +
+                         0.05 * noise;
+    input[i * kChannels] = static_cast<float>(value);
+    input[i * kChannels + 1] = static_cast<float>(value * 0.8);
+  }
+  const auto input_s16 = ToS16(input);
+
+  for (SampleFormat format :
+       {SampleFormat::PackedS16, SampleFormat::PackedFloat}) {
+    const bool is_float = format == SampleFormat::PackedFloat;
+    const auto* data =
+        is_float ? reinterpret_cast<const uint8_t*>(input.data())
+                 : reinterpret_cast<const uint8_t*>(input_s16.data());
+    const size_t size = kSamples * kChannels * (is_float ? 4 : 2);
+    // About 20ms of audio per frame, like a typical decoder.
+    const size_t chunk_size = 1024 * kChannels * (is_float ? 4 : 2);
+
+    for (double rate : {1.25, 1.5, 2.0}) {
+      AudioTimeStretcher stretcher;
+      stretcher.Reset(format, kChannels, kSampleRate, rate);
+      const auto start = std::chrono::steady_clock::now();
+      size_t offset = 0;
+      size_t total = 0;
+      while (offset < size) {
+        size_t consumed;
+        total += stretcher.Process(
+            data + offset, std::min(chunk_size, size - offset), &consumed);
+        offset += consumed;
+      }
+      const double elapsed = std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+      // Report the cost per second of media; at faster rates, a second of
+      // playback needs |rate| seconds of media.
+      printf("%-12s %.2fx: %.3f ms per second of audio, %.3f ms per second "
+             "played (%zu bytes out)\n",
+             (testing::PrintToString(format) + ":").c_str(), rate,
+             elapsed / kSeconds, elapsed / kSeconds * rate, total);
+    }
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,151 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/audio_time_stretch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+constexpr const size_t kSampleRate = 48000;
+constexpr const double kPi = 3.14159265358979323846;
+
+/** Creates interleaved float samples of a sine wave in every channel. */
+std::vector<float> MakeSine(double frequency, size_t channel_count,
+                            size_t sample_count) {
+  std::vector<float> ret(sample_count * channel_count);
+  for (size_t i = 0; i < sample_count; i++) {
+    const float value = static_cast<float>(
+        0.5 * std::sin(2 * kPi * frequency * i / kSampleRate));
+    for (size_t channel = 0; channel < channel_count; channel++)
+      ret[i * channel_count + channel] = value;
+  }
+  return ret;
+}
+
+std::vector<int16_t> ToS16(const std::vector<float>& samples) {
+  std::vector<int16_t> ret(samples.size());
+  for (size_t i = 0; i < samples.size(); i++)
+    ret[i] = static_cast<int16_t>(std::lround(samples[i] * 32768));
+  return ret;
+}
+
+/**
+ * Stretches all the given samples, passing them in chunks like a decoder's
+ * frames.
+ */
+std::vector<uint8_t> Stretch(AudioTimeStretcher* stretcher,
+                             const uint8_t* data, size_t size,
+                             size_t chunk_size) {
+  std::vector<uint8_t> ret;
+  while (size > 0) {
+    const size_t to_process = std::min(size, chunk_size);
+    size_t offset = 0;
+    while (offset < to_process) {
+      size_t consumed;
+      const size_t produced = stretcher->Process(
+          data + offset, to_process - offset, &consumed);
+      ret.insert(ret.end(), stretcher->output(),
+                 stretcher->output() + produced);
+      offset += consumed;
+    }
+    data += to_process;
+    size -= to_process;
+  }
+  return ret;
+}
+
+/** Estimates the frequency of a mono signal by counting zero crossings. */
+double EstimateFrequency(const float* samples, size_t count) {
+  size_t crossings = 0;
+  for (size_t i = 1; i < count; i++) {
+    if (samples[i - 1] < 0 && samples[i] >= 0)
+      crossings++;
+  }
+  return static_cast<double>(crossings) * kSampleRate / count;
+}
+
+}  // namespace
+
+TEST(AudioTimeStretchTest, ChangesDuration) {
+  constexpr const size_t kChannels = 2;
+  constexpr const size_t kSamples = kSampleRate * 2;
+  const auto input = MakeSine(440, kChannels, kSamples);
+  for (double rate : {0.5, 0.75, 1.25, 1.5, 2.0, 3.0, 4.0}) {
+    AudioTimeStretcher stretcher;
+    stretcher.Reset(SampleFormat::PackedFloat, kChannels, kSampleRate, rate);
+    const auto output =
+        Stretch(&stretcher, reinterpret_cast<const uint8_t*>(input.data()),
+                input.size() * sizeof(float), 1024 * kChannels * sizeof(float));
+    const double output_samples =
+        static_cast<double>(output.size()) / (kChannels * sizeof(float));
+    // Some input is held back to match the next segment, so allow up to 50ms.
+    EXPECT_NEAR(kSamples / rate, output_samples, kSampleRate * 0.05) << rate;
+    EXPECT_LE(output_samples, kSamples / rate) << rate;
+  }
+}
+
+TEST(AudioTimeStretchTest, KeepsPitch) {
+  constexpr const double kFrequency = 440;
+  const auto input = MakeSine(kFrequency, 1, kSampleRate * 2);
+  for (double rate : {0.75, 1.5, 2.0}) {
+    AudioTimeStretcher stretcher;
+    stretcher.Reset(SampleFormat::PackedFloat, 1, kSampleRate, rate);
+    const auto output =
+        Stretch(&stretcher, reinterpret_cast<const uint8_t*>(input.data()),
+                input.size() * sizeof(float), 4096);
+    const auto* samples = reinterpret_cast<const float*>(output.data());
+    const size_t count = output.size() / sizeof(float);
+    ASSERT_GT(count, kSampleRate / 2u);
+    // Resampling would change the frequency by |rate|.
+    EXPECT_NEAR(kFrequency, EstimateFrequency(samples, count), 5) << rate;
+  }
+}
+
+TEST(AudioTimeStretchTest, SupportsS16) {
+  constexpr const double kFrequency = 300;
+  constexpr const size_t kChannels = 2;
+  constexpr const size_t kSamples = kSampleRate * 2;
+  constexpr const double kRate = 1.5;
+  const auto input = ToS16(MakeSine(kFrequency, kChannels, kSamples));
+
+  AudioTimeStretcher stretcher;
+  stretcher.Reset(SampleFormat::PlanarS16, kChannels, kSampleRate, kRate);
+  const auto output =
+      Stretch(&stretcher, reinterpret_cast<const uint8_t*>(input.data()),
+              input.size() * sizeof(int16_t), 2000);
+  const size_t count = output.size() / (kChannels * sizeof(int16_t));
+  EXPECT_NEAR(kSamples / kRate, count, kSampleRate * 0.05);
+
+  // Check the first channel keeps the pitch and volume.
+  const auto* samples = reinterpret_cast<const int16_t*>(output.data());
+  std::vector<float> channel(count);
+  float peak = 0;
+  for (size_t i = 0; i < count; i++) {
+    channel[i] = samples[i * kChannels] / 32768.0f;
+    peak = std::max(peak, std::abs(channel[i]));
+  }
+  EXPECT_NEAR(kFrequency, EstimateFrequency(channel.data(), count), 5);
+  EXPECT_NEAR(0.5, peak, 0.02);
+}
+
+}  // namespace media
+}  // namespace shaka
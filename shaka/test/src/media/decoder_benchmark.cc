@@ -0,0 +1,231 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shaka/media/decoder.h"
+
+#include <gtest/gtest.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shaka/media/demuxer.h"
+#include "shaka/media/frames.h"
+#ifdef HAS_FFMPEG_DECODER
+#  include "src/media/ffmpeg/ffmpeg_frame_pool.h"
+#endif
+#include "src/media/media_executor.h"
+#include "src/test/media_files.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+constexpr const char* kMp4LowInit = "clear_low_frag_init.mp4";
+constexpr const char* kMp4LowSeg = "clear_low_frag_seg1.mp4";
+// This isn't fragmented, so it doesn't need an explicit init segment.
+constexpr const char* kMp4High = "clear_high.mp4";
+
+class NullClient : public Demuxer::Client {
+ public:
+  void OnLoadedMetaData(double duration) override {}
+  void OnEncrypted(eme::MediaKeyInitDataType type, const uint8_t* data,
+                   size_t size) override {}
+};
+
+void DemuxFiles(const std::vector<std::string>& paths,
+                std::vector<std::shared_ptr<EncodedFrame>>* frames) {
+  NullClient client;
+  auto* factory = DemuxerFactory::GetFactory();
+  ASSERT_TRUE(factory);
+  auto demuxer = factory->Create("video/mp4", &client);
+  ASSERT_TRUE(demuxer);
+
+  for (const auto& path : paths) {
+    std::vector<uint8_t> data = GetMediaFile(path);
+    ASSERT_TRUE(demuxer->Demux(0, data.data(), data.size(), frames));
+  }
+}
+
+/**
+ * Decodes the given frames, only keeping the most recent |frames_to_keep|
+ * decoded frames alive.  This is similar to how DecoderThread evicts frames
+ * once they have been played.
+ */
+void DecodeAndEvict(const std::vector<std::shared_ptr<EncodedFrame>>& frames,
+                    Decoder* decoder, size_t frames_to_keep) {
+  std::deque<std::shared_ptr<DecodedFrame>> kept;
+  for (size_t i = 0; i <= frames.size(); i++) {
+    auto frame = i < frames.size() ? frames[i] : nullptr;
+    std::string error;
+    std::vector<std::shared_ptr<DecodedFrame>> decoded_frames;
+    ASSERT_EQ(decoder->Decode(frame, nullptr, &decoded_frames, &error),
+              MediaStatus::Success)
+        << error;
+
+    kept.insert(kept.end(), decoded_frames.begin(), decoded_frames.end());
+    while (kept.size() > frames_to_keep)
+      kept.pop_front();
+  }
+}
+
+}  // namespace
+
+TEST(DecoderBenchmark, SeekLatency) {
+  constexpr const size_t kIterations = 50;
+
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4LowInit, kMp4LowSeg}, &frames));
+  std::vector<size_t> key_frames;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i]->is_key_frame)
+      key_frames.push_back(i);
+  }
+  ASSERT_FALSE(key_frames.empty());
+
+  for (bool reuse : {false, true}) {
+    auto decoder = Decoder::CreateDefaultDecoder();
+    double total = 0, max = 0;
+    for (size_t i = 0; i < kIterations; i++) {
+      // Seek to a keyframe and measure the time until the first frame is
+      // decoded.
+      const auto start = std::chrono::steady_clock::now();
+      if (reuse)
+        decoder->ResetDecoder();
+      else
+        decoder = Decoder::CreateDefaultDecoder();
+      std::vector<std::shared_ptr<DecodedFrame>> decoded_frames;
+      for (size_t j = key_frames[i % key_frames.size()];
+           decoded_frames.empty(); j++) {
+        std::string error;
+        auto frame = j < frames.size() ? frames[j] : nullptr;
+        ASSERT_EQ(decoder->Decode(frame, nullptr, &decoded_frames, &error),
+                  MediaStatus::Success)
+            << error;
+        ASSERT_TRUE(frame || !decoded_frames.empty());
+      }
+      const double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      total += ms;
+      max = std::max(max, ms);
+    }
+
+    printf("%-12s seek-to-first-frame avg %.3f ms, max %.3f ms\n",
+           reuse ? "reset:" : "new decoder:", total / kIterations, max);
+  }
+}
+
+TEST(DecoderBenchmark, ThreadingPolicy) {
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4High}, &frames));
+
+  struct Config {
+    const char* name;
+    bool frame_threading;
+    bool slice_threading;
+  };
+  const MediaThreadingPolicy old_policy =
+      MediaExecutor::GlobalThreadingPolicy();
+  for (size_t decoder_count : {1, 4}) {
+    printf("%zu decoders, %u cores:\n", decoder_count,
+           std::thread::hardware_concurrency());
+    for (const Config& config : {Config{"none:", false, false},
+                                 Config{"slice:", false, true},
+                                 Config{"frame:", true, false},
+                                 Config{"frame+slice:", true, true}}) {
+      MediaThreadingPolicy policy = old_policy;
+      policy.frame_threading = config.frame_threading;
+      policy.slice_threading = config.slice_threading;
+      MediaExecutor::SetGlobalThreadingPolicy(policy);
+
+      // Decode the same content on each decoder in parallel, like multiple
+      // players would.
+      std::atomic<size_t> decoded_count{0};
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < decoder_count; i++) {
+        threads.emplace_back([&]() {
+          auto decoder = Decoder::CreateDefaultDecoder();
+          for (size_t j = 0; j <= frames.size(); j++) {
+            auto frame = j < frames.size() ? frames[j] : nullptr;
+            std::string error;
+            std::vector<std::shared_ptr<DecodedFrame>> decoded_frames;
+            EXPECT_EQ(decoder->Decode(frame, nullptr, &decoded_frames, &error),
+                      MediaStatus::Success)
+                << error;
+            decoded_count += decoded_frames.size();
+          }
+        });
+      }
+      for (auto& thread : threads)
+        thread.join();
+      const double seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+      printf("  %-12s %7.1f frames/s\n", config.name,
+             decoded_count / seconds);
+    }
+  }
+  MediaExecutor::SetGlobalThreadingPolicy(old_policy);
+}
+
+#ifdef HAS_FFMPEG_DECODER
+TEST(DecoderBenchmark, FramePool) {
+  constexpr const size_t kIterations = 20;
+  // About one second of video, like the decoded buffer in DecoderThread.
+  constexpr const size_t kFramesToKeep = 24;
+
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4LowInit, kMp4LowSeg}, &frames));
+
+  auto* pool = ffmpeg::FFmpegFramePool::Instance();
+  for (bool use_pool : {false, true}) {
+    pool->Clear();
+    pool->SetMaxPooledBytes(
+        use_pool ? ffmpeg::FFmpegFramePool::kDefaultMaxPooledBytes : 0);
+    pool->ResetStats();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kIterations; i++) {
+      // Create a new decoder each time, like after a seek.
+      auto decoder = Decoder::CreateDefaultDecoder();
+      ASSERT_NO_FATAL_FAILURE(
+          DecodeAndEvict(frames, decoder.get(), kFramesToKeep));
+    }
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+    const auto stats = pool->GetStats();
+    printf("%-8s %.3f ms per frame, %" PRIu64 " buffers allocated for %" PRIu64
+           " frames (%.1f%% reused), peak %.1f MB\n",
+           use_pool ? "pool:" : "no pool:", ms / (kIterations * frames.size()),
+           stats.allocations, stats.requests, stats.hit_rate() * 100,
+           stats.peak_bytes / 1e6);
+  }
+  pool->SetMaxPooledBytes(ffmpeg::FFmpegFramePool::kDefaultMaxPooledBytes);
+}
+#endif
+
+}  // namespace media
+}  // namespace shaka
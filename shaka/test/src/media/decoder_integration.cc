@@ -19,10 +19,15 @@ extern "C" {
 #include <libavutil/imgutils.h>
 }
 
+#include <deque>
+
 #include "shaka/media/decoder.h"
 #include "shaka/media/demuxer.h"
 #include "shaka/media/frames.h"
 #include "src/eme/clearkey_implementation.h"
+#ifdef HAS_FFMPEG_DECODER
+#  include "src/media/ffmpeg/ffmpeg_frame_pool.h"
+#endif
 #include "src/media/media_utils.h"
 #include "src/test/frame_converter.h"
 #include "src/test/media_files.h"
@@ -119,6 +124,28 @@ void DecodeFramesAndCheckHashes(
   EXPECT_EQ(results, expected_str);
 }
 
+/**
+ * Decodes the given frames, only keeping the most recent |frames_to_keep|
+ * decoded frames alive.  This is similar to how DecoderThread evicts frames
+ * once they have been played.
+ */
+void DecodeAndEvict(const std::vector<std::shared_ptr<EncodedFrame>>& frames,
+                    Decoder* decoder, size_t frames_to_keep) {
+  std::deque<std::shared_ptr<DecodedFrame>> kept;
+  for (size_t i = 0; i <= frames.size(); i++) {
+    auto frame = i < frames.size() ? frames[i] : nullptr;
+    std::string error;
+    std::vector<std::shared_ptr<DecodedFrame>> decoded_frames;
+    ASSERT_EQ(decoder->Decode(frame, nullptr, &decoded_frames, &error),
+              MediaStatus::Success)
+        << error;
+
+    kept.insert(kept.end(), decoded_frames.begin(), decoded_frames.end());
+    while (kept.size() > frames_to_keep)
+      kept.pop_front();
+  }
+}
+
 }  // namespace
 
 class DecoderIntegration : public testing::Test {
@@ -176,6 +203,70 @@ TEST_F(DecoderIntegration, CanDecodeWithAdaptation) {
   EXPECT_TRUE(saw_second_stream);
 }
 
+TEST_F(DecoderIntegration, CanDecodeAfterReset) {
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4LowInit, kMp4LowSeg}, &frames));
+
+  // The decoder should be reusable after being flushed and reset, like after a
+  // seek.
+  auto decoder = Decoder::CreateDefaultDecoder();
+  DecodeFramesAndCheckHashes(kHashFile, frames, decoder.get(), nullptr);
+  decoder->ResetDecoder();
+  DecodeFramesAndCheckHashes(kHashFile, frames, decoder.get(), nullptr);
+}
+
+TEST_F(DecoderIntegration, MapsHardwareFrames) {
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4LowInit, kMp4LowSeg}, &frames));
+
+  // With a hardware accelerator (e.g. VAAPI), the frames stay on the GPU until
+  // mapped; software frames can't be mapped.
+  auto decoder = Decoder::CreateDefaultDecoder();
+  for (size_t i = 0; i <= frames.size(); i++) {
+    auto frame = i < frames.size() ? frames[i] : nullptr;
+    std::string error;
+    std::vector<std::shared_ptr<DecodedFrame>> decoded_frames;
+    ASSERT_EQ(decoder->Decode(frame, nullptr, &decoded_frames, &error),
+              MediaStatus::Success)
+        << error;
+
+    for (auto& decoded : decoded_frames) {
+      auto mapped = decoded->MapHardwareFrame();
+      if (get<PixelFormat>(decoded->format) != PixelFormat::HardwareFrame) {
+        EXPECT_FALSE(mapped);
+        continue;
+      }
+
+      ASSERT_TRUE(mapped);
+      EXPECT_NE(get<PixelFormat>(mapped->format), PixelFormat::HardwareFrame);
+      EXPECT_EQ(mapped->pts, decoded->pts);
+      EXPECT_EQ(mapped->stream_info, decoded->stream_info);
+      EXPECT_EQ(mapped->data.size(), mapped->linesize.size());
+    }
+  }
+}
+
+#ifdef HAS_FFMPEG_DECODER
+TEST_F(DecoderIntegration, ReusesFrameBuffers) {
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  ASSERT_NO_FATAL_FAILURE(DemuxFiles({kMp4LowInit, kMp4LowSeg}, &frames));
+
+  auto* pool = ffmpeg::FFmpegFramePool::Instance();
+  pool->ResetStats();
+  {
+    auto decoder = Decoder::CreateDefaultDecoder();
+    ASSERT_NO_FATAL_FAILURE(DecodeAndEvict(frames, decoder.get(), 5));
+  }
+
+  const auto stats = pool->GetStats();
+  ASSERT_GT(stats.requests, 0u);
+  // Only the frames kept alive and the decoder's reference frames should need
+  // their own buffers; the rest should be reused.
+  EXPECT_LT(stats.allocations, stats.requests / 2);
+  // Everything should be returned once the frames and decoder are destroyed.
+  EXPECT_EQ(stats.in_use_bytes, 0u);
+}
+#endif
 
 class DecoderDecryptIntegration : public testing::TestWithParam<std::string> {
  protected:
@@ -0,0 +1,186 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/decoder_thread.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "shaka/media/streams.h"
+#include "src/eme/key_status_notifier.h"
+#include "src/test/decoder_thread_fakes.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+namespace media {
+
+TEST(DecoderThreadBenchmark, Latency) {
+  constexpr const size_t kIterations = 50;
+
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  FrameWaiter waiter(&output);
+  AddFrames(&input, 0, kIterations * 2 + 2);
+
+  int dummy;
+  auto* cdm = reinterpret_cast<eme::Implementation*>(&dummy);
+
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetCdm(cdm);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+
+  using Clock = std::chrono::steady_clock;
+  auto to_ms = [](Clock::duration delta) {
+    return std::chrono::duration<double, std::milli>(delta).count();
+  };
+  double seek_total = 0, seek_max = 0;
+  double license_total = 0, license_max = 0;
+  for (size_t i = 0; i < kIterations; i++) {
+    // Seek to a new position and wait for the first decoded frame.
+    waiter.frame_added.Reset();
+    auto start = Clock::now();
+    client.time = i * 2 + 1;
+    thread.OnSeek();
+    waiter.frame_added.GetValue();
+    double delta = to_ms(Clock::now() - start);
+    seek_total += delta;
+    seek_max = std::max(seek_max, delta);
+
+    // Seek again, but wait until the decoder needs a key and then add it.
+    decoder.key_not_found.Reset();
+    decoder.has_key = false;
+    client.time = i * 2 + 2;
+    thread.OnSeek();
+    decoder.key_not_found.GetValue();
+
+    waiter.frame_added.Reset();
+    start = Clock::now();
+    decoder.has_key = true;
+    eme::KeyStatusNotifier::Instance()->OnKeyStatusChange(cdm);
+    waiter.frame_added.GetValue();
+    delta = to_ms(Clock::now() - start);
+    license_total += delta;
+    license_max = std::max(license_max, delta);
+  }
+
+  printf("seek-to-first-frame:    avg %.3f ms, max %.3f ms\n",
+         seek_total / kIterations, seek_max);
+  printf("license-to-first-frame: avg %.3f ms, max %.3f ms\n",
+         license_total / kIterations, license_max);
+
+  thread.Detach();
+  thread.SetCdm(nullptr);
+}
+
+TEST(DecoderThreadBenchmark, TrickPlay) {
+  constexpr const double kRenderInterval = 1.0 / 60;
+  constexpr const size_t kRenderCount = 120;
+
+  printf("rate  decoded  displayed  decoded/displayed\n");
+  for (double rate : {1, 2, 4, 8, 16, 32}) {
+    FakeClient client;
+    FakeDecoder decoder;
+    ElementaryStream input;
+    DecodedStream output;
+    AddFrames(&input, 0, rate * kRenderCount * kRenderInterval + 10);
+
+    client.rate = rate;
+    client.playing = true;
+    DecoderThread thread(&client, &output, /* is_video= */ true);
+    thread.SetDecoder(&decoder);
+    thread.Attach(&input);
+
+    // Simulate a 60Hz renderer and count the distinct frames it would draw.
+    size_t displayed = 0;
+    double last_pts = NAN;
+    for (size_t i = 0; i < kRenderCount; i++) {
+      util::Clock::Instance.SleepSeconds(kRenderInterval);
+      client.time = client.time + rate * kRenderInterval;
+      auto frame = output.GetFrame(client.time, FrameLocation::Near);
+      if (frame && frame->pts != last_pts) {
+        displayed++;
+        last_pts = frame->pts;
+      }
+    }
+    thread.Detach();
+
+    printf("%4.0f  %7zu  %9zu  %17.2f\n", rate, decoder.decoded_count.load(),
+           displayed,
+           displayed ? static_cast<double>(decoder.decoded_count) / displayed
+                     : 0.0);
+  }
+}
+
+TEST(DecoderThreadBenchmark, DecodeAhead) {
+  constexpr const double kDuration = 12;
+  constexpr const double kTick = 0.01;
+
+  printf("limits       underruns  stalled  decode-ahead\n");
+  for (bool adaptive : {false, true}) {
+    FakeClient client;
+    FakeDecoder decoder;
+    ElementaryStream input;
+    DecodedStream output;
+    AddFrames(&input, 0, kDuration + 2);
+    // Decoding usually takes 40% of real time, but every fourth GOP is
+    // complex and takes twice real time.
+    decoder.cost = [](const EncodedFrame& frame) {
+      return std::fmod(frame.pts, 4) >= 3 ? kFrameDuration * 2
+                                          : kFrameDuration * 0.4;
+    };
+
+    DecoderThread thread(&client, &output, /* is_video= */ true);
+    if (adaptive)
+      thread.SetDecodeBufferLimits({1, 4, 0});
+    else
+      thread.SetDecodeBufferLimits({1, 1, 0});
+    thread.SetDecoder(&decoder);
+    thread.Attach(&input);
+    client.playing = true;
+
+    // Simulate playback in real time; the playhead stops when there aren't
+    // any decoded frames.
+    double stalled = 0;
+    while (client.time < kDuration) {
+      util::Clock::Instance.SleepSeconds(kTick);
+      bool has_frame = false;
+      for (auto& range : output.GetBufferedRanges()) {
+        if (range.start <= client.time + StreamBase::kMaxGapSize &&
+            range.end > client.time) {
+          has_frame = true;
+        }
+      }
+      if (has_frame)
+        client.time = client.time + kTick;
+      else
+        stalled += kTick;
+    }
+
+    const DecodingStats stats = thread.GetStats();
+    printf("%-11s  %9u  %5.2f s  %10.2f s\n",
+           adaptive ? "1-4s:" : "fixed 1s:", stats.underruns, stalled,
+           stats.decode_ahead);
+    thread.Detach();
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
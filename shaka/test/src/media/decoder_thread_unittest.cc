@@ -0,0 +1,299 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/decoder_thread.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/debug/thread_event.h"
+#include "src/eme/key_status_notifier.h"
+#include "src/test/decoder_thread_fakes.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+/** How long to wait for an event; this is less than the thread's max wait. */
+constexpr const auto kTimeout = std::chrono::milliseconds(100);
+
+#define WAIT_WITH_TIMEOUT(cond) \
+  EXPECT_EQ((cond).future().wait_for(kTimeout), std::future_status::ready)
+
+}  // namespace
+
+TEST(DecoderThreadTest, DecodesWhenFramesAdded) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  FrameWaiter waiter(&output);
+
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+
+  // The thread is waiting for frames; adding them should wake it up.
+  util::Clock::Instance.SleepSeconds(0.01);
+  AddFrames(&input, 0, 1);
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, DecodesWhenKeyAdded) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  FrameWaiter waiter(&output);
+  AddFrames(&input, 0, 1);
+
+  // The fake decoder doesn't use the CDM, so any unique pointer will work.
+  int dummy;
+  auto* cdm = reinterpret_cast<eme::Implementation*>(&dummy);
+
+  decoder.has_key = false;
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetCdm(cdm);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  WAIT_WITH_TIMEOUT(decoder.key_not_found);
+
+  decoder.has_key = true;
+  eme::KeyStatusNotifier::Instance()->OnKeyStatusChange(cdm);
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+
+  thread.Detach();
+  thread.SetCdm(nullptr);
+}
+
+TEST(DecoderThreadTest, KeepsDecodedFramesWhenSeekingWithinThem) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  AddFrames(&input, 0, 5);
+
+  FrameWaiter start_waiter(&output, [&]() {
+    return output.CountFramesBetween(0.5, 1) != 0;
+  });
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  WAIT_WITH_TIMEOUT(start_waiter.frame_added);
+  const size_t reset_count = decoder.reset_count;
+
+  // Seeking within the decoded frames shouldn't remove them or reset the
+  // decoder; it should continue decoding after them.
+  const double decoded_end = output.GetBufferedRanges().back().end;
+  FrameWaiter seek_waiter(&output, [&]() {
+    return output.GetBufferedRanges().back().end > decoded_end + 0.1;
+  });
+  client.time = 0.5;
+  thread.OnSeek();
+  EXPECT_NE(0u, output.CountFramesBetween(0.5, 1));
+  WAIT_WITH_TIMEOUT(seek_waiter.frame_added);
+  EXPECT_EQ(reset_count, decoder.reset_count);
+  EXPECT_NE(0u, output.CountFramesBetween(0.5, 1));
+
+  // Seeking past them should start over.  The seeks are close together, so
+  // this may only decode the keyframe before the seek target.
+  FrameWaiter restart_waiter(&output, [&]() {
+    return output.CountFramesBetween(2.9, 4) != 0;
+  });
+  client.time = 3.5;
+  thread.OnSeek();
+  WAIT_WITH_TIMEOUT(restart_waiter.frame_added);
+  EXPECT_EQ(reset_count + 1, decoder.reset_count);
+  EXPECT_EQ(0u, output.CountFramesBetween(0, 1));
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, DecodesFurtherAheadWhenDecodingIsSlow) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  AddFrames(&input, 0, 5);
+  // This is 75% of real time.
+  decoder.cost = [](const EncodedFrame&) { return kFrameDuration * 0.75; };
+  // With the minimum limit, this would stop before this frame.
+  FrameWaiter waiter(&output, [&]() {
+    return output.CountFramesBetween(0.25, 5) != 0;
+  });
+
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetDecodeBufferLimits({0.2, 4, 0});
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  // Decoding is slow, so this takes longer than the usual timeout.
+  EXPECT_EQ(waiter.frame_added.future().wait_for(std::chrono::seconds(1)),
+            std::future_status::ready);
+  EXPECT_GT(thread.GetStats().decode_ahead, 0.2);
+  EXPECT_GT(thread.GetStats().frame_decode_time, 0);
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, LimitsDecodedMemory) {
+  constexpr const size_t kFrameSize = 100000;
+  constexpr const size_t kMaxBytes = 5 * kFrameSize;
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  AddFrames(&input, 0, 5);
+  decoder.frame_size = kFrameSize;
+  // Track the most memory used while decoding, and wait until it decodes more
+  // than the first frame, which is decoded before the frame size is known.
+  size_t max_size = 0;
+  FrameWaiter waiter(&output, [&]() {
+    max_size = std::max(max_size, output.EstimateSize());
+    return output.CountFramesBetween(0.02, 5) != 0;
+  });
+
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetDecodeBufferLimits({1, 4, kMaxBytes});
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+  EXPECT_LT(thread.GetStats().decode_ahead, 1);
+
+  thread.Detach();
+  EXPECT_NE(0u, max_size);
+  EXPECT_LE(max_size, kMaxBytes);
+}
+
+TEST(DecoderThreadTest, OnlyDecodesKeyFramesAtHighRates) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  AddFrames(&input, 0, 20);
+  FrameWaiter waiter(&output, [&]() {
+    return output.CountFramesBetween(-HUGE_VAL, HUGE_VAL) >= 2;
+  });
+
+  client.rate = 16;
+  client.playing = true;
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+
+  // It should decode a few keyframes ahead of the playhead, then wait.
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+  EXPECT_EQ(0u, decoder.non_key_frame_count);
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, OnlyDecodesKeyFrameWhenScrubbing) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  AddFrames(&input, 0, 10);
+
+  // Two seeks close together start scrubbing, so only the keyframe at the seek
+  // target should be decoded.  Seek before attaching so nothing is decoded
+  // from the start.
+  FrameWaiter waiter(&output, [&]() {
+    return output.CountFramesBetween(4.9, 5.1) != 0;
+  });
+  DecoderThread thread(&client, &output, /* is_video= */ true);
+  client.time = 2.5;
+  thread.OnSeek();
+  client.time = 5.5;
+  thread.OnSeek();
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+  EXPECT_EQ(1u, output.CountFramesBetween(-HUGE_VAL, HUGE_VAL));
+  auto frame = output.GetFrame(5.5, FrameLocation::Near);
+  ASSERT_TRUE(frame);
+  EXPECT_NEAR(5, frame->pts, 0.001);
+
+  // Keep scrubbing.  Once the next keyframe is decoded, we know it didn't
+  // decode the frames after the first one.
+  FrameWaiter next_waiter(&output, [&]() {
+    return output.CountFramesBetween(5.9, 6.1) != 0;
+  });
+  client.time = 6.5;
+  thread.OnSeek();
+  WAIT_WITH_TIMEOUT(next_waiter.frame_added);
+  EXPECT_EQ(0u, decoder.non_key_frame_count);
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, DecodesEveryAudioFrameAtHighRates) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  // In key-frame-only mode, there would only be one frame in this second.
+  FrameWaiter waiter(&output, [&]() {
+    return output.CountFramesBetween(0, 1) >= 10;
+  });
+  AddFrames(&input, 0, 2);
+
+  client.rate = 4;
+  client.playing = true;
+  DecoderThread thread(&client, &output, /* is_video= */ false);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+  EXPECT_NE(0u, decoder.non_key_frame_count);
+
+  thread.Detach();
+}
+
+TEST(DecoderThreadTest, DecodesEveryAudioFrameWhenScrubbing) {
+  FakeClient client;
+  FakeDecoder decoder;
+  ElementaryStream input;
+  DecodedStream output;
+  FrameWaiter waiter(&output, [&]() {
+    return output.CountFramesBetween(3, 4) >= 10;
+  });
+  AddFrames(&input, 0, 5);
+
+  DecoderThread thread(&client, &output, /* is_video= */ false);
+  thread.SetDecoder(&decoder);
+  thread.Attach(&input);
+  client.time = 2.5;
+  thread.OnSeek();
+  client.time = 3.5;
+  thread.OnSeek();
+  WAIT_WITH_TIMEOUT(waiter.frame_added);
+
+  thread.Detach();
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,146 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/decrypt_stage.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shaka/eme/configuration.h"
+#include "shaka/eme/implementation.h"
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/media/media_executor.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+constexpr const double kFrameDuration = 1.0 / 30;
+
+/**
+ * A CDM that copies the data at a fixed rate.  This simulates a CDM that is
+ * slower than a plain memory copy (e.g. one that decrypts in a TEE).
+ */
+class SlowCdm : public eme::Implementation {
+ public:
+  explicit SlowCdm(double bytes_per_second)
+      : bytes_per_second_(bytes_per_second) {}
+
+  bool GetExpiration(const std::string& /* session_id */,
+                     int64_t* /* expiration */) const override {
+    return false;
+  }
+  bool GetKeyStatuses(
+      const std::string& /* session_id */,
+      std::vector<eme::KeyStatusInfo>* /* statuses */) const override {
+    return false;
+  }
+  void SetServerCertificate(eme::EmePromise /* promise */,
+                            eme::Data /* cert */) override {}
+  void CreateSessionAndGenerateRequest(
+      eme::EmePromise /* promise */,
+      std::function<void(const std::string&)> /* set_session_id */,
+      eme::MediaKeySessionType /* session_type */,
+      eme::MediaKeyInitDataType /* init_data_type */,
+      eme::Data /* data */) override {}
+  void Load(const std::string& /* session_id */,
+            eme::EmePromise /* promise */) override {}
+  void Update(const std::string& /* session_id */,
+              eme::EmePromise /* promise */, eme::Data /* data */) override {}
+  void Close(const std::string& /* session_id */,
+             eme::EmePromise /* promise */) override {}
+  void Remove(const std::string& /* session_id */,
+              eme::EmePromise /* promise */) override {}
+
+  eme::DecryptStatus Decrypt(const eme::FrameEncryptionInfo* /* info */,
+                             const uint8_t* data, size_t data_size,
+                             uint8_t* dest) const override {
+    std::copy(data, data + data_size, dest);
+    std::this_thread::sleep_for(
+        std::chrono::duration<double>(data_size / bytes_per_second_));
+    return eme::DecryptStatus::Success;
+  }
+
+ private:
+  const double bytes_per_second_;
+};
+
+}  // namespace
+
+TEST(DecryptStageBenchmark, DecodeLoop) {
+  // 4K video: 256 KB frames at 30 fps, with a CDM that decrypts at 400 MB/s
+  // and a hardware decoder that takes 5 ms per frame (mostly waiting on the
+  // hardware).
+  constexpr const size_t kFrameSize = 256 * 1024;
+  constexpr const size_t kFrameCount = 300;
+  constexpr const double kDecodeTime = 0.005;
+  SlowCdm cdm(400e6);
+  const std::vector<uint8_t> data(kFrameSize, 0x42);
+  auto info = std::make_shared<eme::FrameEncryptionInfo>(
+      eme::EncryptionScheme::AesCtr, std::vector<uint8_t>(16, 1),
+      std::vector<uint8_t>(16, 2));
+  std::vector<uint8_t> buffer(kFrameSize);
+
+  for (size_t workers : {0, 1, 2, 4}) {
+    ElementaryStream stream;
+    std::vector<std::shared_ptr<EncodedFrame>> frames;
+    for (size_t i = 0; i < kFrameCount; i++) {
+      const double time = i * kFrameDuration;
+      frames.emplace_back(std::make_shared<EncodedFrame>(
+          nullptr, time, time, kFrameDuration, i == 0, data.data(),
+          data.size(), 0, info));
+      stream.AddFrame(frames.back());
+    }
+
+    // Use enough threads that the workers don't wait on each other.
+    MediaExecutor executor(workers + 1);
+    DecryptStage stage(workers, &executor);
+    stage.Attach(&stream);
+    stage.SetCdm(&cdm);
+
+    size_t decrypted_ahead = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (auto& frame : frames) {
+      // This is what DecoderThread and the decoder do for each frame.
+      auto decrypted = stage.TakeFrame(frame);
+      if (decrypted) {
+        decrypted_ahead++;
+      } else {
+        ASSERT_EQ(MediaStatus::Success, frame->Decrypt(&cdm, buffer.data()));
+      }
+      std::this_thread::sleep_for(std::chrono::duration<double>(kDecodeTime));
+    }
+    const double elapsed = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    stage.Detach();
+    stage.SetCdm(nullptr);
+
+    printf("%zu workers: %.3f ms per frame in the decode loop, %zu/%zu "
+           "frames decrypted ahead\n",
+           workers, elapsed / kFrameCount, decrypted_ahead, kFrameCount);
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,244 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/decrypt_stage.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shaka/eme/configuration.h"
+#include "shaka/eme/implementation.h"
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/eme/key_status_notifier.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+constexpr const double kFrameDuration = 0.04;
+constexpr const uint8_t kXorKey = 0x5a;
+
+/** A CDM that "decrypts" by XOR-ing each byte with a constant. */
+class FakeCdm : public eme::Implementation {
+ public:
+  FakeCdm() {}
+
+  bool GetExpiration(const std::string& /* session_id */,
+                     int64_t* /* expiration */) const override {
+    return false;
+  }
+  bool GetKeyStatuses(
+      const std::string& /* session_id */,
+      std::vector<eme::KeyStatusInfo>* /* statuses */) const override {
+    return false;
+  }
+  void SetServerCertificate(eme::EmePromise /* promise */,
+                            eme::Data /* cert */) override {}
+  void CreateSessionAndGenerateRequest(
+      eme::EmePromise /* promise */,
+      std::function<void(const std::string&)> /* set_session_id */,
+      eme::MediaKeySessionType /* session_type */,
+      eme::MediaKeyInitDataType /* init_data_type */,
+      eme::Data /* data */) override {}
+  void Load(const std::string& /* session_id */,
+            eme::EmePromise /* promise */) override {}
+  void Update(const std::string& /* session_id */,
+              eme::EmePromise /* promise */, eme::Data /* data */) override {}
+  void Close(const std::string& /* session_id */,
+             eme::EmePromise /* promise */) override {}
+  void Remove(const std::string& /* session_id */,
+              eme::EmePromise /* promise */) override {}
+
+  eme::DecryptStatus Decrypt(const eme::FrameEncryptionInfo* /* info */,
+                             const uint8_t* data, size_t data_size,
+                             uint8_t* dest) const override {
+    if (!has_key) {
+      decrypt_count++;
+      return eme::DecryptStatus::KeyNotFound;
+    }
+    for (size_t i = 0; i < data_size; i++)
+      dest[i] = data[i] ^ kXorKey;
+    decrypt_count++;
+    return eme::DecryptStatus::Success;
+  }
+
+  std::atomic<bool> has_key{true};
+  mutable std::atomic<size_t> decrypt_count{0};
+};
+
+class DecryptStageTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(1024);
+    for (size_t i = 0; i < data_.size(); i++)
+      data_[i] = static_cast<uint8_t>(i * 7);
+    info_ = std::make_shared<eme::FrameEncryptionInfo>(
+        eme::EncryptionScheme::AesCtr, std::vector<uint8_t>(16, 1),
+        std::vector<uint8_t>(16, 2));
+  }
+
+  /** Adds |count| frames to |stream_|, where every |clear_every| is clear. */
+  void AddFrames(size_t count, size_t clear_every = 0) {
+    for (size_t i = 0; i < count; i++) {
+      const double time = frames_.size() * kFrameDuration;
+      const bool clear = clear_every > 0 && i % clear_every == clear_every - 1;
+      frames_.emplace_back(std::make_shared<EncodedFrame>(
+          nullptr, time, time, kFrameDuration, i == 0, data_.data(),
+          data_.size(), 0, clear ? nullptr : info_));
+      stream_.AddFrame(frames_.back());
+    }
+  }
+
+  /** Waits until the CDM has been called |count| times. */
+  void WaitForDecrypts(size_t count) {
+    for (int i = 0; i < 100 && cdm_.decrypt_count < count; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_GE(cdm_.decrypt_count, count);
+    // Give the jobs a moment to store the last results.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  void ExpectDecrypted(const std::shared_ptr<EncodedFrame>& expected,
+                       const std::shared_ptr<EncodedFrame>& actual) {
+    ASSERT_TRUE(actual);
+    EXPECT_NE(expected, actual);
+    EXPECT_FALSE(actual->encryption_info);
+    EXPECT_EQ(expected->pts, actual->pts);
+    EXPECT_EQ(expected->dts, actual->dts);
+    EXPECT_EQ(expected->is_key_frame, actual->is_key_frame);
+    ASSERT_EQ(expected->data_size, actual->data_size);
+    for (size_t i = 0; i < actual->data_size; i++) {
+      ASSERT_EQ(expected->data[i] ^ kXorKey, actual->data[i]) << i;
+    }
+  }
+
+  std::vector<uint8_t> data_;
+  std::shared_ptr<eme::FrameEncryptionInfo> info_;
+  std::vector<std::shared_ptr<EncodedFrame>> frames_;
+  ElementaryStream stream_;
+  FakeCdm cdm_;
+};
+
+}  // namespace
+
+TEST_F(DecryptStageTest, DecryptsFramesAhead) {
+  AddFrames(10, 5);
+
+  DecryptStage stage(2);
+  stage.Attach(&stream_);
+  stage.SetCdm(&cdm_);
+
+  // Nothing is decrypted until the decoder starts.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(0u, cdm_.decrypt_count);
+  EXPECT_FALSE(stage.TakeFrame(frames_[0]));
+
+  // The following encrypted frames are decrypted; frames 4 and 9 are clear.
+  WaitForDecrypts(7);
+  for (size_t i = 1; i < 10; i++) {
+    if (i == 4 || i == 9)
+      EXPECT_FALSE(stage.TakeFrame(frames_[i])) << i;
+    else
+      ExpectDecrypted(frames_[i], stage.TakeFrame(frames_[i]));
+  }
+  EXPECT_EQ(7u, cdm_.decrypt_count);
+
+  // Frames added later are decrypted too.
+  AddFrames(2);
+  WaitForDecrypts(9);
+  ExpectDecrypted(frames_[10], stage.TakeFrame(frames_[10]));
+  ExpectDecrypted(frames_[11], stage.TakeFrame(frames_[11]));
+}
+
+TEST_F(DecryptStageTest, RetriesWhenKeyAdded) {
+  AddFrames(10);
+  cdm_.has_key = false;
+
+  DecryptStage stage(2);
+  stage.Attach(&stream_);
+  stage.SetCdm(&cdm_);
+  EXPECT_FALSE(stage.TakeFrame(frames_[0]));
+
+  // This stops once a frame is missing the key.
+  WaitForDecrypts(1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const size_t failed_count = cdm_.decrypt_count;
+  EXPECT_LE(failed_count, 2u);
+
+  cdm_.has_key = true;
+  eme::KeyStatusNotifier::Instance()->OnKeyStatusChange(&cdm_);
+  WaitForDecrypts(failed_count + 9);
+  for (size_t i = 1; i < 10; i++)
+    ExpectDecrypted(frames_[i], stage.TakeFrame(frames_[i]));
+}
+
+TEST_F(DecryptStageTest, HandlesSeeks) {
+  AddFrames(20);
+
+  DecryptStage stage(2);
+  stage.Attach(&stream_);
+  stage.SetCdm(&cdm_);
+  EXPECT_FALSE(stage.TakeFrame(frames_[0]));
+  WaitForDecrypts(19);
+
+  // Skipping forward within the decrypted frames keeps them.
+  ExpectDecrypted(frames_[8], stage.TakeFrame(frames_[8]));
+  ExpectDecrypted(frames_[9], stage.TakeFrame(frames_[9]));
+
+  // Seeking back starts over after the new frame.
+  EXPECT_FALSE(stage.TakeFrame(frames_[3]));
+  WaitForDecrypts(19 + 16);
+  for (size_t i = 4; i < 20; i++)
+    ExpectDecrypted(frames_[i], stage.TakeFrame(frames_[i]));
+}
+
+TEST_F(DecryptStageTest, LimitsDecryptedBytes) {
+  AddFrames(20);
+
+  DecryptStage stage(2);
+  stage.SetMaxBytes(3 * data_.size());
+  stage.Attach(&stream_);
+  stage.SetCdm(&cdm_);
+  EXPECT_FALSE(stage.TakeFrame(frames_[0]));
+  WaitForDecrypts(3);
+  EXPECT_EQ(3u, cdm_.decrypt_count);
+
+  // Taking a frame makes room for another.
+  ExpectDecrypted(frames_[1], stage.TakeFrame(frames_[1]));
+  WaitForDecrypts(4);
+  EXPECT_EQ(4u, cdm_.decrypt_count);
+}
+
+TEST_F(DecryptStageTest, DoesNothingWithoutWorkers) {
+  AddFrames(5);
+
+  DecryptStage stage(0);
+  stage.Attach(&stream_);
+  stage.SetCdm(&cdm_);
+  for (auto& frame : frames_)
+    EXPECT_FALSE(stage.TakeFrame(frame));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(0u, cdm_.decrypt_count);
+}
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,100 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shaka/media/demuxer.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/test/media_files.h"
+#include "test/src/media/media_tests.pb.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+class NullClient : public Demuxer::Client {
+ public:
+  void OnLoadedMetaData(double duration) override {}
+  void OnEncrypted(eme::MediaKeyInitDataType type, const uint8_t* data,
+                   size_t size) override {}
+};
+
+/**
+ * Demuxes the given files, appending at most |chunk_size| bytes at a time.
+ * @return The number of frames produced.
+ */
+size_t DemuxInChunks(const std::string& mime,
+                     const std::vector<std::vector<uint8_t>>& files,
+                     size_t chunk_size) {
+  NullClient client;
+  std::unique_ptr<Demuxer> demuxer =
+      DemuxerFactory::GetFactory()->Create(mime, &client);
+  if (!demuxer)
+    return 0;
+
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  for (const auto& file : files) {
+    for (size_t pos = 0; pos < file.size(); pos += chunk_size) {
+      const size_t size = std::min(chunk_size, file.size() - pos);
+      if (!demuxer->Demux(0, file.data() + pos, size, &frames))
+        return 0;
+    }
+  }
+  return frames.size();
+}
+
+}  // namespace
+
+TEST(DemuxerBenchmark, Demux) {
+  constexpr const size_t kIterations = 50;
+
+  const std::vector<uint8_t> proto_data =
+      GetMediaFile("clear_low_frag_seg1.mp4.dat");
+  proto::MediaInfo info;
+  ASSERT_TRUE(info.ParseFromArray(proto_data.data(), proto_data.size()));
+  const std::vector<std::vector<uint8_t>> files = {
+      GetMediaFile("clear_low_frag_init.mp4"),
+      GetMediaFile("clear_low_frag_seg1.mp4")};
+  size_t total_size = 0;
+  for (auto& file : files)
+    total_size += file.size();
+
+  // Whole segments are the normal case; small chunks show the cost of
+  // switching in and out of the demuxer.
+  for (size_t chunk_size : {total_size, static_cast<size_t>(16 * 1024),
+                            static_cast<size_t>(1024)}) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kIterations; i++) {
+      ASSERT_EQ(static_cast<size_t>(info.frames().size()),
+                DemuxInChunks(info.mime(), files, chunk_size));
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    printf("%7zu byte appends: %.1f MB/s, %.3f ms per segment\n", chunk_size,
+           total_size * kIterations / seconds / 1e6,
+           seconds * 1000 / kIterations);
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
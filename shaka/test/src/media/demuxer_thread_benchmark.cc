@@ -0,0 +1,121 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/demuxer_thread.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <vector>
+
+#include "src/debug/mutex.h"
+#include "src/test/media_files.h"
+#include "src/util/clock.h"
+#include "test/src/media/media_tests.pb.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+class NullClient : public Demuxer::Client {
+ public:
+  void OnLoadedMetaData(double duration) override {}
+  void OnEncrypted(eme::MediaKeyInitDataType type, const uint8_t* data,
+                   size_t size) override {}
+};
+
+/** Blocks until a DemuxerThread operation completes. */
+class Completion {
+ public:
+  Completion() : mutex_("Completion"), done_(false) {}
+
+  std::function<void(bool)> Callback() {
+    return [this](bool success) {
+      std::unique_lock<Mutex> lock(mutex_);
+      EXPECT_TRUE(success);
+      done_ = true;
+      signal_.notify_all();
+    };
+  }
+
+  void Wait() {
+    std::unique_lock<Mutex> lock(mutex_);
+    while (!done_)
+      signal_.wait(lock);
+    done_ = false;
+  }
+
+ private:
+  Mutex mutex_;
+  std::condition_variable_any signal_;
+  bool done_;
+};
+
+}  // namespace
+
+TEST(DemuxerThreadBenchmark, SequentialAppends) {
+  constexpr const size_t kSegmentCount = 50;
+
+  const std::vector<uint8_t> proto_data =
+      GetMediaFile("clear_low_frag_seg1.mp4.dat");
+  proto::MediaInfo info;
+  ASSERT_TRUE(info.ParseFromArray(proto_data.data(), proto_data.size()));
+  const std::vector<uint8_t> init = GetMediaFile("clear_low_frag_init.mp4");
+  const std::vector<uint8_t> segment = GetMediaFile("clear_low_frag_seg1.mp4");
+  double start = HUGE_VAL;
+  double end = -HUGE_VAL;
+  for (const auto& frame : info.frames()) {
+    start = std::min(start, frame.pts());
+    end = std::max(end, frame.pts() + frame.duration());
+  }
+  const double segment_duration = end - start;
+
+  // Appends complete once the segment is demuxed, so the app's fetch of the
+  // next segment and the demuxer take turns, like with SourceBuffer.  The
+  // fetch time simulates downloading the next segment.
+  for (double fetch_seconds : {0.0, 0.005}) {
+    NullClient client;
+    ElementaryStream stream;
+    Completion completion;
+    DemuxerThread demuxer(info.mime(), &client, &stream);
+    demuxer.AppendData(0, 0, HUGE_VAL, init.data(), init.size(),
+                       completion.Callback());
+    completion.Wait();
+
+    const auto start_time = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kSegmentCount; i++) {
+      util::Clock::Instance.SleepSeconds(fetch_seconds);
+      // Offset each copy so they form one long buffered range.
+      demuxer.AppendData(i * segment_duration, 0, HUGE_VAL, segment.data(),
+                         segment.size(), completion.Callback());
+      completion.Wait();
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start_time)
+                               .count();
+    const auto buffered = stream.GetBufferedRanges();
+    EXPECT_EQ(1u, buffered.size());
+    printf("%.0f ms fetch: %.1f segments/s, %.2f s buffered\n",
+           fetch_seconds * 1000, kSegmentCount / seconds,
+           buffered.empty() ? 0 : buffered.back().end);
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
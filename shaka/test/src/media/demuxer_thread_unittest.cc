@@ -0,0 +1,118 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/demuxer_thread.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <condition_variable>
+#include <vector>
+
+#include "src/debug/mutex.h"
+#include "src/test/media_files.h"
+#include "test/src/media/media_tests.pb.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+class NullClient : public Demuxer::Client {
+ public:
+  void OnLoadedMetaData(double duration) override {}
+  void OnEncrypted(eme::MediaKeyInitDataType type, const uint8_t* data,
+                   size_t size) override {}
+};
+
+/** Records the completion callbacks from a DemuxerThread. */
+class Completions {
+ public:
+  Completions() : mutex_("Completions") {}
+
+  /** @return A callback that records |id| when called. */
+  std::function<void(bool)> Callback(int id) {
+    return [this, id](bool success) {
+      std::unique_lock<Mutex> lock(mutex_);
+      EXPECT_TRUE(success) << id;
+      order_.push_back(id);
+      signal_.notify_all();
+    };
+  }
+
+  /** Waits until |count| callbacks have been called. */
+  void WaitFor(size_t count) {
+    std::unique_lock<Mutex> lock(mutex_);
+    while (order_.size() < count)
+      signal_.wait(lock);
+  }
+
+  std::vector<int> order() {
+    std::unique_lock<Mutex> lock(mutex_);
+    return order_;
+  }
+
+ private:
+  Mutex mutex_;
+  std::condition_variable_any signal_;
+  std::vector<int> order_;
+};
+
+class DemuxerThreadTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const std::vector<uint8_t> proto_data =
+        GetMediaFile("clear_low_frag_seg1.mp4.dat");
+    ASSERT_TRUE(info_.ParseFromArray(proto_data.data(), proto_data.size()));
+    init_ = GetMediaFile("clear_low_frag_init.mp4");
+    segment_ = GetMediaFile("clear_low_frag_seg1.mp4");
+  }
+
+  proto::MediaInfo info_;
+  std::vector<uint8_t> init_;
+  std::vector<uint8_t> segment_;
+  NullClient client_;
+};
+
+}  // namespace
+
+TEST_F(DemuxerThreadTest, AppendsAndRemoves) {
+  ElementaryStream stream;
+  Completions completions;
+  DemuxerThread demuxer(info_.mime(), &client_, &stream);
+
+  // Like SourceBuffer, only start an operation once the last one completed.
+  demuxer.AppendData(0, 0, HUGE_VAL, init_.data(), init_.size(),
+                     completions.Callback(0));
+  completions.WaitFor(1);
+  demuxer.AppendData(0, 0, HUGE_VAL, segment_.data(), segment_.size(),
+                     completions.Callback(1));
+  completions.WaitFor(2);
+  EXPECT_EQ(static_cast<size_t>(info_.frames().size()),
+            stream.CountFramesBetween(-HUGE_VAL, HUGE_VAL));
+
+  demuxer.Remove(0, HUGE_VAL, completions.Callback(2));
+  completions.WaitFor(3);
+  EXPECT_EQ(0u, stream.CountFramesBetween(-HUGE_VAL, HUGE_VAL));
+
+  demuxer.AppendData(0, 0, HUGE_VAL, segment_.data(), segment_.size(),
+                     completions.Callback(3));
+  completions.WaitFor(4);
+  EXPECT_EQ(completions.order(), (std::vector<int>{0, 1, 2, 3}));
+  EXPECT_EQ(static_cast<size_t>(info_.frames().size()),
+            stream.CountFramesBetween(-HUGE_VAL, HUGE_VAL));
+}
+
+}  // namespace media
+}  // namespace shaka
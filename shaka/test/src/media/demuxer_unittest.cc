@@ -17,6 +17,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+
 #include "src/media/media_utils.h"
 #include "src/test/media_files.h"
 #include "src/util/crypto.h"
@@ -96,6 +98,30 @@ void RunDemuxerTest(const std::vector<std::string>& files) {
   }
 }
 
+/**
+ * Demuxes the given files, appending at most |chunk_size| bytes at a time.
+ * @return The number of frames produced.
+ */
+size_t DemuxInChunks(const std::string& mime,
+                     const std::vector<std::vector<uint8_t>>& files,
+                     size_t chunk_size) {
+  NiceMock<MockClient> client;
+  std::unique_ptr<Demuxer> demuxer =
+      DemuxerFactory::GetFactory()->Create(mime, &client);
+  if (!demuxer)
+    return 0;
+
+  std::vector<std::shared_ptr<EncodedFrame>> frames;
+  for (const auto& file : files) {
+    for (size_t pos = 0; pos < file.size(); pos += chunk_size) {
+      const size_t size = std::min(chunk_size, file.size() - pos);
+      if (!demuxer->Demux(0, file.data() + pos, size, &frames))
+        return 0;
+    }
+  }
+  return frames.size();
+}
+
 }  // namespace
 
 TEST(DemuxerTest, SingleFile) {
@@ -119,5 +145,19 @@ TEST(DemuxerTest, Encrypted) {
   RunDemuxerTest({"encrypted_low.mp4"});
 }
 
+TEST(DemuxerTest, PartialAppends) {
+  const std::vector<uint8_t> proto_data =
+      GetMediaFile("clear_low_frag_seg1.mp4.dat");
+  proto::MediaInfo info;
+  ASSERT_TRUE(info.ParseFromArray(proto_data.data(), proto_data.size()));
+
+  // The demuxer should pick up where it left off when given more data.
+  const std::vector<std::vector<uint8_t>> files = {
+      GetMediaFile("clear_low_frag_init.mp4"),
+      GetMediaFile("clear_low_frag_seg1.mp4")};
+  EXPECT_EQ(static_cast<size_t>(info.frames().size()),
+            DemuxInChunks(info.mime(), files, 1000));
+}
+
 }  // namespace media
 }  // namespace shaka
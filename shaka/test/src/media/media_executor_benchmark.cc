@@ -0,0 +1,172 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/media_executor.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "src/debug/thread.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** Uses the CPU for the given number of seconds, like a decoder would. */
+void Spin(double seconds) {
+  const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(seconds));
+  while (Clock::now() < end) {
+  }
+}
+
+double SecondsSince(Clock::time_point time) {
+  return std::chrono::duration<double>(Clock::now() - time).count();
+}
+
+/**
+ * Simulates one stream of a player.  Every frame interval, a frame needs to be
+ * decoded, which takes |cost| seconds.  This records how late each frame
+ * started decoding.
+ */
+class FakeStream {
+ public:
+  FakeStream(double interval, double cost)
+      : interval_(interval), cost_(cost), start_(Clock::now()), frame_(0) {}
+
+  /**
+   * Decodes the frame if it is due.
+   * @return The number of seconds until the next frame is due.
+   */
+  double Step() {
+    const double now = SecondsSince(start_);
+    const double due = frame_ * interval_;
+    if (now < due)
+      return due - now;
+
+    lateness_.push_back(now - due);
+    Spin(cost_);
+    frame_++;
+    return std::max(frame_ * interval_ - SecondsSince(start_), 0.0);
+  }
+
+  const std::vector<double>& lateness() const {
+    return lateness_;
+  }
+
+ private:
+  const double interval_;
+  const double cost_;
+  const Clock::time_point start_;
+  size_t frame_;
+  std::vector<double> lateness_;
+};
+
+void PrintLateness(const char* name,
+                   const std::vector<std::unique_ptr<FakeStream>>& streams) {
+  std::vector<double> all;
+  for (auto& stream : streams) {
+    all.insert(all.end(), stream->lateness().begin(),
+               stream->lateness().end());
+  }
+  if (all.empty())
+    return;
+  std::sort(all.begin(), all.end());
+  double total = 0;
+  for (double lateness : all)
+    total += lateness;
+  printf("  %-11s %6.2f ms average late, %6.2f ms 99th percentile\n", name,
+         total / all.size() * 1000, all[all.size() * 99 / 100] * 1000);
+}
+
+}  // namespace
+
+TEST(MediaExecutorBenchmark, PlayerScaling) {
+  // Each player has a 30fps video stream and a 50Hz audio stream.
+  constexpr const double kVideoInterval = 1.0 / 30;
+  constexpr const double kVideoCost = 0.002;
+  constexpr const double kAudioInterval = 1.0 / 50;
+  constexpr const double kAudioCost = 0.0002;
+  constexpr const double kDuration = 2;
+  const size_t thread_count = MediaExecutor::Instance()->thread_count();
+
+  for (size_t players : {1, 4, 9, 16}) {
+    printf("%zu players:\n", players);
+    for (bool shared : {false, true}) {
+      // The first player is the foreground one.
+      std::vector<std::unique_ptr<FakeStream>> foreground;
+      std::vector<std::unique_ptr<FakeStream>> others;
+      for (size_t i = 0; i < players; i++) {
+        auto* list = i == 0 ? &foreground : &others;
+        list->emplace_back(new FakeStream(kVideoInterval, kVideoCost));
+        list->emplace_back(new FakeStream(kAudioInterval, kAudioCost));
+      }
+
+      if (shared) {
+        std::vector<std::unique_ptr<MediaExecutor::Job>> jobs;
+        for (auto* list : {&foreground, &others}) {
+          for (auto& stream : *list) {
+            FakeStream* ptr = stream.get();
+            jobs.emplace_back(
+                new MediaExecutor::Job("Stream", /* pinned= */ false,
+                                       [ptr]() { return ptr->Step(); }));
+            jobs.back()->SetPriority(list == &foreground
+                                         ? MediaPriority::Foreground
+                                         : MediaPriority::Background);
+            jobs.back()->Wake();
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(kDuration));
+        for (auto& job : jobs)
+          job->Stop();
+        printf(" %zu shared threads:\n", thread_count);
+      } else {
+        std::atomic<bool> done{false};
+        std::vector<std::unique_ptr<Thread>> threads;
+        for (auto* list : {&foreground, &others}) {
+          for (auto& stream : *list) {
+            FakeStream* ptr = stream.get();
+            threads.emplace_back(new Thread("Stream", [ptr, &done]() {
+              while (!done) {
+                std::this_thread::sleep_for(
+                    std::chrono::duration<double>(ptr->Step()));
+              }
+            }));
+          }
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(kDuration));
+        done = true;
+        for (auto& thread : threads)
+          thread->join();
+        printf(" %zu dedicated threads:\n", threads.size());
+      }
+
+      PrintLateness("foreground:", foreground);
+      PrintLateness("others:", others);
+    }
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
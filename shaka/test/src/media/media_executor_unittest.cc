@@ -0,0 +1,310 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/media/media_executor.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#ifdef OS_LINUX
+#  include <sched.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "src/debug/mutex.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** A flag that threads can wait on. */
+class Event {
+ public:
+  Event() : mutex_("Event"), set_(false) {}
+
+  void Set() {
+    std::unique_lock<Mutex> lock(mutex_);
+    set_ = true;
+    signal_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<Mutex> lock(mutex_);
+    while (!set_)
+      signal_.wait(lock);
+  }
+
+ private:
+  Mutex mutex_;
+  std::condition_variable_any signal_;
+  bool set_;
+};
+
+/** Uses the CPU for the given number of seconds, like a decoder would. */
+void Spin(double seconds) {
+  const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(seconds));
+  while (Clock::now() < end) {
+  }
+}
+
+double SecondsSince(Clock::time_point time) {
+  return std::chrono::duration<double>(Clock::now() - time).count();
+}
+
+}  // namespace
+
+TEST(MediaExecutorTest, RunsJobWhenWoken) {
+  MediaExecutor executor(2);
+  Event ran;
+  MediaExecutor::Job job("Test", /* pinned= */ false,
+                         [&]() {
+                           ran.Set();
+                           return INFINITY;
+                         },
+                         &executor);
+  job.Wake();
+  ran.Wait();
+}
+
+TEST(MediaExecutorTest, RunsJobAgainAfterDelay) {
+  MediaExecutor executor(2);
+  std::atomic<int> count{0};
+  Event done;
+  const auto start = Clock::now();
+  MediaExecutor::Job job("Test", /* pinned= */ false,
+                         [&]() -> double {
+                           if (++count == 3) {
+                             done.Set();
+                             return INFINITY;
+                           }
+                           return 0.01;
+                         },
+                         &executor);
+  job.Wake();
+  done.Wait();
+  EXPECT_EQ(3, count);
+  EXPECT_GE(SecondsSince(start), 0.02);
+}
+
+TEST(MediaExecutorTest, NeverRunsJobConcurrently) {
+  MediaExecutor executor(4);
+  std::atomic<bool> running{false};
+  std::atomic<int> count{0};
+  MediaExecutor::Job job("Test", /* pinned= */ false,
+                         [&]() {
+                           EXPECT_FALSE(running.exchange(true));
+                           count++;
+                           std::this_thread::yield();
+                           running = false;
+                           return INFINITY;
+                         },
+                         &executor);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < 1000; j++)
+        job.Wake();
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  job.Stop();
+  EXPECT_GT(count, 0);
+}
+
+TEST(MediaExecutorTest, RunsHigherPriorityFirst) {
+  MediaExecutor executor(1);
+  Event blocker_started;
+  Event unblock;
+  Event all_ran;
+  // Only used by the one worker thread until |all_ran| is set.
+  std::vector<int> order;
+
+  // Keep the only worker busy until all the jobs are queued.
+  MediaExecutor::Job blocker("Blocker", /* pinned= */ false,
+                             [&]() {
+                               blocker_started.Set();
+                               unblock.Wait();
+                               return INFINITY;
+                             },
+                             &executor);
+  blocker.Wake();
+  blocker_started.Wait();
+
+  std::vector<std::unique_ptr<MediaExecutor::Job>> jobs;
+  for (MediaPriority priority :
+       {MediaPriority::Background, MediaPriority::Normal,
+        MediaPriority::Foreground}) {
+    jobs.emplace_back(new MediaExecutor::Job("Test", /* pinned= */ false,
+                                             [&, priority]() {
+                                               order.push_back(
+                                                   static_cast<int>(priority));
+                                               if (order.size() == 3)
+                                                 all_ran.Set();
+                                               return INFINITY;
+                                             },
+                                             &executor));
+    jobs.back()->SetPriority(priority);
+    jobs.back()->Wake();
+  }
+  unblock.Set();
+  all_ran.Wait();
+
+  EXPECT_EQ(order,
+            (std::vector<int>{static_cast<int>(MediaPriority::Foreground),
+                              static_cast<int>(MediaPriority::Normal),
+                              static_cast<int>(MediaPriority::Background)}));
+}
+
+TEST(MediaExecutorTest, RunsLowerPriorityWhileHigherPriorityIsBusy) {
+  MediaExecutor executor(1);
+  Event background_ran;
+  std::atomic<bool> done{false};
+
+  // These always have more work, so strict priority would never run the
+  // background job.
+  std::vector<std::unique_ptr<MediaExecutor::Job>> busy;
+  for (int i = 0; i < 2; i++) {
+    busy.emplace_back(new MediaExecutor::Job(
+        "Busy", /* pinned= */ false,
+        [&]() { return done ? INFINITY : 0.0; }, &executor));
+    busy.back()->SetPriority(MediaPriority::Foreground);
+    busy.back()->Wake();
+  }
+
+  MediaExecutor::Job background("Background", /* pinned= */ false,
+                                [&]() {
+                                  background_ran.Set();
+                                  return INFINITY;
+                                },
+                                &executor);
+  background.SetPriority(MediaPriority::Background);
+  background.Wake();
+
+  background_ran.Wait();
+  done = true;
+  for (auto& job : busy)
+    job->Stop();
+}
+
+TEST(MediaExecutorTest, RunsTimersWhileAWorkerIsBusy) {
+  MediaExecutor executor(2);
+  std::atomic<int> count{0};
+  Event first_ran;
+  MediaExecutor::Job timer("Timer", /* pinned= */ false,
+                           [&]() {
+                             if (++count == 1)
+                               first_ran.Set();
+                             return 0.005;
+                           },
+                           &executor);
+  timer.Wake();
+  first_ran.Wait();
+
+  // Whichever worker runs this, the other one needs to handle the timer.
+  Event busy_done;
+  int seen = 0;
+  MediaExecutor::Job busy("Busy", /* pinned= */ false,
+                          [&]() {
+                            const auto start = Clock::now();
+                            while (count < 4 && SecondsSince(start) < 1)
+                              std::this_thread::yield();
+                            seen = count;
+                            busy_done.Set();
+                            return INFINITY;
+                          },
+                          &executor);
+  busy.Wake();
+  busy_done.Wait();
+  timer.Stop();
+  EXPECT_GE(seen, 4);
+}
+
+TEST(MediaExecutorTest, PinnedJobsStayOnOneThread) {
+  MediaExecutor executor(4);
+  std::vector<std::thread::id> ids;
+  Event done;
+  MediaExecutor::Job job("Test", /* pinned= */ true,
+                         [&]() -> double {
+                           ids.push_back(std::this_thread::get_id());
+                           if (ids.size() == 50) {
+                             done.Set();
+                             return INFINITY;
+                           }
+                           return 0.0;
+                         },
+                         &executor);
+  job.Wake();
+  done.Wait();
+  for (auto& id : ids)
+    EXPECT_EQ(ids[0], id);
+}
+
+TEST(MediaExecutorTest, StopWaitsForRunningJob) {
+  MediaExecutor executor(2);
+  Event started;
+  std::atomic<bool> finished{false};
+  MediaExecutor::Job job("Test", /* pinned= */ false,
+                         [&]() {
+                           started.Set();
+                           Spin(0.05);
+                           finished = true;
+                           return 0.0;
+                         },
+                         &executor);
+  job.Wake();
+  started.Wait();
+  job.Stop();
+  EXPECT_TRUE(finished);
+}
+
+#ifdef OS_LINUX
+TEST(MediaExecutorTest, AppliesCpuAffinity) {
+  const MediaThreadingPolicy old_policy =
+      MediaExecutor::GlobalThreadingPolicy();
+  MediaThreadingPolicy policy = old_policy;
+  policy.cpu_affinity = {0};
+  MediaExecutor::SetGlobalThreadingPolicy(policy);
+
+  std::atomic<int> cpu{-1};
+  Event ran;
+  {
+    MediaExecutor executor(2);
+    MediaExecutor::Job job("Test", /* pinned= */ false,
+                           [&]() {
+                             cpu = sched_getcpu();
+                             ran.Set();
+                             return INFINITY;
+                           },
+                           &executor);
+    job.Wake();
+    ran.Wait();
+  }
+  MediaExecutor::SetGlobalThreadingPolicy(old_policy);
+  EXPECT_EQ(0, cpu);
+}
+#endif
+
+}  // namespace media
+}  // namespace shaka
@@ -0,0 +1,134 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shaka/media/streams.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "src/media/frame_reclaimer.h"
+#include "src/test/test_utils.h"
+
+namespace shaka {
+namespace media {
+
+namespace {
+
+std::shared_ptr<BaseFrame> MakeFrame(double start, double end,
+                                     bool is_key_frame = true) {
+  auto* ret = new BaseFrame(nullptr, start, start, end - start, is_key_frame);
+  return std::shared_ptr<BaseFrame>(ret);
+}
+
+using StreamType = Stream<BaseFrame, true>;
+
+}  // namespace
+
+TEST(StreamBaseBenchmark, FrameLookup) {
+  // Simulates a long buffer of 60fps content with a keyframe every second.
+  constexpr const double kFrameDuration = 1.0 / 60;
+  constexpr const size_t kLookups = 100000;
+  for (size_t frame_count : {1000, 10000, 100000}) {
+    StreamType buffer;
+    const double add_ns = BenchmarkNanoseconds(frame_count, [&](size_t i) {
+      buffer.AddFrame(MakeFrame(i * kFrameDuration, (i + 1) * kFrameDuration,
+                                i % 60 == 0));
+    });
+    ASSERT_EQ(1u, buffer.GetBufferedRanges().size());
+
+    // Use a simple LCG so the lookups are spread over the whole buffer.
+    const double total = frame_count * kFrameDuration;
+    uint32_t seed = 1;
+    auto next_time = [&]() {
+      seed = seed * 1103515245u + 12345u;
+      return (seed % 100000) * total / 100000;
+    };
+    const double after_ns = BenchmarkNanoseconds(kLookups, [&](size_t) {
+      buffer.GetFrame(next_time(), FrameLocation::After);
+    });
+    const double key_frame_ns = BenchmarkNanoseconds(kLookups, [&](size_t) {
+      buffer.GetFrame(next_time(), FrameLocation::KeyFrameBefore);
+    });
+    const double near_ns = BenchmarkNanoseconds(kLookups, [&](size_t) {
+      buffer.GetFrame(next_time(), FrameLocation::Near);
+    });
+    // Read every frame in order, like the decoder does.
+    double prev_time = -1;
+    const double next_ns = BenchmarkNanoseconds(frame_count, [&](size_t) {
+      prev_time = buffer.GetFrame(prev_time, FrameLocation::After)->dts;
+    });
+    StreamType::Cursor cursor(&buffer);
+    std::vector<std::shared_ptr<BaseFrame>> frames;
+    frames.reserve(frame_count);
+    const double cursor_ns =
+        BenchmarkNanoseconds(frame_count / 16, [&](size_t) {
+          cursor.Read(16, HUGE_VAL, &frames);
+        }) /
+        16;
+    const double count_ns = BenchmarkNanoseconds(kLookups, [&](size_t) {
+      const double start = next_time();
+      buffer.CountFramesBetween(start, start + 1);
+    });
+    // Evict one second at a time from the front, like the decoder does.
+    const double remove_ns =
+        BenchmarkNanoseconds(static_cast<size_t>(total), [&](size_t i) {
+          buffer.Remove(0, i + 1);
+        });
+
+    printf("%6zu frames: AddFrame=%.0fns After=%.0fns KeyFrameBefore=%.0fns "
+           "Near=%.0fns CountFramesBetween=%.0fns Remove=%.0fns\n",
+           frame_count, add_ns, after_ns, key_frame_ns, near_ns, count_ns,
+           remove_ns);
+    printf("%6zu frames: sequential After=%.0fns/frame "
+           "Cursor(16)=%.0fns/frame\n",
+           frame_count, next_ns, cursor_ns);
+  }
+}
+
+TEST(StreamBaseBenchmark, EvictLargeFrames) {
+  // About 400 MB of decoded 1080p frames.
+  constexpr const size_t kFrameCount = 128;
+  constexpr const size_t kFrameSize = 1920 * 1080 * 3 / 2;
+  StreamType buffer;
+  for (size_t i = 0; i < kFrameCount; i++) {
+    // Hold a large allocation that is freed with the frame, like decoded
+    // frames do.
+    auto* data = new uint8_t[kFrameSize];
+    memset(data, 1, kFrameSize);
+    auto* frame = new BaseFrame(nullptr, i, i, 1, true);
+    buffer.AddFrame(
+        std::shared_ptr<BaseFrame>(frame, [data](BaseFrame* frame) {
+          delete[] data;
+          delete frame;
+        }));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  buffer.Remove(0, HUGE_VAL);
+  const auto removed = std::chrono::steady_clock::now();
+  FrameReclaimer::Instance()->WaitUntilIdle();
+  const auto freed = std::chrono::steady_clock::now();
+  printf("Remove blocked for %.3f ms; frames freed after %.3f ms\n",
+         std::chrono::duration<double, std::milli>(removed - start).count(),
+         std::chrono::duration<double, std::milli>(freed - start).count());
+}
+
+}  // namespace media
+}  // namespace shaka
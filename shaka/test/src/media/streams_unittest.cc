@@ -17,6 +17,11 @@
 #include <gtest/gtest.h>
 #include <math.h>
 
+#include <atomic>
+#include <thread>
+
+#include "src/media/frame_reclaimer.h"
+
 namespace shaka {
 namespace media {
 
@@ -227,6 +232,53 @@ TEST(StreamBaseTest, CountFramesBetween) {
   EXPECT_EQ(2, buffer.CountFramesBetween(100, 200));
 }
 
+TEST(StreamBaseTest, BufferedRangesVersion) {
+  StreamType buffer;
+  const uint64_t empty_version = buffer.GetBufferedRangesVersion();
+  EXPECT_NE(0u, empty_version);
+
+  buffer.AddFrame(MakeFrame(0, 10));
+  buffer.AddFrame(MakeFrame(10, 20));
+  uint64_t version;
+  auto snapshot = buffer.GetBufferedRangesSnapshot(&version);
+  EXPECT_NE(empty_version, version);
+  EXPECT_EQ(version, buffer.GetBufferedRangesVersion());
+  ASSERT_EQ(1u, snapshot->size());
+  EXPECT_EQ(0, (*snapshot)[0].start);
+  EXPECT_EQ(20, (*snapshot)[0].end);
+
+  // Doesn't rebuild the ranges if they haven't changed.
+  EXPECT_EQ(snapshot.get(), buffer.GetBufferedRangesSnapshot().get());
+
+  // Replacing a frame without changing the range times keeps the version.
+  buffer.AddFrame(MakeFrame(0, 10));
+  EXPECT_EQ(version, buffer.GetBufferedRangesVersion());
+  buffer.Remove(50, 60);
+  EXPECT_EQ(version, buffer.GetBufferedRangesVersion());
+
+  buffer.AddFrame(MakeFrame(20, 30));
+  EXPECT_NE(version, buffer.GetBufferedRangesVersion());
+  auto new_snapshot = buffer.GetBufferedRangesSnapshot(&version);
+  ASSERT_EQ(1u, new_snapshot->size());
+  EXPECT_EQ(0, (*new_snapshot)[0].start);
+  EXPECT_EQ(30, (*new_snapshot)[0].end);
+  // The old snapshot is immutable.
+  EXPECT_EQ(0, (*snapshot)[0].start);
+  EXPECT_EQ(20, (*snapshot)[0].end);
+
+  buffer.Remove(20, 30);
+  EXPECT_NE(version, buffer.GetBufferedRangesVersion());
+  version = buffer.GetBufferedRangesVersion();
+  buffer.Clear();
+  EXPECT_NE(version, buffer.GetBufferedRangesVersion());
+  EXPECT_TRUE(buffer.GetBufferedRangesSnapshot()->empty());
+
+  // Versions are unique across streams.
+  StreamType other;
+  EXPECT_NE(buffer.GetBufferedRangesVersion(),
+            other.GetBufferedRangesVersion());
+}
+
 
 TEST(StreamBaseTest, GetFrame_KeyFrameBefore_FindsFrameBefore) {
   StreamType buffer;
@@ -279,6 +331,35 @@ TEST(StreamBaseTest, GetFrame_KeyFrameBefore_WontReturnFutureFrames) {
   EXPECT_EQ(nullptr, frame);
 }
 
+TEST(StreamBaseTest, GetFrame_KeyFrameAfter_SkipsNonKeyFrames) {
+  StreamType buffer;
+  buffer.AddFrame(MakeFrame(0, 10));
+  buffer.AddFrame(MakeFrame(10, 20, false));
+  buffer.AddFrame(MakeFrame(20, 30, false));
+  buffer.AddFrame(MakeFrame(30, 40));
+  ASSERT_EQ(1u, buffer.GetBufferedRanges().size());
+
+  const BaseFrame* frame =
+      buffer.GetFrame(0, FrameLocation::KeyFrameAfter).get();
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(30, frame->pts);
+}
+
+TEST(StreamBaseTest, GetFrame_KeyFrameAfter_UsesNextRange) {
+  StreamType buffer;
+  buffer.AddFrame(MakeFrame(0, 10));
+  buffer.AddFrame(MakeFrame(10, 20, false));
+  buffer.AddFrame(MakeFrame(40, 50));
+  ASSERT_EQ(2u, buffer.GetBufferedRanges().size());
+
+  const BaseFrame* frame =
+      buffer.GetFrame(5, FrameLocation::KeyFrameAfter).get();
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(40, frame->pts);
+
+  EXPECT_EQ(nullptr, buffer.GetFrame(40, FrameLocation::KeyFrameAfter).get());
+}
+
 
 TEST(StreamBaseTest, GetFrame_After_GetsNext) {
   StreamType buffer;
@@ -393,6 +474,84 @@ TEST(StreamBaseTest, GetFrame_Near_ReturnsNull) {
 }
 
 
+TEST(StreamBaseTest, Cursor_ReadsInOrder) {
+  StreamType buffer;
+  for (int i = 0; i < 10; i++)
+    buffer.AddFrame(MakeFrame(i, i + 1));
+
+  StreamType::Cursor cursor(&buffer);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  EXPECT_EQ(4u, cursor.Read(4, HUGE_VAL, &frames));
+  EXPECT_EQ(3u, cursor.Read(3, HUGE_VAL, &frames));
+  EXPECT_EQ(3u, cursor.Read(10, HUGE_VAL, &frames));
+  EXPECT_EQ(0u, cursor.Read(10, HUGE_VAL, &frames));
+
+  ASSERT_EQ(10u, frames.size());
+  for (size_t i = 0; i < frames.size(); i++)
+    EXPECT_EQ(i, frames[i]->pts);
+  EXPECT_EQ(9, cursor.time());
+}
+
+TEST(StreamBaseTest, Cursor_ReadsAcrossRanges) {
+  StreamType buffer;
+  buffer.AddFrame(MakeFrame(0, 1));
+  buffer.AddFrame(MakeFrame(1, 2));
+  buffer.AddFrame(MakeFrame(10, 11));
+  buffer.AddFrame(MakeFrame(11, 12));
+  ASSERT_EQ(2u, buffer.GetBufferedRanges().size());
+
+  StreamType::Cursor cursor(&buffer);
+  cursor.Seek(0);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  ASSERT_EQ(3u, cursor.Read(10, HUGE_VAL, &frames));
+  EXPECT_EQ(1, frames[0]->pts);
+  EXPECT_EQ(10, frames[1]->pts);
+  EXPECT_EQ(11, frames[2]->pts);
+}
+
+TEST(StreamBaseTest, Cursor_StopsAtEndTime) {
+  StreamType buffer;
+  for (int i = 0; i < 10; i++)
+    buffer.AddFrame(MakeFrame(i, i + 1));
+
+  StreamType::Cursor cursor(&buffer);
+  cursor.Seek(2);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  ASSERT_EQ(3u, cursor.Read(10, 5, &frames));
+  EXPECT_EQ(3, frames[0]->pts);
+  EXPECT_EQ(5, frames[2]->pts);
+  EXPECT_EQ(0u, cursor.Read(10, 5.5, &frames));
+}
+
+TEST(StreamBaseTest, Cursor_HandlesStreamChanges) {
+  StreamType buffer;
+  for (int i = 0; i < 10; i++)
+    buffer.AddFrame(MakeFrame(i, i + 1));
+
+  StreamType::Cursor cursor(&buffer);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  ASSERT_EQ(5u, cursor.Read(5, HUGE_VAL, &frames));
+
+  // Removing frames from the front moves the frames within the range.
+  buffer.Remove(0, 3);
+  // New frames should be seen.
+  buffer.AddFrame(MakeFrame(10, 11));
+
+  frames.clear();
+  ASSERT_EQ(6u, cursor.Read(10, HUGE_VAL, &frames));
+  EXPECT_EQ(5, frames[0]->pts);
+  EXPECT_EQ(10, frames[5]->pts);
+
+  // If the last frame read is removed, it continues after its time.
+  buffer.Remove(8, 20);
+  buffer.AddFrame(MakeFrame(11, 12));
+  buffer.AddFrame(MakeFrame(12, 13));
+  frames.clear();
+  ASSERT_EQ(2u, cursor.Read(10, HUGE_VAL, &frames));
+  EXPECT_EQ(11, frames[0]->pts);
+}
+
+
 TEST(StreamBaseTest, Remove_RemovesWholeRange) {
   StreamType buffer;
   buffer.AddFrame(MakeFrame(0, 1));
@@ -548,5 +707,117 @@ TEST(StreamBaseTest, Remove_RemovesUntilKeyframe) {
   EXPECT_EQ(8, buffered[0].end);
 }
 
+TEST(StreamBaseTest, EstimateSize_TracksFrames) {
+  const size_t frame_size = MakeFrame(0, 1)->EstimateSize();
+  StreamType buffer;
+  EXPECT_EQ(0u, buffer.EstimateSize());
+  for (int i = 0; i < 10; i++)
+    buffer.AddFrame(MakeFrame(i, i + 1));
+  EXPECT_EQ(10 * frame_size, buffer.EstimateSize());
+
+  // Replacing a frame shouldn't change the size.
+  buffer.AddFrame(MakeFrame(3, 4));
+  EXPECT_EQ(10 * frame_size, buffer.EstimateSize());
+
+  buffer.Remove(2, 5);
+  EXPECT_EQ(7 * frame_size, buffer.EstimateSize());
+
+  buffer.Clear();
+  EXPECT_EQ(0u, buffer.EstimateSize());
+}
+
+TEST(StreamBaseTest, EvictBefore_RemovesOldestGops) {
+  const size_t frame_size = MakeFrame(0, 1)->EstimateSize();
+  StreamType buffer;
+  for (int i = 0; i < 12; i++)
+    buffer.AddFrame(MakeFrame(i, i + 1, i % 3 == 0));
+  buffer.AddFrame(MakeFrame(20, 21));
+  buffer.AddFrame(MakeFrame(21, 22, false));
+  ASSERT_EQ(2u, buffer.GetBufferedRanges().size());
+
+  // Removes one GOP at a time until it is small enough.
+  EXPECT_EQ(11 * frame_size, buffer.EvictBefore(100, 11 * frame_size));
+  auto buffered = buffer.GetBufferedRanges();
+  ASSERT_EQ(2u, buffered.size());
+  EXPECT_EQ(3, buffered[0].start);
+  EXPECT_EQ(12, buffered[0].end);
+
+  // Stops at the GOP containing the given time.
+  EXPECT_EQ(8 * frame_size, buffer.EvictBefore(8.5, 0));
+  buffered = buffer.GetBufferedRanges();
+  ASSERT_EQ(2u, buffered.size());
+  EXPECT_EQ(6, buffered[0].start);
+  EXPECT_EQ(12, buffered[0].end);
+
+  // Removes whole ranges.
+  EXPECT_EQ(2 * frame_size, buffer.EvictBefore(20, 0));
+  buffered = buffer.GetBufferedRanges();
+  ASSERT_EQ(1u, buffered.size());
+  EXPECT_EQ(20, buffered[0].start);
+}
+
+TEST(StreamBaseTest, Remove_ReleasesFrames) {
+  StreamType buffer;
+  std::vector<std::weak_ptr<BaseFrame>> frames;
+  for (int i = 0; i < 10; i++) {
+    auto frame = MakeFrame(i, i + 1);
+    frames.emplace_back(frame);
+    buffer.AddFrame(frame);
+  }
+
+  buffer.Remove(2, 5);
+  // The frames are destroyed on a background thread.
+  FrameReclaimer::Instance()->WaitUntilIdle();
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(i >= 2 && i < 5, frames[i].expired()) << i;
+
+  buffer.Clear();
+  FrameReclaimer::Instance()->WaitUntilIdle();
+  for (auto& frame : frames)
+    EXPECT_TRUE(frame.expired());
+}
+
+TEST(StreamBaseTest, ReadsWhileAdding) {
+  // Readers use a snapshot of the stream, so they should always see a valid
+  // stream while another thread adds and removes frames.
+  constexpr const int kFrameCount = 2000;
+  StreamType buffer;
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    for (int i = 0; i < kFrameCount; i++) {
+      buffer.AddFrame(MakeFrame(i, i + 1, i % 10 == 0));
+      if (i % 100 == 99)
+        buffer.Remove(0, i - 50);
+    }
+    done = true;
+  });
+
+  StreamType::Cursor cursor(&buffer);
+  std::vector<std::shared_ptr<BaseFrame>> frames;
+  double last_time = -1;
+  while (true) {
+    const bool writer_done = done;
+    frames.clear();
+    cursor.Read(10, HUGE_VAL, &frames);
+    for (auto& frame : frames) {
+      EXPECT_LT(last_time, frame->pts);
+      last_time = frame->pts;
+    }
+
+    for (auto& range : buffer.GetBufferedRanges())
+      EXPECT_LE(range.start, range.end);
+    auto frame = buffer.GetFrame(last_time, FrameLocation::KeyFrameBefore);
+    if (frame)
+      EXPECT_TRUE(frame->is_key_frame);
+
+    if (writer_done && frames.empty())
+      break;
+  }
+  writer.join();
+
+  EXPECT_EQ(kFrameCount - 1, last_time);
+  EXPECT_EQ(kFrameCount - 1950, buffer.CountFramesBetween(-1, kFrameCount));
+}
+
 }  // namespace media
 }  // namespace shaka
@@ -0,0 +1,165 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_TEST_DECODER_THREAD_FAKES_H_
+#define SHAKA_EMBEDDED_TEST_DECODER_THREAD_FAKES_H_
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shaka/media/decoder.h"
+#include "shaka/media/frames.h"
+#include "shaka/media/streams.h"
+#include "src/debug/thread_event.h"
+#include "src/media/decoder_thread.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+namespace media {
+
+/** The duration of the frames added by AddFrames. */
+constexpr const double kFrameDuration = 0.04;
+
+inline std::shared_ptr<EncodedFrame> MakeEncodedFrame(double time,
+                                                     bool is_key_frame) {
+  return std::make_shared<EncodedFrame>(nullptr, time, time, kFrameDuration,
+                                        is_key_frame, nullptr, 0, 0, nullptr);
+}
+
+class FakeClient : public DecoderThread::Client {
+ public:
+  double CurrentTime() const override {
+    return time;
+  }
+  double Duration() const override {
+    return 1000;
+  }
+  double PlaybackRate() const override {
+    return rate;
+  }
+  VideoPlaybackState PlaybackState() const override {
+    return playing ? VideoPlaybackState::Playing : VideoPlaybackState::Paused;
+  }
+  void OnWaitingForKey() override {}
+  void OnError(const std::string& error) override {
+    ADD_FAILURE() << "Unexpected error: " << error;
+  }
+
+  std::atomic<double> time{0};
+  std::atomic<double> rate{1};
+  std::atomic<bool> playing{false};
+};
+
+class FakeDecoder : public Decoder {
+ public:
+  FakeDecoder() : key_not_found("KeyNotFound") {}
+
+  MediaCapabilitiesInfo DecodingInfo(
+      const MediaDecodingConfiguration& /* config */) const override {
+    return MediaCapabilitiesInfo();
+  }
+  void ResetDecoder() override {
+    reset_count++;
+  }
+  MediaStatus Decode(std::shared_ptr<EncodedFrame> input,
+                     const eme::Implementation* /* eme */,
+                     std::vector<std::shared_ptr<DecodedFrame>>* frames,
+                     std::string* /* extra_info */) override {
+    if (!has_key) {
+      key_not_found.SignalAllIfNotSet();
+      return MediaStatus::KeyNotFound;
+    }
+    if (input) {
+      decoded_count++;
+      if (!input->is_key_frame)
+        non_key_frame_count++;
+      if (cost)
+        util::Clock::Instance.SleepSeconds(cost(*input));
+      if (frame_size > 0) {
+        // Audio frames count their line sizes as their size.
+        frames->emplace_back(std::make_shared<DecodedFrame>(
+            nullptr, input->pts, input->dts, input->duration,
+            SampleFormat::PackedU8, frame_size,
+            std::vector<const uint8_t*>{nullptr},
+            std::vector<size_t>{frame_size}));
+      } else {
+        frames->emplace_back(std::make_shared<DecodedFrame>(
+            nullptr, input->pts, input->dts, input->duration,
+            PixelFormat::Unknown, 0, std::vector<const uint8_t*>{},
+            std::vector<size_t>{}));
+      }
+    }
+    return MediaStatus::Success;
+  }
+
+  std::atomic<bool> has_key{true};
+  std::atomic<size_t> reset_count{0};
+  std::atomic<size_t> decoded_count{0};
+  std::atomic<size_t> non_key_frame_count{0};
+  // These should be set before decoding starts.
+  std::function<double(const EncodedFrame&)> cost;
+  size_t frame_size = 0;
+  ThreadEvent<void> key_not_found;
+};
+
+/**
+ * Signals an event when a frame is added to the stream, once the given
+ * condition (if any) is true.
+ */
+class FrameWaiter : public StreamBase::Client {
+ public:
+  explicit FrameWaiter(const StreamBase* stream,
+                       std::function<bool()> condition = nullptr)
+      : frame_added("FrameAdded"), stream_(stream), condition_(condition) {
+    stream_->AddClient(this);
+  }
+  ~FrameWaiter() override {
+    stream_->RemoveClient(this);
+  }
+
+  void OnFrameAdded() override {
+    if (!condition_ || condition_())
+      frame_added.SignalAllIfNotSet();
+  }
+
+  ThreadEvent<void> frame_added;
+
+ private:
+  const StreamBase* stream_;
+  const std::function<bool()> condition_;
+};
+
+/**
+ * Adds frames to the given stream between the given times, with a keyframe
+ * every second.
+ */
+inline void AddFrames(ElementaryStream* stream, double start, double end) {
+  for (double time = start; time < end; time += kFrameDuration) {
+    const bool is_key_frame =
+        std::fmod(time, 1) < kFrameDuration / 2 ||
+        std::fmod(time, 1) > 1 - kFrameDuration / 2;
+    stream->AddFrame(MakeEncodedFrame(time, is_key_frame));
+  }
+}
+
+}  // namespace media
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_TEST_DECODER_THREAD_FAKES_H_
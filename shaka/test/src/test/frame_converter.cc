@@ -53,6 +53,15 @@ FrameConverter::~FrameConverter() {
 
 bool FrameConverter::ConvertFrame(std::shared_ptr<media::DecodedFrame> frame,
                                   const uint8_t** data, size_t* size) {
+  if (get<media::PixelFormat>(frame->format) ==
+      media::PixelFormat::HardwareFrame) {
+    frame = frame->MapHardwareFrame();
+    if (!frame) {
+      LOG(ERROR) << "Error mapping hardware frame";
+      return false;
+    }
+  }
+
   if (frame->stream_info->width != convert_frame_width_ ||
       frame->stream_info->height != convert_frame_height_) {
     av_freep(&convert_frame_data_[0]);
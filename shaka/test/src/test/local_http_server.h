@@ -0,0 +1,254 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHAKA_EMBEDDED_TEST_LOCAL_HTTP_SERVER_H_
+#define SHAKA_EMBEDDED_TEST_LOCAL_HTTP_SERVER_H_
+
+#include <arpa/inet.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "src/core/js_manager_impl.h"
+#include "src/core/ref_ptr.h"
+#include "src/debug/mutex.h"
+#include "src/debug/thread.h"
+#include "src/js/events/event_names.h"
+#include "src/js/xml_http_request.h"
+#include "src/util/clock.h"
+
+namespace shaka {
+
+/** The size of the body LocalHttpServer responds with. */
+constexpr const size_t kSegmentSize = 64 * 1024;
+/** How long WaitOnMainThread waits before giving up. */
+constexpr const std::chrono::seconds kMainThreadTimeout{10};
+
+/**
+ * A minimal HTTP server on the loopback interface that responds to every
+ * request with the same segment-sized body.  This stands in for a CDN so the
+ * tests and benchmarks don't depend on the network.
+ *
+ * The body can be split into chunks that are written with a delay between
+ * them; this simulates a low-latency live encoder that makes each chunk
+ * available as soon as it is encoded.
+ */
+class LocalHttpServer {
+ public:
+  explicit LocalHttpServer(size_t chunk_count = 1, double chunk_delay = 0)
+      : chunk_count_(chunk_count),
+        chunk_delay_(chunk_delay),
+        mutex_("LocalHttpServer"),
+        fd_(CreateSocket(&port_)),
+        thread_("HttpServer", std::bind(&LocalHttpServer::ThreadMain, this)) {}
+
+  ~LocalHttpServer() {
+    // This causes the pending accept() call to fail.
+    shutdown(fd_, SHUT_RDWR);
+    thread_.join();
+    close(fd_);
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/segment";
+  }
+
+  size_t chunk_count() const {
+    return chunk_count_;
+  }
+
+  /** @return The times each chunk of the last response started writing. */
+  std::vector<std::chrono::steady_clock::time_point> chunk_times() {
+    std::unique_lock<Mutex> lock(mutex_);
+    return chunk_times_;
+  }
+
+  /** @return The offset in the body where the given chunk ends. */
+  size_t chunk_end(size_t chunk) const {
+    return kSegmentSize * (chunk + 1) / chunk_count_;
+  }
+
+ private:
+  static int CreateSocket(uint16_t* port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    CHECK_EQ(listen(fd, 1024), 0);
+
+    socklen_t size = sizeof(addr);
+    CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &size), 0);
+    *port = ntohs(addr.sin_port);
+    return fd;
+  }
+
+  static bool WriteAll(int fd, const char* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+      const ssize_t count = write(fd, data + pos, size - pos);
+      if (count <= 0)
+        return false;
+      pos += count;
+    }
+    return true;
+  }
+
+  void ThreadMain() {
+    const std::string headers = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                                std::to_string(kSegmentSize) +
+                                "\r\nConnection: close\r\n\r\n";
+    const std::string body(kSegmentSize, 'x');
+    int client;
+    while ((client = accept(fd_, nullptr, nullptr)) >= 0) {
+      // Read until the end of the request headers; there is no body.
+      std::string request;
+      char buffer[4096];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        const ssize_t count = read(client, buffer, sizeof(buffer));
+        if (count <= 0)
+          break;
+        request.append(buffer, count);
+      }
+
+      {
+        std::unique_lock<Mutex> lock(mutex_);
+        chunk_times_.clear();
+      }
+      bool ok = WriteAll(client, headers.data(), headers.size());
+      for (size_t i = 0; ok && i < chunk_count_; i++) {
+        if (i > 0)
+          util::Clock::Instance.SleepSeconds(chunk_delay_);
+        {
+          std::unique_lock<Mutex> lock(mutex_);
+          chunk_times_.emplace_back(std::chrono::steady_clock::now());
+        }
+        const size_t start = i == 0 ? 0 : chunk_end(i - 1);
+        ok = WriteAll(client, body.data() + start, chunk_end(i) - start);
+      }
+      close(client);
+    }
+  }
+
+  const size_t chunk_count_;
+  const double chunk_delay_;
+  Mutex mutex_;
+  std::vector<std::chrono::steady_clock::time_point> chunk_times_;
+  uint16_t port_;
+  const int fd_;
+  Thread thread_;
+};
+
+/**
+ * Polls the given callback on the main thread until it returns true.
+ * @return True if the callback returned true, false if |kMainThreadTimeout|
+ *   passed.
+ */
+inline bool WaitOnMainThread(std::function<bool()> is_done) {
+  TaskRunner* main_thread = JsManagerImpl::Instance()->MainThread();
+  const auto deadline = std::chrono::steady_clock::now() + kMainThreadTimeout;
+  while (!main_thread->AddInternalTask(TaskPriority::Immediate, "", is_done)
+              ->GetValue()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    util::Clock::Instance.SleepSeconds(0.001);
+  }
+  return true;
+}
+
+/**
+ * Downloads a segment from |server| with the given response type.  This
+ * records when the data becomes available to the app, which is in "progress"
+ * events for chunked responses and in the "load" event otherwise.
+ *
+ * @param received_times [OUT] Where to put the time each chunk of the server's
+ *   response was received.
+ * @param event_count [OUT] Where to put the number of events the data was given
+ *   in.
+ */
+inline void DownloadSegment(
+    LocalHttpServer* server, const std::string& response_type,
+    std::vector<std::chrono::steady_clock::time_point>* received_times,
+    size_t* event_count) {
+  TaskRunner* main_thread = JsManagerImpl::Instance()->MainThread();
+  const bool chunked = response_type != "arraybuffer";
+
+  RefPtr<js::XMLHttpRequest> xhr;
+  size_t received = 0;
+  bool done = false;
+  *event_count = 0;
+  auto on_data = [&]() {
+    if (xhr->response.size() == 0)
+      return;
+    received += xhr->response.size();
+    (*event_count)++;
+    const auto now = std::chrono::steady_clock::now();
+    while (received_times->size() < server->chunk_count() &&
+           server->chunk_end(received_times->size()) <= received) {
+      received_times->emplace_back(now);
+    }
+  };
+
+  received_times->clear();
+  main_thread
+      ->AddInternalTask(TaskPriority::Immediate, "",
+                        [&]() {
+                          xhr = new js::XMLHttpRequest();
+                          xhr->SetCppEventListener(
+                              js::EventType::Progress, [&]() {
+                                if (chunked)
+                                  on_data();
+                              });
+                          xhr->SetCppEventListener(js::EventType::Load,
+                                                   [&]() {
+                                                     if (!chunked)
+                                                       on_data();
+                                                   });
+                          xhr->SetCppEventListener(js::EventType::LoadEnd,
+                                                   [&]() { done = true; });
+                          xhr->Open("GET", server->url(), nullopt, nullopt,
+                                    nullopt);
+                          xhr->response_type = response_type;
+                          xhr->Send(nullopt);
+                        })
+      ->GetValue();
+
+  const bool finished = WaitOnMainThread([&]() { return done; });
+  main_thread
+      ->AddInternalTask(TaskPriority::Immediate, "",
+                        [&]() {
+                          // Abort so the listeners aren't called after we
+                          // return.
+                          if (finished)
+                            EXPECT_EQ(200, xhr->status);
+                          else
+                            xhr->Abort();
+                          xhr.reset();
+                        })
+      ->GetValue();
+  ASSERT_TRUE(finished) << "Timed out waiting for the download";
+  EXPECT_EQ(kSegmentSize, received);
+}
+
+}  // namespace shaka
+
+#endif  // SHAKA_EMBEDDED_TEST_LOCAL_HTTP_SERVER_H_
@@ -15,6 +15,8 @@
 #ifndef SHAKA_EMBEDDED_TEST_TEST_UTILS_H_
 #define SHAKA_EMBEDDED_TEST_TEST_UTILS_H_
 
+#include <chrono>
+
 #include "src/util/clock.h"
 
 namespace shaka {
@@ -64,6 +66,21 @@ bool WaitUntilOrTimeout(T callback) {
   return true;
 }
 
+/**
+ * Calls the given callback |iterations| times, passing the current iteration
+ * index, and returns the average time each call took in nanoseconds.  This is
+ * used by the benchmarks, which are built into their own binary.
+ */
+template <typename T>
+double BenchmarkNanoseconds(size_t iterations, T callback) {
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++)
+    callback(i);
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         iterations;
+}
+
 }  // namespace shaka
 
 #endif  // SHAKA_EMBEDDED_TEST_TEST_UTILS_H_
@@ -0,0 +1,44 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/util/coroutine.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include "src/test/test_utils.h"
+
+namespace shaka {
+namespace util {
+
+TEST(CoroutineBenchmark, Switch) {
+  constexpr const size_t kIterations = 100000;
+
+  bool done = false;
+  Coroutine* routine_ptr;
+  Coroutine routine("Test", [&]() {
+    while (!done)
+      routine_ptr->Yield();
+  });
+  routine_ptr = &routine;
+
+  const double ns =
+      BenchmarkNanoseconds(kIterations, [&](size_t) { routine.Resume(); });
+  done = true;
+  routine.Resume();
+  printf("Resume+Yield: %.1f ns\n", ns);
+}
+
+}  // namespace util
+}  // namespace shaka
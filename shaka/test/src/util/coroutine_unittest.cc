@@ -0,0 +1,133 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/util/coroutine.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace shaka {
+namespace util {
+
+namespace {
+
+/** Uses about |depth| pages of stack. */
+int UseStack(size_t depth) {
+  volatile char buffer[4096];
+  buffer[0] = static_cast<char>(depth);
+  if (depth == 0)
+    return buffer[0];
+  return UseStack(depth - 1) + buffer[0];
+}
+
+}  // namespace
+
+TEST(CoroutineTest, DoesntStartUntilResumed) {
+  bool called = false;
+  Coroutine routine("Test", [&]() { called = true; });
+  EXPECT_FALSE(called);
+  EXPECT_FALSE(routine.started());
+
+  routine.Resume();
+  EXPECT_TRUE(called);
+  EXPECT_TRUE(routine.started());
+  EXPECT_TRUE(routine.finished());
+}
+
+TEST(CoroutineTest, CanBeDestroyedWithoutStarting) {
+  Coroutine routine("Test", []() { FAIL(); });
+}
+
+TEST(CoroutineTest, YieldsToCaller) {
+  std::vector<int> order;
+  Coroutine* routine_ptr;
+  Coroutine routine("Test", [&]() {
+    order.push_back(1);
+    routine_ptr->Yield();
+    order.push_back(3);
+    routine_ptr->Yield();
+    order.push_back(5);
+  });
+  routine_ptr = &routine;
+
+  routine.Resume();
+  order.push_back(2);
+  EXPECT_FALSE(routine.finished());
+  routine.Resume();
+  order.push_back(4);
+  EXPECT_FALSE(routine.finished());
+  routine.Resume();
+  EXPECT_TRUE(routine.finished());
+
+  EXPECT_EQ(order, (std::vector<int>{1, 2, 3, 4, 5}));
+}
+
+TEST(CoroutineTest, KeepsLocalsBetweenResumes) {
+  int output = 0;
+  Coroutine* routine_ptr;
+  Coroutine routine("Test", [&]() {
+    int total = 0;
+    for (int i = 1; i <= 10; i++) {
+      total += i;
+      output = total;
+      routine_ptr->Yield();
+    }
+  });
+  routine_ptr = &routine;
+
+  int expected = 0;
+  for (int i = 1; i <= 10; i++) {
+    routine.Resume();
+    expected += i;
+    EXPECT_EQ(expected, output);
+  }
+  routine.Resume();
+  EXPECT_TRUE(routine.finished());
+}
+
+TEST(CoroutineTest, CanBeResumedFromDifferentThreads) {
+  int count = 0;
+  Coroutine* routine_ptr;
+  Coroutine routine("Test", [&]() {
+    while (count < 5) {
+      count++;
+      routine_ptr->Yield();
+    }
+  });
+  routine_ptr = &routine;
+
+  // Only one thread uses it at a time, but it can move between threads.
+  for (int i = 0; i < 3; i++) {
+    std::thread thread([&]() { routine.Resume(); });
+    thread.join();
+  }
+  EXPECT_EQ(3, count);
+  while (!routine.finished())
+    routine.Resume();
+  EXPECT_EQ(5, count);
+}
+
+#if defined(OS_LINUX) && defined(GTEST_HAS_DEATH_TEST)
+TEST(CoroutineTest, CrashesOnStackOverflow) {
+  // Running off the end of the stack hits the guard page rather than writing
+  // over other memory.
+  Coroutine routine("Test", []() { UseStack(1 << 20); });
+  EXPECT_DEATH(routine.Resume(), "");
+}
+#endif
+
+}  // namespace util
+}  // namespace shaka